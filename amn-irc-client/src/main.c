@@ -17,7 +17,6 @@
 #include <unistd.h>
 
 #define RUNNER_COUNT 10
-#define TIMEOUT 10
 
 static bool StartClient(const Logger* log, TaskQueue* tasks, UserInputQueue* userInput);
 static bool SetupSignals(const Logger* log);
@@ -50,17 +49,23 @@ int main()
 
 	LOG_INFO(log, "Starting amn-irc-client...");
 
+	if (!Application_Init())
+	{
+		LOG_ERROR(log, "Failed to create shutdown eventfd!");
+		goto cleanup;
+	}
+
 	SetupSignals(log);
 
-	tasks = TaskQueue_New(10, TIMEOUT);
+	tasks = TaskQueue_New(10);
 	if (tasks == NULL)
 		goto cleanup;
 
-	userInput = UserInputQueue_New(50, TIMEOUT);
+	userInput = UserInputQueue_New(50);
 	if (userInput == NULL)
 		goto cleanup;
 
-	userOutput = UserOutputQueue_New(200, TIMEOUT);
+	userOutput = UserOutputQueue_New(200);
 	if (userOutput == NULL)
 		goto cleanup;
 
@@ -73,7 +78,10 @@ int main()
 
 	for (size_t i = 0; i < RUNNER_COUNT; i++)
 	{
-		runners[i] = TaskRunner_New(log, tasks);
+		char name[16];
+		snprintf(name, sizeof(name), "runner-%zu", i);
+
+		runners[i] = TaskRunner_New(log, tasks, name, -1);
 		if (runners[i] == NULL)
 		{
 			LOG_ERROR(log, "Failed to create runner %zu.", i);
@@ -94,11 +102,20 @@ int main()
 	}
 
 	result = EXIT_SUCCESS;
-	Application_ShouldShutdown();
 
 cleanup:	
 	fflush(logFile);
 
+	Application_StartShutdown();
+
+	// Wake up runners blocked on the queues.
+	if (userInput != NULL)
+		UserInputQueue_Shutdown(userInput);
+	if (userOutput != NULL)
+		UserOutputQueue_Shutdown(userOutput);
+	if (tasks != NULL)
+		TaskQueue_Shutdown(tasks);
+
 	for (size_t i = 0; i < RUNNER_COUNT; i++)
 	{
 		TaskRunner_Delete(runners[i]);
@@ -108,6 +125,7 @@ cleanup:
 	UserInputQueue_Delete(userInput);
 	UserOutputQueue_Delete(userOutput);
 	TaskQueue_Delete(tasks);
+	Application_Cleanup();
 	Logger_Destroy(log);
 	fclose(logFile);
 
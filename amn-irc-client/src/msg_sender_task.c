@@ -2,7 +2,6 @@
 
 #include "application.h"
 #include "irc_cmd_unparser.h"
-#include "irc_msg_unparser.h"
 #include "irc_msg_writer.h"
 #include "slash_cmd_parser.h"
 #include "str_utils.h"
@@ -30,7 +29,6 @@ typedef struct MsgSenderContext
 	SlashCmdParser* slashCmdParser;
 	IrcMsgValidator* msgValidator;
 	IrcCmdUnparser* cmdUnparser;
-	IrcMsgUnparser* msgUnparser;
 	IrcMsgWriter* writer;
 
 	bool success;
@@ -98,13 +96,6 @@ static MsgSenderContext* MsgSenderContext_New(const Logger* log, UserInputQueue*
 		goto error;
 	}
 
-	self->msgUnparser = IrcMsgUnparser_New(log);
-	if (self->msgUnparser == NULL)
-	{
-		LOG_ERROR(log, "Failed to create IrcCmdUnparser.");
-		goto error;
-	}
-
 	return self;
 
 error:
@@ -117,7 +108,6 @@ static void MsgSenderTaskContext_Delete(void* arg)
 	MsgSenderContext* ctx = (MsgSenderContext*) arg;	
 
 	IrcMsgWriter_Delete(ctx->writer);
-	IrcMsgUnparser_Delete(ctx->msgUnparser);
 	IrcCmdUnparser_Delete(ctx->cmdUnparser);
 	IrcMsgValidator_Delete(ctx->msgValidator);
 	SlashCmdParser_Delete(ctx->slashCmdParser);
@@ -140,9 +130,9 @@ static TaskStatus MsgSenderContext_Run(void* arg)
 	ctx->success = true;
 
 	char* line = UserInputQueue_Pop(ctx->userInput);
-	if (line == NULL && errno == EAGAIN)
+	if (line == NULL && errno == ECANCELED)
 	{
-		return TaskStatus_Yield;
+		return TaskStatus_Done;
 	}
 	else if (line == NULL)
 	{
@@ -229,24 +219,16 @@ static void RegisterNick(MsgSenderContext* ctx)
 		}
 	};
 
-	IrcMsg* msg = IrcCmdUnparser_Unparse(ctx->cmdUnparser, &nickCmd);
-	if (msg == NULL)
+	char rawMsg[IRC_MSG_SIZE + 1];
+	size_t rawMsgLen = IrcCmdUnparser_UnparseTo(ctx->cmdUnparser, &nickCmd, rawMsg, sizeof(rawMsg));
+	if (rawMsgLen == 0)
 	{
 		LOG_ERROR(ctx->log, "Failed to unparse command");
 		ctx->success = false;
 		return;
 	}
 
-	const char* rawMsg = IrcMsgUnparser_Unparse(ctx->msgUnparser, msg);
-	IrcMsg_Delete(msg);
-	if (rawMsg == NULL)
-	{
-		LOG_ERROR(ctx->log, "Failed to unparse message");
-		ctx->success = false;
-		return;
-	}
-
-	if (!IrcMsgWriter_Write(ctx->writer, rawMsg))
+	if (!IrcMsgWriter_WriteLen(ctx->writer, rawMsg, rawMsgLen))
 	{
 		LOG_ERROR(ctx->log, "Failed to send message");
 		ctx->success = false;
@@ -300,24 +282,16 @@ static void RegisterUser(MsgSenderContext* ctx)
 		}
 	};
 
-	IrcMsg* msg = IrcCmdUnparser_Unparse(ctx->cmdUnparser, &userCmd);
-	if (msg == NULL)
+	char rawMsg[IRC_MSG_SIZE + 1];
+	size_t rawMsgLen = IrcCmdUnparser_UnparseTo(ctx->cmdUnparser, &userCmd, rawMsg, sizeof(rawMsg));
+	if (rawMsgLen == 0)
 	{
 		LOG_ERROR(ctx->log, "Failed to unparse command");
 		ctx->success = false;
 		return;
 	}
 
-	const char* rawMsg = IrcMsgUnparser_Unparse(ctx->msgUnparser, msg);
-	IrcMsg_Delete(msg);
-	if (rawMsg == NULL)
-	{
-		LOG_ERROR(ctx->log, "Failed to unparse message");
-		ctx->success = false;
-		return;
-	}
-
-	if (!IrcMsgWriter_Write(ctx->writer, rawMsg))
+	if (!IrcMsgWriter_WriteLen(ctx->writer, rawMsg, rawMsgLen))
 	{
 		LOG_ERROR(ctx->log, "Failed to send message");
 		ctx->success = false;
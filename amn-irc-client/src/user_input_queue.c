@@ -4,9 +4,9 @@
 
 #include <stdlib.h>
 
-UserInputQueue* UserInputQueue_New(size_t capacity, int32_t shutdownTimeout)
+UserInputQueue* UserInputQueue_New(size_t capacity)
 {
-	return (UserInputQueue*) Queue_New(capacity, shutdownTimeout, sizeof(char*)); 
+	return (UserInputQueue*) Queue_New(capacity, sizeof(char*)); 
 }
 
 void UserInputQueue_Delete(UserInputQueue* self)
@@ -14,6 +14,11 @@ void UserInputQueue_Delete(UserInputQueue* self)
 	Queue_Delete((Queue*) self, free, sizeof(char*));
 }
 
+void UserInputQueue_Shutdown(UserInputQueue* self)
+{
+	Queue_Shutdown((Queue*) self);
+}
+
 bool UserInputQueue_Push(UserInputQueue* self, char* line)
 {
 	return Queue_Push((Queue*) self, &line, sizeof(char*));
@@ -8,8 +8,9 @@
 typedef struct UserInputQueue UserInputQueue;
 
 
-UserInputQueue* UserInputQueue_New(size_t capacity, int32_t shutdownTimeout);
+UserInputQueue* UserInputQueue_New(size_t capacity);
 void UserInputQueue_Delete(UserInputQueue* self);
+void UserInputQueue_Shutdown(UserInputQueue* self);
 
 bool UserInputQueue_Push(UserInputQueue* self, char* line);
 char* UserInputQueue_Pop(UserInputQueue* self);
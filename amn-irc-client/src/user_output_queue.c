@@ -3,9 +3,9 @@
 #include <stdlib.h>
 
 
-UserOutputQueue* UserOutputQueue_New(size_t capacity, int32_t shutdownTimeout)
+UserOutputQueue* UserOutputQueue_New(size_t capacity)
 {
-	return (UserOutputQueue*) Queue_New(capacity, shutdownTimeout, sizeof(char*)); 
+	return (UserOutputQueue*) Queue_New(capacity, sizeof(char*)); 
 }
 
 void UserOutputQueue_Delete(UserOutputQueue* self)
@@ -13,6 +13,11 @@ void UserOutputQueue_Delete(UserOutputQueue* self)
 	Queue_Delete((Queue*) self, free, sizeof(char*));
 }
 
+void UserOutputQueue_Shutdown(UserOutputQueue* self)
+{
+	Queue_Shutdown((Queue*) self);
+}
+
 bool UserOutputQueue_Push(UserOutputQueue* self, char* line)
 {
 	return Queue_Push((Queue*) self, &line, sizeof(char*));
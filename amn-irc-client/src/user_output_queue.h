@@ -11,8 +11,9 @@
 
 typedef struct UserOutputQueue UserOutputQueue;
 
-UserOutputQueue* UserOutputQueue_New(size_t capacity, int32_t shutdownTimeout);
+UserOutputQueue* UserOutputQueue_New(size_t capacity);
 void UserOutputQueue_Delete(UserOutputQueue* self);
+void UserOutputQueue_Shutdown(UserOutputQueue* self);
 
 bool UserOutputQueue_Push(UserOutputQueue* self, char* line);
 char* UserOutputQueue_Pop(UserOutputQueue* self);
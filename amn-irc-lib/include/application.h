@@ -6,8 +6,46 @@
 
 #include <sys/time.h>
 
+/**
+ * Creates the shutdown and reload wakeup channels. Must be called before any thread waits on them.
+ */
+bool Application_Init();
+
+/**
+ * Starts shutting down and wakes every wait on Application_ShutdownFd.
+ * Async-signal-safe.
+ */
 void Application_StartShutdown();
 
 bool Application_ShouldShutdown();
 
+/**
+ * File descriptor that becomes readable, and stays readable, once shutdown starts.
+ * Add it to every blocking poll() so waits end as soon as shutdown starts.
+ * Never read from it.
+ */
+int Application_ShutdownFd();
+
+/**
+ * Waits for fd to become readable, for at most timeoutMs, or forever if negative.
+ * fd may be -1 to only wait for the timeout.
+ * Returns false if it didn't, with errno set to EINTR if shutdown started or
+ * a signal arrived, EAGAIN on timeout, or the poll() error.
+ */
+bool Application_WaitReadable(int fd, int timeoutMs);
+
+/**
+ * Asks the thread in Application_WaitForReload to reload configuration.
+ * Async-signal-safe.
+ */
+void Application_RequestReload();
+
+/**
+ * Blocks until a reload is requested, returning true, or shutdown starts,
+ * returning false.
+ */
+bool Application_WaitForReload();
+
+void Application_Cleanup();
+
 #endif // AMN_APPLICATION_H
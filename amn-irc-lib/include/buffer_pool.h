@@ -0,0 +1,34 @@
+#ifndef AMN_BUFFER_POOL_H
+#define AMN_BUFFER_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+  * Thread-safe pool of fixed size buffers, allocated in slabs.
+  * Connections borrow a buffer only while they have data to process, so the
+  * number of buffers follows the number of busy connections, not of open ones.
+  * Buffers are kept for reuse until the pool is deleted.
+  */
+typedef struct BufferPool BufferPool;
+
+/**
+ * @param bufferSize		Size of each buffer in bytes.
+ * @param buffersPerSlab	How many buffers to allocate at once when the pool is empty.
+ */
+BufferPool* BufferPool_New(size_t bufferSize, size_t buffersPerSlab);
+
+/**
+ * Every buffer must have been returned.
+ */
+void BufferPool_Delete(BufferPool* self);
+
+size_t BufferPool_BufferSize(const BufferPool* self);
+
+/**
+ * @return A buffer of BufferPool_BufferSize bytes, or null on allocation failure.
+ */
+uint8_t* BufferPool_Borrow(BufferPool* self);
+void BufferPool_Return(BufferPool* self, uint8_t* buffer);
+
+#endif // AMN_BUFFER_POOL_H
@@ -0,0 +1,78 @@
+#ifndef AMN_FLIGHT_RECORDER_H
+#define AMN_FLIGHT_RECORDER_H
+
+#include "irc_cmd_type.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+  * Rings of the last FLIGHT_RECORDER_EVENTS events of each thread, e.g.
+  * commands being queued and executed and tasks starting and failing, for
+  * post-mortems without verbose logging. Only the owning thread writes its
+  * ring, so recording is a clock read and a few stores. Event times are from
+  * Metrics_NowNs. Rings of exited threads are kept, with their last events.
+  *
+  * The rings are written as text to a file by FlightRecorder_Dump, e.g. from
+  * a fatal signal handler.
+  */
+
+// Per thread, a power of two.
+#define FLIGHT_RECORDER_EVENTS 256
+// Throttled dumps are at most this often.
+#define FLIGHT_RECORDER_DUMP_INTERVAL_S 60
+
+typedef enum FlightEventType
+{
+	// A command was pushed to the command queue, with its depth after.
+	FlightEventType_CmdQueued,
+	// The executor handled a command, with the time it took.
+	FlightEventType_CmdExecuted,
+	FlightEventType_CmdFailed,
+	// A runner popped a task, with the task queue depth after.
+	FlightEventType_TaskStarted,
+	FlightEventType_TaskDone,
+	FlightEventType_TaskFailed,
+	FlightEventType_Len,
+}
+FlightEventType;
+
+/**
+ * Records an event in the ring of the calling thread. Fields that don't
+ * apply to the type are zero.
+ * @param cmd		Type of the command.
+ * @param socket	Connection of the command.
+ * @param depth		Queue depth.
+ * @param ns		Duration.
+ */
+void FlightRecorder_Record(FlightEventType type, IrcCmdType cmd, int socket, size_t depth,
+		uint64_t ns);
+
+/**
+ * Sets the file dumps are appended to, copied. Null to not dump, which is
+ * the default. Call before any dump may happen.
+ * @return False if the path is too long.
+ */
+bool FlightRecorder_SetPath(const char* path);
+
+/**
+ * Appends every thread's ring to the file, oldest events first.
+ * Async-signal-safe. Threads may keep recording while it's dumped, so their
+ * newest events may be missing or mixed with older ones. Waits up to a
+ * second for another dump being written, unless it's the calling thread's,
+ * interrupted by the signal handler calling this.
+ * @param reason	Written in the dump's header.
+ * @return False if there's no file, writing failed or another dump was
+ *         still being written.
+ */
+bool FlightRecorder_Dump(const char* reason);
+
+/**
+ * FlightRecorder_Dump, unless the last dump was less than
+ * FLIGHT_RECORDER_DUMP_INTERVAL_S ago, for failures that may repeat.
+ * Doesn't wait for another dump being written, it's skipped instead.
+ */
+bool FlightRecorder_DumpThrottled(const char* reason);
+
+#endif // AMN_FLIGHT_RECORDER_H
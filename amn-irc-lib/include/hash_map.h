@@ -0,0 +1,220 @@
+#ifndef AMN_HASH_MAP_H
+#define AMN_HASH_MAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+  * Type-specialized hash map, open addressed with linear probing.
+  * HASH_MAP_DEFINE(Name, Key, Value, hash, equals) declares the structs Name
+  * and Name##Entry and their static inline functions, prefixed Name_.
+  * hash(key) returns a size_t and equals(a, b) compares keys, both can be
+  * macros so they're inlined. Zero initialization gives an empty map.
+  *
+  * Keys and values are stored by value. Pointers to values are invalidated
+  * by Put, Remove and Reserve. Values are not deleted by the map, the owner
+  * must do it before removing or freeing them.
+  *
+  * Iterate with Name_At over every slot below capacity.
+  *
+  * Not thread-safe.
+  */
+
+// Spreads integer keys, whose low bits pick the slot.
+static inline size_t HashMap_HashU64(uint64_t key)
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdu;
+	key ^= key >> 33;
+	return (size_t) key;
+}
+
+#define HASH_MAP_EQUALS_SCALAR(a, b) ((a) == (b))
+
+#define HASH_MAP_MIN_CAPACITY 8
+
+#define HASH_MAP_DEFINE(Name, Key, Value, hash, equals)                        \
+                                                                               \
+typedef struct Name##Entry                                                     \
+{                                                                              \
+	Key key;                                                                   \
+	Value value;                                                               \
+}                                                                              \
+Name##Entry;                                                                   \
+                                                                               \
+typedef struct Name                                                            \
+{                                                                              \
+	Name##Entry* entries;                                                      \
+	bool* used;                                                                \
+	size_t size;                                                               \
+	/* Zero or a power of two. */                                              \
+	size_t capacity;                                                           \
+}                                                                              \
+Name;                                                                          \
+                                                                               \
+/* Frees the storage, values must have been deleted already. */                \
+static inline void Name##_Free(Name* self)                                     \
+{                                                                              \
+	free(self->entries);                                                       \
+	free(self->used);                                                          \
+	*self = (Name) { 0 };                                                      \
+}                                                                              \
+                                                                               \
+/* Slot holding key, or the empty slot where it would go. capacity > 0. */     \
+static inline size_t Name##_FindSlot(const Name* self, Key key)                \
+{                                                                              \
+	size_t mask = self->capacity - 1;                                          \
+	size_t slot = (size_t) (hash(key)) & mask;                                 \
+                                                                               \
+	while (self->used[slot] && !(equals(self->entries[slot].key, key)))        \
+	{                                                                          \
+		slot = (slot + 1) & mask;                                              \
+	}                                                                          \
+                                                                               \
+	return slot;                                                               \
+}                                                                              \
+                                                                               \
+/* Makes room for count entries, false on allocation failure. */               \
+static inline bool Name##_Reserve(Name* self, size_t count)                    \
+{                                                                              \
+	/* Probes stay short while at most 3/4 of the slots are used. */           \
+	size_t capacity = HASH_MAP_MIN_CAPACITY;                                   \
+	while (capacity / 4 * 3 < count)                                           \
+	{                                                                          \
+		if (capacity > SIZE_MAX / 2 / sizeof(Name##Entry))                     \
+		{                                                                      \
+			return false;                                                      \
+		}                                                                      \
+                                                                               \
+		capacity *= 2;                                                         \
+	}                                                                          \
+                                                                               \
+	if (capacity <= self->capacity)                                            \
+	{                                                                          \
+		return true;                                                           \
+	}                                                                          \
+                                                                               \
+	Name resized = {                                                           \
+		.entries = malloc(capacity * sizeof(Name##Entry)),                     \
+		.used = calloc(capacity, sizeof(bool)),                                \
+		.size = self->size,                                                    \
+		.capacity = capacity,                                                  \
+	};                                                                         \
+                                                                               \
+	if (resized.entries == NULL || resized.used == NULL)                       \
+	{                                                                          \
+		Name##_Free(&resized);                                                 \
+		return false;                                                          \
+	}                                                                          \
+                                                                               \
+	for (size_t i = 0; i < self->capacity; i++)                                \
+	{                                                                          \
+		if (self->used[i])                                                     \
+		{                                                                      \
+			size_t slot = Name##_FindSlot(&resized, self->entries[i].key);     \
+			resized.entries[slot] = self->entries[i];                          \
+			resized.used[slot] = true;                                         \
+		}                                                                      \
+	}                                                                          \
+                                                                               \
+	Name##_Free(self);                                                         \
+	*self = resized;                                                           \
+	return true;                                                               \
+}                                                                              \
+                                                                               \
+/* The value of key, or null. */                                               \
+static inline Value* Name##_Get(const Name* self, Key key)                     \
+{                                                                              \
+	if (self->size == 0)                                                       \
+	{                                                                          \
+		return NULL;                                                           \
+	}                                                                          \
+                                                                               \
+	size_t slot = Name##_FindSlot(self, key);                                  \
+	return self->used[slot] ? &self->entries[slot].value : NULL;               \
+}                                                                              \
+                                                                               \
+/* Inserts or overwrites the value of key.                                     \
+ * Returns where the value is stored, or null on allocation failure. */        \
+static inline Value* Name##_Put(Name* self, Key key, Value value)              \
+{                                                                              \
+	if (!Name##_Reserve(self, self->size + 1))                                 \
+	{                                                                          \
+		return NULL;                                                           \
+	}                                                                          \
+                                                                               \
+	size_t slot = Name##_FindSlot(self, key);                                  \
+	if (!self->used[slot])                                                     \
+	{                                                                          \
+		self->used[slot] = true;                                               \
+		self->size++;                                                          \
+	}                                                                          \
+                                                                               \
+	self->entries[slot] = (Name##Entry) { .key = key, .value = value };        \
+	return &self->entries[slot].value;                                         \
+}                                                                              \
+                                                                               \
+/* Removes key, copying its value to removed unless null.                      \
+ * False if key isn't in the map. */                                           \
+static inline bool Name##_Remove(Name* self, Key key, Value* removed)          \
+{                                                                              \
+	if (self->size == 0)                                                       \
+	{                                                                          \
+		return false;                                                          \
+	}                                                                          \
+                                                                               \
+	size_t mask = self->capacity - 1;                                          \
+	size_t hole = Name##_FindSlot(self, key);                                  \
+	if (!self->used[hole])                                                     \
+	{                                                                          \
+		return false;                                                          \
+	}                                                                          \
+                                                                               \
+	if (removed != NULL)                                                       \
+	{                                                                          \
+		*removed = self->entries[hole].value;                                  \
+	}                                                                          \
+                                                                               \
+	self->used[hole] = false;                                                  \
+	self->size--;                                                              \
+                                                                               \
+	/* Shift back the entries probing past the hole, so no tombstones. */      \
+	for (size_t slot = (hole + 1) & mask; self->used[slot];                    \
+			slot = (slot + 1) & mask)                                          \
+	{                                                                          \
+		size_t home = (size_t) (hash(self->entries[slot].key)) & mask;         \
+		bool homeAfterHole = hole <= slot                                      \
+			? hole < home && home <= slot                                      \
+			: hole < home || home <= slot;                                     \
+                                                                               \
+		if (!homeAfterHole)                                                    \
+		{                                                                      \
+			self->entries[hole] = self->entries[slot];                         \
+			self->used[hole] = true;                                           \
+			self->used[slot] = false;                                          \
+			hole = slot;                                                       \
+		}                                                                      \
+	}                                                                          \
+                                                                               \
+	return true;                                                               \
+}                                                                              \
+                                                                               \
+/* The entry in slot, or null if it's empty. slot < capacity. */               \
+static inline Name##Entry* Name##_At(const Name* self, size_t slot)           \
+{                                                                              \
+	return self->used[slot] ? &self->entries[slot] : NULL;                     \
+}                                                                              \
+                                                                               \
+static inline void Name##_Clear(Name* self)                                    \
+{                                                                              \
+	for (size_t i = 0; i < self->capacity; i++)                                \
+	{                                                                          \
+		self->used[i] = false;                                                 \
+	}                                                                          \
+                                                                               \
+	self->size = 0;                                                            \
+}
+
+#endif // AMN_HASH_MAP_H
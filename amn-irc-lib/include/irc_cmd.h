@@ -2,8 +2,11 @@
 #define AMN_IRC_CMD_H
 
 #include "irc_msg.h"
+#include "msg_trace.h"
 
 #define IRC_CMD_PRIVMSG_MAX_RECEIVERS 14
+// Longer JOIN lists spill to the heap.
+#define IRC_CMD_JOIN_INLINE_CHANNELS IRC_CMD_PRIVMSG_MAX_RECEIVERS
 
 // https://datatracker.ietf.org/doc/html/rfc1459#section-4.1.2
 typedef struct IrcCmdNick
@@ -34,10 +37,12 @@ typedef enum IrcChannelType
 }
 IrcChannelType;
 
+// Views into IrcCmd.msg.
 typedef struct IrcChannelAndKey
 {
-	char* name;
-	char* key;
+	const char* name;
+	// Null if missing.
+	const char* key;
 	IrcChannelType type;
 }
 IrcChannelAndKey;
@@ -45,8 +50,10 @@ IrcChannelAndKey;
 // https://datatracker.ietf.org/doc/html/rfc1459#section-4.2.1
 typedef struct IrcCmdJoin
 {
-	IrcChannelAndKey* channels;	
+	// Points to inlineChannels, or to the heap for longer lists.
+	IrcChannelAndKey* channels;
 	size_t channelCount;
+	IrcChannelAndKey inlineChannels[IRC_CMD_JOIN_INLINE_CHANNELS];
 }
 IrcCmdJoin;
 
@@ -133,24 +140,69 @@ IrcReceiverType;
 typedef struct IrcReceiver
 {
 	IrcReceiverType type;
-	char* value;
+	const char* value;
 }
 IrcReceiver;
 
 // https://datatracker.ietf.org/doc/html/rfc1459#section-4.4.1
+// Strings are views into IrcCmd.msg.
 typedef struct IrcCmdPrivMsg
 {
-	IrcReceiver* receiver;
+	IrcReceiver receiver[IRC_CMD_PRIVMSG_MAX_RECEIVERS];
 	size_t receiverCount;
-	char* text;
-} IrcCmdPrivMsg; 
+	const char* text;
+} IrcCmdPrivMsg;
+
+// https://datatracker.ietf.org/doc/html/rfc1459#section-4.6.2
+typedef struct IrcCmdPing
+{
+	char* server1;
+	// Optional, null if missing.
+	char* server2;
+}
+IrcCmdPing;
+
+// https://datatracker.ietf.org/doc/html/rfc1459#section-4.6.3
+typedef struct IrcCmdPong
+{
+	char* daemon1;
+	// Optional, null if missing.
+	char* daemon2;
+}
+IrcCmdPong;
+
+// https://datatracker.ietf.org/doc/html/rfc1459#section-4.3.2
+typedef struct IrcCmdStats
+{
+	// Letter of the statistics asked for, '\0' if missing.
+	char query;
+	// Optional, null if missing. A view into IrcCmd.msg.
+	const char* server;
+}
+IrcCmdStats;
+
+// https://datatracker.ietf.org/doc/html/rfc1459#section-4.1.5
+// Strings are views into IrcCmd.msg.
+typedef struct IrcCmdOper
+{
+	const char* user;
+	const char* password;
+}
+IrcCmdOper;
 
 // Generic command structure
 typedef struct IrcCmd
 {
 	IrcCmdType type;
+	IrcCmdPriority priority;
 	IrcMsgPrefix prefix;
 	int peerSocket;
+	// The parsed message, owned by the command, that the views of JOIN,
+	// PRIVMSG, STATS and OPER point into. Null for commands built by hand, whose views point
+	// to storage outliving the command.
+	IrcMsg* msg;
+	// Zero for untraced commands, and not copied by IrcCmd_Clone.
+	MsgTrace trace;
 	union {
 		IrcCmdNick nick;
 		IrcCmdUser user;
@@ -160,10 +212,18 @@ typedef struct IrcCmd
 		IrcCmdMode mode;
 		IrcCmdKick kick;
 		IrcCmdPrivMsg privMsg;
+		IrcCmdPing ping;
+		IrcCmdPong pong;
+		IrcCmdStats stats;
+		IrcCmdOper oper;
 		// TODO: Add missing commands
 	};
 } IrcCmd;
 
+/**
+ * Deep copy, including the message views point into. JOIN, PRIVMSG, STATS
+ * and OPER commands built by hand have no message and can't be cloned.
+ */
 IrcCmd* IrcCmd_Clone(const IrcCmd* self);
 
 void IrcCmd_Delete(IrcCmd* self);
@@ -7,12 +7,19 @@
 
 #include <stdbool.h>
 
+/**
+  * Stateless, one instance can be shared by every connection and thread.
+  */
 typedef struct IrcCmdParser IrcCmdParser;
 
 IrcCmdParser* IrcCmdParser_New(const Logger* logger, const IrcMsgValidator* validator);
 void IrcCmdParser_Delete(IrcCmdParser* self);
 
-IrcCmd* IrcCmdParser_Parse(IrcCmdParser* self, const IrcMsg* msg, int peerSocket);
+/**
+ * Takes ownership of msg, which the command keeps for its views, or which is
+ * deleted on failure.
+ */
+IrcCmd* IrcCmdParser_Parse(const IrcCmdParser* self, IrcMsg* msg, int peerSocket);
 
 
 #endif // AMN_IRC_CMD_PARSER_H
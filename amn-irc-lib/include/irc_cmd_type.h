@@ -2,6 +2,7 @@
 #define AMN_IRC_CMD_TYPE_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 typedef enum IrcCmdType
 {
@@ -67,7 +68,35 @@ typedef enum IrcCmdType
 	IrcCmdType_Len,
 } IrcCmdType;
 
-extern const char* const IRC_CMD_TYPE_STRS[];
+// Scheduling class of a command.
+typedef enum IrcCmdPriority
+{
+	// Keepalives and disconnects, handled ahead of chat traffic so clients
+	// don't time out or linger while the server is under load.
+	IrcCmdPriority_Control,
+	IrcCmdPriority_Normal,
+
+	// Not an actual priority, but the length of the enum
+	IrcCmdPriority_Len,
+}
+IrcCmdPriority;
+
+// Compile-time properties of a command type.
+typedef struct IrcCmdTypeInfo
+{
+	// Wire name, null for IrcCmdType_Null.
+	const char* name;
+	IrcCmdPriority priority;
+	// Flood control charge of each message.
+	// https://datatracker.ietf.org/doc/html/rfc1459#section-8.10
+	uint32_t penaltyMs;
+}
+IrcCmdTypeInfo;
+
+// Indexed by IrcCmdType.
+extern const IrcCmdTypeInfo IRC_CMD_TYPE_INFOS[IrcCmdType_Len];
+
+IrcCmdPriority IrcCmdType_Priority(IrcCmdType type);
 
 #endif // AMN_IRC_CMD_TYPE_H
 
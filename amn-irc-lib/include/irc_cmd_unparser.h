@@ -6,12 +6,29 @@
 #include "irc_msg_validator.h"
 
 #include <stdbool.h>
+#include <stddef.h>
 
+/**
+  * Unparses commands, either into an IrcMsg to be unparsed by IrcMsgUnparser,
+  * or straight into a raw message with UnparseTo.
+  * The unparser is stateless, and can be shared between threads.
+  */
 typedef struct IrcCmdUnparser IrcCmdUnparser;
 
 IrcCmdUnparser* IrcCmdUnparser_New(const Logger* logger, const IrcMsgValidator* validator);
 void IrcCmdUnparser_Delete(IrcCmdUnparser* self);
 
-IrcMsg* IrcCmdUnparser_Unparse(IrcCmdUnparser* self, const IrcCmd* cmd);
+IrcMsg* IrcCmdUnparser_Unparse(const IrcCmdUnparser* self, const IrcCmd* cmd);
+
+/**
+ * Writes a command as a raw message, CRLF and NUL terminator included, into
+ * buffer without allocating. Output is the same as Unparse followed by
+ * IrcMsgUnparser_Unparse.
+ * @return Length of the message without the NUL terminator, or 0 if the command
+ *         can't be unparsed or the message doesn't fit in bufferSize or IRC_MSG_SIZE.
+ *         errno is EINVAL if the command is missing a required parameter.
+ */
+size_t IrcCmdUnparser_UnparseTo(
+		const IrcCmdUnparser* self, const IrcCmd* cmd, char* buffer, size_t bufferSize);
 
 #endif // AMN_IRC_CMD_UNPARSER_H
@@ -30,24 +30,87 @@ typedef struct IrcMsgPrefix
  */
 bool IrcMsgPrefix_Clone(const IrcMsgPrefix* self, IrcMsgPrefix* clone);
 
+// Part of IrcMsg.buffer.
+typedef struct IrcMsgSpan
+{
+	uint16_t offset;
+	uint16_t len;
+}
+IrcMsgSpan;
+
 // Parsed command-agnostic IRC message representation.
 // https://datatracker.ietf.org/doc/html/rfc1459#section-2.3
+// Every string is stored NUL terminated in the inline buffer and referred to
+// by offset, so the message is a single allocation and copied with memcpy.
+// Read the strings with the accessors below.
 typedef struct IrcMsg
 {
-	// Optional field, if missing prefix.origin will be null. 
-	IrcMsgPrefix prefix;
+	// Optional prefix parts, absent when their length is zero.
+	IrcMsgSpan origin;
+	IrcMsgSpan username;
+	IrcMsgSpan hostname;
 	// Command type, either this or reply number must be present.
 	IrcCmdType cmd;
 	// Reply number, either this or command must be present.
 	uint32_t replyNumber;
 	// Command parameters, may be empty check paramCount.
-	char* params[IRC_MSG_MAX_PARAMS];
-	// Parameter count. If greater than zero, params cannot be null.
+	IrcMsgSpan params[IRC_MSG_MAX_PARAMS];
 	size_t paramCount;
+	// Bytes of buffer in use.
+	uint16_t bufferLen;
+	// In a raw message every part is followed by at least one separator, so
+	// the parts of any valid message fit with their terminators.
+	char buffer[IRC_MSG_SIZE];
 } IrcMsg;
 
+/**
+ * An empty message, null on allocation failure.
+ */
+IrcMsg* IrcMsg_New(void);
 IrcMsg* IrcMsg_Clone(const IrcMsg* self);
 void IrcMsg_Delete(IrcMsg* self);
 
+/**
+ * Prefix parts, null if absent. Valid as long as the message.
+ */
+const char* IrcMsg_Origin(const IrcMsg* self);
+const char* IrcMsg_Username(const IrcMsg* self);
+const char* IrcMsg_Hostname(const IrcMsg* self);
+
+/**
+ * Parameter at index, valid as long as the message. Null if index isn't
+ * below paramCount, and then its length is zero.
+ */
+const char* IrcMsg_Param(const IrcMsg* self, size_t index);
+size_t IrcMsg_ParamLen(const IrcMsg* self, size_t index);
+
+/**
+ * Replaces every separator in the parameter at index with NUL, so each item
+ * of a list like "a,b,c" can be used as a string in place. Walk the items up
+ * to IrcMsg_Param + IrcMsg_ParamLen, which are unchanged.
+ */
+void IrcMsg_SplitParam(IrcMsg* self, size_t index, char separator);
+
+/**
+ * Copies the prefix parts into heap allocated strings, as owned by IrcCmd.
+ * On failure returns false, and the contents of prefix are undefined.
+ */
+bool IrcMsg_ClonePrefix(const IrcMsg* self, IrcMsgPrefix* prefix);
+
+/**
+ * Setters copy the string between start and end, end excluded, into the buffer.
+ * They return false if it's full, or for AddParam if there are
+ * IRC_MSG_MAX_PARAMS already.
+ */
+bool IrcMsg_SetOrigin(IrcMsg* self, const char* start, const char* end);
+bool IrcMsg_SetUsername(IrcMsg* self, const char* start, const char* end);
+bool IrcMsg_SetHostname(IrcMsg* self, const char* start, const char* end);
+bool IrcMsg_AddParam(IrcMsg* self, const char* start, const char* end);
+
+/**
+ * Sets every prefix part present in prefix.
+ */
+bool IrcMsg_SetPrefix(IrcMsg* self, const IrcMsgPrefix* prefix);
+
 #endif // AMN_IRC_MSG_H
 
@@ -8,15 +8,15 @@
 #include <stdbool.h>
 
 /**
-  * Note: The parser maintains internal state, and it's not thread-safe.
-  *       Use one instance for each thread.
+  * The parser keeps no state between calls, so one instance can be shared
+  * by every connection and thread.
   */
 typedef struct IrcMsgParser IrcMsgParser;
 
 IrcMsgParser* IrcMsgParser_New(const Logger* logger, const IrcMsgValidator* validator);
 void IrcMsgParser_Delete(IrcMsgParser* self);
 
-IrcMsg* IrcMsgParser_Parse(IrcMsgParser* self, const char* rawMsg);
+IrcMsg* IrcMsgParser_Parse(const IrcMsgParser* self, const char* rawMsg);
 
 
 #endif // AMN_IRC_MSG_PARSER_H
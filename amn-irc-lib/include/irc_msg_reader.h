@@ -1,13 +1,49 @@
 #ifndef AMN_IRC_MSG_READER_H
 #define AMN_IRC_MSG_READER_H
 
+#include "buffer_pool.h"
+#include "irc_msg.h"
 #include "log.h"
 
+#include <stdbool.h>
+
+// Size of the BufferPool buffers given to readers. Room for a partial message
+// left from the last read, plus a few more messages.
+#define IRC_MSG_READER_BUFFER_SIZE (IRC_MSG_SIZE * 8)
+
+/**
+  * Reads CRLF terminated messages from a socket.
+  * A read buffer is only borrowed from the pool between Fill and the Next call
+  * that returns null. A partial message at the end of a read is moved to a
+  * small buffer of the reader's own until the rest of it arrives, so idle
+  * connections hold no read buffer.
+  */
 typedef struct IrcMsgReader IrcMsgReader;
 
-IrcMsgReader* IrcMsgReader_New(const Logger* log, int socket);
+/**
+ * @param buffers	Pool of IRC_MSG_READER_BUFFER_SIZE buffers, it must outlive the reader.
+ */
+IrcMsgReader* IrcMsgReader_New(const Logger* log, BufferPool* buffers, int socket);
 void IrcMsgReader_Delete(IrcMsgReader* self);
 
-const char* IrcMsgReader_Read(IrcMsgReader* self);
+/**
+ * Waits for data on the socket and reads it.
+ * Returns false on errors and end of file, setting errno to zero on end of
+ * file. Also if interrupted by a signal or shutdown, setting errno to EINTR.
+ */
+bool IrcMsgReader_Fill(IrcMsgReader* self);
+
+/**
+ * Returns how many bytes the last Fill read from the socket, zero if it
+ * failed or didn't need to read.
+ */
+size_t IrcMsgReader_LastReadLen(const IrcMsgReader* self);
+
+/**
+ * Returns the next complete message from the last Fill, including its CRLF.
+ * It's valid until the next call. Returns null when there are no more messages,
+ * and then the read buffer goes back to the pool until the next Fill.
+ */
+const char* IrcMsgReader_Next(IrcMsgReader* self);
 
 #endif // AMN_IRC_MSG_READER_H
@@ -4,6 +4,7 @@
 #include "log.h"
 
 #include <stdbool.h>
+#include <stddef.h>
 
 typedef struct IrcMsgWriter IrcMsgWriter;
 
@@ -12,4 +13,9 @@ void IrcMsgWriter_Delete(IrcMsgWriter* self);
 
 bool IrcMsgWriter_Write(IrcMsgWriter* self, const char* msg);
 
+/**
+ * Writes msgLen bytes of an already unparsed message.
+ */
+bool IrcMsgWriter_WriteLen(IrcMsgWriter* self, const char* msg, size_t msgLen);
+
 #endif // AMN_IRC_MSG_WRITER_H
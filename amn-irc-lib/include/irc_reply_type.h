@@ -1,10 +1,42 @@
 #ifndef AMN_REPLY_TYPE_H
 #define AMN_REPLY_TYPE_H
 
+// Numeric replies, valued as their numbers.
+// https://datatracker.ietf.org/doc/html/rfc1459#section-6
+// The welcome burst of 001 to 004 is from RFC 2812, clients expect it.
+// https://datatracker.ietf.org/doc/html/rfc2812#section-5.1
 typedef enum IrcReplyType
 {
+	IrcReplyType_RplWelcome = 1,
+	IrcReplyType_RplYourHost = 2,
+	IrcReplyType_RplCreated = 3,
+	IrcReplyType_RplMyInfo = 4,
+	IrcReplyType_RplStatsLinkInfo = 211,
+	IrcReplyType_RplStatsCommands = 212,
+	IrcReplyType_RplEndOfStats = 219,
+	IrcReplyType_RplStatsUptime = 242,
+	IrcReplyType_RplStatsDebug = 249,
+	IrcReplyType_RplTopic = 332,
+	IrcReplyType_RplYoureOper = 381,
+	IrcReplyType_RplRehashing = 382,
 
+	IrcReplyType_ErrNoSuchNick = 401,
+	IrcReplyType_ErrNoSuchServer = 402,
+	IrcReplyType_ErrNickCollision = 436,
+	IrcReplyType_ErrNotRegistered = 451,
+	IrcReplyType_ErrNeedMoreParams = 461,
+	IrcReplyType_ErrAlreadyRegistered = 462,
+	IrcReplyType_ErrPasswdMismatch = 464,
+	IrcReplyType_ErrChannelIsFull = 471,
+	IrcReplyType_ErrInviteOnlyChan = 473,
+	IrcReplyType_ErrBannedFromChan = 474,
+	IrcReplyType_ErrBadChannelKey = 475,
+	IrcReplyType_ErrNoPrivileges = 481,
+	IrcReplyType_ErrNoOperHost = 491,
 }
 IrcReplyType;
 
+// Numerics are always 3 digits.
+#define IRC_REPLY_TYPE_MAX 999
+
 #endif // AMN_REPLY_TYPE_H
@@ -1,10 +1,22 @@
 #ifndef AMN_LOG_H
 #define AMN_LOG_H
 
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 #include <stdio.h>
 
+/**
+  * Asynchronous logger. Logger_Log packs the raw arguments of the message
+  * and pushes them, with its timestamp and call site, to a lock-free ring
+  * owned by the calling thread. A writer thread merges the rings in time
+  * order, formats the lines and writes them to the log files in large
+  * batches, so callers never wait on formatting or I/O. See log_format.h.
+  *
+  * Formats must be string literals, as they are read by the writer.
+  * Threads that logged must exit before the logger is destroyed.
+  */
 typedef struct Logger Logger;
 
 typedef enum LogLevel {
@@ -14,6 +26,34 @@ typedef enum LogLevel {
 	LogLevel_Error,
 } LogLevel;
 
+// Levels below this are compiled out, along with their arguments.
+// Set with the AMN_LOG_MIN_LEVEL CMake cache variable.
+#ifndef AMN_LOG_MIN_LEVEL
+#define AMN_LOG_MIN_LEVEL LogLevel_Debug
+#endif
+
+/**
+ * Parses "debug", "info", "warn" or "error".
+ * @return False if str is none of them.
+ */
+bool LogLevel_Parse(const char* str, LogLevel* level);
+
+// What Logger_Log does when the ring of its thread is full.
+typedef enum LogFullPolicy
+{
+	// Skip the message and count it, see Logger_DroppedCount.
+	LogFullPolicy_Drop,
+	// Wait for the writer to make room.
+	LogFullPolicy_Block,
+}
+LogFullPolicy;
+
+/**
+ * Parses "drop" or "block".
+ * @return False if str is neither.
+ */
+bool LogFullPolicy_Parse(const char* str, LogFullPolicy* policy);
+
 /**
   * @param logFiles			An array of files to log to, it must live as long
   *							as the logger does.
@@ -23,12 +63,82 @@ typedef enum LogLevel {
 Logger* Logger_Create(FILE* *const logFiles, size_t logFileCount);
 
 /**
+ * Writes the remaining messages and stops the writer thread.
  * @param self Pointer to a logger, must not be null.
  */
 void Logger_Destroy(Logger* self);
 
+/**
+ * Writes the messages still in the rings, which the writer thread won't get
+ * to, for fatal signal handlers. Async-signal-safe, so the messages are
+ * written as text to the log files, even if a binary file replaced them,
+ * timed in seconds since the epoch and formatted by LogArgs_FormatSafe.
+ * Afterwards the writer is stopped, the process is expected to end.
+ * @return False if the writer didn't finish its batch within 100ms, e.g.
+ *         because it's the thread that crashed.
+ */
+bool Logger_WriteFatal(Logger* self);
+
+/**
+ * The default is LogFullPolicy_Drop. Thread-safe.
+ */
+void Logger_SetFullPolicy(Logger* self, LogFullPolicy policy);
+
+/**
+ * @return Messages dropped so far because a ring was full.
+ */
+uint64_t Logger_DroppedCount(const Logger* self);
+
+/**
+ * Messages below level are skipped, unless their module has its own level.
+ * The default is LogLevel_Debug. Thread-safe.
+ */
+void Logger_SetLevel(Logger* self, LogLevel level);
+
+/**
+ * Replaces the per-module levels with the ones in spec, a comma separated
+ * list of "module=level". A module is a source file name without its
+ * extension, e.g. "receive_msg_task=debug,irc_msg_parser=warn".
+ * Null or empty clears them. Thread-safe.
+ * @return False, changing nothing, if spec is invalid or allocation fails.
+ */
+bool Logger_SetModuleLevels(Logger* self, const char* spec);
+
+/**
+ * @return Whether spec is valid for Logger_SetModuleLevels.
+ */
+bool Logger_ValidModuleLevels(const char* spec);
+
+/**
+ * Writes messages in binary to the file at path, created or truncated,
+ * instead of the log files. Formatting them is left to amn-irc-logdump.
+ * Can only be done once per logger, thread-safe.
+ * @return False if a binary file is already open or path can't be opened.
+ */
+bool Logger_OpenBinaryFile(Logger* self, const char* path);
+
+/**
+ * Level of the module of a LOG_* call site, cached so an enabled check is a
+ * load and a compare. The cache is invalidated by bumping LogLevelsVersion
+ * whenever a level changes. As sites are shared by every logger, a process
+ * should use the same levels for all its loggers.
+ */
+typedef struct LogSite
+{
+	// Version the level was resolved at, shifted left by LOG_SITE_LEVEL_BITS, or'ed
+	// with the level. Zero until resolved.
+	_Atomic uint32_t state;
+	// Identifies the site in binary log files, zero until first logged.
+	_Atomic uint32_t id;
+}
+LogSite;
+
+/**
+ * Logs a message of site, usually through the LOG_* macros.
+ */
 void Logger_Log(
 	const Logger* self,
+	LogSite* site,
 	LogLevel level, 
 	const char* function,
 	const char* file,
@@ -36,14 +146,48 @@ void Logger_Log(
 	const char* format,
 	...);
 
-#define LOG_DEBUG(logger, ...) \
-	Logger_Log(logger, LogLevel_Debug, __func__, __FILE__, __LINE__, __VA_ARGS__)
-#define LOG_INFO(logger, ...) \
-	Logger_Log(logger, LogLevel_Info, __func__, __FILE__, __LINE__, __VA_ARGS__)
-#define LOG_WARN(logger, ...) \
-	Logger_Log(logger, LogLevel_Warn, __func__, __FILE__, __LINE__, __VA_ARGS__)
-#define LOG_ERROR(logger, ...) \
-	Logger_Log(logger, LogLevel_Error, __func__, __FILE__, __LINE__, __VA_ARGS__)
+#define LOG_SITE_LEVEL_BITS 2
+
+// Starts at 1, so zero initialized sites resolve on first use.
+extern _Atomic uint32_t LogLevelsVersion;
+
+/**
+ * Resolves and caches the level of the module file for site.
+ * @return The new site state.
+ */
+uint32_t LogSite_Resolve(LogSite* site, const Logger* logger, const char* file);
+
+static inline bool LogSite_Enabled(LogSite* site, const Logger* logger, LogLevel level,
+		const char* file)
+{
+	uint32_t state = atomic_load_explicit(&site->state, memory_order_relaxed);
+	if (state >> LOG_SITE_LEVEL_BITS
+			!= atomic_load_explicit(&LogLevelsVersion, memory_order_relaxed))
+	{
+		state = LogSite_Resolve(site, logger, file);
+	}
+
+	return (uint32_t) level >= (state & ((1u << LOG_SITE_LEVEL_BITS) - 1));
+}
+
+// Arguments are only evaluated if the level is enabled.
+#define LOG_AT(logger, level, ...)                                                      \
+	do                                                                                  \
+	{                                                                                   \
+		static LogSite logSite_;                                                        \
+		if ((level) >= AMN_LOG_MIN_LEVEL                                                \
+				&& LogSite_Enabled(&logSite_, logger, level, __FILE__))                 \
+		{                                                                               \
+			Logger_Log(logger, &logSite_, level, __func__, __FILE__, __LINE__,          \
+					__VA_ARGS__);                                                       \
+		}                                                                               \
+	}                                                                                   \
+	while (0)
+
+#define LOG_DEBUG(logger, ...) LOG_AT(logger, LogLevel_Debug, __VA_ARGS__)
+#define LOG_INFO(logger, ...) LOG_AT(logger, LogLevel_Info, __VA_ARGS__)
+#define LOG_WARN(logger, ...) LOG_AT(logger, LogLevel_Warn, __VA_ARGS__)
+#define LOG_ERROR(logger, ...) LOG_AT(logger, LogLevel_Error, __VA_ARGS__)
 
 #endif //AMN_LOG_H
 
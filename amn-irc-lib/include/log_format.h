@@ -0,0 +1,119 @@
+#ifndef AMN_LOG_FORMAT_H
+#define AMN_LOG_FORMAT_H
+
+#include "log.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/**
+  * Deferred formatting of log messages, shared by the logger and
+  * amn-irc-logdump. Logger_Log only packs the raw arguments of the format
+  * string, which are formatted into the text line later, by the writer
+  * thread or offline from a binary log file.
+  *
+  * Packed arguments are the values of the format's conversions in order, as
+  * 8 byte integers or doubles, or for strings a 4 byte length followed by
+  * the bytes. Supports the printf conversions except %n and wide strings.
+  */
+
+// Longest packed arguments of a message, longer strings are truncated.
+#define LOG_MAX_ARGS_BYTES 1024
+// Longest formatted line, with its errno suffix.
+#define LOG_MAX_LINE_BYTES 2048
+
+/**
+ * Packs the arguments of format into buffer.
+ * @return Bytes used, arguments that don't fit are left out.
+ */
+size_t LogArgs_Pack(unsigned char* buffer, size_t capacity, const char* format, va_list args);
+
+/**
+ * Formats packed arguments like printf(format, ...) would have, into text
+ * of at most capacity bytes, NUL terminated.
+ * @return Length of the text.
+ */
+size_t LogArgs_Format(char* text, size_t capacity, const char* format,
+		const unsigned char* args, size_t argsLen);
+
+/**
+ * LogArgs_Format without printf, so async-signal-safe. Flags, widths and
+ * precisions are ignored, integers are written in decimal, or hexadecimal
+ * for %x, %X and %p, and floating point values as "?".
+ */
+size_t LogArgs_FormatSafe(char* text, size_t capacity, const char* format,
+		const unsigned char* args, size_t argsLen);
+
+/**
+ * Formats a log line, "[time.micros][LEVEL] file:line - function - text\n",
+ * followed by an errno line if errnum isn't zero. Truncated lines still end
+ * with a newline.
+ * @param time HH:MM:SS of the message.
+ * @return Length of the line, at most capacity - 1.
+ */
+size_t LogLine_Format(char* buffer, size_t capacity, const char* time, long micros,
+		LogLevel level, const char* file, uint32_t line, const char* function,
+		const char* text, size_t textLen, int errnum);
+
+/**
+ * LogLine_Format without printf or the local time zone, so
+ * async-signal-safe. The time is in seconds since the epoch, and errno is
+ * written as its number.
+ */
+size_t LogLine_FormatSafe(char* buffer, size_t capacity, const struct timespec* time,
+		LogLevel level, const char* file, uint32_t line, const char* function,
+		const char* text, size_t textLen, int errnum);
+
+/**
+  * Binary log file, see Logger_OpenBinaryFile. A LOG_FILE_MAGIC header
+  * followed by records, each starting with a LogFileRecord and padded to a
+  * multiple of 8 bytes. A call site is described by a Site record before
+  * its first Message. A record of size zero, or the end of the file, ends
+  * the log.
+  */
+
+#define LOG_FILE_MAGIC "AMNLOG01"
+#define LOG_FILE_MAGIC_LEN 8
+#define LOG_FILE_ALIGN 8
+
+typedef enum LogFileRecordType
+{
+	LogFileRecordType_Site = 1,
+	LogFileRecordType_Message = 2,
+}
+LogFileRecordType;
+
+typedef struct LogFileRecord
+{
+	uint32_t size;
+	uint32_t type;
+}
+LogFileRecord;
+
+// Followed by the NUL terminated file, function and format.
+typedef struct LogFileSite
+{
+	LogFileRecord record;
+	uint32_t id;
+	uint32_t line;
+	uint32_t level;
+	uint32_t reserved;
+}
+LogFileSite;
+
+// Followed by argsLen bytes of packed arguments.
+typedef struct LogFileMessage
+{
+	LogFileRecord record;
+	uint32_t siteId;
+	int32_t errnum;
+	int64_t sec;
+	int64_t nsec;
+	uint32_t argsLen;
+	uint32_t reserved;
+}
+LogFileMessage;
+
+#endif // AMN_LOG_FORMAT_H
@@ -0,0 +1,146 @@
+#ifndef AMN_METRICS_H
+#define AMN_METRICS_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+  * Process wide registry of counters, gauges and latency histograms.
+  * Updates go to a shard owned by the calling thread, so they are a few
+  * uncontended stores, and readers merge every thread's shard. Shards of
+  * exited threads keep their counts and are adopted by new threads.
+  *
+  * Metrics are usually static Metric descriptors, registered on first use
+  * or eagerly with Metric_Register so they're listed before being updated.
+  * Descriptors with the same name and labels share their values.
+  */
+
+typedef enum MetricType
+{
+	// Only ever grows.
+	MetricType_Counter,
+	// Goes up and down, e.g. a queue depth.
+	MetricType_Gauge,
+	// Distribution of durations in nanoseconds, named in seconds as they
+	// are exported in seconds.
+	MetricType_Histogram,
+}
+MetricType;
+
+typedef struct Metric
+{
+	MetricType type;
+	const char* name;
+	// Prometheus style labels, e.g. command="PRIVMSG", or null.
+	const char* labels;
+	const char* help;
+	// Registry index plus one, zero until registered, UINT32_MAX if it can't be.
+	_Atomic uint32_t id;
+}
+Metric;
+
+#define METRIC_COUNTER(name, help) { MetricType_Counter, name, NULL, help, 0 }
+#define METRIC_GAUGE(name, help) { MetricType_Gauge, name, NULL, help, 0 }
+#define METRIC_HISTOGRAM(name, help) { MetricType_Histogram, name, NULL, help, 0 }
+
+// Histograms are log-linear like HDR histograms: values below 8 have their
+// own bucket, every power of two above is split in 8 buckets, so a bucket is
+// at most 12.5% wide. Values from 2^40 ns, about 18 minutes, share the last.
+#define METRIC_HISTOGRAM_SUB_BITS 3
+#define METRIC_HISTOGRAM_MAX_BITS 40
+#define METRIC_HISTOGRAM_BUCKETS \
+	((METRIC_HISTOGRAM_MAX_BITS - METRIC_HISTOGRAM_SUB_BITS + 1) << METRIC_HISTOGRAM_SUB_BITS)
+
+// Reading the clock costs as much as the rest of a message's metrics, so
+// latencies on hot paths are sampled: Metrics_SampleNs times one in this many
+// events, each recorded as this many observations.
+#define METRICS_SAMPLE_PERIOD 32
+
+// Merged histogram of every thread.
+typedef struct MetricHistogram
+{
+	uint64_t buckets[METRIC_HISTOGRAM_BUCKETS];
+	uint64_t count;
+	// Sum of the observed values.
+	uint64_t sum;
+}
+MetricHistogram;
+
+/**
+ * Registers self, thread-safe.
+ * @return False if the registry is full or allocation fails, later updates
+ *         are then ignored.
+ */
+bool Metric_Register(Metric* self);
+
+/**
+ * Adds value to a counter or gauge.
+ */
+void Metric_Add(Metric* self, int64_t value);
+
+/**
+ * Records a duration in a histogram.
+ */
+void Metric_Observe(Metric* self, uint64_t ns);
+
+/**
+ * Records the time since sampleNs, a result of Metrics_SampleNs, in a
+ * histogram as METRICS_SAMPLE_PERIOD observations. Does nothing, without
+ * reading the clock, if sampleNs is zero.
+ */
+void Metric_ObserveSince(Metric* self, uint64_t sampleNs);
+
+/**
+ * Records a duration measured between times from Metrics_SampleNs as
+ * METRICS_SAMPLE_PERIOD observations.
+ */
+void Metric_ObserveSampled(Metric* self, uint64_t ns);
+
+/**
+ * @return The current value of a counter or gauge, zero if unregistered.
+ */
+int64_t Metric_Value(Metric* self);
+
+/**
+ * Merges a histogram, empty if unregistered.
+ */
+void Metric_ReadHistogram(Metric* self, MetricHistogram* histogram);
+
+/**
+ * Monotonic time in nanoseconds, for measuring durations.
+ */
+uint64_t Metrics_NowNs(void);
+
+/**
+ * Metrics_NowNs for one in METRICS_SAMPLE_PERIOD calls on each thread, zero
+ * for the others.
+ */
+uint64_t Metrics_SampleNs(void);
+
+/**
+ * Registered metrics can be listed by index, from 0 to Metrics_Count, in
+ * registration order. The returned descriptor is the registry's own copy,
+ * which must not be changed and stays valid until the process exits.
+ */
+size_t Metrics_Count(void);
+Metric* Metrics_At(size_t index);
+
+/**
+ * @return The smallest value of bucket.
+ */
+uint64_t MetricHistogram_BucketMin(size_t bucket);
+
+/**
+ * @return The largest value of bucket, UINT64_MAX for the last one.
+ */
+uint64_t MetricHistogram_BucketMax(size_t bucket);
+
+/**
+ * @param percentile Between 0 and 100.
+ * @return An upper bound of the value at percentile, zero if empty.
+ */
+uint64_t MetricHistogram_Percentile(const MetricHistogram* self, double percentile);
+
+#endif // AMN_METRICS_H
@@ -0,0 +1,84 @@
+#ifndef AMN_MSG_TRACE_H
+#define AMN_MSG_TRACE_H
+
+#include "log.h"
+#include "metrics.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+  * Timestamps of a message going through the server, from the read that
+  * got it off its socket to the write of what it caused. The command carries
+  * them through the command queue, and each send task gets a copy.
+  *
+  * Messages of one in METRICS_SAMPLE_PERIOD reads are traced into the stage
+  * histograms. Others may be traced only to log their breakdown, so the
+  * histograms stay unbiased. Untraced messages have no stamps and cost a
+  * branch per stage.
+  */
+
+typedef enum MsgTraceStage
+{
+	// IrcMsgReader_Fill returned the data.
+	MsgTraceStage_Read,
+	// The command was parsed, and is pushed to the command queue.
+	MsgTraceStage_Parsed,
+	// The executor popped the command.
+	MsgTraceStage_Dequeued,
+	// The executor ran the command, and queues its sends.
+	MsgTraceStage_Executed,
+	// A runner started the send task.
+	MsgTraceStage_Sending,
+	// The send was written to its socket.
+	MsgTraceStage_Written,
+	MsgTraceStage_Len,
+}
+MsgTraceStage;
+
+typedef struct MsgTrace
+{
+	// Monotonic time each stage was reached, zero until then. All zero if
+	// the message isn't traced.
+	uint64_t stampNs[MsgTraceStage_Len];
+	// Recorded in the stage histograms.
+	bool sampled;
+	// Logged when written.
+	bool logged;
+}
+MsgTrace;
+
+/**
+ * Starts tracing at MsgTraceStage_Read, if sampled or logged.
+ * @param readNs	When the message was read, must not be zero if either is set.
+ */
+void MsgTrace_Begin(MsgTrace* self, uint64_t readNs, bool sampled, bool logged);
+
+static inline bool MsgTrace_IsTraced(const MsgTrace* self)
+{
+	return self->stampNs[MsgTraceStage_Read] != 0;
+}
+
+/**
+ * Stamps stage with the current time, if traced.
+ */
+static inline void MsgTrace_Stamp(MsgTrace* self, MsgTraceStage stage)
+{
+	if (MsgTrace_IsTraced(self))
+	{
+		self->stampNs[stage] = Metrics_NowNs();
+	}
+}
+
+/**
+ * Records the stages up to MsgTraceStage_Executed, once per command.
+ */
+void MsgTrace_RecordExecuted(const MsgTrace* self);
+
+/**
+ * Records the stages after MsgTraceStage_Executed and the whole latency,
+ * once per send, and logs the breakdown if the trace is logged.
+ */
+void MsgTrace_RecordWritten(const MsgTrace* self, const Logger* log, int socket);
+
+#endif // AMN_MSG_TRACE_H
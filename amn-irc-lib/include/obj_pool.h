@@ -0,0 +1,31 @@
+#ifndef AMN_OBJ_POOL_H
+#define AMN_OBJ_POOL_H
+
+#include <stddef.h>
+
+/**
+  * Thread-local slab allocator for small fixed-size objects that are
+  * created and deleted for every message, like tasks, commands and messages.
+  * Each thread allocates from its own free lists, one per size class, so
+  * threads don't contend on the malloc arenas. An object freed by another
+  * thread than the one that allocated it is pushed, lock-free, onto a
+  * remote free list that the owning thread takes back when it runs out.
+  * Slabs are kept for reuse until the process exits.
+  *
+  * Objects too big for every size class fall back to malloc.
+  * Building with AMN_OBJ_POOL_USE_MALLOC sends every allocation to malloc,
+  * so leak checkers see each object.
+  */
+
+/**
+ * @return An object of at least size bytes aligned like malloc, or null on
+ *         allocation failure. Only ObjPool_Free can free it.
+ */
+void* ObjPool_Alloc(size_t size);
+
+/**
+ * Frees an object from ObjPool_Alloc, from any thread. Null is ignored.
+ */
+void ObjPool_Free(void* obj);
+
+#endif // AMN_OBJ_POOL_H
@@ -0,0 +1,38 @@
+#ifndef AMN_PROBES_H
+#define AMN_PROBES_H
+
+/**
+  * Static tracepoints (USDT probes) of the "amn" provider, for perf and
+  * bpftrace. Built with the AMN_USDT CMake option, each probe is a single
+  * nop in the code and a note in the binary, until a tracer attaches to it.
+  * Without the option they compile to nothing and their arguments are not
+  * evaluated.
+  *
+  * Arguments must be integers or pointers, and cheap to compute, as they
+  * are computed whenever the probe is built in. The probes and their
+  * arguments are listed in amn-irc-server/bpftrace/README.md.
+  */
+
+#ifdef AMN_USDT
+
+#include <sys/sdt.h>
+
+#define AMN_PROBE0(name) DTRACE_PROBE(amn, name)
+#define AMN_PROBE1(name, a) DTRACE_PROBE1(amn, name, a)
+#define AMN_PROBE2(name, a, b) DTRACE_PROBE2(amn, name, a, b)
+#define AMN_PROBE3(name, a, b, c) DTRACE_PROBE3(amn, name, a, b, c)
+#define AMN_PROBE4(name, a, b, c, d) DTRACE_PROBE4(amn, name, a, b, c, d)
+
+#else
+
+// sizeof keeps the arguments used, so they don't warn, without evaluating them.
+#define AMN_PROBE0(name) ((void) 0)
+#define AMN_PROBE1(name, a) ((void) sizeof(a))
+#define AMN_PROBE2(name, a, b) ((void) sizeof(a), (void) sizeof(b))
+#define AMN_PROBE3(name, a, b, c) ((void) sizeof(a), (void) sizeof(b), (void) sizeof(c))
+#define AMN_PROBE4(name, a, b, c, d) \
+	((void) sizeof(a), (void) sizeof(b), (void) sizeof(c), (void) sizeof(d))
+
+#endif
+
+#endif // AMN_PROBES_H
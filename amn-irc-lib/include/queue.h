@@ -5,9 +5,12 @@
 #include <stddef.h>
 #include <stdint.h>
 
+// Maximum number of priority lanes a Queue can have.
+#define QUEUE_MAX_PRIORITIES 4
+
 typedef struct Queue Queue;
 
-typedef enum Queue_TryPopResult 
+typedef enum Queue_TryPopResult
 {
 	Queue_TryPopResult_Ok,
 	Queue_TryPopResult_Empty,
@@ -15,10 +18,48 @@ typedef enum Queue_TryPopResult
 }
 Queue_TryPopResult;
 
-Queue* Queue_New(size_t capacity, int32_t shutdownTimeout, size_t elementSize);
+/**
+ * Creates a queue with a single priority lane.
+ */
+Queue* Queue_New(size_t capacity, size_t elementSize);
+
+/**
+ * Creates a queue with priorityCount lanes, lane 0 being the highest priority.
+ * Each lane holds up to capacity elements.
+ *
+ * @param weights	Null for strict priority, where a lane is only popped from
+ *					when all higher priority lanes are empty.
+ *					Otherwise priorityCount weights, a lane is popped from at
+ *					most weights[lane] times while lower lanes have elements
+ *					waiting, and it is their turn.
+ */
+Queue* Queue_NewPriority(size_t capacity, size_t elementSize,
+		size_t priorityCount, const uint32_t* weights);
 void Queue_Delete(Queue* self, void (*elementDeleter)(void*), size_t elementSize);
 
+/**
+ * Wakes every thread blocked on the queue. Afterwards pushes fail, and pops
+ * fail once the queue is empty, both setting errno to ECANCELED.
+ */
+void Queue_Shutdown(Queue* self);
+
+/**
+ * @return The most elements the queue held at once, across all lanes.
+ */
+size_t Queue_HighWater(Queue* self);
+
+/**
+ * @return How many elements the queue holds, across all lanes. Read without
+ *         locking, so it may be a little behind.
+ */
+size_t Queue_Depth(Queue* self);
+
+/**
+ * Pushes onto the lowest priority lane.
+ * Push and Pop block until there's room or an element, or the queue is shut down.
+ */
 bool Queue_Push(Queue* self, void* element, size_t elementSize);
+bool Queue_PushPriority(Queue* self, void* element, size_t elementSize, size_t priority);
 bool Queue_Pop(Queue* self, void* outElement, size_t elementSize);
 Queue_TryPopResult Queue_TryPop(Queue* self, void* outElement, size_t elementSize);
 
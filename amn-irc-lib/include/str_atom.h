@@ -0,0 +1,68 @@
+#ifndef AMN_STR_ATOM_H
+#define AMN_STR_ATOM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+  * Interned, immutable and reference counted string.
+  * A table holds at most one atom for each string, so two atoms are equal
+  * only if they're the same pointer.
+  * Each atom also references the atom of its casefolded form, following
+  * https://datatracker.ietf.org/doc/html/rfc1459#section-2.2, for
+  * case-insensitive comparison of nicknames and channel names.
+  */
+typedef struct StrAtom StrAtom;
+
+/**
+  * Thread-safe table of atoms. Atoms are removed from it when their last
+  * reference goes away, and it must outlive every atom.
+  */
+typedef struct StrAtomTable StrAtomTable;
+
+StrAtomTable* StrAtomTable_New(size_t initialBucketCount);
+void StrAtomTable_Delete(StrAtomTable* self);
+
+/**
+ * Returns the atom for str, creating it if it doesn't exist yet.
+ * The caller owns a reference to the returned atom, null on allocation failure.
+ */
+StrAtom* StrAtomTable_Intern(StrAtomTable* self, const char* str);
+
+/**
+ * Same as Intern for the string between start and end, end excluded.
+ */
+StrAtom* StrAtomTable_InternRange(StrAtomTable* self, const char* start, const char* end);
+
+/**
+ * Returns the atom of the casefolded form of str if any atom has that form,
+ * or null. No reference is taken, so it must only be compared against.
+ */
+const StrAtom* StrAtomTable_FindFolded(StrAtomTable* self, const char* str);
+
+/**
+ * Takes another reference to an atom.
+ */
+StrAtom* StrAtom_Ref(StrAtom* self);
+
+/**
+ * Releases a reference. Null is ignored.
+ */
+void StrAtom_Unref(StrAtom* self);
+
+const char* StrAtom_Str(const StrAtom* self);
+size_t StrAtom_Len(const StrAtom* self);
+uint32_t StrAtom_Hash(const StrAtom* self);
+
+/**
+ * The atom of the casefolded form, which may be self.
+ */
+const StrAtom* StrAtom_Folded(const StrAtom* self);
+
+/**
+ * Case-insensitive equality, by RFC 1459 rules.
+ */
+bool StrAtom_EqualsFolded(const StrAtom* self, const StrAtom* other);
+
+#endif // AMN_STR_ATOM_H
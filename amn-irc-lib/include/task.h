@@ -1,6 +1,8 @@
 #ifndef AMN_TASK_H
 #define AMN_TASK_H
 
+#include <stdint.h>
+
 typedef struct Task Task;
 
 typedef enum TaskStatus
@@ -29,5 +31,11 @@ TaskStatus Task_Run(Task* self);
 
 void Task_Delete(Task* self);
 
+/**
+ * When the task was last pushed to a TaskQueue if sampled, see Metrics_SampleNs.
+ */
+uint64_t Task_QueuedNs(const Task* self);
+void Task_SetQueuedNs(Task* self, uint64_t ns);
+
 #endif
 
@@ -7,12 +7,42 @@
 #include <stddef.h>
 #include <stdint.h>
 
+typedef enum TaskPriority
+{
+	// Tasks that keep connections alive or tear them down, e.g. PONG replies.
+	TaskPriority_High,
+	TaskPriority_Normal,
+
+	// Not an actual priority, but the length of the enum
+	TaskPriority_Len,
+}
+TaskPriority;
+
 typedef struct TaskQueue TaskQueue;
 
-TaskQueue* TaskQueue_New(size_t capacity, int32_t shutdownTimeout);
+TaskQueue* TaskQueue_New(size_t capacity);
 void TaskQueue_Delete(TaskQueue* self);
 
+/**
+ * Wakes every thread blocked on the queue, see Queue_Shutdown.
+ */
+void TaskQueue_Shutdown(TaskQueue* self);
+
+/**
+ * @return The most tasks the queue held at once.
+ */
+size_t TaskQueue_HighWater(TaskQueue* self);
+
+/**
+ * @return How many tasks are queued, see Queue_Depth.
+ */
+size_t TaskQueue_Depth(TaskQueue* self);
+
+/**
+ * Pushes a task with TaskPriority_Normal.
+ */
 bool TaskQueue_Push(TaskQueue* self, Task* task);
+bool TaskQueue_PushPriority(TaskQueue* self, Task* task, TaskPriority priority);
 Task* TaskQueue_Pop(TaskQueue* self);
 
 
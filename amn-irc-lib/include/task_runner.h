@@ -4,10 +4,32 @@
 #include "log.h"
 #include "task_queue.h"
 
+#include <stdbool.h>
+#include <stdint.h>
+
 typedef struct TaskRunner TaskRunner;
 
-TaskRunner* TaskRunner_New(Logger* log, TaskQueue* tasks);
+/**
+ * Starts a thread running tasks from the queue.
+ * @param name	Thread name shown in ps, top and profilers, at most 15 characters.
+ * @param cpu	CPU to pin the thread to, or -1 to let it run anywhere.
+ */
+TaskRunner* TaskRunner_New(Logger* log, TaskQueue* tasks, const char* name, int cpu);
+
+/**
+ * Waits for the thread to exit, which it does once shutdown starts.
+ * Runners can be joined before any is deleted, so tasks still running on
+ * the others may use them, e.g. with TaskRunner_Times.
+ */
+void TaskRunner_Join(TaskRunner* self);
 void TaskRunner_Delete(TaskRunner* self);
 
+/**
+ * Time the runner spent since it started, thread-safe.
+ * @param busyNs	CPU time of its thread.
+ * @param idleNs	The rest, waiting for tasks or blocked in them, e.g. on I/O.
+ */
+bool TaskRunner_Times(TaskRunner* self, uint64_t* busyNs, uint64_t* idleNs);
+
 #endif // AMN_TASK_RUNNER_H
 
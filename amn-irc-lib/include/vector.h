@@ -0,0 +1,146 @@
+#ifndef AMN_VECTOR_H
+#define AMN_VECTOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+  * Type-specialized growable array.
+  * VECTOR_DEFINE(Name, Type, equals) declares the struct Name and its
+  * static inline functions, prefixed Name_. Elements are stored by value
+  * and compared with equals(a, b), which can be a macro so comparisons are
+  * inlined. Zero initialization gives an empty vector.
+  *
+  * Growth is geometric. Pointers to elements are invalidated by anything
+  * changing the size or capacity. Elements are not deleted by the vector,
+  * the owner must do it before removing or freeing them.
+  *
+  * Not thread-safe.
+  */
+
+// equals for scalar and pointer elements.
+#define VECTOR_EQUALS_SCALAR(a, b) ((a) == (b))
+
+#define VECTOR_MIN_CAPACITY 8
+
+#define VECTOR_DEFINE(Name, Type, equals)                                      \
+                                                                               \
+typedef struct Name                                                            \
+{                                                                              \
+	Type* items;                                                               \
+	size_t size;                                                               \
+	size_t capacity;                                                           \
+}                                                                              \
+Name;                                                                          \
+                                                                               \
+/* Frees the storage, elements must have been deleted already. */              \
+static inline void Name##_Free(Name* self)                                     \
+{                                                                              \
+	free(self->items);                                                         \
+	*self = (Name) { 0 };                                                      \
+}                                                                              \
+                                                                               \
+/* Makes room for at least capacity elements, false on allocation failure. */  \
+static inline bool Name##_Reserve(Name* self, size_t capacity)                 \
+{                                                                              \
+	if (capacity <= self->capacity)                                            \
+	{                                                                          \
+		return true;                                                           \
+	}                                                                          \
+                                                                               \
+	if (capacity > SIZE_MAX / sizeof(Type))                                    \
+	{                                                                          \
+		return false;                                                          \
+	}                                                                          \
+                                                                               \
+	Type* items = realloc(self->items, capacity * sizeof(Type));               \
+	if (items == NULL)                                                         \
+	{                                                                          \
+		return false;                                                          \
+	}                                                                          \
+                                                                               \
+	self->items = items;                                                       \
+	self->capacity = capacity;                                                 \
+	return true;                                                               \
+}                                                                              \
+                                                                               \
+/* Releases unused capacity, keeping the current one if that fails. */         \
+static inline void Name##_Shrink(Name* self)                                   \
+{                                                                              \
+	if (self->size == 0)                                                       \
+	{                                                                          \
+		Name##_Free(self);                                                     \
+		return;                                                                \
+	}                                                                          \
+                                                                               \
+	Type* items = realloc(self->items, self->size * sizeof(Type));             \
+	if (items != NULL)                                                         \
+	{                                                                          \
+		self->items = items;                                                   \
+		self->capacity = self->size;                                           \
+	}                                                                          \
+}                                                                              \
+                                                                               \
+/* Appends a copy of item, false on allocation failure. */                     \
+static inline bool Name##_Push(Name* self, Type item)                          \
+{                                                                              \
+	if (self->size == self->capacity)                                          \
+	{                                                                          \
+		size_t capacity = self->capacity * 2;                                  \
+		if (!Name##_Reserve(self,                                              \
+				capacity > VECTOR_MIN_CAPACITY ? capacity : VECTOR_MIN_CAPACITY))  \
+		{                                                                      \
+			return false;                                                      \
+		}                                                                      \
+	}                                                                          \
+                                                                               \
+	self->items[self->size++] = item;                                          \
+	return true;                                                               \
+}                                                                              \
+                                                                               \
+/* Index of the first element equal to item, or SIZE_MAX. */                  \
+static inline size_t Name##_IndexOf(const Name* self, Type item)               \
+{                                                                              \
+	for (size_t i = 0; i < self->size; i++)                                    \
+	{                                                                          \
+		if (equals(self->items[i], item))                                      \
+		{                                                                      \
+			return i;                                                          \
+		}                                                                      \
+	}                                                                          \
+                                                                               \
+	return SIZE_MAX;                                                           \
+}                                                                              \
+                                                                               \
+static inline bool Name##_Contains(const Name* self, Type item)                \
+{                                                                              \
+	return Name##_IndexOf(self, item) != SIZE_MAX;                             \
+}                                                                              \
+                                                                               \
+/* O(1) removal, moving the last element into index. Order isn't kept. */      \
+static inline void Name##_SwapRemove(Name* self, size_t index)                 \
+{                                                                              \
+	self->items[index] = self->items[--self->size];                            \
+}                                                                              \
+                                                                               \
+/* SwapRemove of the first element equal to item, false if there's none. */    \
+static inline bool Name##_SwapRemoveItem(Name* self, Type item)                \
+{                                                                              \
+	size_t index = Name##_IndexOf(self, item);                                 \
+	if (index == SIZE_MAX)                                                     \
+	{                                                                          \
+		return false;                                                          \
+	}                                                                          \
+                                                                               \
+	Name##_SwapRemove(self, index);                                            \
+	return true;                                                               \
+}                                                                              \
+                                                                               \
+static inline void Name##_Clear(Name* self)                                    \
+{                                                                              \
+	self->size = 0;                                                            \
+}
+
+#endif // AMN_VECTOR_H
@@ -1,16 +1,154 @@
 #include "application.h"
 
+#include <errno.h>
+#include <poll.h>
 #include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <time.h>
 
-static volatile sig_atomic_t ShouldShutdown = 0;
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+// Set by signal handlers and read by every thread, lock-free so both may.
+static atomic_bool ShouldShutdown = false;
+static int ShutdownFd = -1;
+static int ReloadFd = -1;
+
+static void SignalFd(int fd);
+
+bool Application_Init()
+{
+	if (ShutdownFd != -1)
+	{
+		return true;
+	}
+
+	ShutdownFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (ShutdownFd == -1)
+	{
+		return false;
+	}
+
+	ReloadFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (ReloadFd == -1)
+	{
+		Application_Cleanup();
+		return false;
+	}
+
+	return true;
+}
 
 void Application_StartShutdown()
 {
-	ShouldShutdown = 1;
+	atomic_store(&ShouldShutdown, true);
+	SignalFd(ShutdownFd);
 }
 
 bool Application_ShouldShutdown()
 {
-	return ShouldShutdown == 1;
+	return atomic_load(&ShouldShutdown);
+}
+
+int Application_ShutdownFd()
+{
+	return ShutdownFd;
+}
+
+bool Application_WaitReadable(int fd, int timeoutMs)
+{
+	struct pollfd polls[2] = {
+		{ .fd = fd, .events = POLLIN },
+		{ .fd = ShutdownFd, .events = POLLIN },
+	};
+
+	int ready = poll(polls, 2, timeoutMs);
+	if (ready == -1)
+	{
+		return false;
+	}
+
+	if (polls[1].revents != 0 || Application_ShouldShutdown())
+	{
+		errno = EINTR;
+		return false;
+	}
+
+	if (ready == 0)
+	{
+		errno = EAGAIN;
+		return false;
+	}
+
+	// Errors and hang ups are reported by the read or accept that follows.
+	return true;
+}
+
+void Application_RequestReload()
+{
+	SignalFd(ReloadFd);
+}
+
+bool Application_WaitForReload()
+{
+	struct pollfd polls[2] = {
+		{ .fd = ShutdownFd, .events = POLLIN },
+		{ .fd = ReloadFd, .events = POLLIN },
+	};
+
+	while (!Application_ShouldShutdown())
+	{
+		if (poll(polls, 2, -1) == -1)
+		{
+			if (errno != EINTR)
+			{
+				return false;
+			}
+
+			continue;
+		}
+
+		// Reading resets the eventfd, so requests made while reloading aren't lost.
+		uint64_t count;
+		if (polls[1].revents != 0 && read(ReloadFd, &count, sizeof(count)) == sizeof(count))
+		{
+			return !Application_ShouldShutdown();
+		}
+	}
+
+	return false;
+}
+
+void Application_Cleanup()
+{
+	if (ShutdownFd != -1)
+	{
+		close(ShutdownFd);
+		ShutdownFd = -1;
+	}
+
+	if (ReloadFd != -1)
+	{
+		close(ReloadFd);
+		ReloadFd = -1;
+	}
+}
+
+/**
+ * Makes an eventfd readable. Async-signal-safe.
+ */
+static void SignalFd(int fd)
+{
+	if (fd == -1)
+	{
+		return;
+	}
+
+	// Called from signal handlers, don't clobber the interrupted code's errno.
+	int savedErrno = errno;
+	uint64_t one = 1;
+	ssize_t written = write(fd, &one, sizeof(one));
+	(void) written;
+	errno = savedErrno;
 }
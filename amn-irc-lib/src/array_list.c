@@ -16,8 +16,10 @@ struct ArrayList
 
 static bool ArrayList_Expand(ArrayList* self)
 {
-	size_t newSize = self->allocatedSize + self->expandSize;
-	uint8_t* elements = realloc(self->elements, newSize * sizeof(uint8_t*));
+	// Grows at least geometrically, so appending stays amortized O(1).
+	size_t newSize = self->allocatedSize
+		+ (self->allocatedSize > self->expandSize ? self->allocatedSize : self->expandSize);
+	uint8_t* elements = realloc(self->elements, newSize * self->elementSize);
 	if (!elements)
 	{
 		return false;
@@ -145,7 +147,7 @@ bool ArrayList_RemoveIndex(ArrayList* self, size_t index, bool delete)
 
 	uint8_t* copyTo = self->elements + index * self->elementSize;
 	uint8_t* copyFrom = self->elements + (index + 1) * self->elementSize;
-	size_t copyLen = self->currentSize - index - 1;
+	size_t copyLen = (self->currentSize - index - 1) * self->elementSize;
 
 	memmove(copyTo, copyFrom, copyLen);
 
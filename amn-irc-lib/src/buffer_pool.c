@@ -0,0 +1,147 @@
+#include "buffer_pool.h"
+
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <pthread.h>
+
+// Free buffers store the link to the next free buffer in their first bytes.
+typedef struct FreeBuffer
+{
+	struct FreeBuffer* next;
+}
+FreeBuffer;
+
+typedef struct Slab
+{
+	struct Slab* next;
+	alignas(max_align_t) uint8_t buffers[];
+}
+Slab;
+
+struct BufferPool
+{
+	size_t bufferSize;
+	size_t buffersPerSlab;
+
+	Slab* slabs;
+	FreeBuffer* free;
+
+	pthread_mutex_t mutex;
+};
+
+static bool BufferPool_Grow(BufferPool* self);
+
+BufferPool* BufferPool_New(size_t bufferSize, size_t buffersPerSlab)
+{
+	if (bufferSize == 0 || buffersPerSlab == 0)
+	{
+		return NULL;
+	}
+
+	BufferPool* self = malloc(sizeof(BufferPool));
+	if (self == NULL)
+	{
+		return NULL;
+	}
+
+	// Keep every buffer in a slab aligned, and big enough for the free list link.
+	size_t alignment = alignof(max_align_t);
+	bufferSize = bufferSize < sizeof(FreeBuffer) ? sizeof(FreeBuffer) : bufferSize;
+
+	*self = (BufferPool) {
+		.bufferSize = (bufferSize + alignment - 1) / alignment * alignment,
+		.buffersPerSlab = buffersPerSlab,
+	};
+
+	if (pthread_mutex_init(&self->mutex, NULL) != 0)
+	{
+		free(self);
+		return NULL;
+	}
+
+	return self;
+}
+
+void BufferPool_Delete(BufferPool* self)
+{
+	if (self == NULL)
+	{
+		return;
+	}
+
+	while (self->slabs != NULL)
+	{
+		Slab* next = self->slabs->next;
+		free(self->slabs);
+		self->slabs = next;
+	}
+
+	pthread_mutex_destroy(&self->mutex);
+	free(self);
+}
+
+size_t BufferPool_BufferSize(const BufferPool* self)
+{
+	return self->bufferSize;
+}
+
+uint8_t* BufferPool_Borrow(BufferPool* self)
+{
+	if (pthread_mutex_lock(&self->mutex) != 0)
+	{
+		return NULL;
+	}
+
+	uint8_t* buffer = NULL;
+
+	if (self->free != NULL || BufferPool_Grow(self))
+	{
+		buffer = (uint8_t*) self->free;
+		self->free = self->free->next;
+	}
+
+	pthread_mutex_unlock(&self->mutex);
+
+	return buffer;
+}
+
+void BufferPool_Return(BufferPool* self, uint8_t* buffer)
+{
+	if (buffer == NULL || pthread_mutex_lock(&self->mutex) != 0)
+	{
+		return;
+	}
+
+	FreeBuffer* freeBuffer = (FreeBuffer*) buffer;
+	freeBuffer->next = self->free;
+	self->free = freeBuffer;
+
+	pthread_mutex_unlock(&self->mutex);
+}
+
+/**
+ * Allocates a slab and adds its buffers to the free list.
+ * Must be called with the mutex held.
+ */
+static bool BufferPool_Grow(BufferPool* self)
+{
+	Slab* slab = malloc(sizeof(Slab) + self->bufferSize * self->buffersPerSlab);
+	if (slab == NULL)
+	{
+		return false;
+	}
+
+	slab->next = self->slabs;
+	self->slabs = slab;
+
+	for (size_t i = self->buffersPerSlab; i > 0; i--)
+	{
+		FreeBuffer* buffer = (FreeBuffer*) (slab->buffers + (i - 1) * self->bufferSize);
+		buffer->next = self->free;
+		self->free = buffer;
+	}
+
+	return true;
+}
@@ -0,0 +1,418 @@
+// For pthread_getname_np.
+#define _GNU_SOURCE
+
+#include "flight_recorder.h"
+
+#include "metrics.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#define MAX_PATH 4096
+#define THREAD_NAME_SIZE 16
+#define DUMP_BUFFER_SIZE 4096
+// How long a dump waits for one in progress, in DUMP_WAIT_NS sleeps.
+#define DUMP_WAIT_TRIES 1000
+#define DUMP_WAIT_NS 1000000
+
+// Fields are atomic only so a dump from another thread reads whole values,
+// the owning thread writes them with plain stores.
+typedef struct FlightEvent
+{
+	_Atomic uint64_t timeNs;
+	_Atomic uint64_t ns;
+	_Atomic int32_t socket;
+	_Atomic uint32_t depth;
+	_Atomic uint8_t type;
+	_Atomic uint8_t cmd;
+}
+FlightEvent;
+
+typedef struct FlightRing
+{
+	FlightEvent events[FLIGHT_RECORDER_EVENTS];
+	// Events ever recorded, the next goes at count % FLIGHT_RECORDER_EVENTS.
+	_Atomic uint64_t count;
+	char threadName[THREAD_NAME_SIZE];
+
+	// Rings are only ever prepended, so dumps can walk them without locking.
+	struct FlightRing* next;
+}
+FlightRing;
+
+// What a dump shows of each event type.
+typedef struct FlightEventInfo
+{
+	const char* name;
+	bool hasCmd;
+	bool hasDepth;
+	bool hasNs;
+}
+FlightEventInfo;
+
+// Buffers a dump, so it's written in a few write calls.
+typedef struct DumpWriter
+{
+	int fd;
+	char buffer[DUMP_BUFFER_SIZE];
+	size_t len;
+	bool failed;
+}
+DumpWriter;
+
+static const FlightEventInfo EVENT_INFOS[FlightEventType_Len] = {
+	[FlightEventType_CmdQueued] = { "cmd_queued", true, true, false },
+	[FlightEventType_CmdExecuted] = { "cmd_executed", true, false, true },
+	[FlightEventType_CmdFailed] = { "cmd_failed", true, false, true },
+	[FlightEventType_TaskStarted] = { "task_started", false, true, false },
+	[FlightEventType_TaskDone] = { "task_done", false, false, false },
+	[FlightEventType_TaskFailed] = { "task_failed", false, false, false },
+};
+
+static _Atomic(FlightRing*) rings = NULL;
+static pthread_mutex_t ringsMutex = PTHREAD_MUTEX_INITIALIZER;
+static _Thread_local FlightRing* currentRing = NULL;
+
+// Empty to not dump.
+static char dumpPath[MAX_PATH] = "";
+static atomic_flag dumping = ATOMIC_FLAG_INIT;
+// Set while the thread holds dumping, so a signal handler interrupting its
+// dump doesn't wait for itself.
+static _Thread_local volatile sig_atomic_t dumpingThread = 0;
+// Monotonic time of the last dump, zero if there was none.
+static _Atomic uint64_t lastDumpNs = 0;
+
+static bool Dump(const char* reason, bool wait);
+static bool LockDump(bool wait);
+static FlightRing* CurrentRing(void);
+static void DumpRing(DumpWriter* writer, FlightRing* ring);
+static void DumpWriter_Str(DumpWriter* self, const char* str);
+static void DumpWriter_Uint(DumpWriter* self, uint64_t value);
+static void DumpWriter_Int(DumpWriter* self, int64_t value);
+static void DumpWriter_Seconds(DumpWriter* self, uint64_t ns);
+static void DumpWriter_Flush(DumpWriter* self);
+
+void FlightRecorder_Record(FlightEventType type, IrcCmdType cmd, int socket, size_t depth,
+		uint64_t ns)
+{
+	FlightRing* ring = CurrentRing();
+	if (ring == NULL)
+	{
+		return;
+	}
+
+	uint64_t count = atomic_load_explicit(&ring->count, memory_order_relaxed);
+	FlightEvent* event = &ring->events[count % FLIGHT_RECORDER_EVENTS];
+
+	atomic_store_explicit(&event->timeNs, Metrics_NowNs(), memory_order_relaxed);
+	atomic_store_explicit(&event->ns, ns, memory_order_relaxed);
+	atomic_store_explicit(&event->socket, socket, memory_order_relaxed);
+	atomic_store_explicit(&event->depth, depth > UINT32_MAX ? UINT32_MAX : (uint32_t) depth,
+			memory_order_relaxed);
+	atomic_store_explicit(&event->type, (uint8_t) type, memory_order_relaxed);
+	atomic_store_explicit(&event->cmd, (uint8_t) cmd, memory_order_relaxed);
+
+	atomic_store_explicit(&ring->count, count + 1, memory_order_release);
+}
+
+bool FlightRecorder_SetPath(const char* path)
+{
+	if (path == NULL)
+	{
+		dumpPath[0] = '\0';
+		return true;
+	}
+
+	if (strlen(path) >= MAX_PATH)
+	{
+		return false;
+	}
+
+	strcpy(dumpPath, path);
+	return true;
+}
+
+bool FlightRecorder_Dump(const char* reason)
+{
+	return Dump(reason, true);
+}
+
+bool FlightRecorder_DumpThrottled(const char* reason)
+{
+	uint64_t last = atomic_load(&lastDumpNs);
+	if (last != 0
+			&& Metrics_NowNs() - last < (uint64_t) FLIGHT_RECORDER_DUMP_INTERVAL_S * 1000000000)
+	{
+		return false;
+	}
+
+	// A dump in progress has the same events.
+	return Dump(reason, false);
+}
+
+/**
+ * @param wait	Wait for a dump in progress, otherwise give up.
+ */
+static bool Dump(const char* reason, bool wait)
+{
+	// May be called from signal handlers, don't clobber the interrupted code's errno.
+	int savedErrno = errno;
+
+	if (dumpPath[0] == '\0' || !LockDump(wait))
+	{
+		errno = savedErrno;
+		return false;
+	}
+
+	uint64_t nowNs = Metrics_NowNs();
+	atomic_store(&lastDumpNs, nowNs);
+
+	// The monotonic times of the events are only meaningful next to a wall clock time.
+	struct timespec wallTime;
+	clock_gettime(CLOCK_REALTIME, &wallTime);
+
+	// Static, as signal handlers may run on a small stack. Protected by dumping.
+	static DumpWriter writer;
+	writer.fd = open(dumpPath, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	writer.len = 0;
+	writer.failed = writer.fd == -1;
+
+	if (!writer.failed)
+	{
+		DumpWriter_Str(&writer, "Flight recorder dump, ");
+		DumpWriter_Str(&writer, reason);
+		DumpWriter_Str(&writer, ", at ");
+		DumpWriter_Uint(&writer, (uint64_t) wallTime.tv_sec);
+		DumpWriter_Str(&writer, " (monotonic ");
+		DumpWriter_Seconds(&writer, nowNs);
+		DumpWriter_Str(&writer, ")\n");
+
+		for (FlightRing* ring = atomic_load_explicit(&rings, memory_order_acquire);
+				ring != NULL; ring = ring->next)
+		{
+			DumpRing(&writer, ring);
+		}
+
+		DumpWriter_Str(&writer, "\n");
+		DumpWriter_Flush(&writer);
+		close(writer.fd);
+	}
+
+	bool success = !writer.failed;
+
+	dumpingThread = 0;
+	atomic_flag_clear(&dumping);
+	errno = savedErrno;
+
+	return success;
+}
+
+/**
+ * Takes dumping, waiting up to DUMP_WAIT_TRIES sleeps for the dump holding it
+ * if wait. Never waits for a dump of the calling thread, which a signal
+ * handler interrupted and so can't finish.
+ * @return False if it didn't get it.
+ */
+static bool LockDump(bool wait)
+{
+	for (int tries = 0; atomic_flag_test_and_set(&dumping); tries++)
+	{
+		if (!wait || dumpingThread || tries == DUMP_WAIT_TRIES)
+		{
+			return false;
+		}
+
+		// nanosleep is async-signal-safe.
+		struct timespec delay = { .tv_sec = 0, .tv_nsec = DUMP_WAIT_NS };
+		nanosleep(&delay, NULL);
+	}
+
+	dumpingThread = 1;
+	return true;
+}
+
+/**
+ * The ring of the calling thread, creating it on first use. Null on failure.
+ */
+static FlightRing* CurrentRing(void)
+{
+	if (currentRing != NULL)
+	{
+		return currentRing;
+	}
+
+	FlightRing* ring = calloc(1, sizeof(FlightRing));
+	if (ring == NULL)
+	{
+		return NULL;
+	}
+
+	// Runners are named by their creator, after they started, but well
+	// before they record anything.
+	if (pthread_getname_np(pthread_self(), ring->threadName, THREAD_NAME_SIZE) != 0)
+	{
+		strcpy(ring->threadName, "?");
+	}
+
+	if (pthread_mutex_lock(&ringsMutex) != 0)
+	{
+		free(ring);
+		return NULL;
+	}
+
+	ring->next = atomic_load(&rings);
+	atomic_store_explicit(&rings, ring, memory_order_release);
+
+	pthread_mutex_unlock(&ringsMutex);
+
+	currentRing = ring;
+	return ring;
+}
+
+static void DumpRing(DumpWriter* writer, FlightRing* ring)
+{
+	uint64_t count = atomic_load_explicit(&ring->count, memory_order_acquire);
+	uint64_t first = count > FLIGHT_RECORDER_EVENTS ? count - FLIGHT_RECORDER_EVENTS : 0;
+
+	DumpWriter_Str(writer, ring->threadName);
+	DumpWriter_Str(writer, ": last ");
+	DumpWriter_Uint(writer, count - first);
+	DumpWriter_Str(writer, " of ");
+	DumpWriter_Uint(writer, count);
+	DumpWriter_Str(writer, " events\n");
+
+	for (uint64_t i = first; i < count; i++)
+	{
+		FlightEvent* event = &ring->events[i % FLIGHT_RECORDER_EVENTS];
+		uint8_t type = atomic_load_explicit(&event->type, memory_order_relaxed);
+		if (type >= FlightEventType_Len)
+		{
+			continue;
+		}
+
+		const FlightEventInfo* info = &EVENT_INFOS[type];
+
+		DumpWriter_Str(writer, "  ");
+		DumpWriter_Seconds(writer, atomic_load_explicit(&event->timeNs, memory_order_relaxed));
+		DumpWriter_Str(writer, " ");
+		DumpWriter_Str(writer, info->name);
+
+		if (info->hasCmd)
+		{
+			uint8_t cmd = atomic_load_explicit(&event->cmd, memory_order_relaxed);
+			const char* name = cmd < IrcCmdType_Len ? IRC_CMD_TYPE_INFOS[cmd].name : NULL;
+
+			DumpWriter_Str(writer, " socket=");
+			DumpWriter_Int(writer, atomic_load_explicit(&event->socket, memory_order_relaxed));
+			DumpWriter_Str(writer, " cmd=");
+			DumpWriter_Str(writer, name != NULL ? name : "?");
+		}
+
+		if (info->hasDepth)
+		{
+			DumpWriter_Str(writer, " depth=");
+			DumpWriter_Uint(writer, atomic_load_explicit(&event->depth, memory_order_relaxed));
+		}
+
+		if (info->hasNs)
+		{
+			DumpWriter_Str(writer, " ns=");
+			DumpWriter_Uint(writer, atomic_load_explicit(&event->ns, memory_order_relaxed));
+		}
+
+		DumpWriter_Str(writer, "\n");
+	}
+}
+
+// The writers format by hand, printf isn't async-signal-safe.
+
+static void DumpWriter_Str(DumpWriter* self, const char* str)
+{
+	for (; *str != '\0'; str++)
+	{
+		if (self->len == DUMP_BUFFER_SIZE)
+		{
+			DumpWriter_Flush(self);
+		}
+
+		self->buffer[self->len++] = *str;
+	}
+}
+
+static void DumpWriter_Uint(DumpWriter* self, uint64_t value)
+{
+	// Digits of UINT64_MAX and a terminator.
+	char digits[21];
+	size_t i = sizeof(digits) - 1;
+	digits[i] = '\0';
+
+	do
+	{
+		digits[--i] = (char) ('0' + value % 10);
+		value /= 10;
+	}
+	while (value != 0);
+
+	DumpWriter_Str(self, &digits[i]);
+}
+
+static void DumpWriter_Int(DumpWriter* self, int64_t value)
+{
+	if (value < 0)
+	{
+		DumpWriter_Str(self, "-");
+		DumpWriter_Uint(self, (uint64_t) -(value + 1) + 1);
+		return;
+	}
+
+	DumpWriter_Uint(self, (uint64_t) value);
+}
+
+/**
+ * Writes ns as seconds with nine decimals.
+ */
+static void DumpWriter_Seconds(DumpWriter* self, uint64_t ns)
+{
+	DumpWriter_Uint(self, ns / 1000000000);
+	DumpWriter_Str(self, ".");
+
+	char decimals[10];
+	uint64_t fraction = ns % 1000000000;
+	for (size_t i = 9; i > 0; i--)
+	{
+		decimals[i - 1] = (char) ('0' + fraction % 10);
+		fraction /= 10;
+	}
+	decimals[9] = '\0';
+
+	DumpWriter_Str(self, decimals);
+}
+
+static void DumpWriter_Flush(DumpWriter* self)
+{
+	size_t written = 0;
+	while (written < self->len && !self->failed)
+	{
+		ssize_t result = write(self->fd, self->buffer + written, self->len - written);
+		if (result == -1 && errno == EINTR)
+		{
+			continue;
+		}
+
+		self->failed = result <= 0;
+		if (!self->failed)
+		{
+			written += (size_t) result;
+		}
+	}
+
+	self->len = 0;
+}
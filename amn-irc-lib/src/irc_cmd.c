@@ -1,5 +1,6 @@
 #include "irc_cmd.h"
 
+#include "obj_pool.h"
 #include "str_utils.h"
 
 #include <stdlib.h>
@@ -9,16 +10,23 @@ static bool IrcCmd_CloneUser(const IrcCmd* self, IrcCmd* clone);
 static bool IrcCmd_CloneJoin(const IrcCmd* self, IrcCmd* clone);
 static bool IrcCmd_CloneQuit(const IrcCmd* self, IrcCmd* clone);
 static bool IrcCmd_ClonePrivMsg(const IrcCmd* self, IrcCmd* clone);
+static bool IrcCmd_ClonePing(const IrcCmd* self, IrcCmd* clone);
+static bool IrcCmd_ClonePong(const IrcCmd* self, IrcCmd* clone);
+static bool IrcCmd_CloneStats(const IrcCmd* self, IrcCmd* clone);
+static bool IrcCmd_CloneOper(const IrcCmd* self, IrcCmd* clone);
+
+static const char* IrcCmd_Rebase(const IrcCmd* self, const IrcCmd* clone, const char* view);
 
 static void IrcCmd_DeleteNick(IrcCmd* self);
 static void IrcCmd_DeleteUser(IrcCmd* self);
 static void IrcCmd_DeleteJoin(IrcCmd* self);
 static void IrcCmd_DeleteQuit(IrcCmd* self);
-static void IrcCmd_DeletePrivMsg(IrcCmd* self);
+static void IrcCmd_DeletePing(IrcCmd* self);
+static void IrcCmd_DeletePong(IrcCmd* self);
 
 IrcCmd* IrcCmd_Clone(const IrcCmd* self)
 {
-	IrcCmd* clone = malloc(sizeof(IrcCmd));
+	IrcCmd* clone = ObjPool_Alloc(sizeof(IrcCmd));
 	if (clone == NULL)
 	{
 		return NULL;
@@ -26,6 +34,7 @@ IrcCmd* IrcCmd_Clone(const IrcCmd* self)
 
 	*clone = (IrcCmd) {
 		.type = self->type,
+		.priority = self->priority,
 		.peerSocket = self->peerSocket,
 	};
 
@@ -35,6 +44,16 @@ IrcCmd* IrcCmd_Clone(const IrcCmd* self)
 		return NULL;
 	}
 
+	if (self->msg != NULL)
+	{
+		clone->msg = IrcMsg_Clone(self->msg);
+		if (clone->msg == NULL)
+		{
+			IrcCmd_Delete(clone);
+			return NULL;
+		}
+	}
+
 	bool success = true;
 	switch (clone->type)
 	{
@@ -53,8 +72,21 @@ IrcCmd* IrcCmd_Clone(const IrcCmd* self)
 		case IrcCmdType_PrivMsg:
 			success = IrcCmd_ClonePrivMsg(self, clone);
 			break;
+		case IrcCmdType_Ping:
+			success = IrcCmd_ClonePing(self, clone);
+			break;
+		case IrcCmdType_Pong:
+			success = IrcCmd_ClonePong(self, clone);
+			break;
+		case IrcCmdType_Stats:
+			success = IrcCmd_CloneStats(self, clone);
+			break;
+		case IrcCmdType_Operator:
+			success = IrcCmd_CloneOper(self, clone);
+			break;
 		default:
-			return NULL;
+			success = false;
+			break;
 	}
 
 	if (!success)
@@ -110,29 +142,35 @@ static bool IrcCmd_CloneUser(const IrcCmd* self, IrcCmd* clone)
 
 static bool IrcCmd_CloneJoin(const IrcCmd* self, IrcCmd* clone)
 {
-	clone->join.channels = malloc(sizeof(IrcReceiver) * self->join.channelCount);
-	if (clone->join.channels == NULL)
+	if (self->msg == NULL)
 	{
 		return false;
 	}
 
-	for (size_t i = 0; i < self->join.channelCount; i++)
+	if (self->join.channelCount <= IRC_CMD_JOIN_INLINE_CHANNELS)
 	{
-		clone->join.channels[i].name = StrUtils_Clone(self->join.channels[i].name);
-		if (clone->join.channels[i].name == NULL)
-		{
-			return false;
-		}
-
-		clone->join.channels[i].key = StrUtils_Clone(self->join.channels[i].key);
-		if (clone->join.channels[i].key == NULL)
+		clone->join.channels = clone->join.inlineChannels;
+	}
+	else
+	{
+		clone->join.channels = malloc(sizeof(IrcChannelAndKey) * self->join.channelCount);
+		if (clone->join.channels == NULL)
 		{
 			return false;
 		}
+	}
 
-		clone->join.channelCount++;
+	for (size_t i = 0; i < self->join.channelCount; i++)
+	{
+		clone->join.channels[i] = (IrcChannelAndKey) {
+			.name = IrcCmd_Rebase(self, clone, self->join.channels[i].name),
+			.key = IrcCmd_Rebase(self, clone, self->join.channels[i].key),
+			.type = self->join.channels[i].type,
+		};
 	}
 
+	clone->join.channelCount = self->join.channelCount;
+
 	return true;
 }
 
@@ -149,32 +187,99 @@ static bool IrcCmd_CloneQuit(const IrcCmd* self, IrcCmd* clone)
 
 static bool IrcCmd_ClonePrivMsg(const IrcCmd* self, IrcCmd* clone)
 {
-	clone->privMsg.receiver = malloc(sizeof(IrcReceiver) * self->privMsg.receiverCount);
-	if (clone->privMsg.receiver == NULL)
+	if (self->msg == NULL)
 	{
 		return false;
 	}
 
 	for (size_t i = 0; i < self->privMsg.receiverCount; i++)
 	{
-		clone->privMsg.receiver[i].value = StrUtils_Clone(self->privMsg.receiver[i].value);
-		if (clone->privMsg.receiver[i].value == NULL)
+		clone->privMsg.receiver[i] = (IrcReceiver) {
+			.type = self->privMsg.receiver[i].type,
+			.value = IrcCmd_Rebase(self, clone, self->privMsg.receiver[i].value),
+		};
+	}
+
+	clone->privMsg.receiverCount = self->privMsg.receiverCount;
+	clone->privMsg.text = IrcCmd_Rebase(self, clone, self->privMsg.text);
+
+	return true;
+}
+
+static bool IrcCmd_ClonePing(const IrcCmd* self, IrcCmd* clone)
+{
+	clone->ping.server1 = StrUtils_Clone(self->ping.server1);
+	if (clone->ping.server1 == NULL)
+	{
+		return false;
+	}
+
+	if (self->ping.server2 != NULL)
+	{
+		clone->ping.server2 = StrUtils_Clone(self->ping.server2);
+		if (clone->ping.server2 == NULL)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool IrcCmd_ClonePong(const IrcCmd* self, IrcCmd* clone)
+{
+	clone->pong.daemon1 = StrUtils_Clone(self->pong.daemon1);
+	if (clone->pong.daemon1 == NULL)
+	{
+		return false;
+	}
+
+	if (self->pong.daemon2 != NULL)
+	{
+		clone->pong.daemon2 = StrUtils_Clone(self->pong.daemon2);
+		if (clone->pong.daemon2 == NULL)
 		{
 			return false;
 		}
+	}
 
-		clone->privMsg.receiverCount++;
+	return true;
+}
+
+static bool IrcCmd_CloneStats(const IrcCmd* self, IrcCmd* clone)
+{
+	if (self->msg == NULL)
+	{
+		return false;
 	}
 
-	clone->privMsg.text = StrUtils_Clone(self->privMsg.text);
-	if (clone->privMsg.text == NULL)
+	clone->stats.query = self->stats.query;
+	clone->stats.server = IrcCmd_Rebase(self, clone, self->stats.server);
+
+	return true;
+}
+
+static bool IrcCmd_CloneOper(const IrcCmd* self, IrcCmd* clone)
+{
+	if (self->msg == NULL)
 	{
 		return false;
 	}
 
+	clone->oper.user = IrcCmd_Rebase(self, clone, self->oper.user);
+	clone->oper.password = IrcCmd_Rebase(self, clone, self->oper.password);
+
 	return true;
 }
 
+/**
+ * The view in the message of clone matching a view in the message of self.
+ */
+static const char* IrcCmd_Rebase(const IrcCmd* self, const IrcCmd* clone, const char* view)
+{
+	return view != NULL ? clone->msg->buffer + (view - self->msg->buffer) : NULL;
+}
+
 void IrcCmd_Delete(IrcCmd* self)
 {
 	if (self == NULL)
@@ -196,8 +301,11 @@ void IrcCmd_Delete(IrcCmd* self)
 		case IrcCmdType_Quit:
 			IrcCmd_DeleteQuit(self);
 			break;
-		case IrcCmdType_PrivMsg:
-			IrcCmd_DeletePrivMsg(self);
+		case IrcCmdType_Ping:
+			IrcCmd_DeletePing(self);
+			break;
+		case IrcCmdType_Pong:
+			IrcCmd_DeletePong(self);
 			break;
 		default:
 			break;
@@ -206,7 +314,8 @@ void IrcCmd_Delete(IrcCmd* self)
 	free(self->prefix.origin);
 	free(self->prefix.username);
 	free(self->prefix.hostname);
-	free(self);
+	IrcMsg_Delete(self->msg);
+	ObjPool_Free(self);
 }
 
 static void IrcCmd_DeleteNick(IrcCmd* self)
@@ -224,13 +333,10 @@ static void IrcCmd_DeleteUser(IrcCmd* self)
 
 static void IrcCmd_DeleteJoin(IrcCmd* self)
 {
-	for (size_t i = 0; i < self->join.channelCount; i++)
+	if (self->join.channels != self->join.inlineChannels)
 	{
-		free(self->join.channels[i].name);
-		free(self->join.channels[i].key);
+		free(self->join.channels);
 	}
-
-	free(self->join.channels);
 }
 
 static void IrcCmd_DeleteQuit(IrcCmd* self)
@@ -238,12 +344,14 @@ static void IrcCmd_DeleteQuit(IrcCmd* self)
 	free(self->quit.quitMessage);
 }
 
-static void IrcCmd_DeletePrivMsg(IrcCmd* self)
+static void IrcCmd_DeletePing(IrcCmd* self)
 {
-	for (size_t i = 0; i < self->privMsg.receiverCount; i++)
-	{
-		free(self->privMsg.receiver[i].value);
-	}
-	free(self->privMsg.receiver);
-	free(self->privMsg.text);
+	free(self->ping.server1);
+	free(self->ping.server2);
+}
+
+static void IrcCmd_DeletePong(IrcCmd* self)
+{
+	free(self->pong.daemon1);
+	free(self->pong.daemon2);
 }
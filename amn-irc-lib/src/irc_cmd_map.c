@@ -31,29 +31,28 @@
 
 #line 1 "commands.gperf"
 
-
 #include "irc_cmd_map.h"
 
-struct IrcCmdMapping
+struct IrcCmdTypeMapping
 {
 	const char* name;
 	IrcCmdType cmd;
 };
 
-const struct IrcCmdMapping* in_word_set(const char* cmd, size_t len);
+const struct IrcCmdTypeMapping* in_word_set(const char* cmd, size_t len);
 
 IrcCmdType IrcCmdType_FromStr(const char* cmd, size_t len)
 {
-	const struct IrcCmdMapping* mapping =  in_word_set(cmd, len);
+	const struct IrcCmdTypeMapping* mapping =  in_word_set(cmd, len);
 
 	return mapping != NULL ? mapping->cmd : IrcCmdType_Null;
 }
 
 
-#line 26 "commands.gperf"
-struct IrcCmdMapping;
+#line 28 "commands.gperf"
+struct IrcCmdTypeMapping;
 #include <string.h>
-/* maximum key range = 71, duplicates = 0 */
+/* maximum key range = 49, duplicates = 0 */
 
 #ifdef __GNUC__
 __inline
@@ -67,37 +66,37 @@ hash (register const char *str, register size_t len)
 {
   static const unsigned char asso_values[] =
     {
-      75, 75, 75, 75, 75, 75, 75, 75, 75, 75,
-      75, 75, 75, 75, 75, 75, 75, 75, 75, 75,
-      75, 75, 75, 75, 75, 75, 75, 75, 75, 75,
-      75, 75, 75, 75, 75, 75, 75, 75, 75, 75,
-      75, 75, 75, 75, 75, 75, 75, 75, 75, 75,
-      75, 75, 75, 75, 75, 75, 75, 75, 75, 75,
-      75, 75, 75, 75, 75,  0, 75, 15, 30,  5,
-      55, 75,  5,  5,  6, 25, 35, 30, 10,  0,
-      10, 15,  5,  0, 20, 30,  5,  0, 75, 75,
-      75, 75, 75, 75, 75, 75, 75, 75, 75, 75,
-      75, 75, 75, 75, 75, 75, 75, 75, 75, 75,
-      75, 75, 75, 75, 75, 75, 75, 75, 75, 75,
-      75, 75, 75, 75, 75, 75, 75, 75, 75, 75,
-      75, 75, 75, 75, 75, 75, 75, 75, 75, 75,
-      75, 75, 75, 75, 75, 75, 75, 75, 75, 75,
-      75, 75, 75, 75, 75, 75, 75, 75, 75, 75,
-      75, 75, 75, 75, 75, 75, 75, 75, 75, 75,
-      75, 75, 75, 75, 75, 75, 75, 75, 75, 75,
-      75, 75, 75, 75, 75, 75, 75, 75, 75, 75,
-      75, 75, 75, 75, 75, 75, 75, 75, 75, 75,
-      75, 75, 75, 75, 75, 75, 75, 75, 75, 75,
-      75, 75, 75, 75, 75, 75, 75, 75, 75, 75,
-      75, 75, 75, 75, 75, 75, 75, 75, 75, 75,
-      75, 75, 75, 75, 75, 75, 75, 75, 75, 75,
-      75, 75, 75, 75, 75, 75, 75, 75, 75, 75,
-      75, 75, 75, 75, 75, 75
+      57, 57, 57, 57, 57, 57, 57, 57, 57, 57,
+      57, 57, 57, 57, 57, 57, 57, 57, 57, 57,
+      57, 57, 57, 57, 57, 57, 57, 57, 57, 57,
+      57, 57, 57, 57, 57, 57, 57, 57, 57, 57,
+      57, 57, 57, 57, 57, 57, 57, 57, 57, 57,
+      57, 57, 57, 57, 57, 57, 57, 57, 57, 57,
+      57, 57, 57, 57, 57,  9, 57,  8,  0,  1,
+      17, 57, 13, 19, 14, 10, 10,  5, 16, 14,
+      15, 10,  1,  3, 10,  6,  7,  0, 57, 57,
+      57, 57, 57, 57, 57, 57, 57, 57, 57, 57,
+      57, 57, 57, 57, 57, 57, 57, 57, 57, 57,
+      57, 57, 57, 57, 57, 57, 57, 57, 57, 57,
+      57, 57, 57, 57, 57, 57, 57, 57, 57, 57,
+      57, 57, 57, 57, 57, 57, 57, 57, 57, 57,
+      57, 57, 57, 57, 57, 57, 57, 57, 57, 57,
+      57, 57, 57, 57, 57, 57, 57, 57, 57, 57,
+      57, 57, 57, 57, 57, 57, 57, 57, 57, 57,
+      57, 57, 57, 57, 57, 57, 57, 57, 57, 57,
+      57, 57, 57, 57, 57, 57, 57, 57, 57, 57,
+      57, 57, 57, 57, 57, 57, 57, 57, 57, 57,
+      57, 57, 57, 57, 57, 57, 57, 57, 57, 57,
+      57, 57, 57, 57, 57, 57, 57, 57, 57, 57,
+      57, 57, 57, 57, 57, 57, 57, 57, 57, 57,
+      57, 57, 57, 57, 57, 57, 57, 57, 57, 57,
+      57, 57, 57, 57, 57, 57, 57, 57, 57, 57,
+      57, 57, 57, 57, 57, 57
     };
   return (unsigned int) len + asso_values[(unsigned char)str[2]] + asso_values[(unsigned char)str[1]] + asso_values[(unsigned char)str[0]];
 }
 
-const struct IrcCmdMapping *
+const struct IrcCmdTypeMapping *
 in_word_set (register const char *str, register size_t len)
 {
   enum
@@ -105,106 +104,99 @@ in_word_set (register const char *str, register size_t len)
       TOTAL_KEYWORDS = 40,
       MIN_WORD_LENGTH = 3,
       MAX_WORD_LENGTH = 8,
-      MIN_HASH_VALUE = 4,
-      MAX_HASH_VALUE = 74
+      MIN_HASH_VALUE = 8,
+      MAX_HASH_VALUE = 56
     };
 
-  static const struct IrcCmdMapping wordlist[] =
+  static const struct IrcCmdTypeMapping wordlist[] =
     {
-      {"", IrcCmdType_Null}, {"", IrcCmdType_Null}, {"", IrcCmdType_Null}, {"", IrcCmdType_Null},
-#line 60 "commands.gperf"
-      {"AWAY", IrcCmdType_Away},
-      {"", IrcCmdType_Null}, {"", IrcCmdType_Null}, {"", IrcCmdType_Null},
-#line 53 "commands.gperf"
-      {"WHO", IrcCmdType_Who},
-#line 67 "commands.gperf"
-      {"ISON", IrcCmdType_IsOn},
-#line 54 "commands.gperf"
-      {"WHOIS", IrcCmdType_Whois},
-#line 55 "commands.gperf"
-      {"WHOWAS", IrcCmdType_Whowas},
+      {"", IrcCmdType_Null}, {"", IrcCmdType_Null}, {"", IrcCmdType_Null}, {"", IrcCmdType_Null}, {"", IrcCmdType_Null}, {"", IrcCmdType_Null}, {"", IrcCmdType_Null}, {"", IrcCmdType_Null},
+#line 61 "commands.gperf"
+      {"ERROR", IrcCmdType_Error},
       {"", IrcCmdType_Null}, {"", IrcCmdType_Null},
-#line 28 "commands.gperf"
-      {"PASS", IrcCmdType_Pass},
-#line 35 "commands.gperf"
-      {"JOIN", IrcCmdType_Join},
-#line 31 "commands.gperf"
+#line 33 "commands.gperf"
       {"SERVER", IrcCmdType_Server},
-#line 62 "commands.gperf"
+#line 64 "commands.gperf"
       {"RESTART", IrcCmdType_Restart},
       {"", IrcCmdType_Null},
-#line 36 "commands.gperf"
-      {"PART", IrcCmdType_Part},
-#line 59 "commands.gperf"
-      {"ERROR", IrcCmdType_Error},
-#line 61 "commands.gperf"
-      {"REHASH", IrcCmdType_Rehash},
-#line 43 "commands.gperf"
-      {"VERSION", IrcCmdType_Version},
 #line 32 "commands.gperf"
-      {"OPERATOR", IrcCmdType_Operator},
-#line 58 "commands.gperf"
-      {"PONG", IrcCmdType_Pong},
-#line 44 "commands.gperf"
-      {"STATS", IrcCmdType_Stats},
-#line 41 "commands.gperf"
-      {"INVITE", IrcCmdType_Invite},
-#line 51 "commands.gperf"
-      {"PRIVMSG", IrcCmdType_PrivMsg},
-      {"", IrcCmdType_Null},
-#line 57 "commands.gperf"
-      {"PING", IrcCmdType_Ping},
-#line 48 "commands.gperf"
-      {"TRACE", IrcCmdType_Trace},
-      {"", IrcCmdType_Null},
-#line 47 "commands.gperf"
-      {"CONNECT", IrcCmdType_Connect},
-      {"", IrcCmdType_Null},
-#line 29 "commands.gperf"
-      {"NICK", IrcCmdType_Nick},
-#line 38 "commands.gperf"
-      {"TOPIC", IrcCmdType_Topic},
-#line 52 "commands.gperf"
-      {"NOTICE", IrcCmdType_Notice},
-      {"", IrcCmdType_Null}, {"", IrcCmdType_Null},
-#line 30 "commands.gperf"
       {"USER", IrcCmdType_User},
-#line 64 "commands.gperf"
+#line 66 "commands.gperf"
       {"USERS", IrcCmdType_Users},
+#line 45 "commands.gperf"
+      {"VERSION", IrcCmdType_Version},
       {"", IrcCmdType_Null},
-#line 65 "commands.gperf"
-      {"WALLOPS", IrcCmdType_WallOps},
-#line 66 "commands.gperf"
+#line 68 "commands.gperf"
       {"USERHOST", IrcCmdType_UserHost},
-#line 40 "commands.gperf"
-      {"LIST", IrcCmdType_List},
+#line 51 "commands.gperf"
+      {"ADMIN", IrcCmdType_Admin},
+#line 65 "commands.gperf"
+      {"SUMMON", IrcCmdType_Summon},
+#line 63 "commands.gperf"
+      {"REHASH", IrcCmdType_Rehash},
+#line 62 "commands.gperf"
+      {"AWAY", IrcCmdType_Away},
 #line 39 "commands.gperf"
+      {"MODE", IrcCmdType_Mode},
+#line 36 "commands.gperf"
+      {"SQUIT", IrcCmdType_ServerQuit},
+#line 50 "commands.gperf"
+      {"TRACE", IrcCmdType_Trace},
+#line 67 "commands.gperf"
+      {"WALLOPS", IrcCmdType_WallOps},
+#line 46 "commands.gperf"
+      {"STATS", IrcCmdType_Stats},
+      {"", IrcCmdType_Null},
+#line 38 "commands.gperf"
+      {"PART", IrcCmdType_Part},
+#line 55 "commands.gperf"
+      {"WHO", IrcCmdType_Who},
+#line 30 "commands.gperf"
+      {"PASS", IrcCmdType_Pass},
+#line 56 "commands.gperf"
+      {"WHOIS", IrcCmdType_Whois},
+#line 57 "commands.gperf"
+      {"WHOWAS", IrcCmdType_Whowas},
+#line 34 "commands.gperf"
+      {"OPER", IrcCmdType_Operator},
+#line 41 "commands.gperf"
       {"NAMES", IrcCmdType_Names},
-      {"", IrcCmdType_Null}, {"", IrcCmdType_Null}, {"", IrcCmdType_Null},
 #line 42 "commands.gperf"
-      {"KICK", IrcCmdType_Kick},
-#line 34 "commands.gperf"
-      {"SQUIT", IrcCmdType_ServerQuit},
-      {"", IrcCmdType_Null}, {"", IrcCmdType_Null}, {"", IrcCmdType_Null},
-#line 33 "commands.gperf"
+      {"LIST", IrcCmdType_List},
+      {"", IrcCmdType_Null},
+#line 48 "commands.gperf"
+      {"TIME", IrcCmdType_Time},
+#line 35 "commands.gperf"
       {"QUIT", IrcCmdType_Quit},
-#line 45 "commands.gperf"
+#line 69 "commands.gperf"
+      {"ISON", IrcCmdType_IsOn},
+#line 44 "commands.gperf"
+      {"KICK", IrcCmdType_Kick},
+#line 53 "commands.gperf"
+      {"PRIVMSG", IrcCmdType_PrivMsg},
+#line 58 "commands.gperf"
+      {"KILL", IrcCmdType_Kill},
+#line 40 "commands.gperf"
+      {"TOPIC", IrcCmdType_Topic},
+#line 49 "commands.gperf"
+      {"CONNECT", IrcCmdType_Connect},
+#line 54 "commands.gperf"
+      {"NOTICE", IrcCmdType_Notice},
+#line 31 "commands.gperf"
+      {"NICK", IrcCmdType_Nick},
+#line 43 "commands.gperf"
+      {"INVITE", IrcCmdType_Invite},
+#line 60 "commands.gperf"
+      {"PONG", IrcCmdType_Pong},
+#line 47 "commands.gperf"
       {"LINKS", IrcCmdType_Links},
-      {"", IrcCmdType_Null}, {"", IrcCmdType_Null}, {"", IrcCmdType_Null},
-#line 46 "commands.gperf"
-      {"TIME", IrcCmdType_Time},
-      {"", IrcCmdType_Null}, {"", IrcCmdType_Null}, {"", IrcCmdType_Null}, {"", IrcCmdType_Null},
 #line 37 "commands.gperf"
-      {"MODE", IrcCmdType_Mode},
-#line 49 "commands.gperf"
-      {"ADMIN", IrcCmdType_Admin},
-#line 63 "commands.gperf"
-      {"SUMMON", IrcCmdType_Summon},
+      {"JOIN", IrcCmdType_Join},
       {"", IrcCmdType_Null}, {"", IrcCmdType_Null},
-#line 56 "commands.gperf"
-      {"KILL", IrcCmdType_Kill},
-      {"", IrcCmdType_Null}, {"", IrcCmdType_Null}, {"", IrcCmdType_Null}, {"", IrcCmdType_Null},
-#line 50 "commands.gperf"
+#line 59 "commands.gperf"
+      {"PING", IrcCmdType_Ping},
+      {"", IrcCmdType_Null},
+#line 52 "commands.gperf"
       {"INFO", IrcCmdType_Info}
     };
 
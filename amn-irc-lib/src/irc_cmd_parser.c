@@ -1,6 +1,7 @@
 #include "irc_cmd_parser.h"
 
 #include "irc_msg_validator.h"
+#include "obj_pool.h"
 #include "str_utils.h"
 
 #include <stdlib.h>
@@ -12,13 +13,34 @@ struct IrcCmdParser
 	const IrcMsgValidator* validator;
 };
 
-static bool ParseNick(IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg);
-static bool ParseUser(IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg);
-static bool ParseJoin(IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg);
-// static bool ParseMode(IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg);
-// static bool ParseKick(IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg);
-static bool ParseQuit(IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg);
-static bool ParsePrivMsg(IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg);
+static bool ParseNick(const IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg);
+static bool ParseUser(const IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg);
+static bool ParseJoin(const IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg);
+// static bool ParseMode(const IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg);
+// static bool ParseKick(const IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg);
+static bool ParseQuit(const IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg);
+static bool ParsePrivMsg(const IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg);
+static bool ParsePing(const IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg);
+static bool ParsePong(const IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg);
+static bool ParseStats(const IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg);
+static bool ParseOper(const IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg);
+static bool ParseNoParams(const IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg);
+
+typedef bool (*ParseFn)(const IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg);
+
+// Indexed by IrcCmdType, null for unsupported commands.
+static const ParseFn PARSERS[IrcCmdType_Len] = {
+	[IrcCmdType_Nick] = ParseNick,
+	[IrcCmdType_User] = ParseUser,
+	[IrcCmdType_Join] = ParseJoin,
+	[IrcCmdType_Quit] = ParseQuit,
+	[IrcCmdType_PrivMsg] = ParsePrivMsg,
+	[IrcCmdType_Ping] = ParsePing,
+	[IrcCmdType_Pong] = ParsePong,
+	[IrcCmdType_Stats] = ParseStats,
+	[IrcCmdType_Rehash] = ParseNoParams,
+	[IrcCmdType_Operator] = ParseOper,
+};
 
 static size_t CsvCount(const char* param);
 
@@ -42,50 +64,41 @@ void IrcCmdParser_Delete(IrcCmdParser* self)
 	free(self);
 }
 
-IrcCmd* IrcCmdParser_Parse(IrcCmdParser* self, const IrcMsg* msg, const int peerSocket)
+IrcCmd* IrcCmdParser_Parse(const IrcCmdParser* self, IrcMsg* msg, const int peerSocket)
 {
-	IrcCmd* cmd = malloc(sizeof(IrcCmd));
+	ParseFn parse = msg->cmd < IrcCmdType_Len ? PARSERS[msg->cmd] : NULL;
+	if (parse == NULL)
+	{
+		LOG_DEBUG(self->log, "Unsupported command: %s.",
+				msg->cmd < IrcCmdType_Len && msg->cmd != IrcCmdType_Null
+					? IRC_CMD_TYPE_INFOS[msg->cmd].name : "(null)");
+		IrcMsg_Delete(msg);
+		return NULL;
+	}
+
+	IrcCmd* cmd = ObjPool_Alloc(sizeof(IrcCmd));
 	if (cmd == NULL)
 	{
 		LOG_ERROR(self->log, "Failed to allocate IrcCmd.");
+		IrcMsg_Delete(msg);
 		return NULL;
 	}
 
 	*cmd = (IrcCmd) { 0 };
 
 	cmd->type = msg->cmd;
+	cmd->priority = IrcCmdType_Priority(msg->cmd);
 	cmd->peerSocket = peerSocket;
+	cmd->msg = msg;
 
-	if (!IrcMsgPrefix_Clone(&msg->prefix, &cmd->prefix))
+	if (!IrcMsg_ClonePrefix(msg, &cmd->prefix))
 	{
 		LOG_ERROR(self->log, "Failed to clone IrcMsgPrefix.");
-		free(cmd);
+		IrcCmd_Delete(cmd);
 		return NULL;
 	}
 
-	bool success = false;
-	switch (cmd->type)
-	{
-	case IrcCmdType_Nick:
-		success = ParseNick(self, cmd, msg);
-		break;
-	case IrcCmdType_User:
-		success = ParseUser(self, cmd, msg);
-		break;
-	case IrcCmdType_Join:
-		success = ParseJoin(self, cmd, msg);
-		break;
-	case IrcCmdType_Quit:
-		success = ParseQuit(self, cmd, msg);
-		break;
-	case IrcCmdType_PrivMsg:
-		success = ParsePrivMsg(self, cmd, msg);
-		break;
-	default:
-		break;
-	}
-
-	if (!success)
+	if (!parse(self, cmd, msg))
 	{
 		IrcCmd_Delete(cmd);
 		return NULL;
@@ -94,7 +107,7 @@ IrcCmd* IrcCmdParser_Parse(IrcCmdParser* self, const IrcMsg* msg, const int peer
 	return cmd;
 }
 
-static bool ParseNick(IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg)
+static bool ParseNick(const IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg)
 {
 	// Initialize everything to defaults in case we need to call Delete.
 	cmd->nick = (IrcCmdNick) {0};
@@ -104,15 +117,16 @@ static bool ParseNick(IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg)
 		LOG_WARN(self->log,
 				"Got NICK cmd with unexpected parameter count: %zu. Expected: 1 or 2",
 				msg->paramCount);
+		return false;
 	}
 
-	if (!IrcMsgValidator_ValidateNick(self->validator, msg->params[0], NULL))
+	if (!IrcMsgValidator_ValidateNick(self->validator, IrcMsg_Param(msg, 0), NULL))
 	{
-		LOG_WARN(self->log, "Got NICK cmd with invalid nickname: %s.", msg->params[0]);
+		LOG_WARN(self->log, "Got NICK cmd with invalid nickname: %s.", IrcMsg_Param(msg, 0));
 		return false;
 	}
 
-	cmd->nick.nickname = StrUtils_Clone(msg->params[0]);
+	cmd->nick.nickname = StrUtils_Clone(IrcMsg_Param(msg, 0));
 	if (cmd->nick.nickname == NULL)
 	{
 		LOG_ERROR(self->log, "Failed to clone nickname string.");
@@ -125,16 +139,16 @@ static bool ParseNick(IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg)
 		return true;
 	}
 
-	if (!StrUtils_ReadSizeT(msg->params[1], &cmd->nick.hopCount))
+	if (!StrUtils_ReadSizeT(IrcMsg_Param(msg, 1), &cmd->nick.hopCount))
 	{
-		LOG_WARN(self->log, "Got NICK cmd with invalid hopCount: %s.", msg->params[1]);
+		LOG_WARN(self->log, "Got NICK cmd with invalid hopCount: %s.", IrcMsg_Param(msg, 1));
 		return false;
 	}
 
 	return true;
 }
 
-static bool ParseUser(IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg)
+static bool ParseUser(const IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg)
 {
 	// Initialize everything to defaults in case we need to call Delete.
 	cmd->user = (IrcCmdUser) {0};
@@ -143,48 +157,49 @@ static bool ParseUser(IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg)
 	{
 		LOG_WARN(self->log, "Got USER cmd with unexpected parameter count: %zu. Expected: 4",
 				msg->paramCount);
+		return false;
 	}
 
-	if (!IrcMsgValidator_ValidateUser(self->validator, msg->params[0], NULL))
+	if (!IrcMsgValidator_ValidateUser(self->validator, IrcMsg_Param(msg, 0), NULL))
 	{
-		LOG_WARN(self->log, "Got USER cmd with invalid username: %s.", msg->params[0]);
+		LOG_WARN(self->log, "Got USER cmd with invalid username: %s.", IrcMsg_Param(msg, 0));
 		return false;
 	}
 
-	cmd->user.username = StrUtils_Clone(msg->params[0]);
+	cmd->user.username = StrUtils_Clone(IrcMsg_Param(msg, 0));
 	if (cmd->user.username == NULL)
 	{
 		LOG_ERROR(self->log, "Failed to clone username string.");
 		return false;
 	}
 
-	if (!IrcMsgValidator_ValidateHost(self->validator, msg->params[1], NULL))
+	if (!IrcMsgValidator_ValidateHost(self->validator, IrcMsg_Param(msg, 1), NULL))
 	{
-		LOG_WARN(self->log, "Got USER cmd with invalid hostname: %s.", msg->params[1]);
+		LOG_WARN(self->log, "Got USER cmd with invalid hostname: %s.", IrcMsg_Param(msg, 1));
 		return false;
 	}
 
-	cmd->user.hostname = StrUtils_Clone(msg->params[1]);
+	cmd->user.hostname = StrUtils_Clone(IrcMsg_Param(msg, 1));
 	if (cmd->user.hostname == NULL)
 	{
 		LOG_ERROR(self->log, "Failed to clone hostname string.");
 		return false;
 	}
 
-	if (!IrcMsgValidator_ValidateServer(self->validator, msg->params[2], NULL))
+	if (!IrcMsgValidator_ValidateServer(self->validator, IrcMsg_Param(msg, 2), NULL))
 	{
-		LOG_WARN(self->log, "Got USER cmd with invalid servername: %s.", msg->params[2]);
+		LOG_WARN(self->log, "Got USER cmd with invalid servername: %s.", IrcMsg_Param(msg, 2));
 		return false;
 	}
 
-	cmd->user.servername = StrUtils_Clone(msg->params[2]);
+	cmd->user.servername = StrUtils_Clone(IrcMsg_Param(msg, 2));
 	if (cmd->user.servername == NULL)
 	{
 		LOG_ERROR(self->log, "Failed to clone servername string");
 		return false;
 	}
 
-	cmd->user.realname = StrUtils_Clone(msg->params[3]);
+	cmd->user.realname = StrUtils_Clone(IrcMsg_Param(msg, 3));
 	if (cmd->user.realname == NULL)
 	{
 		LOG_ERROR(self->log, "Failed to clone realname string.");
@@ -194,7 +209,7 @@ static bool ParseUser(IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg)
 	return true;
 }
 
-static bool ParseQuit(IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg)
+static bool ParseQuit(const IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg)
 {
 	// Initialize everything to defaults in case we need to call Delete.
 	cmd->quit = (IrcCmdQuit) {0};
@@ -208,7 +223,7 @@ static bool ParseQuit(IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg)
 
 	if (msg->paramCount == 1)
 	{
-		cmd->quit.quitMessage = StrUtils_Clone(msg->params[0]);
+		cmd->quit.quitMessage = StrUtils_Clone(IrcMsg_Param(msg, 0));
 		if (cmd->quit.quitMessage == NULL)
 		{
 			LOG_ERROR(self->log, "Failed to clone quit message.");
@@ -219,7 +234,7 @@ static bool ParseQuit(IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg)
 	return true;
 }
 
-static bool ParseJoin(IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg)
+static bool ParseJoin(const IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg)
 {
 	// Initialize everything to defaults in case we need to call Delete.
 	cmd->join = (IrcCmdJoin) {0};
@@ -231,10 +246,10 @@ static bool ParseJoin(IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg)
 		return false;
 	}
 		
-	size_t channelCount = CsvCount(msg->params[0]);
+	size_t channelCount = CsvCount(IrcMsg_Param(msg, 0));
 	if (msg->paramCount == 2)
 	{
-		size_t keyCount = CsvCount(msg->params[1]);
+		size_t keyCount = CsvCount(IrcMsg_Param(msg, 1));
 		if (keyCount > channelCount)
 		{
 			LOG_WARN(self->log, "Got JOIN cmd with more keys than channels.",
@@ -243,17 +258,28 @@ static bool ParseJoin(IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg)
 		}
 	}
 
-	cmd->join.channels = malloc(sizeof(IrcChannelAndKey) * channelCount);
-	if (cmd->join.channels == NULL)
+	if (channelCount <= IRC_CMD_JOIN_INLINE_CHANNELS)
 	{
-		return false;
+		cmd->join.channels = cmd->join.inlineChannels;
+	}
+	else
+	{
+		cmd->join.channels = malloc(sizeof(IrcChannelAndKey) * channelCount);
+		if (cmd->join.channels == NULL)
+		{
+			LOG_ERROR(self->log, "Failed to allocate channel list.");
+			return false;
+		}
 	}
 
-	const char* channel = msg->params[0];
-	for (size_t i = 0; true; i++)
+	// Channels and keys are views into the message, each list item made a string.
+	IrcMsg_SplitParam(cmd->msg, 0, ',');
+
+	const char* channel = IrcMsg_Param(msg, 0);
+	const char* channelsEnd = channel + IrcMsg_ParamLen(msg, 0);
+	for (size_t i = 0; channel <= channelsEnd; i++)
 	{
-		const char* channelEnd = strchr(channel, ',');
-		channelEnd = channelEnd == NULL ? strchr(channel, '\0') : channelEnd;
+		const char* channelEnd = channel + strlen(channel);
 
 		switch(*channel)
 		{
@@ -280,24 +306,11 @@ static bool ParseJoin(IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg)
 				return false;	
 		}
 
-		cmd->join.channels[i].name = StrUtils_CloneRange(channel, channelEnd);
-		if (cmd->join.channels[i].name == NULL)
-		{
-			LOG_ERROR(self->log, "Failed to clone channel[%zu] name string", i);
-			return false;
-		}
-
+		cmd->join.channels[i].name = channel;
 		cmd->join.channels[i].key = NULL;
 		cmd->join.channelCount++; 
 
-		if (*channelEnd != '\0')
-		{
-			channel = channelEnd + 1;
-		}
-		else
-		{
-			break;
-		}
+		channel = channelEnd + 1;
 	}
 
 	if (msg->paramCount == 1)
@@ -305,33 +318,20 @@ static bool ParseJoin(IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg)
 		return true;
 	}
 
-	const char* key = msg->params[1];
-	for (size_t i = 0; true; i++)
-	{
-		const char* keyEnd = strchr(key, ',');
-		keyEnd = keyEnd == NULL ? strchr(key, '\0') : keyEnd;
+	IrcMsg_SplitParam(cmd->msg, 1, ',');
 
-		cmd->join.channels[i].key = StrUtils_CloneRange(key, keyEnd);
-		if (cmd->join.channels[i].key == NULL)
-		{
-			LOG_ERROR(self->log, "Failed to clone channel[%zu] key string", i);
-			return false;
-		}
-
-		if (*keyEnd != '\0')
-		{
-			key = keyEnd + 1;
-		}
-		else
-		{
-			break;
-		}
+	const char* key = IrcMsg_Param(msg, 1);
+	const char* keysEnd = key + IrcMsg_ParamLen(msg, 1);
+	for (size_t i = 0; key <= keysEnd; i++)
+	{
+		cmd->join.channels[i].key = key;
+		key += strlen(key) + 1;
 	}
 
 	return true;	
 }
 
-static bool ParsePrivMsg(IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg)
+static bool ParsePrivMsg(const IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg)
 {
 	// Initialize everything to defaults in case we need to call Delete.
 	cmd->privMsg = (IrcCmdPrivMsg) {0};
@@ -343,19 +343,22 @@ static bool ParsePrivMsg(IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg)
 		return false;
 	}
 		
-	size_t receiverCount = CsvCount(msg->params[0]);
-
-	cmd->privMsg.receiver = malloc(sizeof(IrcReceiver) * receiverCount);
-	if (cmd->privMsg.receiver == NULL)
+	size_t receiverCount = CsvCount(IrcMsg_Param(msg, 0));
+	if (receiverCount > IRC_CMD_PRIVMSG_MAX_RECEIVERS)
 	{
+		LOG_WARN(self->log, "Got PRIVMSG cmd with %zu receivers. Limit: %d",
+				receiverCount, IRC_CMD_PRIVMSG_MAX_RECEIVERS);
 		return false;
 	}
 
-	const char* receiver = msg->params[0];
-	for (size_t i = 0; true; i++)
+	// Receivers are views into the message, each list item made a string.
+	IrcMsg_SplitParam(cmd->msg, 0, ',');
+
+	const char* receiver = IrcMsg_Param(msg, 0);
+	const char* receiversEnd = receiver + IrcMsg_ParamLen(msg, 0);
+	for (size_t i = 0; receiver <= receiversEnd; i++)
 	{
-		const char* receiverEnd = strchr(receiver, ',');
-		receiverEnd = receiverEnd == NULL ? strchr(receiver, '\0') : receiverEnd;
+		const char* receiverEnd = receiver + strlen(receiver);
 
 		switch(*receiver)
 		{
@@ -390,31 +393,120 @@ static bool ParsePrivMsg(IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg)
 				}
 		}
 
-		cmd->privMsg.receiver[i].value = StrUtils_CloneRange(receiver, receiverEnd);
-		if (cmd->privMsg.receiver[i].value == NULL)
+		cmd->privMsg.receiver[i].value = receiver;
+		cmd->privMsg.receiverCount++; 
+
+		receiver = receiverEnd + 1;
+	}
+
+	cmd->privMsg.text = IrcMsg_Param(msg, msg->paramCount - 1);
+
+	return true;
+}
+
+static bool ParsePing(const IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg)
+{
+	// Initialize everything to defaults in case we need to call Delete.
+	cmd->ping = (IrcCmdPing) {0};
+
+	if (msg->paramCount < 1 || msg->paramCount > 2)
+	{
+		LOG_WARN(self->log, "Got PING cmd with %zu parameters. Expected: 1 or 2",
+				msg->paramCount);
+		return false;
+	}
+
+	cmd->ping.server1 = StrUtils_Clone(IrcMsg_Param(msg, 0));
+	if (cmd->ping.server1 == NULL)
+	{
+		LOG_ERROR(self->log, "Failed to clone server1 string.");
+		return false;
+	}
+
+	if (msg->paramCount == 2)
+	{
+		cmd->ping.server2 = StrUtils_Clone(IrcMsg_Param(msg, 1));
+		if (cmd->ping.server2 == NULL)
 		{
-			LOG_ERROR(self->log, "Failed to clone receiver[%zu] string", i);
+			LOG_ERROR(self->log, "Failed to clone server2 string.");
 			return false;
 		}
+	}
 
-		cmd->privMsg.receiverCount++; 
-		if (*receiverEnd != '\0')
-		{
-			receiver = receiverEnd + 1;
-		}
-		else
+	return true;
+}
+
+static bool ParsePong(const IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg)
+{
+	// Initialize everything to defaults in case we need to call Delete.
+	cmd->pong = (IrcCmdPong) {0};
+
+	if (msg->paramCount < 1 || msg->paramCount > 2)
+	{
+		LOG_WARN(self->log, "Got PONG cmd with %zu parameters. Expected: 1 or 2",
+				msg->paramCount);
+		return false;
+	}
+
+	cmd->pong.daemon1 = StrUtils_Clone(IrcMsg_Param(msg, 0));
+	if (cmd->pong.daemon1 == NULL)
+	{
+		LOG_ERROR(self->log, "Failed to clone daemon1 string.");
+		return false;
+	}
+
+	if (msg->paramCount == 2)
+	{
+		cmd->pong.daemon2 = StrUtils_Clone(IrcMsg_Param(msg, 1));
+		if (cmd->pong.daemon2 == NULL)
 		{
-			break;
+			LOG_ERROR(self->log, "Failed to clone daemon2 string.");
+			return false;
 		}
 	}
 
-	cmd->privMsg.text = StrUtils_Clone(msg->params[msg->paramCount - 1]);
-	if (cmd->privMsg.text == NULL)
+	return true;
+}
+
+static bool ParseStats(const IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg)
+{
+	cmd->stats = (IrcCmdStats) {0};
+
+	if (msg->paramCount > 2)
+	{
+		LOG_WARN(self->log, "Got STATS cmd with %zu parameters. Expected: 0 to 2",
+				msg->paramCount);
+		return false;
+	}
+
+	if (msg->paramCount >= 1)
+	{
+		// Only the first letter counts, as in other servers.
+		cmd->stats.query = IrcMsg_Param(msg, 0)[0];
+	}
+
+	if (msg->paramCount == 2)
+	{
+		cmd->stats.server = IrcMsg_Param(msg, 1);
+	}
+
+	return true;
+}
+
+static bool ParseOper(const IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg)
+{
+	cmd->oper = (IrcCmdOper) {0};
+
+	if (msg->paramCount != 2)
 	{
-		LOG_ERROR(self->log, "Failed to clone text string.");
+		LOG_WARN(self->log, "Got OPER cmd with %zu parameters. Expected: 2",
+				msg->paramCount);
 		return false;
 	}
 
+	cmd->oper.user = IrcMsg_Param(msg, 0);
+	cmd->oper.password = IrcMsg_Param(msg, 1);
+
 	return true;
 }
 
@@ -432,3 +524,12 @@ static size_t CsvCount(const char* param)
 
 	return count;
 }
+
+static bool ParseNoParams(const IrcCmdParser* self, IrcCmd* cmd, const IrcMsg* msg)
+{
+	(void) self;
+	(void) cmd;
+	(void) msg;
+
+	return true;
+}
@@ -1,45 +1,59 @@
 #include "irc_cmd_type.h"
 
-const char* const IRC_CMD_TYPE_STRS[] = {
-	NULL,
-	"PASS",
-	"NICK",
-	"USER",
-	"SERVER",
-	"OPERATOR",
-	"QUIT",
-	"SQUIT",
-	"JOIN",
-	"PART",
-	"MODE",
-	"TOPIC",
-	"NAMES",
-	"LIST",
-	"INVITE",
-	"KICK",
-	"VERSION",
-	"STATS",
-	"LINKS",
-	"TIME",
-	"CONNECT",
-	"TRACE",
-	"ADMIN",
-	"INFO",
-	"PRIVMSG",
-	"NOTICE",
-	"WHO",
-	"WHOIS",
-	"WHOWAS",
-	"KILL",
-	"PING",
-	"PONG",
-	"ERROR",
-	"AWAY",
-	"REHASH",
-	"RESTART",
-	"SUMMON",
-	"USERS",
-	"WALLOPS",
-	"USERHOST",
-	"ISON"
+// RFC 1459 penalizes each message by 2 seconds.
+#define DEFAULT_PENALTY_MS 2000
+// Commands that change shared server state are more expensive.
+#define STATE_PENALTY_MS 3000
+// Queries that walk every user or channel.
+#define QUERY_PENALTY_MS 4000
+
+// Keepalives and disconnects are Control so they skip ahead of chat traffic,
+// which keeps them cheap but not free.
+const IrcCmdTypeInfo IRC_CMD_TYPE_INFOS[IrcCmdType_Len] = {
+	[IrcCmdType_Null] = { NULL, IrcCmdPriority_Normal, DEFAULT_PENALTY_MS },
+	[IrcCmdType_Pass] = { "PASS", IrcCmdPriority_Normal, DEFAULT_PENALTY_MS },
+	[IrcCmdType_Nick] = { "NICK", IrcCmdPriority_Normal, STATE_PENALTY_MS },
+	[IrcCmdType_User] = { "USER", IrcCmdPriority_Normal, DEFAULT_PENALTY_MS },
+	[IrcCmdType_Server] = { "SERVER", IrcCmdPriority_Normal, DEFAULT_PENALTY_MS },
+	[IrcCmdType_Operator] = { "OPER", IrcCmdPriority_Normal, DEFAULT_PENALTY_MS },
+	[IrcCmdType_Quit] = { "QUIT", IrcCmdPriority_Control, 1 },
+	[IrcCmdType_ServerQuit] = { "SQUIT", IrcCmdPriority_Normal, DEFAULT_PENALTY_MS },
+	[IrcCmdType_Join] = { "JOIN", IrcCmdPriority_Normal, STATE_PENALTY_MS },
+	[IrcCmdType_Part] = { "PART", IrcCmdPriority_Normal, STATE_PENALTY_MS },
+	[IrcCmdType_Mode] = { "MODE", IrcCmdPriority_Normal, STATE_PENALTY_MS },
+	[IrcCmdType_Topic] = { "TOPIC", IrcCmdPriority_Normal, STATE_PENALTY_MS },
+	[IrcCmdType_Names] = { "NAMES", IrcCmdPriority_Normal, QUERY_PENALTY_MS },
+	[IrcCmdType_List] = { "LIST", IrcCmdPriority_Normal, QUERY_PENALTY_MS },
+	[IrcCmdType_Invite] = { "INVITE", IrcCmdPriority_Normal, STATE_PENALTY_MS },
+	[IrcCmdType_Kick] = { "KICK", IrcCmdPriority_Normal, STATE_PENALTY_MS },
+	[IrcCmdType_Version] = { "VERSION", IrcCmdPriority_Normal, DEFAULT_PENALTY_MS },
+	[IrcCmdType_Stats] = { "STATS", IrcCmdPriority_Normal, QUERY_PENALTY_MS },
+	[IrcCmdType_Links] = { "LINKS", IrcCmdPriority_Normal, DEFAULT_PENALTY_MS },
+	[IrcCmdType_Time] = { "TIME", IrcCmdPriority_Normal, DEFAULT_PENALTY_MS },
+	[IrcCmdType_Connect] = { "CONNECT", IrcCmdPriority_Normal, DEFAULT_PENALTY_MS },
+	[IrcCmdType_Trace] = { "TRACE", IrcCmdPriority_Normal, DEFAULT_PENALTY_MS },
+	[IrcCmdType_Admin] = { "ADMIN", IrcCmdPriority_Normal, DEFAULT_PENALTY_MS },
+	[IrcCmdType_Info] = { "INFO", IrcCmdPriority_Normal, DEFAULT_PENALTY_MS },
+	[IrcCmdType_PrivMsg] = { "PRIVMSG", IrcCmdPriority_Normal, DEFAULT_PENALTY_MS },
+	[IrcCmdType_Notice] = { "NOTICE", IrcCmdPriority_Normal, DEFAULT_PENALTY_MS },
+	[IrcCmdType_Who] = { "WHO", IrcCmdPriority_Normal, QUERY_PENALTY_MS },
+	[IrcCmdType_Whois] = { "WHOIS", IrcCmdPriority_Normal, QUERY_PENALTY_MS },
+	[IrcCmdType_Whowas] = { "WHOWAS", IrcCmdPriority_Normal, QUERY_PENALTY_MS },
+	[IrcCmdType_Kill] = { "KILL", IrcCmdPriority_Normal, DEFAULT_PENALTY_MS },
+	[IrcCmdType_Ping] = { "PING", IrcCmdPriority_Control, 1000 },
+	[IrcCmdType_Pong] = { "PONG", IrcCmdPriority_Control, 1000 },
+	[IrcCmdType_Error] = { "ERROR", IrcCmdPriority_Normal, DEFAULT_PENALTY_MS },
+	[IrcCmdType_Away] = { "AWAY", IrcCmdPriority_Normal, DEFAULT_PENALTY_MS },
+	[IrcCmdType_Rehash] = { "REHASH", IrcCmdPriority_Normal, DEFAULT_PENALTY_MS },
+	[IrcCmdType_Restart] = { "RESTART", IrcCmdPriority_Normal, DEFAULT_PENALTY_MS },
+	[IrcCmdType_Summon] = { "SUMMON", IrcCmdPriority_Normal, DEFAULT_PENALTY_MS },
+	[IrcCmdType_Users] = { "USERS", IrcCmdPriority_Normal, DEFAULT_PENALTY_MS },
+	[IrcCmdType_WallOps] = { "WALLOPS", IrcCmdPriority_Normal, DEFAULT_PENALTY_MS },
+	[IrcCmdType_UserHost] = { "USERHOST", IrcCmdPriority_Normal, DEFAULT_PENALTY_MS },
+	[IrcCmdType_IsOn] = { "ISON", IrcCmdPriority_Normal, DEFAULT_PENALTY_MS },
 };
+
+IrcCmdPriority IrcCmdType_Priority(IrcCmdType type)
+{
+	return type < IrcCmdType_Len ? IRC_CMD_TYPE_INFOS[type].priority : IrcCmdPriority_Normal;
+}
@@ -1,7 +1,7 @@
 #include "irc_cmd_unparser.h"
 #include "irc_msg.h"
-#include "str_utils.h"
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,9 +12,30 @@ struct IrcCmdUnparser
 	const IrcMsgValidator* validator;
 };
 
-static bool UnparseNick(IrcCmdUnparser* self, IrcMsg* msg, const IrcCmd* cmd);
-static bool UnparseUser(IrcCmdUnparser* self, IrcMsg* msg, const IrcCmd* cmd);
-static bool UnparsePrivMsg(IrcCmdUnparser* self, IrcMsg* msg, const IrcCmd* cmd);
+static bool AddParam(const IrcCmdUnparser* self, IrcMsg* msg, const char* param);
+static bool MissingParam(const IrcCmdUnparser* self);
+static bool UnparseNick(const IrcCmdUnparser* self, IrcMsg* msg, const IrcCmd* cmd);
+static bool UnparseUser(const IrcCmdUnparser* self, IrcMsg* msg, const IrcCmd* cmd);
+static bool UnparsePrivMsg(const IrcCmdUnparser* self, IrcMsg* msg, const IrcCmd* cmd);
+static bool UnparsePong(const IrcCmdUnparser* self, IrcMsg* msg, const IrcCmd* cmd);
+
+// Output of UnparseTo. Writes past the end only set overflow, so unparsing
+// doesn't need to check every write.
+typedef struct RawWriter
+{
+	char* buffer;
+	size_t capacity;
+	size_t len;
+	bool overflow;
+}
+RawWriter;
+
+static void RawWriter_Char(RawWriter* self, char character);
+static void RawWriter_String(RawWriter* self, const char* string);
+static void RawWriter_Size(RawWriter* self, size_t number);
+
+static void UnparseToPrefix(RawWriter* writer, const IrcMsgPrefix* prefix);
+static bool UnparseToParams(const IrcCmdUnparser* self, RawWriter* writer, const IrcCmd* cmd);
 
 
 IrcCmdUnparser* IrcCmdUnparser_New(const Logger* log, const IrcMsgValidator* validator)
@@ -37,24 +58,22 @@ void IrcCmdUnparser_Delete(IrcCmdUnparser* self)
 	free(self);
 }
 
-IrcMsg* IrcCmdUnparser_Unparse(IrcCmdUnparser* self, const IrcCmd* cmd)
+IrcMsg* IrcCmdUnparser_Unparse(const IrcCmdUnparser* self, const IrcCmd* cmd)
 {
-	IrcMsg* msg = malloc(sizeof(IrcMsg));
+	IrcMsg* msg = IrcMsg_New();
 	if (msg == NULL)
 	{
 		LOG_ERROR(self->log, "Failed to allocate IrcMsg");
 		return NULL;
 	}
 
-	*msg = (IrcMsg) {
-		.cmd = cmd->type,
-		.paramCount = 0,
-	};
+	msg->cmd = cmd->type;
 
-	if (!IrcMsgPrefix_Clone(&cmd->prefix, &msg->prefix))
+	if (!IrcMsg_SetPrefix(msg, &cmd->prefix))
 	{
-		LOG_ERROR(self->log, "Failed to clone message prefix");
-		return false;
+		LOG_ERROR(self->log, "Failed to copy message prefix");
+		IrcMsg_Delete(msg);
+		return NULL;
 	}
 
 	bool success = false;
@@ -69,6 +88,9 @@ IrcMsg* IrcCmdUnparser_Unparse(IrcCmdUnparser* self, const IrcCmd* cmd)
 	case IrcCmdType_PrivMsg:
 		success = UnparsePrivMsg(self, msg, cmd);
 		break;
+	case IrcCmdType_Pong:
+		success = UnparsePong(self, msg, cmd);
+		break;
 	default:
 		break;
 	}
@@ -82,16 +104,28 @@ IrcMsg* IrcCmdUnparser_Unparse(IrcCmdUnparser* self, const IrcCmd* cmd)
 	return msg;
 }
 
-static bool UnparseNick(IrcCmdUnparser* self, IrcMsg* msg, const IrcCmd* cmd)
+static bool AddParam(const IrcCmdUnparser* self, IrcMsg* msg, const char* param)
 {
-	msg->params[0] = StrUtils_Clone(cmd->nick.nickname);
-	if (msg->params[0] == NULL)
+	if (param == NULL)
 	{
-		LOG_ERROR(self->log, "Failed to clone nickname");
+		return MissingParam(self);
+	}
+
+	if (!IrcMsg_AddParam(msg, param, param + strlen(param)))
+	{
+		LOG_WARN(self->log, "Message exceeds size limit. Limit: %zu", IRC_MSG_SIZE);
 		return false;
 	}
 
-	msg->paramCount = 1;
+	return true;
+}
+
+static bool UnparseNick(const IrcCmdUnparser* self, IrcMsg* msg, const IrcCmd* cmd)
+{
+	if (!AddParam(self, msg, cmd->nick.nickname))
+	{
+		return false;
+	}
 
 	if (cmd->nick.hopCount == 0)
 	{
@@ -99,127 +133,318 @@ static bool UnparseNick(IrcCmdUnparser* self, IrcMsg* msg, const IrcCmd* cmd)
 		return true;
 	}
 
-	int len = snprintf(NULL, 0, "%zu", cmd->nick.hopCount);
-	if (len < 0)
+	char hopCount[24];
+	int len = snprintf(hopCount, sizeof(hopCount), "%zu", cmd->nick.hopCount);
+	if (len < 0 || (size_t) len >= sizeof(hopCount))
 	{
 		LOG_ERROR(self->log, "Failed to unparse hopcount: Format error");
 		return false;
 	}
 
-	msg->params[1] = malloc(sizeof(char) * (size_t) (len + 1));
-	if (msg->params[1] == NULL)
+	return AddParam(self, msg, hopCount);
+}
+
+static bool UnparseUser(const IrcCmdUnparser* self, IrcMsg* msg, const IrcCmd* cmd)
+{
+	return AddParam(self, msg, cmd->user.username)
+		&& AddParam(self, msg, cmd->user.hostname)
+		&& AddParam(self, msg, cmd->user.servername)
+		&& AddParam(self, msg, cmd->user.realname);
+}
+
+static bool UnparsePrivMsg(const IrcCmdUnparser* self, IrcMsg* msg, const IrcCmd* cmd)
+{
+	char receivers[IRC_MSG_SIZE + 1];
+	RawWriter writer = {
+		.buffer = receivers,
+		.capacity = IRC_MSG_SIZE,
+	};
+
+	for (size_t i = 0; i < cmd->privMsg.receiverCount; i++)
 	{
-		LOG_ERROR(self->log, "Failed to unparse hopcount: Allocation error");
-		return false;
+		if (cmd->privMsg.receiver[i].value == NULL)
+		{
+			return MissingParam(self);
+		}
+
+		if (i > 0)
+		{
+			RawWriter_Char(&writer, ',');
+		}
+
+		switch (cmd->privMsg.receiver[i].type)
+		{
+			case IrcReceiverType_Nickname:
+				break;
+			case IrcReceiverType_LocalChannel:
+				RawWriter_Char(&writer, '&');
+				break;
+			case IrcReceiverType_DistChannelOrHostMask:
+				RawWriter_Char(&writer, '#');
+				break;
+			case IrcReceiverType_ServerMask:
+				RawWriter_Char(&writer, '$');
+				break;
+		}
+
+		RawWriter_String(&writer, cmd->privMsg.receiver[i].value);
 	}
-	msg->paramCount = 2;
 
-	int actualLen = snprintf(msg->params[1], (size_t) len + 1, "%zu", cmd->nick.hopCount);
-	if (actualLen < 0 || actualLen > len)
+	if (writer.overflow)
 	{
-		LOG_ERROR(self->log, "Failed to unparse hopcount: Format error");
+		LOG_WARN(self->log, "Message exceeds size limit. Limit: %zu", IRC_MSG_SIZE);
 		return false;
 	}
 
-	return true;
+	receivers[writer.len] = '\0';
+
+	return AddParam(self, msg, receivers)
+		&& AddParam(self, msg, cmd->privMsg.text);
 }
 
-static bool UnparseUser(IrcCmdUnparser* self, IrcMsg* msg, const IrcCmd* cmd)
+static bool UnparsePong(const IrcCmdUnparser* self, IrcMsg* msg, const IrcCmd* cmd)
 {
-	msg->params[0] = StrUtils_Clone(cmd->user.username);
-	if (msg->params[0] == NULL)
+	if (!AddParam(self, msg, cmd->pong.daemon1))
 	{
-		LOG_ERROR(self->log, "Failed to clone username");
 		return false;
 	}
-	msg->paramCount++;
 
-	msg->params[1] = StrUtils_Clone(cmd->user.hostname);
-	if (msg->params[1] == NULL)
+	return cmd->pong.daemon2 == NULL || AddParam(self, msg, cmd->pong.daemon2);
+}
+
+/**
+ * Fails unparsing a command missing a required parameter, setting errno to EINVAL.
+ */
+static bool MissingParam(const IrcCmdUnparser* self)
+{
+	LOG_WARN(self->log, "Command is missing a parameter.");
+	errno = EINVAL;
+	return false;
+}
+
+size_t IrcCmdUnparser_UnparseTo(
+		const IrcCmdUnparser* self, const IrcCmd* cmd, char* buffer, size_t bufferSize)
+{
+	if (bufferSize == 0)
 	{
-		LOG_ERROR(self->log, "Failed to clone hostname");
-		return false;
+		return 0;
+	}
+
+	if (cmd->type >= IrcCmdType_Len || IRC_CMD_TYPE_INFOS[cmd->type].name == NULL)
+	{
+		errno = EINVAL;
+		return 0;
 	}
-	msg->paramCount++;
 
+	// Room for the NUL terminator, and no more than a message can take.
+	size_t capacity = bufferSize > IRC_MSG_SIZE ? IRC_MSG_SIZE : bufferSize - 1;
 
-	msg->params[2] = StrUtils_Clone(cmd->user.servername);
-	if (msg->params[2] == NULL)
+	RawWriter writer = {
+		.buffer = buffer,
+		.capacity = capacity,
+	};
+
+	UnparseToPrefix(&writer, &cmd->prefix);
+	RawWriter_String(&writer, IRC_CMD_TYPE_INFOS[cmd->type].name);
+
+	if (!UnparseToParams(self, &writer, cmd))
 	{
-		LOG_ERROR(self->log, "Failed to clone servername");
-		return false;
+		return 0;
 	}
-	msg->paramCount++;
 
-	msg->params[3] = StrUtils_Clone(cmd->user.realname);
-	if (msg->params[3] == NULL)
+	RawWriter_Char(&writer, '\r');
+	RawWriter_Char(&writer, '\n');
+
+	if (writer.overflow)
 	{
-		LOG_ERROR(self->log, "Failed to clone realname");
-		return false;
+		LOG_WARN(self->log, "Message exceeds size limit. Limit: %zu", capacity);
+		return 0;
 	}
-	msg->paramCount++;
 
-	return true;
+	buffer[writer.len] = '\0';
+
+	return writer.len;
 }
 
-static bool UnparsePrivMsg(IrcCmdUnparser* self, IrcMsg* msg, const IrcCmd* cmd)
+static void RawWriter_Char(RawWriter* self, char character)
 {
-	size_t receiverLen = 0;
-	for (size_t i = 0; i < cmd->privMsg.receiverCount; i++)
+	if (self->len + 1 > self->capacity)
 	{
-		if (cmd->privMsg.receiver->value == NULL)
-		{
-			return false;
-		}
+		self->overflow = true;
+		return;
+	}
 
-		if (cmd->privMsg.receiver->type != IrcReceiverType_Nickname)
-		{
-			receiverLen++;
-		}
-		
-		receiverLen += strlen(cmd->privMsg.receiver->value) + 1;
+	self->buffer[self->len] = character;
+	self->len++;
+}
+
+static void RawWriter_String(RawWriter* self, const char* string)
+{
+	size_t len = strlen(string);
+
+	if (self->len + len > self->capacity)
+	{
+		self->overflow = true;
+		return;
 	}
 
-	msg->params[0] = malloc(sizeof(char) * receiverLen);
-	if (msg->params[0] == NULL)
+	memcpy(self->buffer + self->len, string, len);
+	self->len += len;
+}
+
+static void RawWriter_Size(RawWriter* self, size_t number)
+{
+	// Enough for the digits of a 64 bit number.
+	char digits[20];
+	size_t digitCount = 0;
+
+	do
 	{
-		return false;
+		digits[digitCount] = (char) ('0' + number % 10);
+		digitCount++;
+		number /= 10;
 	}
-	msg->paramCount++;
-	
-	for (size_t i = 0, pos = 0; i < cmd->privMsg.receiverCount && pos < receiverLen - 1; i++)
+	while (number > 0);
+
+	while (digitCount > 0)
 	{
-		switch (cmd->privMsg.receiver[i].type)
-		{
-			case IrcReceiverType_Nickname:
-				break;
-			case IrcReceiverType_LocalChannel:
-				msg->params[0][pos] = '&';
-				pos++;
-				break;
-			case IrcReceiverType_DistChannelOrHostMask:
-				msg->params[0][pos] = '#';
-				pos++;
-				break;
-			case IrcReceiverType_ServerMask:
-				msg->params[0][pos] = '$';
-				pos++;
-				break;
-		}
+		digitCount--;
+		RawWriter_Char(self, digits[digitCount]);
+	}
+}
+
+static void UnparseToPrefix(RawWriter* writer, const IrcMsgPrefix* prefix)
+{
+	if (prefix->origin == NULL)
+	{
+		return;
+	}
+
+	RawWriter_Char(writer, ':');
+	RawWriter_String(writer, prefix->origin);
 
-		size_t len = strlen(cmd->privMsg.receiver->value);
-		memcpy(msg->params[0] + pos, cmd->privMsg.receiver->value, len);
-		pos += len;
+	if (prefix->username != NULL)
+	{
+		RawWriter_Char(writer, '!');
+		RawWriter_String(writer, prefix->username);
 	}
-	msg->params[0][receiverLen - 1] = '\0';
-	
-	msg->params[msg->paramCount] = StrUtils_Clone(cmd->privMsg.text);
-	if (msg->params[msg->paramCount] == NULL)
+
+	if (prefix->hostname != NULL)
 	{
-		LOG_ERROR(self->log, "Failed to clone text");
-		return false;
+		RawWriter_Char(writer, '@');
+		RawWriter_String(writer, prefix->hostname);
 	}
-	msg->paramCount++;
 
-	return true;
+	RawWriter_Char(writer, ' ');
+}
+
+/**
+ * Params are written the way IrcMsgUnparser does, with the last one always
+ * after a colon.
+ */
+static bool UnparseToParams(const IrcCmdUnparser* self, RawWriter* writer, const IrcCmd* cmd)
+{
+	switch (cmd->type)
+	{
+	case IrcCmdType_Nick:
+		if (cmd->nick.nickname == NULL)
+		{
+			return MissingParam(self);
+		}
+
+		if (cmd->nick.hopCount == 0)
+		{
+			// Local connection omit hop count.
+			RawWriter_String(writer, " :");
+			RawWriter_String(writer, cmd->nick.nickname);
+			return true;
+		}
+
+		RawWriter_Char(writer, ' ');
+		RawWriter_String(writer, cmd->nick.nickname);
+		RawWriter_String(writer, " :");
+		RawWriter_Size(writer, cmd->nick.hopCount);
+		return true;
+
+	case IrcCmdType_User:
+		if (cmd->user.username == NULL || cmd->user.hostname == NULL
+				|| cmd->user.servername == NULL || cmd->user.realname == NULL)
+		{
+			return MissingParam(self);
+		}
+
+		RawWriter_Char(writer, ' ');
+		RawWriter_String(writer, cmd->user.username);
+		RawWriter_Char(writer, ' ');
+		RawWriter_String(writer, cmd->user.hostname);
+		RawWriter_Char(writer, ' ');
+		RawWriter_String(writer, cmd->user.servername);
+		RawWriter_String(writer, " :");
+		RawWriter_String(writer, cmd->user.realname);
+		return true;
+
+	case IrcCmdType_PrivMsg:
+		RawWriter_Char(writer, ' ');
+		for (size_t i = 0; i < cmd->privMsg.receiverCount; i++)
+		{
+			if (cmd->privMsg.receiver[i].value == NULL)
+			{
+				return MissingParam(self);
+			}
+
+			if (i > 0)
+			{
+				RawWriter_Char(writer, ',');
+			}
+
+			switch (cmd->privMsg.receiver[i].type)
+			{
+				case IrcReceiverType_Nickname:
+					break;
+				case IrcReceiverType_LocalChannel:
+					RawWriter_Char(writer, '&');
+					break;
+				case IrcReceiverType_DistChannelOrHostMask:
+					RawWriter_Char(writer, '#');
+					break;
+				case IrcReceiverType_ServerMask:
+					RawWriter_Char(writer, '$');
+					break;
+			}
+
+			RawWriter_String(writer, cmd->privMsg.receiver[i].value);
+		}
+
+		if (cmd->privMsg.text == NULL)
+		{
+			return MissingParam(self);
+		}
+
+		RawWriter_String(writer, " :");
+		RawWriter_String(writer, cmd->privMsg.text);
+		return true;
+
+	case IrcCmdType_Pong:
+		if (cmd->pong.daemon1 == NULL)
+		{
+			return MissingParam(self);
+		}
+
+		if (cmd->pong.daemon2 == NULL)
+		{
+			RawWriter_String(writer, " :");
+			RawWriter_String(writer, cmd->pong.daemon1);
+			return true;
+		}
+
+		RawWriter_Char(writer, ' ');
+		RawWriter_String(writer, cmd->pong.daemon1);
+		RawWriter_String(writer, " :");
+		RawWriter_String(writer, cmd->pong.daemon2);
+		return true;
+
+	default:
+		LOG_ERROR(self->log, "Unparsing %s is unimplemented.", IRC_CMD_TYPE_INFOS[cmd->type].name);
+		return false;
+	}
 }
@@ -1,8 +1,13 @@
 #include "irc_msg.h"
 
+#include "obj_pool.h"
 #include "str_utils.h"
 
 #include <stdlib.h>
+#include <string.h>
+
+static const char* IrcMsg_SpanStr(const IrcMsg* self, IrcMsgSpan span);
+static bool IrcMsg_Append(IrcMsg* self, const char* start, const char* end, IrcMsgSpan* span);
 
 bool IrcMsgPrefix_Clone(const IrcMsgPrefix* self, IrcMsgPrefix* clone)
 {
@@ -48,55 +53,160 @@ bool IrcMsgPrefix_Clone(const IrcMsgPrefix* self, IrcMsgPrefix* clone)
 	return true;
 }
 
+IrcMsg* IrcMsg_New(void)
+{
+	IrcMsg* self = ObjPool_Alloc(sizeof(IrcMsg));
+	if (self == NULL)
+	{
+		return NULL;
+	}
+
+	// Leaves the buffer uninitialized.
+	memset(self, 0, offsetof(IrcMsg, buffer));
+
+	return self;
+}
+
 IrcMsg* IrcMsg_Clone(const IrcMsg* self)
 {
-	IrcMsg* clone = malloc(sizeof(IrcMsg));
+	IrcMsg* clone = ObjPool_Alloc(sizeof(IrcMsg));
 	if (clone == NULL)
 	{
 		return NULL;
 	}
 
-	*clone = (IrcMsg){0};
-	clone->cmd = self->cmd;
-	clone->replyNumber = self->replyNumber;
+	memcpy(clone, self, offsetof(IrcMsg, buffer) + self->bufferLen);
+
+	return clone;
+}
+
+void IrcMsg_Delete(IrcMsg* self)
+{
+	ObjPool_Free(self);
+}
+
+const char* IrcMsg_Origin(const IrcMsg* self)
+{
+	return IrcMsg_SpanStr(self, self->origin);
+}
+
+const char* IrcMsg_Username(const IrcMsg* self)
+{
+	return IrcMsg_SpanStr(self, self->username);
+}
 
-	if (!IrcMsgPrefix_Clone(&self->prefix, &clone->prefix))
+const char* IrcMsg_Hostname(const IrcMsg* self)
+{
+	return IrcMsg_SpanStr(self, self->hostname);
+}
+
+const char* IrcMsg_Param(const IrcMsg* self, size_t index)
+{
+	if (index >= self->paramCount)
 	{
-		IrcMsg_Delete(clone);
 		return NULL;
 	}
 
-	for (size_t i = 0; i < self->paramCount; i++)
-	{
-		clone->params[i] = StrUtils_Clone(self->params[i]);
-		if (clone->params[i] == NULL)
-		{
-			IrcMsg_Delete(clone);
-			return NULL;
-		}
+	return self->buffer + self->params[index].offset;
+}
 
-		clone->paramCount++;
+size_t IrcMsg_ParamLen(const IrcMsg* self, size_t index)
+{
+	if (index >= self->paramCount)
+	{
+		return 0;
 	}
 
-	return clone;
+	return self->params[index].len;
 }
 
-void IrcMsg_Delete(IrcMsg* self)
+void IrcMsg_SplitParam(IrcMsg* self, size_t index, char separator)
 {
-	if (self == NULL)
+	if (index >= self->paramCount)
 	{
 		return;
 	}
 
-	free(self->prefix.origin);
-	free(self->prefix.username);
-	free(self->prefix.hostname);
+	char* param = self->buffer + self->params[index].offset;
+	char* paramEnd = param + self->params[index].len;
 
-	for (size_t i = 0; i < self->paramCount; i++)
+	while ((param = memchr(param, separator, (size_t) (paramEnd - param))) != NULL)
 	{
-		free(self->params[i]);
+		*param++ = '\0';
 	}
+}
+
+bool IrcMsg_ClonePrefix(const IrcMsg* self, IrcMsgPrefix* prefix)
+{
+	IrcMsgPrefix view = {
+		.origin = (char*) IrcMsg_Origin(self),
+		.username = (char*) IrcMsg_Username(self),
+		.hostname = (char*) IrcMsg_Hostname(self),
+	};
+
+	return IrcMsgPrefix_Clone(&view, prefix);
+}
+
+bool IrcMsg_SetOrigin(IrcMsg* self, const char* start, const char* end)
+{
+	return IrcMsg_Append(self, start, end, &self->origin);
+}
+
+bool IrcMsg_SetUsername(IrcMsg* self, const char* start, const char* end)
+{
+	return IrcMsg_Append(self, start, end, &self->username);
+}
 
+bool IrcMsg_SetHostname(IrcMsg* self, const char* start, const char* end)
+{
+	return IrcMsg_Append(self, start, end, &self->hostname);
+}
 
-	free(self);
+bool IrcMsg_AddParam(IrcMsg* self, const char* start, const char* end)
+{
+	if (self->paramCount == IRC_MSG_MAX_PARAMS
+			|| !IrcMsg_Append(self, start, end, &self->params[self->paramCount]))
+	{
+		return false;
+	}
+
+	self->paramCount++;
+	return true;
+}
+
+bool IrcMsg_SetPrefix(IrcMsg* self, const IrcMsgPrefix* prefix)
+{
+	const char* origin = prefix->origin;
+	const char* username = prefix->username;
+	const char* hostname = prefix->hostname;
+
+	return (origin == NULL || IrcMsg_SetOrigin(self, origin, origin + strlen(origin)))
+		&& (username == NULL || IrcMsg_SetUsername(self, username, username + strlen(username)))
+		&& (hostname == NULL || IrcMsg_SetHostname(self, hostname, hostname + strlen(hostname)));
+}
+
+static const char* IrcMsg_SpanStr(const IrcMsg* self, IrcMsgSpan span)
+{
+	return span.len != 0 ? self->buffer + span.offset : NULL;
+}
+
+static bool IrcMsg_Append(IrcMsg* self, const char* start, const char* end, IrcMsgSpan* span)
+{
+	size_t len = (size_t) (end - start);
+
+	if (len + 1 > sizeof(self->buffer) - self->bufferLen)
+	{
+		return false;
+	}
+
+	memcpy(self->buffer + self->bufferLen, start, len);
+	self->buffer[self->bufferLen + len] = '\0';
+
+	*span = (IrcMsgSpan) {
+		.offset = self->bufferLen,
+		.len = (uint16_t) len,
+	};
+	self->bufferLen = (uint16_t) (self->bufferLen + len + 1);
+
+	return true;
 }
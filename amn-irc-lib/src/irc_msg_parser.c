@@ -8,12 +8,20 @@
 
 
 struct IrcMsgParser
+{
+	const Logger* log;
+	const IrcMsgValidator* validator;
+};
+
+// State of a single Parse call, so the parser itself can be shared between threads.
+typedef struct ParseState
 {
 	const Logger* log;
 	const IrcMsgValidator* validator;
 	IrcMsg* msg;
 	const char* rawMsg;
-};
+}
+ParseState;
 
 
 IrcMsgParser* IrcMsgParser_New(const Logger* logger, const IrcMsgValidator* validator)
@@ -26,8 +34,6 @@ IrcMsgParser* IrcMsgParser_New(const Logger* logger, const IrcMsgValidator* vali
 
 	self->log = logger;
 	self->validator = validator;
-	self->msg = NULL;
-	self->rawMsg = NULL;
 
 	return self;
 }
@@ -37,7 +43,7 @@ void IrcMsgParser_Delete(IrcMsgParser* self)
 	free(self);
 }
 
-static bool IrcMsgParser_ParsePrefixOrigin(IrcMsgParser* self)
+static bool IrcMsgParser_ParsePrefixOrigin(ParseState* self)
 {
 	const char* originStart = self->rawMsg;
 	const char* originEnd = StrUtils_FindFirst(originStart, "!@ ");
@@ -58,17 +64,16 @@ static bool IrcMsgParser_ParsePrefixOrigin(IrcMsgParser* self)
 		return false;
 	}
 
-	self->msg->prefix.origin = StrUtils_CloneRange(originStart, originEnd);
-	if (self->msg->prefix.origin == NULL)
+	if (!IrcMsg_SetOrigin(self->msg, originStart, originEnd))
 	{
-		LOG_ERROR(self->log, "Failed to copy IrcMsgPrefix.origin");
+		LOG_WARN(self->log, "Invalid message: too long.");
 		return false;
 	}
 
 	return true;
 }
 
-static bool IrcMsgParser_ParsePrefixUsername(IrcMsgParser* self)
+static bool IrcMsgParser_ParsePrefixUsername(ParseState* self)
 {
 	if (*self->rawMsg != '!')
 	{
@@ -95,17 +100,16 @@ static bool IrcMsgParser_ParsePrefixUsername(IrcMsgParser* self)
 		return false;
 	}
 
-	self->msg->prefix.username = StrUtils_CloneRange(usernameStart, usernameEnd);
-	if (self->msg->prefix.username == NULL)
+	if (!IrcMsg_SetUsername(self->msg, usernameStart, usernameEnd))
 	{
-		LOG_ERROR(self->log, "Failed to copy IrcMsgPrefix.username");
+		LOG_WARN(self->log, "Invalid message: too long.");
 		return false;
 	}
 
 	return true;
 }
 
-static bool IrcMsgParser_ParsePrefixHostname(IrcMsgParser* self)
+static bool IrcMsgParser_ParsePrefixHostname(ParseState* self)
 {
 	if (*self->rawMsg != '@')
 	{
@@ -132,17 +136,16 @@ static bool IrcMsgParser_ParsePrefixHostname(IrcMsgParser* self)
 		return false;
 	}
 
-	self->msg->prefix.hostname = StrUtils_CloneRange(hostnameStart, hostnameEnd);
-	if (self->msg->prefix.hostname == NULL)
+	if (!IrcMsg_SetHostname(self->msg, hostnameStart, hostnameEnd))
 	{
-		LOG_ERROR(self->log, "Failed to copy IrcMsgPrefix.hostname");
+		LOG_WARN(self->log, "Invalid message: too long.");
 		return false;
 	}
 
 	return true;
 }
 
-static bool IrcMsgParser_ParsePrefix(IrcMsgParser* self)
+static bool IrcMsgParser_ParsePrefix(ParseState* self)
 {
 	if (*self->rawMsg != ':')
 	{
@@ -173,7 +176,7 @@ static bool IrcMsgParser_ParsePrefix(IrcMsgParser* self)
 	return true;
 }
 
-static void IrcMsgParser_ParseSpace(IrcMsgParser* self)
+static void IrcMsgParser_ParseSpace(ParseState* self)
 {
 	while(*self->rawMsg == ' ')
 	{
@@ -181,17 +184,18 @@ static void IrcMsgParser_ParseSpace(IrcMsgParser* self)
 	}
 }
 
-static bool IrcMsgParser_ParseCommand(IrcMsgParser* self)
+static bool IrcMsgParser_ParseCommand(ParseState* self)
 {
 	const char* cmdStart = self->rawMsg;
-	const char* cmdEnd = strchr(cmdStart, ' ');
+	// Commands without params are followed by the CRLF.
+	const char* cmdEnd = StrUtils_FindFirst(cmdStart, " \r");
 
 	self->rawMsg = cmdEnd;
 
 	if (cmdEnd == NULL)
 	{
 		LOG_WARN(self->log,
-				"Invalid message: expected <SPACE> after <command>.");
+				"Invalid message: expected <SPACE> or <CR> after <command>.");
 
 		return false;
 	}
@@ -209,7 +213,7 @@ static bool IrcMsgParser_ParseCommand(IrcMsgParser* self)
 	return true;
 }
 
-static bool IrcMsgParser_ParseMiddleParam(IrcMsgParser* self)
+static bool IrcMsgParser_ParseMiddleParam(ParseState* self)
 {
 	const char* paramStart = self->rawMsg;
 	const char* paramEnd = StrUtils_FindFirst(paramStart, " \r");
@@ -229,20 +233,16 @@ static bool IrcMsgParser_ParseMiddleParam(IrcMsgParser* self)
 		return false;
 	}
 
-	char* param = StrUtils_CloneRange(paramStart, paramEnd);
-	if (param == NULL)
+	if (!IrcMsg_AddParam(self->msg, paramStart, paramEnd))
 	{
-		LOG_ERROR(self->log, "Failed to allocate parameter.");
+		LOG_WARN(self->log, "Invalid message: too long.");
 		return false;
 	}
 
-	self->msg->params[self->msg->paramCount] = param;
-	self->msg->paramCount += 1;
-
 	return true;
 }
 
-static bool IrcMsgParser_ParseTrailingParam(IrcMsgParser* self)
+static bool IrcMsgParser_ParseTrailingParam(ParseState* self)
 {
 	const char* paramStart = self->rawMsg + 1;
 	const char* paramEnd = strchr(paramStart, '\r');
@@ -262,20 +262,16 @@ static bool IrcMsgParser_ParseTrailingParam(IrcMsgParser* self)
 		return false;
 	}
 
-	char* param = StrUtils_CloneRange(paramStart, paramEnd);
-	if (param == NULL)
+	if (!IrcMsg_AddParam(self->msg, paramStart, paramEnd))
 	{
-		LOG_ERROR(self->log, "Failed to allocate parameter.");
+		LOG_WARN(self->log, "Invalid message: too long.");
 		return false;
 	}
 
-	self->msg->params[self->msg->paramCount] = param;
-	self->msg->paramCount += 1;
-
 	return true;
 }
 
-static bool IrcMsgParser_ParseParams(IrcMsgParser* self)
+static bool IrcMsgParser_ParseParams(ParseState* self)
 {
 	IrcMsgParser_ParseSpace(self);
 
@@ -309,7 +305,7 @@ static bool IrcMsgParser_ParseParams(IrcMsgParser* self)
 	return true;
 }
 
-static bool IrcMsgParser_ParseCRLF(IrcMsgParser* self)
+static bool IrcMsgParser_ParseCRLF(ParseState* self)
 {
 	if (*self->rawMsg != '\r')
 	{
@@ -328,7 +324,7 @@ static bool IrcMsgParser_ParseCRLF(IrcMsgParser* self)
 	return true;
 }
 
-static bool IrcMsgParser_ParseMessage(IrcMsgParser* self)
+static bool IrcMsgParser_ParseMessage(ParseState* self)
 {
 	if(!IrcMsgParser_ParsePrefix(self))
 	{
@@ -360,24 +356,27 @@ static bool IrcMsgParser_ParseMessage(IrcMsgParser* self)
 	return true;
 }
 
-IrcMsg* IrcMsgParser_Parse(IrcMsgParser* self, const char* rawMsg)
+IrcMsg* IrcMsgParser_Parse(const IrcMsgParser* self, const char* rawMsg)
 {
-	self->rawMsg = rawMsg;
+	ParseState state = {
+		.log = self->log,
+		.validator = self->validator,
+		.rawMsg = rawMsg,
+	};
 
-	self->msg = malloc(sizeof(IrcMsg));
-	if (self == NULL)
+	state.msg = IrcMsg_New();
+	if (state.msg == NULL)
 	{
 		LOG_ERROR(self->log, "Failed to allocate IrcMsg");
 		return NULL;
 	}
-	// Empty-initialize msg
-	*self->msg = (IrcMsg) { 0 };
 
-	if (!IrcMsgParser_ParseMessage(self))
+	if (!IrcMsgParser_ParseMessage(&state))
 	{
 		LOG_WARN(self->log, "Failed to parse <message>");
+		IrcMsg_Delete(state.msg);
 		return NULL;
 	}
 
-	return self->msg;
+	return state.msg;
 }
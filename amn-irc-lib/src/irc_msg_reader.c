@@ -9,45 +9,60 @@
 #include <sys/socket.h>
 #include <unistd.h>
 
-#include "irc_msg.h"
-
-#define BUF_SIZE IRC_MSG_SIZE
+#include "application.h"
 
 struct IrcMsgReader
 {
 	const Logger* log;
+	BufferPool* buffers;
 	int socket;
 
-	// Temporary buffer to read data from socket.
-	uint8_t readBuffer[BUF_SIZE];
-
-	// Buffer to assemble message.
-	// A reference is returned to the caller after each Read
-	// call, and is valid until the next Read or Delete call.
-	char msgBuffer[IRC_MSG_SIZE + 1];
-
-	// Position on the readBuffer where the next message starts.
-	// SIZE_MAX if the next message is not available.
-	size_t nextMsgStart;
-	// Length of next message data in the readBuffer.
-	size_t nextMsgLen;
+	// Borrowed between Fill and the last Next call, null otherwise.
+	uint8_t* buffer;
+	// Range of the buffer that hasn't been returned by Next yet.
+	size_t start;
+	size_t end;
+	// Next replaces the byte after the returned message with a NUL,
+	// and puts it back on the following call.
+	size_t savedPos;
+	uint8_t savedByte;
+
+	// Start of a message that didn't fit in the last read.
+	// Only allocated while there's one.
+	uint8_t* spill;
+	size_t spillLen;
+	// Skipping a message longer than IRC_MSG_SIZE until its CRLF.
+	bool discarding;
+	// Bytes read by the last Fill.
+	size_t lastReadLen;
 };
 
-static ssize_t FindMessageEnd(const uint8_t* buffer, ssize_t len);
+static ssize_t FindMessageEnd(const uint8_t* buffer, size_t len);
+static bool IrcMsgReader_Spill(IrcMsgReader* self);
+static void IrcMsgReader_Release(IrcMsgReader* self);
 
 
-IrcMsgReader* IrcMsgReader_New(const Logger* log, int socket)
+IrcMsgReader* IrcMsgReader_New(const Logger* log, BufferPool* buffers, int socket)
 {
+	if (BufferPool_BufferSize(buffers) < IRC_MSG_READER_BUFFER_SIZE)
+	{
+		LOG_ERROR(log, "IrcMsgReader buffers must be at least %d bytes.",
+				IRC_MSG_READER_BUFFER_SIZE);
+		return NULL;
+	}
+
 	IrcMsgReader* self = malloc(sizeof(IrcMsgReader));
 	if (self == NULL)
 	{
 		return NULL;
 	}
 
-	self->log = log;
-	self->socket = socket;
-	self->nextMsgStart = SIZE_MAX;
-	self->nextMsgLen = 0;
+	*self = (IrcMsgReader) {
+		.log = log,
+		.buffers = buffers,
+		.socket = socket,
+		.savedPos = SIZE_MAX,
+	};
 
 	return self;
 }
@@ -55,98 +70,203 @@ IrcMsgReader* IrcMsgReader_New(const Logger* log, int socket)
 
 void IrcMsgReader_Delete(IrcMsgReader* self)
 {
+	if (self == NULL)
+	{
+		return;
+	}
+
+	IrcMsgReader_Release(self);
+	free(self->spill);
 	free(self);
 }
 
 
-const char* IrcMsgReader_Read(IrcMsgReader* self)
+bool IrcMsgReader_Fill(IrcMsgReader* self)
 {
-	if (self->nextMsgStart != SIZE_MAX)
+	self->lastReadLen = 0;
+
+	if (self->buffer != NULL)
 	{
-		// Copy start of next message
-		memcpy(self->msgBuffer, self->readBuffer + self->nextMsgStart, self->nextMsgLen); 
+		// Messages from the last Fill weren't all taken, keep them.
+		return true;
 	}
 
-	size_t msgLen = 0;
-	ssize_t msgEnd = -1;
-	ssize_t readLen = 0;
-	do
+	LOG_DEBUG(self->log, "Waiting for mesage");
+
+	// Blocks without a timeout, shutdown wakes it up.
+	if (!Application_WaitReadable(self->socket, -1))
 	{
-		LOG_DEBUG(self->log, "Waiting for mesage");
+		return false;
+	}
 
-		readLen = read(self->socket, self->readBuffer, IRC_MSG_SIZE);
+	self->buffer = BufferPool_Borrow(self->buffers);
+	if (self->buffer == NULL)
+	{
+		LOG_ERROR(self->log, "Failed to borrow read buffer.");
+		return false;
+	}
 
-		if (readLen == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
-		{
-			return NULL;
-		}
+	// Read after the spilled bytes, leaving room for a NUL after the last message.
+	size_t readMax = BufferPool_BufferSize(self->buffers) - self->spillLen - 1;
+	ssize_t readLen = read(self->socket, self->buffer + self->spillLen, readMax);
 
-		LOG_DEBUG(self->log, "Received %zd bytes", readLen);
+	if (readLen <= 0)
+	{
+		IrcMsgReader_Release(self);
 
-		if(readLen == 0)
+		if (readLen == 0)
 		{
-			LOG_INFO(self->log, "EOF. Unexpected client disconnect.");
-			return NULL;
+			LOG_INFO(self->log, "EOF, the client disconnected.");
+			errno = 0;
 		}
-		else if (readLen == -1)
+		else if (errno == ECONNRESET)
+		{
+			LOG_INFO(self->log, "The client reset the connection.");
+		}
+		else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
 		{
 			LOG_ERROR(self->log, "Failed to read message.");
-			return NULL;
 		}
 
+		return false;
+	}
+
+	LOG_DEBUG(self->log, "Received %zd bytes", readLen);
+
+	// Put the start of the partial message back in front of the rest of it.
+	memcpy(self->buffer, self->spill, self->spillLen);
+	self->start = 0;
+	self->end = self->spillLen + (size_t) readLen;
+	self->lastReadLen = (size_t) readLen;
 
-		// Check if we have a CRLF in the readBuffer
-		ssize_t msgEnd = FindMessageEnd(self->readBuffer, readLen);
-		// Copy until the CRLF or the read length otherwise.
-		size_t copyLen = (size_t) (msgEnd != -1 ? msgEnd + 1 : readLen);
+	free(self->spill);
+	self->spill = NULL;
+	self->spillLen = 0;
+
+	return true;
+}
 
-		if (msgLen + copyLen <= IRC_MSG_SIZE)
+
+size_t IrcMsgReader_LastReadLen(const IrcMsgReader* self)
+{
+	return self->lastReadLen;
+}
+
+
+const char* IrcMsgReader_Next(IrcMsgReader* self)
+{
+	if (self->buffer == NULL)
+	{
+		return NULL;
+	}
+
+	if (self->savedPos != SIZE_MAX)
+	{
+		self->buffer[self->savedPos] = self->savedByte;
+		self->savedPos = SIZE_MAX;
+	}
+
+	while (true)
+	{
+		ssize_t msgEnd = FindMessageEnd(self->buffer + self->start, self->end - self->start);
+		if (msgEnd == -1)
 		{
-			memcpy(self->msgBuffer + msgLen, self->readBuffer, copyLen);
-			msgLen += copyLen;
+			if (!IrcMsgReader_Spill(self))
+			{
+				LOG_ERROR(self->log, "Failed to keep partial message.");
+			}
+
+			IrcMsgReader_Release(self);
+			return NULL;
 		}
-		else
+
+		size_t msgStart = self->start;
+		size_t msgLen = (size_t) msgEnd + 1;
+		self->start += msgLen;
+
+		if (self->discarding)
+		{
+			// End of the message that was too long.
+			self->discarding = false;
+			continue;
+		}
+
+		if (msgLen > IRC_MSG_SIZE)
 		{
 			LOG_ERROR(self->log, "Received message exceeds expected size");
+			continue;
+		}
 
-			// We will keep receiving the "too long message" bytes,
-			// and ignoring them, until we get a CRLF and can continue to
-			// the next message.
-			if (msgEnd != -1)
-			{
-				// Recover from too long message: Discard long message, and start
-				// assembling the next one.
-				size_t nextMsgStart = (size_t) msgEnd + 1;
-				size_t nextMsgLen = (size_t) readLen - nextMsgStart;
+		// There's always a byte after end for this.
+		self->savedPos = self->start;
+		self->savedByte = self->buffer[self->savedPos];
+		self->buffer[self->savedPos] = '\0';
 
-				memcpy(self->msgBuffer, self->readBuffer + nextMsgStart, nextMsgLen);
+		return (const char*) self->buffer + msgStart;
+	}
+}
 
-				// Clear msgEnd flag, as we discarded that message.
-				msgEnd = -1;
-			}
-		}
+
+/**
+ * Moves the unfinished message at the end of the buffer to the spill buffer.
+ */
+static bool IrcMsgReader_Spill(IrcMsgReader* self)
+{
+	size_t len = self->end - self->start;
+
+	if (!self->discarding && len >= IRC_MSG_SIZE)
+	{
+		// No CRLF where the message should have ended, skip it.
+		LOG_ERROR(self->log, "Received message exceeds expected size");
+		self->discarding = true;
+	}
+
+	if (self->discarding)
+	{
+		// Only keep a trailing CR, in case the LF ending the message comes next.
+		bool endsInCr = len > 0 && self->buffer[self->end - 1] == '\r';
+		self->start = self->end - (endsInCr ? 1 : 0);
+		len = endsInCr ? 1 : 0;
+	}
+
+	if (len == 0)
+	{
+		return true;
+	}
+
+	self->spill = malloc(len);
+	if (self->spill == NULL)
+	{
+		return false;
 	}
-	while (msgEnd != -1);
 
-	// There may still be bytes from the next message on the readBuffer.
-	// Store the information needed to assemble that next call.
-	self->nextMsgStart = (size_t) msgEnd + 1;
-	self->nextMsgLen = (size_t) readLen - self->nextMsgStart;
+	memcpy(self->spill, self->buffer + self->start, len);
+	self->spillLen = len;
 
-	// Set delimiter. There's one extra byte in the array size for it if needed.
-	self->msgBuffer[msgLen] = '\0';
-	// Return message, this will be valid until the next Read or Delete call.
-	return self->msgBuffer;
+	return true;
+}
+
+
+static void IrcMsgReader_Release(IrcMsgReader* self)
+{
+	BufferPool_Return(self->buffers, self->buffer);
+	self->buffer = NULL;
+	self->start = 0;
+	self->end = 0;
+	self->savedPos = SIZE_MAX;
 }
 
 
-static ssize_t FindMessageEnd(const uint8_t* buffer, ssize_t len)
+/**
+ * Returns the index of the LF in the first CRLF, or -1 if there's none.
+ */
+static ssize_t FindMessageEnd(const uint8_t* buffer, size_t len)
 {
-	for (ssize_t i = 0; i + 1 < len; i++)
+	for (size_t i = 0; i + 1 < len; i++)
 	{
 		if (buffer[i] == '\r' && buffer[i + 1] == '\n')
 		{
-			return i + 1;
+			return (ssize_t) i + 1;
 		}
 	}
 
@@ -33,6 +33,7 @@ void IrcMsgUnparser_Delete(IrcMsgUnparser* self)
 
 static bool WriteChar(IrcMsgUnparser* self, char character);
 static bool WriteString(IrcMsgUnparser* self, const char* string);
+static bool WriteRange(IrcMsgUnparser* self, const char* string, size_t len);
 static bool WriteUInt32(IrcMsgUnparser* self, uint32_t number);
 
 static bool UnparsePrefix(IrcMsgUnparser* self);
@@ -90,8 +91,11 @@ static bool WriteChar(IrcMsgUnparser* self, char character)
 
 static bool WriteString(IrcMsgUnparser* self, const char* string)
 {
-	size_t len = strlen(string);
+	return WriteRange(self, string, strlen(string));
+}
 
+static bool WriteRange(IrcMsgUnparser* self, const char* string, size_t len)
+{
 	if (self->msgLen + len > IRC_MSG_SIZE)
 	{
 		LOG_WARN(self->log, "Message exceeds size limit. Limit: %zu", IRC_MSG_SIZE);
@@ -133,7 +137,7 @@ static bool WriteUInt32(IrcMsgUnparser* self, uint32_t number)
 
 static bool UnparsePrefix(IrcMsgUnparser* self)
 {
-	if (self->msg->prefix.origin == NULL)
+	if (IrcMsg_Origin(self->msg) == NULL)
 	{
 		return true;
 	}
@@ -168,12 +172,12 @@ static bool UnparsePrefix(IrcMsgUnparser* self)
 
 static bool UnparsePrefixOrigin(IrcMsgUnparser* self)
 {
-	return WriteString(self, self->msg->prefix.origin);
+	return WriteString(self, IrcMsg_Origin(self->msg));
 }
 
 static bool UnparsePrefixUsername(IrcMsgUnparser* self)
 {
-	if (self->msg->prefix.username == NULL)
+	if (IrcMsg_Username(self->msg) == NULL)
 	{
 		return true;
 	}
@@ -183,7 +187,7 @@ static bool UnparsePrefixUsername(IrcMsgUnparser* self)
 		return false;
 	}
 
-	if (!WriteString(self, self->msg->prefix.username))
+	if (!WriteString(self, IrcMsg_Username(self->msg)))
 	{
 		return false;
 	}
@@ -193,7 +197,7 @@ static bool UnparsePrefixUsername(IrcMsgUnparser* self)
 
 static bool UnparsePrefixHostname(IrcMsgUnparser* self)
 {
-	if (self->msg->prefix.hostname == NULL)
+	if (IrcMsg_Hostname(self->msg) == NULL)
 	{
 		return true;
 	}
@@ -203,7 +207,7 @@ static bool UnparsePrefixHostname(IrcMsgUnparser* self)
 		return false;
 	}
 
-	if (!WriteString(self, self->msg->prefix.hostname))
+	if (!WriteString(self, IrcMsg_Hostname(self->msg)))
 	{
 		return false;
 	}
@@ -215,7 +219,7 @@ static bool UnparseCommand(IrcMsgUnparser* self)
 {
 	if (self->msg->cmd != IrcCmdType_Null)
 	{
-		const char* cmdStr = IRC_CMD_TYPE_STRS[self->msg->cmd];
+		const char* cmdStr = IRC_CMD_TYPE_INFOS[self->msg->cmd].name;
 
 		if (!WriteString(self, cmdStr))
 		{
@@ -252,7 +256,7 @@ static bool UnparseParams(IrcMsgUnparser* self)
 			return false;	
 		}
 
-		if (!WriteString(self, self->msg->params[i]))
+		if (!WriteRange(self, IrcMsg_Param(self->msg, i), IrcMsg_ParamLen(self->msg, i)))
 		{
 			return false;
 		}
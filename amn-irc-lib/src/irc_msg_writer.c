@@ -1,5 +1,8 @@
 #include "irc_msg_writer.h"
 
+#include "obj_pool.h"
+#include "probes.h"
+
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,7 +17,7 @@ struct IrcMsgWriter
 
 IrcMsgWriter* IrcMsgWriter_New(const Logger* log, int socket)
 {
-	IrcMsgWriter* self = malloc(sizeof(IrcMsgWriter));
+	IrcMsgWriter* self = ObjPool_Alloc(sizeof(IrcMsgWriter));
 	if (self == NULL) {
 		LOG_ERROR(log, "Failure to allocate IrcMsgWriter");
 		return NULL;
@@ -28,13 +31,16 @@ IrcMsgWriter* IrcMsgWriter_New(const Logger* log, int socket)
 
 void IrcMsgWriter_Delete(IrcMsgWriter* self)
 {
-	free(self);
+	ObjPool_Free(self);
 }
 
 bool IrcMsgWriter_Write(IrcMsgWriter* self, const char* msg)
 {
-	size_t msgLen = strlen(msg);
+	return IrcMsgWriter_WriteLen(self, msg, strlen(msg));
+}
 
+bool IrcMsgWriter_WriteLen(IrcMsgWriter* self, const char* msg, size_t msgLen)
+{
 	size_t totalBytesWritten = 0;
 	do
 	{
@@ -50,6 +56,7 @@ bool IrcMsgWriter_Write(IrcMsgWriter* self, const char* msg)
 				LOG_ERROR(self->log, "Failure while writing message to socket");
 			}
 
+			AMN_PROBE4(write_done, self->socket, msg, totalBytesWritten, 0);
 			return false;
 		}
 
@@ -57,5 +64,7 @@ bool IrcMsgWriter_Write(IrcMsgWriter* self, const char* msg)
 	}
 	while (totalBytesWritten < msgLen);
 
+	AMN_PROBE4(write_done, self->socket, msg, totalBytesWritten, 1);
+
 	return true;
 }
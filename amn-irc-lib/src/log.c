@@ -1,7 +1,14 @@
 #include "log.h"
 
+#include "log_file.h"
+#include "log_format.h"
+#include "log_ring.h"
+#include "str_utils.h"
+
+#include <ctype.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <stdalign.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -9,35 +16,108 @@
 #include <string.h>
 #include <time.h>
 
+#include <pthread.h>
+#include <unistd.h>
 
-const char* TIME_PATTERN = "%H:%M:%S";
-const size_t MAX_TIME_BYTES = 128;
 
-const size_t MAX_MSG_BYTES = 1024;
+const char* TIME_PATTERN = "%H:%M:%S";
+#define MAX_TIME_BYTES 128
 
-const char* LOG_PATTERN = "[%s][%s] %s:%"PRIu32" - %s - %s\n%s%s%s";
+#define MAX_MSG_BYTES 1024
 
-const char* LOG_LEVEL_STRS[] = {
-	"\033[38;2;⟨164⟩;⟨164⟩;⟨164⟩mDEBUG\033[0m",
-	"INFO",
-	"\033[38;2;⟨255⟩;⟨200⟩;⟨0⟩mWARN\033[0m",
-	"\033[38;2;⟨240⟩;⟨20⟩;⟨20⟩mERROR\033[0m" };
+static const char* LEVEL_NAMES[] = { "debug", "info", "warn", "error" };
+static const char* FULL_POLICY_NAMES[] = { "drop", "block" };
 
-const size_t ERRNO_MSG_BYTES = 256;
+// Lines are batched into writes of up to this many bytes.
+#define WRITE_BATCH_BYTES (64 * 1024)
+// How long the writer sleeps when there's nothing to write.
+#define WRITER_IDLE_NS (10 * 1000 * 1000)
+// How long a blocked producer waits before checking for room again.
+#define BLOCKED_WAIT_NS (100 * 1000)
+// How many BLOCKED_WAIT_NS Logger_WriteFatal waits for the writer.
+#define FATAL_WAIT_TRIES 1000
 
-const char* SRC_PATH_PREFIX = "amn-irc-";
+_Atomic uint32_t LogLevelsVersion = 1;
 
+// Site ids start at 1, zero means unassigned.
+static _Atomic uint32_t NextSiteId = 1;
 
-static const char* LogLevel_ToString(LogLevel level)
+typedef struct ModuleLevel
 {
-	return LOG_LEVEL_STRS[level];
+	char* module;
+	LogLevel level;
 }
+ModuleLevel;
 
 struct Logger {
 	FILE** logFiles;
 	size_t logFileCount;
+
+	// Protects the levels, read when a call site resolves its level.
+	pthread_mutex_t levelsMutex;
+	LogLevel level;
+	ModuleLevel* moduleLevels;
+	size_t moduleLevelCount;
+
+	// One per thread that logged. Prepended to under ringsMutex.
+	_Atomic(LogRing*) rings;
+	pthread_mutex_t ringsMutex;
+	_Atomic LogFullPolicy fullPolicy;
+	// Messages dropped because a ring couldn't be allocated.
+	_Atomic uint64_t ringlessDropped;
+	// Replaces the log files once open.
+	_Atomic(LogFile*) binaryFile;
+
+	pthread_t writer;
+	// Wakes the writer before its idle timeout.
+	pthread_mutex_t wakeMutex;
+	pthread_cond_t wakeCond;
+	atomic_bool stopping;
+	// Held by whoever pops the rings, the writer or Logger_WriteFatal.
+	atomic_flag consuming;
+
+	// Writer only.
+	char batch[WRITE_BATCH_BYTES];
+	size_t batchLen;
+	uint64_t reportedRinglessDropped;
+	// Formatted time of cachedSecond, so it's formatted once per second.
+	time_t cachedSecond;
+	char cachedTime[MAX_TIME_BYTES];
+	// Indexed by site id, whether the site was written to the binary file.
+	bool* writtenSites;
+	size_t writtenSiteCount;
 };
 
+// Marks rings unowned when their thread exits.
+static pthread_key_t ringKey;
+static pthread_once_t ringKeyOnce = PTHREAD_ONCE_INIT;
+
+static _Thread_local LogRing* threadRing = NULL;
+static _Thread_local const Logger* threadRingLogger = NULL;
+
+static bool ParseModuleLevels(const char* spec, ModuleLevel** levels, size_t* count);
+static void FreeModuleLevels(ModuleLevel* levels, size_t count);
+static void BumpLevelsVersion(void);
+
+static LogRing* Logger_ThreadRing(Logger* self);
+static void CreateRingKey(void);
+static void ReleaseRing(void* ring);
+static void Logger_WakeWriter(Logger* self);
+
+static uint32_t LogSite_Id(LogSite* self);
+
+static void* Logger_RunWriter(void* arg);
+static size_t Logger_WriteRecords(Logger* self, bool fatal);
+static void Logger_WriteDrops(Logger* self);
+static void Logger_WriteRecord(Logger* self, const LogRecord* record);
+static void Logger_WriteFatalRecord(Logger* self, const LogRecord* record);
+static void Logger_WriteBinary(Logger* self, LogFile* file, const LogRecord* record);
+static bool Logger_WriteBinarySite(Logger* self, LogFile* file, const LogRecord* record);
+static void Logger_AppendLine(Logger* self, const struct timespec* time, LogLevel level,
+		const char* file, uint32_t line, const char* function,
+		const char* text, size_t textLen, int errnum);
+static void Logger_Flush(Logger* self);
+
 Logger* Logger_Create(FILE* *const logFiles, size_t logFileCount)
 {
 	Logger* self = malloc(sizeof(Logger));
@@ -46,6 +126,21 @@ Logger* Logger_Create(FILE* *const logFiles, size_t logFileCount)
 		return NULL;
 	}
 
+	self->level = LogLevel_Debug;
+	self->moduleLevels = NULL;
+	self->moduleLevelCount = 0;
+	atomic_init(&self->rings, NULL);
+	atomic_init(&self->fullPolicy, LogFullPolicy_Drop);
+	atomic_init(&self->ringlessDropped, 0);
+	atomic_init(&self->binaryFile, NULL);
+	atomic_init(&self->stopping, false);
+	atomic_flag_clear(&self->consuming);
+	self->batchLen = 0;
+	self->reportedRinglessDropped = 0;
+	self->cachedSecond = (time_t) -1;
+	self->writtenSites = NULL;
+	self->writtenSiteCount = 0;
+
 	self->logFiles = malloc(sizeof(FILE*) * logFileCount);
 	if (self->logFiles == NULL)
 	{
@@ -55,8 +150,55 @@ Logger* Logger_Create(FILE* *const logFiles, size_t logFileCount)
 
 	memcpy(self->logFiles, logFiles, sizeof(FILE*) * logFileCount);
 	self->logFileCount = logFileCount;
+
+	// The writer bypasses stdio, anything buffered must come first.
+	for (size_t i = 0; i < logFileCount; i++)
+	{
+		fflush(logFiles[i]);
+	}
+
+	if (pthread_mutex_init(&self->levelsMutex, NULL) != 0)
+	{
+		goto levelsMutexError;
+	}
+
+	if (pthread_mutex_init(&self->ringsMutex, NULL) != 0)
+	{
+		goto ringsMutexError;
+	}
+
+	if (pthread_mutex_init(&self->wakeMutex, NULL) != 0)
+	{
+		goto wakeMutexError;
+	}
+
+	if (pthread_cond_init(&self->wakeCond, NULL) != 0)
+	{
+		goto wakeCondError;
+	}
+
+	if (pthread_create(&self->writer, NULL, Logger_RunWriter, self) != 0)
+	{
+		goto writerError;
+	}
+
+	// Sites may have cached the levels of a previous logger.
+	BumpLevelsVersion();
 	
 	return self;
+
+writerError:
+	pthread_cond_destroy(&self->wakeCond);
+wakeCondError:
+	pthread_mutex_destroy(&self->wakeMutex);
+wakeMutexError:
+	pthread_mutex_destroy(&self->ringsMutex);
+ringsMutexError:
+	pthread_mutex_destroy(&self->levelsMutex);
+levelsMutexError:
+	free(self->logFiles);
+	free(self);
+	return NULL;
 }
 
 void Logger_Destroy(Logger* self)
@@ -66,19 +208,295 @@ void Logger_Destroy(Logger* self)
 		return;
 	}
 
+	atomic_store(&self->stopping, true);
+	Logger_WakeWriter(self);
+	pthread_join(self->writer, NULL);
+
+	LogRing* ring = atomic_load(&self->rings);
+	while (ring != NULL)
+	{
+		LogRing* next = ring->next;
+		LogRing_Delete(ring);
+		ring = next;
+	}
+
+	if (threadRingLogger == self)
+	{
+		threadRing = NULL;
+		threadRingLogger = NULL;
+	}
+
+	LogFile_Close(atomic_load(&self->binaryFile));
+	free(self->writtenSites);
+	FreeModuleLevels(self->moduleLevels, self->moduleLevelCount);
+	pthread_cond_destroy(&self->wakeCond);
+	pthread_mutex_destroy(&self->wakeMutex);
+	pthread_mutex_destroy(&self->ringsMutex);
+	pthread_mutex_destroy(&self->levelsMutex);
 	free(self->logFiles);
 	free(self);
 }
 
-static const char* getRelativePathForLog(const char* file)
+bool Logger_OpenBinaryFile(Logger* self, const char* path)
 {
-	const char* substr = strstr(file, SRC_PATH_PREFIX);
-	
-	return substr != NULL ? substr : file;
+	if (atomic_load(&self->binaryFile) != NULL)
+	{
+		return false;
+	}
+
+	LogFile* file = LogFile_Open(path);
+	if (file == NULL)
+	{
+		return false;
+	}
+
+	LogFile* expected = NULL;
+	if (!atomic_compare_exchange_strong(&self->binaryFile, &expected, file))
+	{
+		LogFile_Close(file);
+		return false;
+	}
+
+	return true;
+}
+
+bool LogFullPolicy_Parse(const char* str, LogFullPolicy* policy)
+{
+	for (size_t i = 0; i < sizeof(FULL_POLICY_NAMES) / sizeof(FULL_POLICY_NAMES[0]); i++)
+	{
+		if (StrUtils_Equals(FULL_POLICY_NAMES[i], str))
+		{
+			*policy = (LogFullPolicy) i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void Logger_SetFullPolicy(Logger* self, LogFullPolicy policy)
+{
+	atomic_store(&self->fullPolicy, policy);
+}
+
+uint64_t Logger_DroppedCount(const Logger* self)
+{
+	uint64_t dropped = atomic_load(&self->ringlessDropped);
+
+	for (LogRing* ring = atomic_load(&self->rings); ring != NULL; ring = ring->next)
+	{
+		dropped += atomic_load(&ring->dropped);
+	}
+
+	return dropped;
+}
+
+bool LogLevel_Parse(const char* str, LogLevel* level)
+{
+	for (size_t i = 0; i < sizeof(LEVEL_NAMES) / sizeof(LEVEL_NAMES[0]); i++)
+	{
+		if (StrUtils_Equals(LEVEL_NAMES[i], str))
+		{
+			*level = (LogLevel) i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void Logger_SetLevel(Logger* self, LogLevel level)
+{
+	pthread_mutex_lock(&self->levelsMutex);
+	self->level = level;
+	pthread_mutex_unlock(&self->levelsMutex);
+
+	BumpLevelsVersion();
+}
+
+bool Logger_SetModuleLevels(Logger* self, const char* spec)
+{
+	ModuleLevel* levels;
+	size_t count;
+	if (!ParseModuleLevels(spec, &levels, &count))
+	{
+		return false;
+	}
+
+	pthread_mutex_lock(&self->levelsMutex);
+	ModuleLevel* previous = self->moduleLevels;
+	size_t previousCount = self->moduleLevelCount;
+	self->moduleLevels = levels;
+	self->moduleLevelCount = count;
+	pthread_mutex_unlock(&self->levelsMutex);
+
+	FreeModuleLevels(previous, previousCount);
+	BumpLevelsVersion();
+
+	return true;
+}
+
+bool Logger_ValidModuleLevels(const char* spec)
+{
+	ModuleLevel* levels;
+	size_t count;
+	if (!ParseModuleLevels(spec, &levels, &count))
+	{
+		return false;
+	}
+
+	FreeModuleLevels(levels, count);
+	return true;
+}
+
+uint32_t LogSite_Resolve(LogSite* site, const Logger* logger, const char* file)
+{
+	// Read before the levels, so a concurrent change makes the site resolve again.
+	uint32_t version = atomic_load_explicit(&LogLevelsVersion, memory_order_acquire);
+
+	const char* module = strrchr(file, '/');
+	module = module != NULL ? module + 1 : file;
+	size_t moduleLen = strcspn(module, ".");
+
+	// Logger_Log only takes a const logger, the mutex is the only mutable part.
+	pthread_mutex_t* mutex = (pthread_mutex_t*) &logger->levelsMutex;
+	pthread_mutex_lock(mutex);
+
+	LogLevel level = logger->level;
+	for (size_t i = 0; i < logger->moduleLevelCount; i++)
+	{
+		const char* name = logger->moduleLevels[i].module;
+		if (strlen(name) == moduleLen && strncmp(name, module, moduleLen) == 0)
+		{
+			level = logger->moduleLevels[i].level;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(mutex);
+
+	uint32_t state = version << LOG_SITE_LEVEL_BITS | (uint32_t) level;
+	atomic_store_explicit(&site->state, state, memory_order_relaxed);
+
+	return state;
+}
+
+/**
+ * Parses "module=level,..." into a new array, empty for a null or blank spec.
+ */
+static bool ParseModuleLevels(const char* spec, ModuleLevel** levels, size_t* count)
+{
+	*levels = NULL;
+	*count = 0;
+
+	const char* item = spec != NULL ? spec : "";
+	while (true)
+	{
+		const char* itemEnd = item + strcspn(item, ",");
+
+		// Trims the item, then splits it at '='.
+		while (item < itemEnd && isspace((unsigned char) *item))
+		{
+			item++;
+		}
+
+		const char* equals = memchr(item, '=', (size_t) (itemEnd - item));
+		if (equals == NULL && item == itemEnd && *itemEnd == '\0' && *count == 0)
+		{
+			// Blank spec.
+			return true;
+		}
+
+		if (equals == NULL)
+		{
+			goto error;
+		}
+
+		const char* moduleEnd = equals;
+		while (moduleEnd > item && isspace((unsigned char) moduleEnd[-1]))
+		{
+			moduleEnd--;
+		}
+
+		const char* levelStart = equals + 1;
+		while (levelStart < itemEnd && isspace((unsigned char) *levelStart))
+		{
+			levelStart++;
+		}
+
+		const char* levelEnd = itemEnd;
+		while (levelEnd > levelStart && isspace((unsigned char) levelEnd[-1]))
+		{
+			levelEnd--;
+		}
+
+		char levelName[8];
+		size_t levelLen = (size_t) (levelEnd - levelStart);
+		LogLevel level;
+		if (moduleEnd == item || levelLen >= sizeof(levelName))
+		{
+			goto error;
+		}
+
+		memcpy(levelName, levelStart, levelLen);
+		levelName[levelLen] = '\0';
+		if (!LogLevel_Parse(levelName, &level))
+		{
+			goto error;
+		}
+
+		ModuleLevel* grown = realloc(*levels, sizeof(ModuleLevel) * (*count + 1));
+		if (grown == NULL)
+		{
+			goto error;
+		}
+		*levels = grown;
+
+		(*levels)[*count] = (ModuleLevel) {
+			.module = StrUtils_CloneRange(item, moduleEnd),
+			.level = level,
+		};
+		if ((*levels)[*count].module == NULL)
+		{
+			goto error;
+		}
+		(*count)++;
+
+		if (*itemEnd == '\0')
+		{
+			return true;
+		}
+
+		item = itemEnd + 1;
+	}
+
+error:
+	FreeModuleLevels(*levels, *count);
+	*levels = NULL;
+	*count = 0;
+	return false;
+}
+
+static void FreeModuleLevels(ModuleLevel* levels, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		free(levels[i].module);
+	}
+
+	free(levels);
+}
+
+static void BumpLevelsVersion(void)
+{
+	// Past 2^30 changes versions no longer fit the site state, and sites
+	// resolve on every call. Still correct, and levels don't change that often.
+	atomic_fetch_add_explicit(&LogLevelsVersion, 1, memory_order_release);
 }
 
 void Logger_Log(
-	const Logger* self,
+	const Logger* constSelf,
+	LogSite* site,
 	LogLevel level, 
 	const char* function,
 	const char* file,
@@ -86,42 +504,488 @@ void Logger_Log(
 	const char* format,
 	...)
 {
-   (void) self;
+	// Callers only have a const logger, rings are its internal state.
+	Logger* self = (Logger*) constSelf;
 
-	bool hasErrno = errno != 0;
-	// Format errno
-	char errorMsg[ERRNO_MSG_BYTES];
-	bool errnoOk = !hasErrno || strerror_r(errno, errorMsg, ERRNO_MSG_BYTES) == 0;
+	int errnum = errno;
 
-	// Format message
+	struct timespec time;
+	clock_gettime(CLOCK_REALTIME, &time);
+
+	// Formatting is left to the writer, or to amn-irc-logdump.
 	va_list args;
 	va_start(args, format);
 
-	char message[MAX_MSG_BYTES];
-	bool messageOk = vsnprintf(message, MAX_MSG_BYTES, format, args) >= 0;
+	unsigned char packed[LOG_MAX_ARGS_BYTES];
+	size_t packedLen = LogArgs_Pack(packed, LOG_MAX_ARGS_BYTES, format, args);
 
 	va_end(args);
 
-	// Format time
-	time_t currentTime = time(NULL);
-	struct tm localTime;
-	bool timeOk = localtime_r(&currentTime, &localTime) != NULL;
+	LogRing* ring = Logger_ThreadRing(self);
+	if (ring == NULL)
+	{
+		atomic_fetch_add_explicit(&self->ringlessDropped, 1, memory_order_relaxed);
+		errno = 0;
+		return;
+	}
+
+	LogRecord* record;
+	while ((record = LogRing_Reserve(ring, packedLen)) == NULL)
+	{
+		if (atomic_load_explicit(&self->fullPolicy, memory_order_relaxed) == LogFullPolicy_Drop)
+		{
+			atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+			errno = 0;
+			return;
+		}
 
-	char timeString[MAX_TIME_BYTES];
-	timeOk = timeOk && strftime(timeString, MAX_TIME_BYTES, TIME_PATTERN, &localTime) != 0;
+		Logger_WakeWriter(self);
+		nanosleep(&(struct timespec) { .tv_nsec = BLOCKED_WAIT_NS }, NULL);
+	}
 
-	for (size_t i = 0; i < self->logFileCount; i++)
+	record->level = level;
+	record->line = line;
+	record->errnum = errnum;
+	record->time = time;
+	record->siteId = LogSite_Id(site);
+	record->function = function;
+	record->file = file;
+	record->format = format;
+	memcpy(record->args, packed, packedLen);
+
+	LogRing_Commit(ring);
+
+	if (LogRing_HalfFull(ring))
 	{
-		fprintf(self->logFiles[i], LOG_PATTERN,
-				timeOk ? timeString : "time fmt err",
-				LogLevel_ToString(level),
-				getRelativePathForLog(file),
-				line, function,
-				messageOk ? message : "msg fmt err",
-				hasErrno ? "\tErrno: " : "",
-				hasErrno ? (errnoOk ? errorMsg : "errno fmt err") : "",
-				hasErrno ? "\n" : "");
+		Logger_WakeWriter(self);
 	}
 
 	errno = 0;
 }
+
+/**
+ * The id of site, assigned on first use.
+ */
+static uint32_t LogSite_Id(LogSite* self)
+{
+	uint32_t id = atomic_load_explicit(&self->id, memory_order_relaxed);
+	if (id != 0)
+	{
+		return id;
+	}
+
+	// Threads racing on a new site agree on the first id stored, others are unused.
+	uint32_t expected = 0;
+	id = atomic_fetch_add_explicit(&NextSiteId, 1, memory_order_relaxed);
+	if (!atomic_compare_exchange_strong_explicit(&self->id, &expected, id,
+				memory_order_relaxed, memory_order_relaxed))
+	{
+		id = expected;
+	}
+
+	return id;
+}
+
+/**
+ * The ring of the calling thread, adopting one left by an exited thread or
+ * creating it on first use. Null on failure.
+ */
+static LogRing* Logger_ThreadRing(Logger* self)
+{
+	if (threadRingLogger == self)
+	{
+		return threadRing;
+	}
+
+	if (pthread_once(&ringKeyOnce, CreateRingKey) != 0
+			|| pthread_mutex_lock(&self->ringsMutex) != 0)
+	{
+		return NULL;
+	}
+
+	LogRing* ring = atomic_load(&self->rings);
+	while (ring != NULL && !atomic_compare_exchange_strong(&ring->owned, &(bool) { false }, true))
+	{
+		ring = ring->next;
+	}
+
+	if (ring == NULL)
+	{
+		ring = LogRing_New();
+		if (ring != NULL)
+		{
+			ring->next = atomic_load(&self->rings);
+			atomic_store_explicit(&self->rings, ring, memory_order_release);
+		}
+	}
+
+	pthread_mutex_unlock(&self->ringsMutex);
+
+	if (ring == NULL)
+	{
+		return NULL;
+	}
+
+	// Without the destructor the ring is never adopted, but still works.
+	pthread_setspecific(ringKey, ring);
+	threadRing = ring;
+	threadRingLogger = self;
+
+	return ring;
+}
+
+static void CreateRingKey(void)
+{
+	pthread_key_create(&ringKey, ReleaseRing);
+}
+
+/**
+ * Called when a thread exits.
+ */
+static void ReleaseRing(void* ring)
+{
+	atomic_store(&((LogRing*) ring)->owned, false);
+	threadRing = NULL;
+	threadRingLogger = NULL;
+}
+
+static void Logger_WakeWriter(Logger* self)
+{
+	pthread_mutex_lock(&self->wakeMutex);
+	pthread_cond_signal(&self->wakeCond);
+	pthread_mutex_unlock(&self->wakeMutex);
+}
+
+static void* Logger_RunWriter(void* arg)
+{
+	Logger* self = arg;
+
+	while (true)
+	{
+		// Read first, so every message logged before stopping gets written.
+		bool stopping = atomic_load(&self->stopping);
+
+		// Only held by a fatal signal handler otherwise, which ends the process.
+		while (atomic_flag_test_and_set_explicit(&self->consuming, memory_order_acquire))
+		{
+			nanosleep(&(struct timespec) { .tv_nsec = BLOCKED_WAIT_NS }, NULL);
+		}
+
+		size_t written = Logger_WriteRecords(self, false);
+		Logger_WriteDrops(self);
+		Logger_Flush(self);
+
+		atomic_flag_clear_explicit(&self->consuming, memory_order_release);
+
+		if (written > 0)
+		{
+			continue;
+		}
+
+		if (stopping)
+		{
+			break;
+		}
+
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += WRITER_IDLE_NS;
+		if (deadline.tv_nsec >= 1000000000)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+
+		pthread_mutex_lock(&self->wakeMutex);
+		if (!atomic_load(&self->stopping))
+		{
+			pthread_cond_timedwait(&self->wakeCond, &self->wakeMutex, &deadline);
+		}
+		pthread_mutex_unlock(&self->wakeMutex);
+	}
+
+	return NULL;
+}
+
+bool Logger_WriteFatal(Logger* self)
+{
+	// The writer only holds it for one batch, unless it's the thread that crashed.
+	for (int i = 0; atomic_flag_test_and_set_explicit(&self->consuming, memory_order_acquire); i++)
+	{
+		if (i == FATAL_WAIT_TRIES)
+		{
+			return false;
+		}
+
+		nanosleep(&(struct timespec) { .tv_nsec = BLOCKED_WAIT_NS }, NULL);
+	}
+
+	// Anything left in the batch was flushed before the writer let go.
+	Logger_WriteRecords(self, true);
+	Logger_Flush(self);
+
+	// Kept, the writer must not pop the rings in the middle of a crash.
+	return true;
+}
+
+/**
+ * Writes every record in the rings, oldest first across rings.
+ * @param fatal		Whether to write them with Logger_WriteFatalRecord.
+ * @return How many records were written.
+ */
+static size_t Logger_WriteRecords(Logger* self, bool fatal)
+{
+	LogRing* rings = atomic_load_explicit(&self->rings, memory_order_acquire);
+	size_t written = 0;
+
+	while (true)
+	{
+		LogRing* oldestRing = NULL;
+		LogRecord* oldest = NULL;
+
+		for (LogRing* ring = rings; ring != NULL; ring = ring->next)
+		{
+			LogRecord* record = LogRing_Peek(ring);
+			if (record != NULL && (oldest == NULL
+						|| record->time.tv_sec < oldest->time.tv_sec
+						|| (record->time.tv_sec == oldest->time.tv_sec
+							&& record->time.tv_nsec < oldest->time.tv_nsec)))
+			{
+				oldestRing = ring;
+				oldest = record;
+			}
+		}
+
+		if (oldest == NULL)
+		{
+			return written;
+		}
+
+		if (fatal)
+		{
+			Logger_WriteFatalRecord(self, oldest);
+		}
+		else
+		{
+			Logger_WriteRecord(self, oldest);
+		}
+		LogRing_Pop(oldestRing, oldest);
+		written++;
+	}
+}
+
+/**
+ * Reports messages dropped since the last call.
+ */
+static void Logger_WriteDrops(Logger* self)
+{
+	uint64_t dropped = atomic_load(&self->ringlessDropped) - self->reportedRinglessDropped;
+	self->reportedRinglessDropped += dropped;
+
+	for (LogRing* ring = atomic_load(&self->rings); ring != NULL; ring = ring->next)
+	{
+		uint64_t ringDropped = atomic_load(&ring->dropped);
+		dropped += ringDropped - ring->reportedDropped;
+		ring->reportedDropped = ringDropped;
+	}
+
+	if (dropped == 0)
+	{
+		return;
+	}
+
+	static LogSite site;
+	alignas(LogRecord) unsigned char buffer[sizeof(LogRecord) + sizeof(dropped)];
+	LogRecord* record = (LogRecord*) buffer;
+
+	*record = (LogRecord) {
+		.level = LogLevel_Warn,
+		.line = __LINE__,
+		.siteId = LogSite_Id(&site),
+		.function = __func__,
+		.file = __FILE__,
+		.format = "Dropped %"PRIu64" log messages.",
+		// Packed like LogArgs_Pack does.
+		.argsLen = sizeof(dropped),
+	};
+	memcpy(record->args, &dropped, sizeof(dropped));
+	clock_gettime(CLOCK_REALTIME, &record->time);
+
+	Logger_WriteRecord(self, record);
+}
+
+/**
+ * Writes record to the binary file if open, else formats it into the batch.
+ */
+static void Logger_WriteRecord(Logger* self, const LogRecord* record)
+{
+	LogFile* binaryFile = atomic_load_explicit(&self->binaryFile, memory_order_acquire);
+	if (binaryFile != NULL)
+	{
+		Logger_WriteBinary(self, binaryFile, record);
+		return;
+	}
+
+	char text[MAX_MSG_BYTES];
+	size_t textLen = LogArgs_Format(text, MAX_MSG_BYTES, record->format,
+			record->args, record->argsLen);
+
+	Logger_AppendLine(self, &record->time, record->level, record->file, record->line,
+			record->function, text, textLen, record->errnum);
+}
+
+/**
+ * Formats record into the batch, async-signal-safely. The binary file is
+ * skipped, as appending to it may allocate.
+ */
+static void Logger_WriteFatalRecord(Logger* self, const LogRecord* record)
+{
+	char text[MAX_MSG_BYTES];
+	size_t textLen = LogArgs_FormatSafe(text, MAX_MSG_BYTES, record->format,
+			record->args, record->argsLen);
+
+	if (WRITE_BATCH_BYTES - self->batchLen < LOG_MAX_LINE_BYTES)
+	{
+		Logger_Flush(self);
+	}
+
+	self->batchLen += LogLine_FormatSafe(self->batch + self->batchLen, LOG_MAX_LINE_BYTES,
+			&record->time, record->level, record->file, record->line, record->function,
+			text, textLen, record->errnum);
+}
+
+static void Logger_WriteBinary(Logger* self, LogFile* file, const LogRecord* record)
+{
+	// Failures lose the message, there's nowhere to report them.
+	if (!Logger_WriteBinarySite(self, file, record))
+	{
+		return;
+	}
+
+	LogFileMessage* message = (LogFileMessage*) LogFile_Append(file,
+			LogFileRecordType_Message, sizeof(LogFileMessage) + record->argsLen);
+	if (message == NULL)
+	{
+		return;
+	}
+
+	message->siteId = record->siteId;
+	message->errnum = record->errnum;
+	message->sec = record->time.tv_sec;
+	message->nsec = record->time.tv_nsec;
+	message->argsLen = (uint32_t) record->argsLen;
+	memcpy(message + 1, record->args, record->argsLen);
+}
+
+/**
+ * Describes the site of record in the binary file, before its first message.
+ */
+static bool Logger_WriteBinarySite(Logger* self, LogFile* file, const LogRecord* record)
+{
+	if (record->siteId < self->writtenSiteCount && self->writtenSites[record->siteId])
+	{
+		return true;
+	}
+
+	if (record->siteId >= self->writtenSiteCount)
+	{
+		size_t count = self->writtenSiteCount > 0 ? self->writtenSiteCount : 64;
+		while (count <= record->siteId)
+		{
+			count *= 2;
+		}
+
+		bool* sites = realloc(self->writtenSites, sizeof(bool) * count);
+		if (sites == NULL)
+		{
+			return false;
+		}
+
+		memset(sites + self->writtenSiteCount, 0, sizeof(bool) * (count - self->writtenSiteCount));
+		self->writtenSites = sites;
+		self->writtenSiteCount = count;
+	}
+
+	size_t fileLen = strlen(record->file) + 1;
+	size_t functionLen = strlen(record->function) + 1;
+	size_t formatLen = strlen(record->format) + 1;
+
+	LogFileSite* site = (LogFileSite*) LogFile_Append(file, LogFileRecordType_Site,
+			sizeof(LogFileSite) + fileLen + functionLen + formatLen);
+	if (site == NULL)
+	{
+		return false;
+	}
+
+	site->id = record->siteId;
+	site->line = record->line;
+	site->level = (uint32_t) record->level;
+
+	char* strings = (char*) (site + 1);
+	memcpy(strings, record->file, fileLen);
+	memcpy(strings + fileLen, record->function, functionLen);
+	memcpy(strings + fileLen + functionLen, record->format, formatLen);
+
+	self->writtenSites[record->siteId] = true;
+
+	return true;
+}
+
+static void Logger_AppendLine(Logger* self, const struct timespec* time, LogLevel level,
+		const char* file, uint32_t line, const char* function,
+		const char* text, size_t textLen, int errnum)
+{
+	if (WRITE_BATCH_BYTES - self->batchLen < LOG_MAX_LINE_BYTES)
+	{
+		Logger_Flush(self);
+	}
+
+	// Format time, localtime_r reads the time zone so only once per second.
+	if (time->tv_sec != self->cachedSecond)
+	{
+		struct tm localTime;
+		bool timeOk = localtime_r(&time->tv_sec, &localTime) != NULL
+			&& strftime(self->cachedTime, MAX_TIME_BYTES, TIME_PATTERN, &localTime) != 0;
+
+		if (!timeOk)
+		{
+			strcpy(self->cachedTime, "time fmt err");
+		}
+
+		self->cachedSecond = time->tv_sec;
+	}
+
+	self->batchLen += LogLine_Format(self->batch + self->batchLen, LOG_MAX_LINE_BYTES,
+			self->cachedTime, time->tv_nsec / 1000, level, file, line, function,
+			text, textLen, errnum);
+}
+
+/**
+ * Writes the batch to every log file.
+ */
+static void Logger_Flush(Logger* self)
+{
+	for (size_t i = 0; i < self->logFileCount; i++)
+	{
+		int fd = fileno(self->logFiles[i]);
+		size_t offset = 0;
+
+		while (offset < self->batchLen)
+		{
+			ssize_t writeLen = write(fd, self->batch + offset, self->batchLen - offset);
+			if (writeLen < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			else if (writeLen < 0)
+			{
+				// Nowhere to report it.
+				break;
+			}
+
+			offset += (size_t) writeLen;
+		}
+	}
+
+	self->batchLen = 0;
+}
@@ -0,0 +1,118 @@
+#include "log_file.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// How much the file and its mapping grow at once.
+#define GROW_BYTES (1024 * 1024)
+
+struct LogFile
+{
+	int fd;
+	unsigned char* map;
+	size_t mapLen;
+	// Bytes written, the rest of the mapping is zeroes.
+	size_t len;
+};
+
+static bool LogFile_Grow(LogFile* self, size_t minLen);
+
+LogFile* LogFile_Open(const char* path)
+{
+	LogFile* self = malloc(sizeof(LogFile));
+	if (self == NULL)
+	{
+		return NULL;
+	}
+
+	self->map = NULL;
+	self->mapLen = 0;
+	self->len = 0;
+
+	self->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (self->fd == -1)
+	{
+		free(self);
+		return NULL;
+	}
+
+	if (!LogFile_Grow(self, GROW_BYTES))
+	{
+		close(self->fd);
+		free(self);
+		return NULL;
+	}
+
+	memcpy(self->map, LOG_FILE_MAGIC, LOG_FILE_MAGIC_LEN);
+	self->len = LOG_FILE_MAGIC_LEN;
+
+	return self;
+}
+
+void LogFile_Close(LogFile* self)
+{
+	if (self == NULL)
+	{
+		return;
+	}
+
+	munmap(self->map, self->mapLen);
+	// Nowhere to report a failure, readers stop at the zeroes anyway.
+	(void) !ftruncate(self->fd, (off_t) self->len);
+	close(self->fd);
+	free(self);
+}
+
+LogFileRecord* LogFile_Append(LogFile* self, LogFileRecordType type, size_t len)
+{
+	size_t paddedLen = (len + LOG_FILE_ALIGN - 1) / LOG_FILE_ALIGN * LOG_FILE_ALIGN;
+
+	if (paddedLen > UINT32_MAX
+			|| (self->mapLen - self->len < paddedLen && !LogFile_Grow(self, self->len + paddedLen)))
+	{
+		return NULL;
+	}
+
+	// The padding is already zero, from the file growing.
+	LogFileRecord* record = (LogFileRecord*) (self->map + self->len);
+	record->size = (uint32_t) paddedLen;
+	record->type = (uint32_t) type;
+	self->len += paddedLen;
+
+	return record;
+}
+
+/**
+ * Extends the file and remaps it to at least minLen bytes.
+ */
+static bool LogFile_Grow(LogFile* self, size_t minLen)
+{
+	size_t mapLen = (minLen + GROW_BYTES - 1) / GROW_BYTES * GROW_BYTES;
+
+	if (ftruncate(self->fd, (off_t) mapLen) == -1)
+	{
+		return false;
+	}
+
+	unsigned char* map = mmap(NULL, mapLen, PROT_READ | PROT_WRITE, MAP_SHARED, self->fd, 0);
+	if (map == MAP_FAILED)
+	{
+		return false;
+	}
+
+	if (self->map != NULL)
+	{
+		munmap(self->map, self->mapLen);
+	}
+
+	self->map = map;
+	self->mapLen = mapLen;
+
+	return true;
+}
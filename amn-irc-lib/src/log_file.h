@@ -0,0 +1,34 @@
+#ifndef AMN_LOG_FILE_H
+#define AMN_LOG_FILE_H
+
+#include "log_format.h"
+
+#include <stddef.h>
+
+/**
+  * Binary log file written through a shared memory mapping, so appending a
+  * record is a copy rather than a system call. Grows in fixed steps and is
+  * truncated to what was written when closed. Not thread-safe, only the
+  * logger's writer thread uses it.
+  */
+typedef struct LogFile LogFile;
+
+/**
+ * Creates or truncates path and writes the file header.
+ * @return Null on failure.
+ */
+LogFile* LogFile_Open(const char* path);
+
+/**
+ * Truncates the file to its records and closes it.
+ */
+void LogFile_Close(LogFile* self);
+
+/**
+ * Appends a record of len bytes, header included, padded to LOG_FILE_ALIGN.
+ * @return The record, with its header set, for the caller to fill in. Valid
+ * until the next append. Null if the file couldn't grow.
+ */
+LogFileRecord* LogFile_Append(LogFile* self, LogFileRecordType type, size_t len);
+
+#endif // AMN_LOG_FILE_H
@@ -0,0 +1,817 @@
+#include "log_format.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/types.h>
+
+const char* LOG_PATTERN = "[%s.%06ld][%s] %s:%"PRIu32" - %s - %.*s\n%s%s%s";
+
+const char* LOG_LEVEL_STRS[] = {
+	"\033[38;2;⟨164⟩;⟨164⟩;⟨164⟩mDEBUG\033[0m",
+	"INFO",
+	"\033[38;2;⟨255⟩;⟨200⟩;⟨0⟩mWARN\033[0m",
+	"\033[38;2;⟨240⟩;⟨20⟩;⟨20⟩mERROR\033[0m" };
+
+#define ERRNO_MSG_BYTES 256
+
+const char* SRC_PATH_PREFIX = "amn-irc-";
+
+// Longest printf conversion Format rebuilds, longer ones end the text.
+#define MAX_SPEC_BYTES 64
+
+typedef enum ArgLength
+{
+	ArgLength_None,
+	ArgLength_Char,
+	ArgLength_Short,
+	ArgLength_Long,
+	ArgLength_LongLong,
+	ArgLength_Size,
+	ArgLength_Max,
+	ArgLength_PtrDiff,
+	ArgLength_LongDouble,
+}
+ArgLength;
+
+// A conversion of a format string, without its '%'.
+typedef struct ConvSpec
+{
+	const char* flags;
+	size_t flagsLen;
+	// Digits, or a single '*' taking an int argument.
+	const char* width;
+	size_t widthLen;
+	bool hasPrecision;
+	const char* precision;
+	size_t precisionLen;
+	ArgLength length;
+	char conversion;
+	// Length of the whole conversion.
+	size_t len;
+}
+ConvSpec;
+
+static void ParseSpec(const char* spec, ConvSpec* result);
+static bool PackValue(unsigned char* buffer, size_t capacity, size_t* len, uint64_t value);
+static bool PackString(unsigned char* buffer, size_t capacity, size_t* len, const char* str,
+		long precision);
+static bool UnpackValue(const unsigned char* args, size_t argsLen, size_t* offset,
+		uint64_t* value);
+static bool AppendSpec(char* spec, size_t* specLen, const char* str, size_t len);
+static void AppendBytes(char* text, size_t capacity, size_t* len, const char* bytes, size_t count);
+static void AppendInteger(char* text, size_t capacity, size_t* len, uint64_t value, bool negative);
+static void AppendHex(char* text, size_t capacity, size_t* len, uint64_t value, bool upper);
+static size_t FormatArgs(char* text, size_t capacity, const char* format,
+		const unsigned char* args, size_t argsLen, bool signalSafe);
+static bool FormatSafe(char* text, size_t capacity, size_t* len, const ConvSpec* spec,
+		const unsigned char* args, size_t argsLen, size_t* offset);
+static void Append(char* text, size_t capacity, size_t* len, const char* spec, ...);
+
+size_t LogArgs_Pack(unsigned char* buffer, size_t capacity, const char* format, va_list args)
+{
+	size_t len = 0;
+
+	for (const char* c = strchr(format, '%'); c != NULL; c = strchr(c, '%'))
+	{
+		ConvSpec spec;
+		ParseSpec(c + 1, &spec);
+		c += 1 + spec.len;
+
+		if (spec.widthLen == 1 && *spec.width == '*'
+				&& !PackValue(buffer, capacity, &len, (uint64_t) (int64_t) va_arg(args, int)))
+		{
+			return len;
+		}
+
+		long precision = -1;
+		if (spec.hasPrecision && spec.precisionLen == 1 && *spec.precision == '*')
+		{
+			precision = va_arg(args, int);
+			if (!PackValue(buffer, capacity, &len, (uint64_t) (int64_t) precision))
+			{
+				return len;
+			}
+		}
+		else if (spec.hasPrecision)
+		{
+			precision = strtol(spec.precision, NULL, 10);
+		}
+
+		uint64_t value;
+		switch (spec.conversion)
+		{
+			case 'd':
+			case 'i':
+				switch (spec.length)
+				{
+					case ArgLength_Char: value = (uint64_t) (signed char) va_arg(args, int); break;
+					case ArgLength_Short: value = (uint64_t) (short) va_arg(args, int); break;
+					case ArgLength_Long: value = (uint64_t) va_arg(args, long); break;
+					case ArgLength_LongLong: value = (uint64_t) va_arg(args, long long); break;
+					case ArgLength_Size: value = (uint64_t) va_arg(args, ssize_t); break;
+					case ArgLength_Max: value = (uint64_t) va_arg(args, intmax_t); break;
+					case ArgLength_PtrDiff: value = (uint64_t) va_arg(args, ptrdiff_t); break;
+					default: value = (uint64_t) va_arg(args, int); break;
+				}
+				break;
+
+			case 'u':
+			case 'o':
+			case 'x':
+			case 'X':
+				switch (spec.length)
+				{
+					case ArgLength_Char: value = (unsigned char) va_arg(args, unsigned int); break;
+					case ArgLength_Short: value = (unsigned short) va_arg(args, unsigned int); break;
+					case ArgLength_Long: value = va_arg(args, unsigned long); break;
+					case ArgLength_LongLong: value = va_arg(args, unsigned long long); break;
+					case ArgLength_Size: value = va_arg(args, size_t); break;
+					case ArgLength_Max: value = va_arg(args, uintmax_t); break;
+					case ArgLength_PtrDiff: value = (uint64_t) va_arg(args, ptrdiff_t); break;
+					default: value = va_arg(args, unsigned int); break;
+				}
+				break;
+
+			case 'c':
+				value = (uint64_t) va_arg(args, int);
+				break;
+
+			case 'p':
+				value = (uintptr_t) va_arg(args, void*);
+				break;
+
+			case 'f':
+			case 'F':
+			case 'e':
+			case 'E':
+			case 'g':
+			case 'G':
+			case 'a':
+			case 'A':
+			{
+				// Long doubles lose their extra precision.
+				double real = spec.length == ArgLength_LongDouble
+					? (double) va_arg(args, long double) : va_arg(args, double);
+				memcpy(&value, &real, sizeof(value));
+				break;
+			}
+
+			case 's':
+				if (spec.length != ArgLength_None
+						|| !PackString(buffer, capacity, &len, va_arg(args, const char*), precision))
+				{
+					return len;
+				}
+				continue;
+
+			case '%':
+				continue;
+
+			default:
+				// %n, or not a conversion.
+				return len;
+		}
+
+		if (!PackValue(buffer, capacity, &len, value))
+		{
+			return len;
+		}
+	}
+
+	return len;
+}
+
+size_t LogArgs_Format(char* text, size_t capacity, const char* format,
+		const unsigned char* args, size_t argsLen)
+{
+	return FormatArgs(text, capacity, format, args, argsLen, false);
+}
+
+size_t LogArgs_FormatSafe(char* text, size_t capacity, const char* format,
+		const unsigned char* args, size_t argsLen)
+{
+	return FormatArgs(text, capacity, format, args, argsLen, true);
+}
+
+/**
+ * LogArgs_Format, or LogArgs_FormatSafe if signalSafe.
+ */
+static size_t FormatArgs(char* text, size_t capacity, const char* format,
+		const unsigned char* args, size_t argsLen, bool signalSafe)
+{
+	size_t len = 0;
+	size_t offset = 0;
+	text[0] = '\0';
+
+	const char* c = format;
+	while (true)
+	{
+		const char* percent = strchr(c, '%');
+		size_t literalLen = percent != NULL ? (size_t) (percent - c) : strlen(c);
+		AppendBytes(text, capacity, &len, c, literalLen);
+
+		if (percent == NULL)
+		{
+			return len;
+		}
+
+		ConvSpec spec;
+		ParseSpec(percent + 1, &spec);
+		c = percent + 1 + spec.len;
+
+		if (spec.conversion == '%')
+		{
+			AppendBytes(text, capacity, &len, "%", 1);
+			continue;
+		}
+
+		// Plain %s, %d and %u are most of the conversions, and much faster
+		// without printf.
+		bool plain = spec.flagsLen == 0 && spec.widthLen == 0 && !spec.hasPrecision;
+		if (plain && spec.conversion == 's' && spec.length == ArgLength_None)
+		{
+			uint32_t strLen;
+			if (argsLen - offset < sizeof(strLen))
+			{
+				return len;
+			}
+
+			memcpy(&strLen, args + offset, sizeof(strLen));
+			offset += sizeof(strLen);
+			if (argsLen - offset < strLen)
+			{
+				return len;
+			}
+
+			AppendBytes(text, capacity, &len, (const char*) args + offset, strLen);
+			offset += strLen;
+			continue;
+		}
+		else if (plain && spec.length != ArgLength_LongDouble
+				&& (spec.conversion == 'd' || spec.conversion == 'i' || spec.conversion == 'u'))
+		{
+			uint64_t value;
+			if (!UnpackValue(args, argsLen, &offset, &value))
+			{
+				return len;
+			}
+
+			bool negative = spec.conversion != 'u' && (int64_t) value < 0;
+			AppendInteger(text, capacity, &len, negative ? -value : value, negative);
+			continue;
+		}
+		else if (signalSafe)
+		{
+			if (!FormatSafe(text, capacity, &len, &spec, args, argsLen, &offset))
+			{
+				return len;
+			}
+			continue;
+		}
+
+		// Rebuilds the conversion with the star arguments filled in, and
+		// integers widened to the 8 bytes they were packed as.
+		char specStr[MAX_SPEC_BYTES];
+		size_t specLen = 0;
+		uint64_t value;
+		char number[24];
+
+		if (!AppendSpec(specStr, &specLen, "%", 1)
+				|| !AppendSpec(specStr, &specLen, spec.flags, spec.flagsLen))
+		{
+			return len;
+		}
+
+		if (spec.widthLen == 1 && *spec.width == '*')
+		{
+			if (!UnpackValue(args, argsLen, &offset, &value))
+			{
+				return len;
+			}
+
+			int numberLen = snprintf(number, sizeof(number), "%"PRId64, (int64_t) value);
+			if (!AppendSpec(specStr, &specLen, number, (size_t) numberLen))
+			{
+				return len;
+			}
+		}
+		else if (!AppendSpec(specStr, &specLen, spec.width, spec.widthLen))
+		{
+			return len;
+		}
+
+		if (spec.hasPrecision && spec.precisionLen == 1 && *spec.precision == '*')
+		{
+			if (!UnpackValue(args, argsLen, &offset, &value))
+			{
+				return len;
+			}
+
+			int numberLen = snprintf(number, sizeof(number), ".%"PRId64, (int64_t) value);
+			if (spec.conversion != 's'
+					&& !AppendSpec(specStr, &specLen, number, (size_t) numberLen))
+			{
+				return len;
+			}
+		}
+		else if (spec.hasPrecision && spec.conversion != 's'
+				&& (!AppendSpec(specStr, &specLen, ".", 1)
+					|| !AppendSpec(specStr, &specLen, spec.precision, spec.precisionLen)))
+		{
+			return len;
+		}
+
+		switch (spec.conversion)
+		{
+			case 'd':
+			case 'i':
+			case 'u':
+			case 'o':
+			case 'x':
+			case 'X':
+				if (!UnpackValue(args, argsLen, &offset, &value)
+						|| !AppendSpec(specStr, &specLen, "ll", 2)
+						|| !AppendSpec(specStr, &specLen, &spec.conversion, 1))
+				{
+					return len;
+				}
+
+				if (spec.conversion == 'd' || spec.conversion == 'i')
+				{
+					Append(text, capacity, &len, specStr, (long long) (int64_t) value);
+				}
+				else
+				{
+					Append(text, capacity, &len, specStr, (unsigned long long) value);
+				}
+				break;
+
+			case 'c':
+				if (!UnpackValue(args, argsLen, &offset, &value)
+						|| !AppendSpec(specStr, &specLen, "c", 1))
+				{
+					return len;
+				}
+
+				Append(text, capacity, &len, specStr, (int) (int64_t) value);
+				break;
+
+			case 'p':
+				if (!UnpackValue(args, argsLen, &offset, &value)
+						|| !AppendSpec(specStr, &specLen, "p", 1))
+				{
+					return len;
+				}
+
+				Append(text, capacity, &len, specStr, (void*) (uintptr_t) value);
+				break;
+
+			case 'f':
+			case 'F':
+			case 'e':
+			case 'E':
+			case 'g':
+			case 'G':
+			case 'a':
+			case 'A':
+			{
+				if (!UnpackValue(args, argsLen, &offset, &value)
+						|| !AppendSpec(specStr, &specLen, &spec.conversion, 1))
+				{
+					return len;
+				}
+
+				double real;
+				memcpy(&real, &value, sizeof(real));
+				Append(text, capacity, &len, specStr, real);
+				break;
+			}
+
+			case 's':
+			{
+				// The precision was applied when packing, the packed length
+				// replaces it.
+				uint32_t strLen;
+				if (spec.length != ArgLength_None || argsLen - offset < sizeof(strLen))
+				{
+					return len;
+				}
+
+				memcpy(&strLen, args + offset, sizeof(strLen));
+				offset += sizeof(strLen);
+				if (argsLen - offset < strLen || !AppendSpec(specStr, &specLen, ".*s", 3))
+				{
+					return len;
+				}
+
+				Append(text, capacity, &len, specStr, (int) strLen, (const char*) args + offset);
+				offset += strLen;
+				break;
+			}
+
+			default:
+				return len;
+		}
+	}
+}
+
+static const char* getRelativePathForLog(const char* file)
+{
+	const char* substr = strstr(file, SRC_PATH_PREFIX);
+
+	return substr != NULL ? substr : file;
+}
+
+size_t LogLine_Format(char* buffer, size_t capacity, const char* time, long micros,
+		LogLevel level, const char* file, uint32_t line, const char* function,
+		const char* text, size_t textLen, int errnum)
+{
+	// Format errno
+	char errorMsg[ERRNO_MSG_BYTES];
+	bool errnoOk = errnum == 0 || strerror_r(errnum, errorMsg, ERRNO_MSG_BYTES) == 0;
+
+	int len = snprintf(buffer, capacity, LOG_PATTERN,
+			time, micros,
+			LOG_LEVEL_STRS[level],
+			getRelativePathForLog(file),
+			line, function,
+			(int) textLen, text,
+			errnum != 0 ? "\tErrno: " : "",
+			errnum != 0 ? (errnoOk ? errorMsg : "errno fmt err") : "",
+			errnum != 0 ? "\n" : "");
+
+	if (len < 0)
+	{
+		buffer[0] = '\0';
+		return 0;
+	}
+
+	// Truncated lines still end with a newline.
+	if ((size_t) len >= capacity)
+	{
+		len = (int) capacity - 1;
+		buffer[len - 1] = '\n';
+	}
+
+	return (size_t) len;
+}
+
+size_t LogLine_FormatSafe(char* buffer, size_t capacity, const struct timespec* time,
+		LogLevel level, const char* file, uint32_t line, const char* function,
+		const char* text, size_t textLen, int errnum)
+{
+	size_t len = 0;
+	buffer[0] = '\0';
+
+	AppendBytes(buffer, capacity, &len, "[", 1);
+	AppendInteger(buffer, capacity, &len, (uint64_t) time->tv_sec, false);
+
+	// Microseconds, zero padded.
+	char micros[7] = "000000";
+	long value = time->tv_nsec / 1000;
+	for (size_t i = 6; i > 0 && value > 0; i--)
+	{
+		micros[i - 1] = (char) ('0' + value % 10);
+		value /= 10;
+	}
+	AppendBytes(buffer, capacity, &len, ".", 1);
+	AppendBytes(buffer, capacity, &len, micros, 6);
+
+	AppendBytes(buffer, capacity, &len, "][", 2);
+	AppendBytes(buffer, capacity, &len, LOG_LEVEL_STRS[level], strlen(LOG_LEVEL_STRS[level]));
+	AppendBytes(buffer, capacity, &len, "] ", 2);
+	file = getRelativePathForLog(file);
+	AppendBytes(buffer, capacity, &len, file, strlen(file));
+	AppendBytes(buffer, capacity, &len, ":", 1);
+	AppendInteger(buffer, capacity, &len, line, false);
+	AppendBytes(buffer, capacity, &len, " - ", 3);
+	AppendBytes(buffer, capacity, &len, function, strlen(function));
+	AppendBytes(buffer, capacity, &len, " - ", 3);
+	AppendBytes(buffer, capacity, &len, text, textLen);
+	AppendBytes(buffer, capacity, &len, "\n", 1);
+
+	if (errnum != 0)
+	{
+		AppendBytes(buffer, capacity, &len, "\tErrno: ", 8);
+		AppendInteger(buffer, capacity, &len,
+				errnum < 0 ? -(uint64_t) errnum : (uint64_t) errnum, errnum < 0);
+		AppendBytes(buffer, capacity, &len, "\n", 1);
+	}
+
+	// Truncated lines still end with a newline.
+	if (len > 0 && buffer[len - 1] != '\n')
+	{
+		buffer[len - 1] = '\n';
+	}
+
+	return len;
+}
+
+static void ParseSpec(const char* spec, ConvSpec* result)
+{
+	const char* c = spec;
+
+	result->flags = c;
+	c += strspn(c, "-+ #0'");
+	result->flagsLen = (size_t) (c - result->flags);
+
+	result->width = c;
+	c += *c == '*' ? 1 : strspn(c, "0123456789");
+	result->widthLen = (size_t) (c - result->width);
+
+	result->hasPrecision = *c == '.';
+	if (result->hasPrecision)
+	{
+		c++;
+	}
+
+	result->precision = c;
+	if (result->hasPrecision)
+	{
+		c += *c == '*' ? 1 : strspn(c, "0123456789");
+	}
+	result->precisionLen = (size_t) (c - result->precision);
+
+	switch (*c)
+	{
+		case 'h':
+			result->length = c[1] == 'h' ? ArgLength_Char : ArgLength_Short;
+			c += c[1] == 'h' ? 2 : 1;
+			break;
+		case 'l':
+			result->length = c[1] == 'l' ? ArgLength_LongLong : ArgLength_Long;
+			c += c[1] == 'l' ? 2 : 1;
+			break;
+		case 'z': result->length = ArgLength_Size; c++; break;
+		case 'j': result->length = ArgLength_Max; c++; break;
+		case 't': result->length = ArgLength_PtrDiff; c++; break;
+		case 'L': result->length = ArgLength_LongDouble; c++; break;
+		default: result->length = ArgLength_None; break;
+	}
+
+	result->conversion = *c;
+	if (*c != '\0')
+	{
+		c++;
+	}
+
+	result->len = (size_t) (c - spec);
+}
+
+static bool PackValue(unsigned char* buffer, size_t capacity, size_t* len, uint64_t value)
+{
+	if (capacity - *len < sizeof(value))
+	{
+		return false;
+	}
+
+	memcpy(buffer + *len, &value, sizeof(value));
+	*len += sizeof(value);
+
+	return true;
+}
+
+/**
+ * Packs at most precision bytes of str, if not negative, truncated to what
+ * fits.
+ */
+static bool PackString(unsigned char* buffer, size_t capacity, size_t* len, const char* str,
+		long precision)
+{
+	uint32_t strLen;
+	if (capacity - *len <= sizeof(strLen))
+	{
+		return false;
+	}
+
+	if (str == NULL)
+	{
+		str = "(null)";
+	}
+
+	size_t maxLen = capacity - *len - sizeof(strLen);
+	if (precision >= 0 && (size_t) precision < maxLen)
+	{
+		maxLen = (size_t) precision;
+	}
+
+	strLen = (uint32_t) strnlen(str, maxLen);
+	memcpy(buffer + *len, &strLen, sizeof(strLen));
+	memcpy(buffer + *len + sizeof(strLen), str, strLen);
+	*len += sizeof(strLen) + strLen;
+
+	return true;
+}
+
+static bool UnpackValue(const unsigned char* args, size_t argsLen, size_t* offset,
+		uint64_t* value)
+{
+	if (argsLen - *offset < sizeof(*value))
+	{
+		return false;
+	}
+
+	memcpy(value, args + *offset, sizeof(*value));
+	*offset += sizeof(*value);
+
+	return true;
+}
+
+/**
+ * Appends to a conversion being rebuilt, keeping it NUL terminated.
+ */
+static bool AppendSpec(char* spec, size_t* specLen, const char* str, size_t len)
+{
+	if (MAX_SPEC_BYTES - *specLen <= len)
+	{
+		return false;
+	}
+
+	memcpy(spec + *specLen, str, len);
+	*specLen += len;
+	spec[*specLen] = '\0';
+
+	return true;
+}
+
+/**
+ * Appends count bytes to text, truncated to capacity, keeping it NUL terminated.
+ */
+static void AppendBytes(char* text, size_t capacity, size_t* len, const char* bytes, size_t count)
+{
+	if (count > capacity - *len - 1)
+	{
+		count = capacity - *len - 1;
+	}
+
+	memcpy(text + *len, bytes, count);
+	*len += count;
+	text[*len] = '\0';
+}
+
+static void AppendInteger(char* text, size_t capacity, size_t* len, uint64_t value, bool negative)
+{
+	// Digits of UINT64_MAX, and the sign.
+	char digits[21];
+	size_t start = sizeof(digits);
+
+	do
+	{
+		digits[--start] = (char) ('0' + value % 10);
+		value /= 10;
+	}
+	while (value > 0);
+
+	if (negative)
+	{
+		digits[--start] = '-';
+	}
+
+	AppendBytes(text, capacity, len, digits + start, sizeof(digits) - start);
+}
+
+static void AppendHex(char* text, size_t capacity, size_t* len, uint64_t value, bool upper)
+{
+	const char* hexDigits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+	// Digits of UINT64_MAX.
+	char digits[16];
+	size_t start = sizeof(digits);
+
+	do
+	{
+		digits[--start] = hexDigits[value % 16];
+		value /= 16;
+	}
+	while (value > 0);
+
+	AppendBytes(text, capacity, len, digits + start, sizeof(digits) - start);
+}
+
+/**
+ * Appends a conversion the way LogArgs_FormatSafe does, without printf.
+ * @return False if the arguments ran out or the conversion is unsupported.
+ */
+static bool FormatSafe(char* text, size_t capacity, size_t* len, const ConvSpec* spec,
+		const unsigned char* args, size_t argsLen, size_t* offset)
+{
+	uint64_t value;
+
+	// Star widths and precisions take an argument each, unused here.
+	if ((spec->widthLen == 1 && *spec->width == '*')
+			&& !UnpackValue(args, argsLen, offset, &value))
+	{
+		return false;
+	}
+
+	if ((spec->hasPrecision && spec->precisionLen == 1 && *spec->precision == '*')
+			&& !UnpackValue(args, argsLen, offset, &value))
+	{
+		return false;
+	}
+
+	switch (spec->conversion)
+	{
+		case 's':
+		{
+			uint32_t strLen;
+			if (spec->length != ArgLength_None || argsLen - *offset < sizeof(strLen))
+			{
+				return false;
+			}
+
+			memcpy(&strLen, args + *offset, sizeof(strLen));
+			*offset += sizeof(strLen);
+			if (argsLen - *offset < strLen)
+			{
+				return false;
+			}
+
+			AppendBytes(text, capacity, len, (const char*) args + *offset, strLen);
+			*offset += strLen;
+			return true;
+		}
+
+		case 'f':
+		case 'F':
+		case 'e':
+		case 'E':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			if (!UnpackValue(args, argsLen, offset, &value))
+			{
+				return false;
+			}
+
+			AppendBytes(text, capacity, len, "?", 1);
+			return true;
+
+		case 'd':
+		case 'i':
+		case 'u':
+		case 'o':
+		case 'x':
+		case 'X':
+		case 'c':
+		case 'p':
+			if (!UnpackValue(args, argsLen, offset, &value))
+			{
+				return false;
+			}
+			break;
+
+		default:
+			return false;
+	}
+
+	if (spec->conversion == 'd' || spec->conversion == 'i')
+	{
+		bool negative = (int64_t) value < 0;
+		AppendInteger(text, capacity, len, negative ? -value : value, negative);
+	}
+	else if (spec->conversion == 'c')
+	{
+		char character = (char) value;
+		AppendBytes(text, capacity, len, &character, 1);
+	}
+	else if (spec->conversion == 'p')
+	{
+		AppendBytes(text, capacity, len, "0x", 2);
+		AppendHex(text, capacity, len, value, false);
+	}
+	else if (spec->conversion == 'x' || spec->conversion == 'X')
+	{
+		AppendHex(text, capacity, len, value, spec->conversion == 'X');
+	}
+	else
+	{
+		// Octal is rare enough to be written in decimal.
+		AppendInteger(text, capacity, len, value, false);
+	}
+
+	return true;
+}
+
+/**
+ * Appends printf(spec, ...) to text, truncated to capacity.
+ */
+static void Append(char* text, size_t capacity, size_t* len, const char* spec, ...)
+{
+	va_list args;
+	va_start(args, spec);
+	int appended = vsnprintf(text + *len, capacity - *len, spec, args);
+	va_end(args);
+
+	if (appended < 0)
+	{
+		return;
+	}
+
+	*len += (size_t) appended < capacity - *len ? (size_t) appended : capacity - *len - 1;
+}
@@ -0,0 +1,113 @@
+#include "log_ring.h"
+
+#include <stdlib.h>
+
+#define RECORD_ALIGN alignof(LogRecord)
+
+static size_t RecordSize(size_t argsLen);
+
+LogRing* LogRing_New(void)
+{
+	LogRing* self = aligned_alloc(alignof(LogRing), sizeof(LogRing));
+	if (self == NULL)
+	{
+		return NULL;
+	}
+
+	atomic_init(&self->head, 0);
+	atomic_init(&self->tail, 0);
+	self->reservedTail = 0;
+	atomic_init(&self->dropped, 0);
+	self->reportedDropped = 0;
+	atomic_init(&self->owned, true);
+	self->next = NULL;
+
+	return self;
+}
+
+void LogRing_Delete(LogRing* self)
+{
+	free(self);
+}
+
+LogRecord* LogRing_Reserve(LogRing* self, size_t argsLen)
+{
+	size_t size = RecordSize(argsLen);
+	size_t tail = atomic_load_explicit(&self->tail, memory_order_relaxed);
+	size_t offset = tail % LOG_RING_BYTES;
+
+	// Records are contiguous, so one that doesn't fit before the end of the
+	// ring starts over at the beginning.
+	size_t padding = LOG_RING_BYTES - offset < size ? LOG_RING_BYTES - offset : 0;
+
+	size_t head = atomic_load_explicit(&self->head, memory_order_acquire);
+	if (tail - head + padding + size > LOG_RING_BYTES)
+	{
+		return NULL;
+	}
+
+	if (padding > 0)
+	{
+		LogRecord* pad = (LogRecord*) (self->data + offset);
+		pad->size = (uint32_t) padding;
+		pad->padding = true;
+		offset = 0;
+	}
+
+	LogRecord* record = (LogRecord*) (self->data + offset);
+	record->size = (uint32_t) size;
+	record->padding = false;
+	record->argsLen = argsLen;
+
+	self->reservedTail = tail + padding + size;
+
+	return record;
+}
+
+void LogRing_Commit(LogRing* self)
+{
+	atomic_store_explicit(&self->tail, self->reservedTail, memory_order_release);
+}
+
+LogRecord* LogRing_Peek(LogRing* self)
+{
+	size_t head = atomic_load_explicit(&self->head, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&self->tail, memory_order_acquire);
+
+	if (head == tail)
+	{
+		return NULL;
+	}
+
+	LogRecord* record = (LogRecord*) (self->data + head % LOG_RING_BYTES);
+	if (!record->padding)
+	{
+		return record;
+	}
+
+	// Padding is always followed by the record that didn't fit.
+	head += record->size;
+	atomic_store_explicit(&self->head, head, memory_order_release);
+
+	return (LogRecord*) (self->data + head % LOG_RING_BYTES);
+}
+
+void LogRing_Pop(LogRing* self, LogRecord* record)
+{
+	size_t head = atomic_load_explicit(&self->head, memory_order_relaxed);
+	atomic_store_explicit(&self->head, head + record->size, memory_order_release);
+}
+
+bool LogRing_HalfFull(const LogRing* self)
+{
+	size_t head = atomic_load_explicit(&self->head, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&self->tail, memory_order_relaxed);
+
+	return tail - head > LOG_RING_BYTES / 2;
+}
+
+static size_t RecordSize(size_t argsLen)
+{
+	size_t size = sizeof(LogRecord) + argsLen;
+	return (size + RECORD_ALIGN - 1) / RECORD_ALIGN * RECORD_ALIGN;
+}
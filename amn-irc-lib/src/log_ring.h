@@ -0,0 +1,93 @@
+#ifndef AMN_LOG_RING_H
+#define AMN_LOG_RING_H
+
+#include "log.h"
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/**
+  * Lock-free single producer, single consumer ring of variable sized log
+  * records. Each logging thread owns one and pushes to it, the logger's
+  * writer thread pops from every ring.
+  */
+
+#define LOG_RING_BYTES (64 * 1024)
+
+// A message captured by Logger_Log, formatted or written in binary by the writer.
+typedef struct LogRecord
+{
+	// Bytes from this record to the next one.
+	uint32_t size;
+	// Fills the rest of the ring when a record doesn't fit before the end.
+	bool padding;
+	LogLevel level;
+	uint32_t line;
+	// errno when the message was logged, zero if none.
+	int errnum;
+	struct timespec time;
+	uint32_t siteId;
+	// Call site strings, which are literals.
+	const char* function;
+	const char* file;
+	const char* format;
+	// Arguments of format, see LogArgs_Pack.
+	size_t argsLen;
+	unsigned char args[];
+}
+LogRecord;
+
+typedef struct LogRing
+{
+	// Byte counts, only growing. Only the writer moves head, only the
+	// producer moves tail. On their own cache lines so they don't bounce.
+	alignas(64) _Atomic size_t head;
+	alignas(64) _Atomic size_t tail;
+	// Where tail goes on LogRing_Commit, producer only.
+	size_t reservedTail;
+	// Records the producer dropped because the ring was full.
+	_Atomic uint64_t dropped;
+	// Dropped records the writer already reported.
+	uint64_t reportedDropped;
+
+	// False once the producer thread exited, so another thread can adopt it.
+	atomic_bool owned;
+	// Rings of a logger are only ever prepended, so the writer can walk them
+	// without locking.
+	struct LogRing* next;
+
+	alignas(LogRecord) unsigned char data[LOG_RING_BYTES];
+}
+LogRing;
+
+/**
+ * An empty ring, owned by the calling thread. Null on allocation failure.
+ */
+LogRing* LogRing_New(void);
+void LogRing_Delete(LogRing* self);
+
+/**
+ * Producer only. Space for a record with argsLen bytes of arguments, or null if
+ * the ring is full. The record is published by LogRing_Commit.
+ */
+LogRecord* LogRing_Reserve(LogRing* self, size_t argsLen);
+void LogRing_Commit(LogRing* self);
+
+/**
+ * Consumer only. The oldest record, or null if the ring is empty. It stays
+ * valid until LogRing_Pop.
+ */
+LogRecord* LogRing_Peek(LogRing* self);
+void LogRing_Pop(LogRing* self, LogRecord* record);
+
+/**
+ * Whether more than half of the ring is used. Used by the producer to wake
+ * the writer early.
+ */
+bool LogRing_HalfFull(const LogRing* self);
+
+#endif // AMN_LOG_RING_H
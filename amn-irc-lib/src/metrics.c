@@ -0,0 +1,411 @@
+#include "metrics.h"
+
+#include "str_utils.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#define MAX_METRICS 256
+// Counters and gauges.
+#define MAX_VALUES 128
+#define MAX_HISTOGRAMS 32
+
+#define SUB_BUCKETS (1 << METRIC_HISTOGRAM_SUB_BITS)
+#define UNREGISTERABLE UINT32_MAX
+
+typedef struct HistogramShard
+{
+	_Atomic uint64_t buckets[METRIC_HISTOGRAM_BUCKETS];
+	_Atomic uint64_t sum;
+}
+HistogramShard;
+
+// Values of one thread. Only the owning thread writes them, so updates are
+// plain loads and stores, atomic only so readers see whole values.
+typedef struct MetricsShard
+{
+	_Atomic int64_t values[MAX_VALUES];
+	HistogramShard histograms[MAX_HISTOGRAMS];
+
+	// Shards are only ever prepended, so readers can walk them without locking.
+	struct MetricsShard* next;
+	// False once its thread exited, so another thread can adopt it.
+	// Protected by shardsMutex.
+	bool owned;
+}
+MetricsShard;
+
+// Registered metrics, with their slot in MetricsShard.values or histograms.
+// Entries are filled before metricCount is raised past them, and never change.
+static Metric metrics[MAX_METRICS];
+static uint32_t metricSlots[MAX_METRICS];
+static _Atomic size_t metricCount = 0;
+static size_t valueCount = 0;
+static size_t histogramCount = 0;
+static pthread_mutex_t metricsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static _Atomic(MetricsShard*) shards = NULL;
+static pthread_mutex_t shardsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_key_t shardKey;
+static pthread_once_t shardKeyOnce = PTHREAD_ONCE_INIT;
+
+static _Thread_local MetricsShard* currentShard = NULL;
+static _Thread_local uint32_t sampleCountdown = 0;
+
+static inline uint32_t Metric_Id(Metric* self);
+static uint32_t Metric_Resolve(Metric* self);
+static void Metric_ObserveWeighted(Metric* self, uint64_t ns, uint64_t weight);
+static MetricsShard* CurrentShard(void);
+static void CreateShardKey(void);
+static void ReleaseShard(void* shard);
+static size_t BucketOf(uint64_t value);
+
+bool Metric_Register(Metric* self)
+{
+	return Metric_Id(self) != UNREGISTERABLE;
+}
+
+void Metric_Add(Metric* self, int64_t value)
+{
+	uint32_t id = Metric_Id(self);
+	MetricsShard* shard = CurrentShard();
+	if (id == UNREGISTERABLE || shard == NULL)
+	{
+		return;
+	}
+
+	_Atomic int64_t* slot = &shard->values[metricSlots[id - 1]];
+	atomic_store_explicit(slot, atomic_load_explicit(slot, memory_order_relaxed) + value,
+			memory_order_relaxed);
+}
+
+void Metric_Observe(Metric* self, uint64_t ns)
+{
+	Metric_ObserveWeighted(self, ns, 1);
+}
+
+void Metric_ObserveSince(Metric* self, uint64_t sampleNs)
+{
+	if (sampleNs != 0)
+	{
+		Metric_ObserveWeighted(self, Metrics_NowNs() - sampleNs, METRICS_SAMPLE_PERIOD);
+	}
+}
+
+void Metric_ObserveSampled(Metric* self, uint64_t ns)
+{
+	Metric_ObserveWeighted(self, ns, METRICS_SAMPLE_PERIOD);
+}
+
+int64_t Metric_Value(Metric* self)
+{
+	uint32_t id = Metric_Id(self);
+	if (id == UNREGISTERABLE)
+	{
+		return 0;
+	}
+
+	uint32_t slot = metricSlots[id - 1];
+	int64_t value = 0;
+
+	for (MetricsShard* shard = atomic_load_explicit(&shards, memory_order_acquire);
+			shard != NULL; shard = shard->next)
+	{
+		value += atomic_load_explicit(&shard->values[slot], memory_order_relaxed);
+	}
+
+	return value;
+}
+
+void Metric_ReadHistogram(Metric* self, MetricHistogram* histogram)
+{
+	*histogram = (MetricHistogram) {0};
+
+	uint32_t id = Metric_Id(self);
+	if (id == UNREGISTERABLE)
+	{
+		return;
+	}
+
+	uint32_t slot = metricSlots[id - 1];
+
+	for (MetricsShard* shard = atomic_load_explicit(&shards, memory_order_acquire);
+			shard != NULL; shard = shard->next)
+	{
+		HistogramShard* shardHistogram = &shard->histograms[slot];
+
+		for (size_t i = 0; i < METRIC_HISTOGRAM_BUCKETS; i++)
+		{
+			histogram->buckets[i] += atomic_load_explicit(&shardHistogram->buckets[i],
+					memory_order_relaxed);
+		}
+
+		histogram->sum += atomic_load_explicit(&shardHistogram->sum, memory_order_relaxed);
+	}
+
+	// Counted from the buckets, so it matches them even while being updated.
+	for (size_t i = 0; i < METRIC_HISTOGRAM_BUCKETS; i++)
+	{
+		histogram->count += histogram->buckets[i];
+	}
+}
+
+uint64_t Metrics_NowNs(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+uint64_t Metrics_SampleNs(void)
+{
+	if (sampleCountdown != 0)
+	{
+		sampleCountdown--;
+		return 0;
+	}
+
+	sampleCountdown = METRICS_SAMPLE_PERIOD - 1;
+
+	// Zero means not sampled, the clock can't be there after boot anyway.
+	return Metrics_NowNs();
+}
+
+size_t Metrics_Count(void)
+{
+	return atomic_load_explicit(&metricCount, memory_order_acquire);
+}
+
+Metric* Metrics_At(size_t index)
+{
+	return &metrics[index];
+}
+
+uint64_t MetricHistogram_BucketMin(size_t bucket)
+{
+	if (bucket < SUB_BUCKETS)
+	{
+		return bucket;
+	}
+
+	size_t shift = bucket / SUB_BUCKETS - 1;
+	return (uint64_t) (SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+}
+
+uint64_t MetricHistogram_BucketMax(size_t bucket)
+{
+	return bucket + 1 < METRIC_HISTOGRAM_BUCKETS
+		? MetricHistogram_BucketMin(bucket + 1) - 1
+		: UINT64_MAX;
+}
+
+uint64_t MetricHistogram_Percentile(const MetricHistogram* self, double percentile)
+{
+	if (self->count == 0)
+	{
+		return 0;
+	}
+
+	// Rank of the value, counting from 1.
+	double rank = percentile / 100 * (double) self->count;
+	uint64_t target = rank < 1 ? 1 : (uint64_t) rank;
+	if ((double) target < rank)
+	{
+		target++;
+	}
+
+	uint64_t seen = 0;
+	for (size_t i = 0; i < METRIC_HISTOGRAM_BUCKETS; i++)
+	{
+		seen += self->buckets[i];
+		if (seen >= target)
+		{
+			return MetricHistogram_BucketMax(i);
+		}
+	}
+
+	return MetricHistogram_BucketMax(METRIC_HISTOGRAM_BUCKETS - 1);
+}
+
+static void Metric_ObserveWeighted(Metric* self, uint64_t ns, uint64_t weight)
+{
+	uint32_t id = Metric_Id(self);
+	MetricsShard* shard = CurrentShard();
+	if (id == UNREGISTERABLE || shard == NULL)
+	{
+		return;
+	}
+
+	HistogramShard* histogram = &shard->histograms[metricSlots[id - 1]];
+	_Atomic uint64_t* bucket = &histogram->buckets[BucketOf(ns)];
+
+	atomic_store_explicit(bucket, atomic_load_explicit(bucket, memory_order_relaxed) + weight,
+			memory_order_relaxed);
+	atomic_store_explicit(&histogram->sum,
+			atomic_load_explicit(&histogram->sum, memory_order_relaxed) + ns * weight,
+			memory_order_relaxed);
+}
+
+static inline uint32_t Metric_Id(Metric* self)
+{
+	// Acquire, so the registry entry is visible when another thread resolved it.
+	uint32_t id = atomic_load_explicit(&self->id, memory_order_acquire);
+
+	return id != 0 ? id : Metric_Resolve(self);
+}
+
+/**
+ * Finds the registry entry with the name and labels of self, adding one if
+ * there's none.
+ */
+static uint32_t Metric_Resolve(Metric* self)
+{
+	if (pthread_mutex_lock(&metricsMutex) != 0)
+	{
+		return UNREGISTERABLE;
+	}
+
+	size_t count = atomic_load_explicit(&metricCount, memory_order_relaxed);
+	uint32_t id = UNREGISTERABLE;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (metrics[i].type == self->type
+				&& StrUtils_Equals(metrics[i].name, self->name)
+				&& StrUtils_Equals(metrics[i].labels, self->labels))
+		{
+			id = (uint32_t) i + 1;
+			goto cleanup;
+		}
+	}
+
+	bool histogram = self->type == MetricType_Histogram;
+	if (count == MAX_METRICS
+			|| (histogram && histogramCount == MAX_HISTOGRAMS)
+			|| (!histogram && valueCount == MAX_VALUES))
+	{
+		goto cleanup;
+	}
+
+	Metric* entry = &metrics[count];
+	entry->type = self->type;
+	entry->name = StrUtils_Clone(self->name);
+	entry->labels = self->labels != NULL ? StrUtils_Clone(self->labels) : NULL;
+	entry->help = StrUtils_Clone(self->help);
+
+	if (entry->name == NULL || entry->help == NULL
+			|| (self->labels != NULL && entry->labels == NULL))
+	{
+		free((char*) entry->name);
+		free((char*) entry->labels);
+		free((char*) entry->help);
+		goto cleanup;
+	}
+
+	id = (uint32_t) count + 1;
+	atomic_init(&entry->id, id);
+	metricSlots[count] = (uint32_t) (histogram ? histogramCount++ : valueCount++);
+	atomic_store_explicit(&metricCount, count + 1, memory_order_release);
+
+cleanup:
+	pthread_mutex_unlock(&metricsMutex);
+
+	atomic_store_explicit(&self->id, id, memory_order_release);
+	return id;
+}
+
+/**
+ * The shard of the calling thread, adopting one left by an exited thread or
+ * creating it on first use. Null on failure.
+ */
+static MetricsShard* CurrentShard(void)
+{
+	if (currentShard != NULL)
+	{
+		return currentShard;
+	}
+
+	if (pthread_once(&shardKeyOnce, CreateShardKey) != 0
+			|| pthread_mutex_lock(&shardsMutex) != 0)
+	{
+		return NULL;
+	}
+
+	MetricsShard* shard = atomic_load(&shards);
+	while (shard != NULL && shard->owned)
+	{
+		shard = shard->next;
+	}
+
+	if (shard == NULL)
+	{
+		shard = calloc(1, sizeof(MetricsShard));
+		if (shard != NULL)
+		{
+			shard->next = atomic_load(&shards);
+			atomic_store_explicit(&shards, shard, memory_order_release);
+		}
+	}
+
+	if (shard != NULL)
+	{
+		shard->owned = true;
+	}
+
+	pthread_mutex_unlock(&shardsMutex);
+
+	if (shard == NULL)
+	{
+		return NULL;
+	}
+
+	// Without the destructor the shard is never adopted, but still works.
+	pthread_setspecific(shardKey, shard);
+	currentShard = shard;
+
+	return shard;
+}
+
+static void CreateShardKey(void)
+{
+	pthread_key_create(&shardKey, ReleaseShard);
+}
+
+/**
+ * Called when a thread exits.
+ */
+static void ReleaseShard(void* shard)
+{
+	if (pthread_mutex_lock(&shardsMutex) != 0)
+	{
+		return;
+	}
+
+	((MetricsShard*) shard)->owned = false;
+
+	pthread_mutex_unlock(&shardsMutex);
+
+	currentShard = NULL;
+}
+
+static size_t BucketOf(uint64_t value)
+{
+	if (value < SUB_BUCKETS)
+	{
+		return (size_t) value;
+	}
+
+	size_t bits = 64 - (size_t) __builtin_clzll(value);
+	if (bits > METRIC_HISTOGRAM_MAX_BITS)
+	{
+		return METRIC_HISTOGRAM_BUCKETS - 1;
+	}
+
+	// The top bit picks the power of two, the next SUB_BITS the bucket within it.
+	size_t shift = bits - 1 - METRIC_HISTOGRAM_SUB_BITS;
+	return (shift + 1) * SUB_BUCKETS + (size_t) ((value >> shift) & (SUB_BUCKETS - 1));
+}
@@ -0,0 +1,86 @@
+#include "msg_trace.h"
+
+#include <inttypes.h>
+
+#define STAGE_HELP "Time messages took from one stage of the server to the next."
+
+// Time from the previous stage, indexed by MsgTraceStage.
+static Metric StageTimes[MsgTraceStage_Len] = {
+	[MsgTraceStage_Parsed] =
+		{ MetricType_Histogram, "amn_msg_stage_seconds", "stage=\"parse\"", STAGE_HELP, 0 },
+	[MsgTraceStage_Dequeued] =
+		{ MetricType_Histogram, "amn_msg_stage_seconds", "stage=\"cmd_queue\"", STAGE_HELP, 0 },
+	[MsgTraceStage_Executed] =
+		{ MetricType_Histogram, "amn_msg_stage_seconds", "stage=\"execute\"", STAGE_HELP, 0 },
+	[MsgTraceStage_Sending] =
+		{ MetricType_Histogram, "amn_msg_stage_seconds", "stage=\"task_queue\"", STAGE_HELP, 0 },
+	[MsgTraceStage_Written] =
+		{ MetricType_Histogram, "amn_msg_stage_seconds", "stage=\"write\"", STAGE_HELP, 0 },
+};
+
+static Metric Latency = METRIC_HISTOGRAM("amn_msg_latency_seconds",
+		"Time from reading a message to writing what it caused, once per send.");
+
+static void RecordStages(const MsgTrace* self, MsgTraceStage first, MsgTraceStage last);
+
+void MsgTrace_Begin(MsgTrace* self, uint64_t readNs, bool sampled, bool logged)
+{
+	if (!sampled && !logged)
+	{
+		return;
+	}
+
+	self->stampNs[MsgTraceStage_Read] = readNs;
+	self->sampled = sampled;
+	self->logged = logged;
+}
+
+void MsgTrace_RecordExecuted(const MsgTrace* self)
+{
+	RecordStages(self, MsgTraceStage_Parsed, MsgTraceStage_Executed);
+}
+
+void MsgTrace_RecordWritten(const MsgTrace* self, const Logger* log, int socket)
+{
+	if (!MsgTrace_IsTraced(self))
+	{
+		return;
+	}
+
+	RecordStages(self, MsgTraceStage_Sending, MsgTraceStage_Written);
+
+	const uint64_t* stamps = self->stampNs;
+	uint64_t totalNs = stamps[MsgTraceStage_Written] - stamps[MsgTraceStage_Read];
+
+	if (self->sampled)
+	{
+		Metric_ObserveSampled(&Latency, totalNs);
+	}
+
+	if (self->logged)
+	{
+		LOG_INFO(log, "Trace of a message to socket %d: %" PRIu64 "ns parse, "
+				"%" PRIu64 "ns command queue, %" PRIu64 "ns execute, "
+				"%" PRIu64 "ns task queue, %" PRIu64 "ns write, %" PRIu64 "ns total.",
+				socket,
+				stamps[MsgTraceStage_Parsed] - stamps[MsgTraceStage_Read],
+				stamps[MsgTraceStage_Dequeued] - stamps[MsgTraceStage_Parsed],
+				stamps[MsgTraceStage_Executed] - stamps[MsgTraceStage_Dequeued],
+				stamps[MsgTraceStage_Sending] - stamps[MsgTraceStage_Executed],
+				stamps[MsgTraceStage_Written] - stamps[MsgTraceStage_Sending],
+				totalNs);
+	}
+}
+
+static void RecordStages(const MsgTrace* self, MsgTraceStage first, MsgTraceStage last)
+{
+	if (!self->sampled)
+	{
+		return;
+	}
+
+	for (size_t stage = first; stage <= last; stage++)
+	{
+		Metric_ObserveSampled(&StageTimes[stage], self->stampNs[stage] - self->stampNs[stage - 1]);
+	}
+}
@@ -0,0 +1,290 @@
+#include "obj_pool.h"
+
+#include <stdlib.h>
+
+#ifdef AMN_OBJ_POOL_USE_MALLOC
+
+void* ObjPool_Alloc(size_t size)
+{
+	return malloc(size);
+}
+
+void ObjPool_Free(void* obj)
+{
+	free(obj);
+}
+
+#else
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <pthread.h>
+
+// IrcMsg, with its inline buffer, takes the largest class.
+static const size_t SIZE_CLASSES[] = { 32, 64, 96, 128, 192, 256, 384, 512, 640 };
+
+#define SIZE_CLASS_COUNT (sizeof(SIZE_CLASSES) / sizeof(SIZE_CLASSES[0]))
+#define OBJS_PER_SLAB 64
+// Marks objects allocated with malloc, in ObjHeader.sizeClass.
+#define NO_SIZE_CLASS SIZE_MAX
+
+typedef struct ThreadHeap ThreadHeap;
+
+// In front of every object, keeping the object aligned like malloc.
+typedef struct ObjHeader
+{
+	alignas(max_align_t) ThreadHeap* heap;
+	size_t sizeClass;
+}
+ObjHeader;
+
+// Free objects store the link to the next free object in their first bytes.
+typedef struct FreeObj
+{
+	struct FreeObj* next;
+}
+FreeObj;
+
+typedef struct SizeClassCache
+{
+	// Only used by the thread owning the heap.
+	FreeObj* free;
+	// Pushed to by other threads, taken whole by the owning thread.
+	_Atomic(FreeObj*) remoteFree;
+}
+SizeClassCache;
+
+typedef struct Slab
+{
+	struct Slab* next;
+	alignas(max_align_t) uint8_t objs[];
+}
+Slab;
+
+struct ThreadHeap
+{
+	SizeClassCache caches[SIZE_CLASS_COUNT];
+	Slab* slabs;
+
+	// Following fields are protected by heapsMutex.
+	ThreadHeap* next;
+	// False once its thread exited, so another thread can adopt it.
+	bool owned;
+};
+
+// Every heap ever created. Heaps outlive their threads, as objects they
+// allocated may still be freed.
+static ThreadHeap* heaps = NULL;
+static pthread_mutex_t heapsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_key_t heapKey;
+static pthread_once_t heapKeyOnce = PTHREAD_ONCE_INIT;
+
+static _Thread_local ThreadHeap* currentHeap = NULL;
+
+static void* AllocUnpooled(size_t size);
+static ThreadHeap* CurrentHeap(void);
+static void CreateHeapKey(void);
+static void ReleaseHeap(void* heap);
+static bool ThreadHeap_Grow(ThreadHeap* self, size_t sizeClass);
+
+void* ObjPool_Alloc(size_t size)
+{
+	size_t sizeClass = 0;
+	while (sizeClass < SIZE_CLASS_COUNT && SIZE_CLASSES[sizeClass] < size)
+	{
+		sizeClass++;
+	}
+
+	ThreadHeap* heap = sizeClass < SIZE_CLASS_COUNT ? CurrentHeap() : NULL;
+	if (heap == NULL)
+	{
+		return AllocUnpooled(size);
+	}
+
+	SizeClassCache* cache = &heap->caches[sizeClass];
+
+	if (cache->free == NULL)
+	{
+		cache->free = atomic_exchange_explicit(&cache->remoteFree, NULL, memory_order_acquire);
+	}
+
+	if (cache->free == NULL && !ThreadHeap_Grow(heap, sizeClass))
+	{
+		return NULL;
+	}
+
+	FreeObj* obj = cache->free;
+	cache->free = obj->next;
+
+	return obj;
+}
+
+void ObjPool_Free(void* obj)
+{
+	if (obj == NULL)
+	{
+		return;
+	}
+
+	ObjHeader* header = (ObjHeader*) obj - 1;
+
+	if (header->sizeClass == NO_SIZE_CLASS)
+	{
+		free(header);
+		return;
+	}
+
+	SizeClassCache* cache = &header->heap->caches[header->sizeClass];
+	FreeObj* freeObj = (FreeObj*) obj;
+
+	if (header->heap == currentHeap)
+	{
+		freeObj->next = cache->free;
+		cache->free = freeObj;
+		return;
+	}
+
+	// The owner only ever takes the whole list, so pushing is safe from ABA.
+	freeObj->next = atomic_load_explicit(&cache->remoteFree, memory_order_relaxed);
+	while (!atomic_compare_exchange_weak_explicit(&cache->remoteFree, &freeObj->next, freeObj,
+				memory_order_release, memory_order_relaxed))
+	{
+	}
+}
+
+static void* AllocUnpooled(size_t size)
+{
+	if (size > SIZE_MAX - sizeof(ObjHeader))
+	{
+		return NULL;
+	}
+
+	ObjHeader* header = malloc(sizeof(ObjHeader) + size);
+	if (header == NULL)
+	{
+		return NULL;
+	}
+
+	*header = (ObjHeader) {
+		.heap = NULL,
+		.sizeClass = NO_SIZE_CLASS,
+	};
+
+	return header + 1;
+}
+
+/**
+ * The heap of the calling thread, adopting one left by an exited thread or
+ * creating it on first use. Null on failure.
+ */
+static ThreadHeap* CurrentHeap(void)
+{
+	if (currentHeap != NULL)
+	{
+		return currentHeap;
+	}
+
+	if (pthread_once(&heapKeyOnce, CreateHeapKey) != 0
+			|| pthread_mutex_lock(&heapsMutex) != 0)
+	{
+		return NULL;
+	}
+
+	ThreadHeap* heap = heaps;
+	while (heap != NULL && heap->owned)
+	{
+		heap = heap->next;
+	}
+
+	if (heap == NULL)
+	{
+		heap = calloc(1, sizeof(ThreadHeap));
+		if (heap != NULL)
+		{
+			heap->next = heaps;
+			heaps = heap;
+		}
+	}
+
+	if (heap != NULL)
+	{
+		heap->owned = true;
+	}
+
+	pthread_mutex_unlock(&heapsMutex);
+
+	if (heap == NULL)
+	{
+		return NULL;
+	}
+
+	// Without the destructor the heap is never adopted, but still works.
+	pthread_setspecific(heapKey, heap);
+	currentHeap = heap;
+
+	return heap;
+}
+
+static void CreateHeapKey(void)
+{
+	pthread_key_create(&heapKey, ReleaseHeap);
+}
+
+/**
+ * Called when a thread exits.
+ */
+static void ReleaseHeap(void* heap)
+{
+	if (pthread_mutex_lock(&heapsMutex) != 0)
+	{
+		return;
+	}
+
+	((ThreadHeap*) heap)->owned = false;
+
+	pthread_mutex_unlock(&heapsMutex);
+
+	// Anything freed by later destructors of this thread goes to the remote
+	// free lists, as another thread may adopt the heap from now on.
+	currentHeap = NULL;
+}
+
+/**
+ * Allocates a slab and adds its objects to the free list of sizeClass.
+ */
+static bool ThreadHeap_Grow(ThreadHeap* self, size_t sizeClass)
+{
+	size_t stride = sizeof(ObjHeader) + SIZE_CLASSES[sizeClass];
+
+	Slab* slab = malloc(sizeof(Slab) + stride * OBJS_PER_SLAB);
+	if (slab == NULL)
+	{
+		return false;
+	}
+
+	slab->next = self->slabs;
+	self->slabs = slab;
+
+	SizeClassCache* cache = &self->caches[sizeClass];
+
+	for (size_t i = OBJS_PER_SLAB; i > 0; i--)
+	{
+		ObjHeader* header = (ObjHeader*) (slab->objs + (i - 1) * stride);
+		*header = (ObjHeader) {
+			.heap = self,
+			.sizeClass = sizeClass,
+		};
+
+		FreeObj* obj = (FreeObj*) (header + 1);
+		obj->next = cache->free;
+		cache->free = obj;
+	}
+
+	return true;
+}
+
+#endif // AMN_OBJ_POOL_USE_MALLOC
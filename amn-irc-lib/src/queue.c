@@ -1,17 +1,37 @@
 #include "queue.h"
 
 #include <errno.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
 
+typedef struct QueueLane
+{
+	uint8_t* elements;
+	size_t front; // The index of the next element to be popped.
+	size_t count;
+	// How many more times this lane may be popped before yielding to lower lanes.
+	uint32_t credits;
+}
+QueueLane;
+
 struct Queue
 {
-	uint8_t* elements;	
-	size_t front; // The index of the next ircMsg to be popped.
-	size_t rear; // The index of the last pushed ircMsged.
+	uint8_t* elements;
 	size_t capacity;
-	int32_t shutdownTimeout;
+	bool shutdown;
+
+	QueueLane lanes[QUEUE_MAX_PRIORITIES];
+	size_t priorityCount;
+	// Only used when weighted, otherwise lanes have strict priority.
+	uint32_t weights[QUEUE_MAX_PRIORITIES];
+	bool weighted;
+	// Most elements the lanes held at once. Written under the mutex, read
+	// without it so statistics don't contend with pushes and pops.
+	_Atomic size_t highWater;
+	// Elements the lanes hold, written and read like highWater.
+	_Atomic size_t depth;
 
 	pthread_mutex_t mutex;
 	pthread_cond_t notEmpty;
@@ -19,21 +39,48 @@ struct Queue
 };
 
 static bool Queue_IsEmpty(const Queue* self);
+static bool Queue_IsFull(const Queue* self, size_t priority);
+static QueueLane* Queue_NextLane(Queue* self);
+static void Queue_PopLane(Queue* self, QueueLane* lane, void* outElement, size_t elementSize);
 
-Queue* Queue_New(size_t capacity, int32_t shutdownTimeout, size_t elementSize)
+Queue* Queue_New(size_t capacity, size_t elementSize)
 {
+	return Queue_NewPriority(capacity, elementSize, 1, NULL);
+}
+
+Queue* Queue_NewPriority(size_t capacity, size_t elementSize,
+		size_t priorityCount, const uint32_t* weights)
+{
+	if (priorityCount == 0 || priorityCount > QUEUE_MAX_PRIORITIES)
+		return NULL;
+
+	// The lanes share one allocation, whose size mustn't overflow.
+	if (elementSize != 0 && capacity > SIZE_MAX / elementSize / priorityCount)
+		return NULL;
+
 	Queue* self = malloc(sizeof(Queue));
 	if (self == NULL)
 		return NULL;
 
-	self->front = SIZE_MAX; 
-	self->rear = SIZE_MAX;
+	*self = (Queue) {0};
 	self->capacity = capacity;
-	self->shutdownTimeout = shutdownTimeout;
+	self->priorityCount = priorityCount;
+	self->weighted = weights != NULL;
+
+	if (weights != NULL)
+	{
+		memcpy(self->weights, weights, sizeof(uint32_t) * priorityCount);
+	}
 
-	self->elements = malloc(sizeof(elementSize) * self->capacity);
+	self->elements = malloc(elementSize * self->capacity * priorityCount);
 	if (self->elements == NULL)
-		goto error_ircMsgs;
+		goto error_elements;
+
+	for (size_t i = 0; i < priorityCount; i++)
+	{
+		self->lanes[i].elements = self->elements + i * self->capacity * elementSize;
+		self->lanes[i].credits = self->weights[i];
+	}
 
 	if (pthread_mutex_init(&self->mutex, NULL) != 0)
 		goto error_mutex;
@@ -52,23 +99,32 @@ error_notEmpty:
 	pthread_mutex_destroy(&self->mutex);
 error_mutex:
 	free(self->elements);
-error_ircMsgs:
+error_elements:
 	free(self);
 	return NULL;
 }
 
 void Queue_Delete(Queue* self, void (*elementDeleter)(void*), size_t elementSize)
 {
+	if (self == NULL)
+	{
+		return;
+	}
+
 	pthread_cond_destroy(&self->notFull);
 	pthread_cond_destroy(&self->notEmpty);
 	pthread_mutex_destroy(&self->mutex);
 
-	if (!Queue_IsEmpty(self))
+	for (size_t p = 0; p < self->priorityCount; p++)
 	{
-		for (size_t i = self->front; i <= self->rear; i = (i + 1) % self->capacity)
+		QueueLane* lane = &self->lanes[p];
+
+		for (size_t i = 0; i < lane->count; i++)
 		{
+			size_t index = (lane->front + i) % self->capacity;
+
 			void* element;
-			memcpy(&element, self->elements + i * elementSize, elementSize);
+			memcpy(&element, lane->elements + index * elementSize, elementSize);
 
 			elementDeleter(element);
 		}
@@ -78,61 +134,100 @@ void Queue_Delete(Queue* self, void (*elementDeleter)(void*), size_t elementSize
 	free(self);
 }
 
-bool Queue_IsEmpty(const Queue* self)
+void Queue_Shutdown(Queue* self)
 {
-	return self->front == SIZE_MAX;
+	if (pthread_mutex_lock(&self->mutex) != 0)
+	{
+		return;
+	}
+
+	self->shutdown = true;
+
+	pthread_cond_broadcast(&self->notEmpty);
+	pthread_cond_broadcast(&self->notFull);
+
+	pthread_mutex_unlock(&self->mutex);
 }
 
-bool Queue_IsFull(const Queue* self)
+size_t Queue_HighWater(Queue* self)
 {
-	return self->capacity == 0 || (self->rear + 1) % self->capacity == self->front;
+	return atomic_load_explicit(&self->highWater, memory_order_relaxed);
 }
 
-bool Queue_IsLastElement(const Queue* self)
+size_t Queue_Depth(Queue* self)
 {
-	return self->front == self->rear;
+	return atomic_load_explicit(&self->depth, memory_order_relaxed);
+}
+
+bool Queue_IsEmpty(const Queue* self)
+{
+	for (size_t i = 0; i < self->priorityCount; i++)
+	{
+		if (self->lanes[i].count > 0)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool Queue_IsFull(const Queue* self, size_t priority)
+{
+	return self->lanes[priority].count == self->capacity;
 }
 
 bool Queue_Push(Queue* self, void* element, size_t elementSize)
 {
+	return Queue_PushPriority(self, element, elementSize, self->priorityCount - 1);
+}
+
+bool Queue_PushPriority(Queue* self, void* element, size_t elementSize, size_t priority)
+{
+	if (priority >= self->priorityCount)
+	{
+		errno = EINVAL;
+		return false;
+	}
+
 	if (pthread_mutex_lock(&self->mutex) != 0)
 	{
 		return false;
 	}
-	
+
 	bool success = false;
 
-	while(Queue_IsFull(self))
+	while (Queue_IsFull(self, priority) && !self->shutdown)
 	{
-		struct timespec abs_timeout;
-		if (clock_gettime(CLOCK_REALTIME, &abs_timeout) == -1)
+		if (pthread_cond_wait(&self->notFull, &self->mutex) != 0)
 		{
 			goto cleanup;
 		}
-		abs_timeout.tv_sec += self->shutdownTimeout;
-
-		switch (pthread_cond_timedwait(&self->notFull, &self->mutex, &abs_timeout))
-		{
-			case 0: // Success
-				break;
-			case ETIMEDOUT:
-				errno = EAGAIN;
-			default:
-				goto cleanup;
-		}
 	}
 
-	if (Queue_IsEmpty(self))
+	if (self->shutdown)
 	{
-		self->front = 0;
-		self->rear = 0;
+		errno = ECANCELED;
+		goto cleanup;
 	}
-	else
+
+	QueueLane* lane = &self->lanes[priority];
+	size_t rear = (lane->front + lane->count) % self->capacity;
+
+	memcpy(lane->elements + rear * elementSize, element, elementSize);
+	lane->count++;
+
+	size_t count = 0;
+	for (size_t i = 0; i < self->priorityCount; i++)
 	{
-		self->rear = (self->rear + 1) % self->capacity;
+		count += self->lanes[i].count;
 	}
 
-	memcpy(self->elements + self->rear * elementSize, element, elementSize);
+	atomic_store_explicit(&self->depth, count, memory_order_relaxed);
+	if (count > atomic_load_explicit(&self->highWater, memory_order_relaxed))
+	{
+		atomic_store_explicit(&self->highWater, count, memory_order_relaxed);
+	}
 
 	if (pthread_cond_signal(&self->notEmpty) != 0)
 	{
@@ -159,39 +254,24 @@ bool Queue_Pop(Queue* self, void* outElement, size_t elementSize)
 
 	bool success = false;
 
-	while (Queue_IsEmpty(self))
+	while (Queue_IsEmpty(self) && !self->shutdown)
 	{
-		struct timespec abs_timeout;
-		if (clock_gettime(CLOCK_REALTIME, &abs_timeout) == -1)
+		if (pthread_cond_wait(&self->notEmpty, &self->mutex) != 0)
 		{
 			goto cleanup;
 		}
-		abs_timeout.tv_sec += self->shutdownTimeout;
-
-		switch (pthread_cond_timedwait(&self->notEmpty, &self->mutex, &abs_timeout))
-		{
-			case 0: // Success
-				break;
-			case ETIMEDOUT:
-				errno = EAGAIN;
-			default:
-				goto cleanup;
-		}
 	}
 
-	memcpy(outElement, self->elements + self->front * elementSize, elementSize);
-
-	if (Queue_IsLastElement(self))
-	{
-		self->front = SIZE_MAX; 
-		self->rear = SIZE_MAX;
-	}
-	else
+	if (Queue_IsEmpty(self))
 	{
-		self->front = (self->front + 1) % self->capacity;
+		errno = ECANCELED;
+		goto cleanup;
 	}
 
-	if (pthread_cond_signal(&self->notFull) != 0)
+	Queue_PopLane(self, Queue_NextLane(self), outElement, elementSize);
+
+	// Pushers may be waiting on any of the lanes.
+	if (pthread_cond_broadcast(&self->notFull) != 0)
 	{
 		goto cleanup;
 	}
@@ -222,19 +302,9 @@ Queue_TryPopResult Queue_TryPop(Queue* self, void* outElement, size_t elementSiz
 		goto cleanup;
 	}
 
-	memcpy(&outElement, self->elements + self->front * elementSize, elementSize);
+	Queue_PopLane(self, Queue_NextLane(self), outElement, elementSize);
 
-	if (Queue_IsLastElement(self))
-	{
-		self->front = SIZE_MAX; 
-		self->rear = SIZE_MAX;
-	}
-	else
-	{
-		self->front = (self->front + 1) % self->capacity;
-	}
-
-	if (pthread_cond_signal(&self->notFull) != 0)
+	if (pthread_cond_broadcast(&self->notFull) != 0)
 	{
 		goto cleanup;
 	}
@@ -249,3 +319,60 @@ cleanup:
 
 	return result;
 }
+
+/**
+ * Picks the lane to pop from. The queue must not be empty.
+ */
+static QueueLane* Queue_NextLane(Queue* self)
+{
+	QueueLane* first = NULL;
+
+	for (size_t i = 0; i < self->priorityCount; i++)
+	{
+		QueueLane* lane = &self->lanes[i];
+		if (lane->count == 0)
+		{
+			continue;
+		}
+
+		if (!self->weighted)
+		{
+			return lane;
+		}
+
+		if (first == NULL)
+		{
+			first = lane;
+		}
+
+		if (lane->credits > 0)
+		{
+			lane->credits--;
+			return lane;
+		}
+	}
+
+	// Every lane with elements has used up its credits, start a new round.
+	for (size_t i = 0; i < self->priorityCount; i++)
+	{
+		self->lanes[i].credits = self->weights[i];
+	}
+
+	if (first->credits > 0)
+	{
+		first->credits--;
+	}
+
+	return first;
+}
+
+static void Queue_PopLane(Queue* self, QueueLane* lane, void* outElement, size_t elementSize)
+{
+	memcpy(outElement, lane->elements + lane->front * elementSize, elementSize);
+
+	lane->front = (lane->front + 1) % self->capacity;
+	lane->count--;
+
+	atomic_store_explicit(&self->depth,
+			atomic_load_explicit(&self->depth, memory_order_relaxed) - 1, memory_order_relaxed);
+}
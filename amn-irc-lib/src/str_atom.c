@@ -0,0 +1,415 @@
+#include "str_atom.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+
+struct StrAtom
+{
+	StrAtomTable* table;
+	// Next atom in the same bucket.
+	StrAtom* next;
+	// Holds a reference, unless it's the atom itself.
+	StrAtom* folded;
+
+	atomic_size_t refCount;
+	uint32_t hash;
+	size_t len;
+	char str[];
+};
+
+struct StrAtomTable
+{
+	// Always a power of two.
+	StrAtom** buckets;
+	size_t bucketCount;
+	size_t atomCount;
+
+	pthread_mutex_t mutex;
+};
+
+static StrAtom* StrAtomTable_InternLocked(
+		StrAtomTable* self, const char* str, size_t len, uint32_t hash);
+static void StrAtomTable_Grow(StrAtomTable* self);
+static bool StrAtomTable_Unlink(StrAtomTable* self, StrAtom* atom);
+
+static char Fold(char character);
+static uint32_t Hash(const char* str, size_t len);
+static uint32_t HashFolded(const char* str, size_t len);
+
+
+StrAtomTable* StrAtomTable_New(size_t initialBucketCount)
+{
+	size_t bucketCount = 1;
+	while (bucketCount < initialBucketCount)
+	{
+		bucketCount *= 2;
+	}
+
+	StrAtomTable* self = malloc(sizeof(StrAtomTable));
+	if (self == NULL)
+	{
+		return NULL;
+	}
+
+	*self = (StrAtomTable) {
+		.buckets = calloc(bucketCount, sizeof(StrAtom*)),
+		.bucketCount = bucketCount,
+	};
+
+	if (self->buckets == NULL)
+	{
+		free(self);
+		return NULL;
+	}
+
+	if (pthread_mutex_init(&self->mutex, NULL) != 0)
+	{
+		free(self->buckets);
+		free(self);
+		return NULL;
+	}
+
+	return self;
+}
+
+void StrAtomTable_Delete(StrAtomTable* self)
+{
+	if (self == NULL)
+	{
+		return;
+	}
+
+	// Every atom should have been released by now, free any leftovers anyway.
+	for (size_t i = 0; i < self->bucketCount; i++)
+	{
+		StrAtom* atom = self->buckets[i];
+		while (atom != NULL)
+		{
+			StrAtom* next = atom->next;
+			free(atom);
+			atom = next;
+		}
+	}
+
+	pthread_mutex_destroy(&self->mutex);
+	free(self->buckets);
+	free(self);
+}
+
+StrAtom* StrAtomTable_Intern(StrAtomTable* self, const char* str)
+{
+	return StrAtomTable_InternRange(self, str, str + strlen(str));
+}
+
+StrAtom* StrAtomTable_InternRange(StrAtomTable* self, const char* start, const char* end)
+{
+	size_t len = (size_t) (end - start);
+	uint32_t hash = Hash(start, len);
+
+	if (pthread_mutex_lock(&self->mutex) != 0)
+	{
+		return NULL;
+	}
+
+	StrAtom* atom = StrAtomTable_InternLocked(self, start, len, hash);
+
+	pthread_mutex_unlock(&self->mutex);
+
+	return atom;
+}
+
+const StrAtom* StrAtomTable_FindFolded(StrAtomTable* self, const char* str)
+{
+	size_t len = strlen(str);
+	uint32_t hash = HashFolded(str, len);
+
+	if (pthread_mutex_lock(&self->mutex) != 0)
+	{
+		return NULL;
+	}
+
+	const StrAtom* found = NULL;
+
+	for (StrAtom* atom = self->buckets[hash & (self->bucketCount - 1)];
+			atom != NULL; atom = atom->next)
+	{
+		if (atom->hash != hash || atom->len != len || atom->folded != atom)
+		{
+			continue;
+		}
+
+		size_t i = 0;
+		while (i < len && Fold(str[i]) == atom->str[i])
+		{
+			i++;
+		}
+
+		if (i == len)
+		{
+			found = atom;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&self->mutex);
+
+	return found;
+}
+
+StrAtom* StrAtom_Ref(StrAtom* self)
+{
+	atomic_fetch_add_explicit(&self->refCount, 1, memory_order_relaxed);
+	return self;
+}
+
+void StrAtom_Unref(StrAtom* self)
+{
+	if (self == NULL)
+	{
+		return;
+	}
+
+	// Releasing any reference but the last doesn't need the table lock.
+	size_t refCount = atomic_load_explicit(&self->refCount, memory_order_relaxed);
+	while (refCount > 1)
+	{
+		if (atomic_compare_exchange_weak_explicit(&self->refCount, &refCount, refCount - 1,
+					memory_order_release, memory_order_relaxed))
+		{
+			return;
+		}
+	}
+
+	// The last reference is released under the lock, so Intern can't find
+	// the atom while it's being removed.
+	StrAtomTable* table = self->table;
+	if (pthread_mutex_lock(&table->mutex) != 0)
+	{
+		return;
+	}
+
+	bool removed = atomic_fetch_sub_explicit(&self->refCount, 1, memory_order_acq_rel) == 1
+		&& StrAtomTable_Unlink(table, self);
+
+	pthread_mutex_unlock(&table->mutex);
+
+	if (!removed)
+	{
+		return;
+	}
+
+	StrAtom* folded = self->folded;
+	free(self);
+
+	if (folded != self)
+	{
+		StrAtom_Unref(folded);
+	}
+}
+
+const char* StrAtom_Str(const StrAtom* self)
+{
+	return self->str;
+}
+
+size_t StrAtom_Len(const StrAtom* self)
+{
+	return self->len;
+}
+
+uint32_t StrAtom_Hash(const StrAtom* self)
+{
+	return self->hash;
+}
+
+const StrAtom* StrAtom_Folded(const StrAtom* self)
+{
+	return self->folded;
+}
+
+bool StrAtom_EqualsFolded(const StrAtom* self, const StrAtom* other)
+{
+	return self->folded == other->folded;
+}
+
+/**
+ * Must be called with the mutex held.
+ */
+static StrAtom* StrAtomTable_InternLocked(
+		StrAtomTable* self, const char* str, size_t len, uint32_t hash)
+{
+	StrAtom** bucket = &self->buckets[hash & (self->bucketCount - 1)];
+
+	for (StrAtom* atom = *bucket; atom != NULL; atom = atom->next)
+	{
+		if (atom->hash == hash && atom->len == len && memcmp(atom->str, str, len) == 0)
+		{
+			return StrAtom_Ref(atom);
+		}
+	}
+
+	StrAtom* atom = malloc(sizeof(StrAtom) + len + 1);
+	if (atom == NULL)
+	{
+		return NULL;
+	}
+
+	*atom = (StrAtom) {
+		.table = self,
+		.folded = atom,
+		.refCount = 1,
+		.hash = hash,
+		.len = len,
+	};
+	memcpy(atom->str, str, len);
+	atom->str[len] = '\0';
+
+	size_t firstToFold = 0;
+	while (firstToFold < len && Fold(str[firstToFold]) == str[firstToFold])
+	{
+		firstToFold++;
+	}
+
+	if (firstToFold < len)
+	{
+		// The folded form is folded already, so this never goes deeper.
+		char* foldedStr = malloc(len);
+		if (foldedStr == NULL)
+		{
+			free(atom);
+			return NULL;
+		}
+
+		for (size_t i = 0; i < len; i++)
+		{
+			foldedStr[i] = Fold(str[i]);
+		}
+
+		atom->folded = StrAtomTable_InternLocked(self, foldedStr, len, Hash(foldedStr, len));
+		free(foldedStr);
+
+		if (atom->folded == NULL)
+		{
+			free(atom);
+			return NULL;
+		}
+
+		// Interning the folded form may have grown the table.
+		bucket = &self->buckets[hash & (self->bucketCount - 1)];
+	}
+
+	atom->next = *bucket;
+	*bucket = atom;
+	self->atomCount++;
+
+	if (self->atomCount > self->bucketCount)
+	{
+		StrAtomTable_Grow(self);
+	}
+
+	return atom;
+}
+
+/**
+ * Doubles the bucket count, keeping the current buckets if that fails.
+ */
+static void StrAtomTable_Grow(StrAtomTable* self)
+{
+	size_t bucketCount = self->bucketCount * 2;
+
+	StrAtom** buckets = calloc(bucketCount, sizeof(StrAtom*));
+	if (buckets == NULL)
+	{
+		return;
+	}
+
+	for (size_t i = 0; i < self->bucketCount; i++)
+	{
+		StrAtom* atom = self->buckets[i];
+		while (atom != NULL)
+		{
+			StrAtom* next = atom->next;
+			StrAtom** bucket = &buckets[atom->hash & (bucketCount - 1)];
+			atom->next = *bucket;
+			*bucket = atom;
+			atom = next;
+		}
+	}
+
+	free(self->buckets);
+	self->buckets = buckets;
+	self->bucketCount = bucketCount;
+}
+
+static bool StrAtomTable_Unlink(StrAtomTable* self, StrAtom* atom)
+{
+	StrAtom** link = &self->buckets[atom->hash & (self->bucketCount - 1)];
+
+	while (*link != NULL)
+	{
+		if (*link == atom)
+		{
+			*link = atom->next;
+			self->atomCount--;
+			return true;
+		}
+
+		link = &(*link)->next;
+	}
+
+	return false;
+}
+
+/**
+ * https://datatracker.ietf.org/doc/html/rfc1459#section-2.2
+ * {}| are the lowercase of []\.
+ */
+static char Fold(char character)
+{
+	if (character >= 'A' && character <= 'Z')
+	{
+		return (char) (character - 'A' + 'a');
+	}
+
+	switch (character)
+	{
+		case '[':
+			return '{';
+		case ']':
+			return '}';
+		case '\\':
+			return '|';
+		default:
+			return character;
+	}
+}
+
+// FNV-1a
+static uint32_t Hash(const char* str, size_t len)
+{
+	uint32_t hash = 2166136261u;
+
+	for (size_t i = 0; i < len; i++)
+	{
+		hash ^= (uint8_t) str[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static uint32_t HashFolded(const char* str, size_t len)
+{
+	uint32_t hash = 2166136261u;
+
+	for (size_t i = 0; i < len; i++)
+	{
+		hash ^= (uint8_t) Fold(str[i]);
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
@@ -1,5 +1,7 @@
 #include "task.h"
 
+#include "obj_pool.h"
+
 #include <stdlib.h>
 
 struct Task
@@ -7,6 +9,7 @@ struct Task
 	TaskStatus (*task)(void* context);
 	void* context;	
 	void (*deleteContext)(void* context);
+	uint64_t queuedNs;
 };
 
 Task* Task_Create(
@@ -14,7 +17,7 @@ Task* Task_Create(
 	void* context,	
 	void (*deleteContext)(void* context))
 {
-	Task* self = malloc(sizeof(Task));
+	Task* self = ObjPool_Alloc(sizeof(Task));
 
 	if(self == NULL)
 	{
@@ -24,6 +27,7 @@ Task* Task_Create(
 	self->task = task;
 	self->context = context;
 	self->deleteContext = deleteContext;
+	self->queuedNs = 0;
 
 	return self;
 }
@@ -38,6 +42,16 @@ void Task_Delete(Task* self)
 	if (self != NULL)
 	{
 		self->deleteContext(self->context);
-		free(self);
+		ObjPool_Free(self);
 	}
 }
+
+uint64_t Task_QueuedNs(const Task* self)
+{
+	return self->queuedNs;
+}
+
+void Task_SetQueuedNs(Task* self, uint64_t ns)
+{
+	self->queuedNs = ns;
+}
@@ -1,14 +1,32 @@
 #include "task_queue.h"
 
+#include "metrics.h"
 #include "queue.h"
 
-TaskQueue* TaskQueue_New(size_t capacity, int32_t shutdownTimeout)
+// High priority tasks are popped up to 8 times for each normal one, so a burst
+// of them can't starve everything else.
+static const uint32_t PRIORITY_WEIGHTS[TaskPriority_Len] = {
+	[TaskPriority_High] = 8,
+	[TaskPriority_Normal] = 1,
+};
+
+static Metric TaskQueueDepth = METRIC_GAUGE("amn_task_queue_depth",
+		"Tasks waiting for a runner.");
+static Metric TaskQueueWait = METRIC_HISTOGRAM("amn_task_queue_wait_seconds",
+		"Time tasks waited for a runner.");
+
+TaskQueue* TaskQueue_New(size_t capacity)
 {
-	return (TaskQueue*) Queue_New(capacity, shutdownTimeout, sizeof(Task*)); 
+	Metric_Register(&TaskQueueDepth);
+	Metric_Register(&TaskQueueWait);
+
+	return (TaskQueue*) Queue_NewPriority(capacity, sizeof(Task*),
+			TaskPriority_Len, PRIORITY_WEIGHTS);
 }
 
 static void ElementDeleter(void* element)
 {
+	Metric_Add(&TaskQueueDepth, -1);
 	Task_Delete((Task*) element);
 }
 
@@ -17,9 +35,40 @@ void TaskQueue_Delete(TaskQueue* self)
 	Queue_Delete((Queue*) self, ElementDeleter, sizeof(Task*));
 }
 
+void TaskQueue_Shutdown(TaskQueue* self)
+{
+	Queue_Shutdown((Queue*) self);
+}
+
+size_t TaskQueue_HighWater(TaskQueue* self)
+{
+	return Queue_HighWater((Queue*) self);
+}
+
+size_t TaskQueue_Depth(TaskQueue* self)
+{
+	return Queue_Depth((Queue*) self);
+}
+
 bool TaskQueue_Push(TaskQueue* self, Task* task)
 {
-	return Queue_Push((Queue*) self, &task, sizeof(Task*));
+	return TaskQueue_PushPriority(self, task, TaskPriority_Normal);
+}
+
+bool TaskQueue_PushPriority(TaskQueue* self, Task* task, TaskPriority priority)
+{
+	Task_SetQueuedNs(task, Metrics_SampleNs());
+
+	// Counted first, so a quick pop can't take the depth below zero.
+	Metric_Add(&TaskQueueDepth, 1);
+
+	if (!Queue_PushPriority((Queue*) self, &task, sizeof(Task*), (size_t) priority))
+	{
+		Metric_Add(&TaskQueueDepth, -1);
+		return false;
+	}
+
+	return true;
 }
 
 Task* TaskQueue_Pop(TaskQueue* self)
@@ -31,5 +80,8 @@ Task* TaskQueue_Pop(TaskQueue* self)
 		return false;
 	}
 
+	Metric_Add(&TaskQueueDepth, -1);
+	Metric_ObserveSince(&TaskQueueWait, Task_QueuedNs(task));
+
 	return task;
 }
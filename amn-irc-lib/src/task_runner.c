@@ -1,24 +1,42 @@
+// For pthread_setname_np and pthread_attr_setaffinity_np.
+#define _GNU_SOURCE
+
 #include "task_runner.h"
 
 #include "application.h"
+#include "flight_recorder.h"
+#include "metrics.h"
 #include "task.h"
 #include "task_queue.h"
 
 #include <errno.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include <pthread.h>
+#include <sched.h>
 
 struct TaskRunner
 {
 	const Logger* log;
 	TaskQueue* tasks;
 	pthread_t thread;
+	// When the thread was started, see Metrics_NowNs.
+	uint64_t startNs;
+	bool joined;
+
+	// Held by TaskRunner_Times while it reads the thread's clock, so the
+	// thread can't exit meanwhile. Once exited is set, the thread is gone and
+	// its CPU time is in exitBusyNs.
+	pthread_mutex_t timesMutex;
+	bool exited;
+	uint64_t exitBusyNs;
 };
 
 static void* TaskRunner_Run(void* self);
+static void TaskRunner_Exit(TaskRunner* self);
 
-TaskRunner* TaskRunner_New(Logger* log, TaskQueue* taskQueue)
+TaskRunner* TaskRunner_New(Logger* log, TaskQueue* taskQueue, const char* name, int cpu)
 {
 	TaskRunner* self = malloc(sizeof(TaskRunner));
 	if (self == NULL)
@@ -29,19 +47,68 @@ TaskRunner* TaskRunner_New(Logger* log, TaskQueue* taskQueue)
 
 	self->log = log;
 	self->tasks = taskQueue;
+	self->joined = false;
+	self->exited = false;
+	self->exitBusyNs = 0;
+
+	if (pthread_mutex_init(&self->timesMutex, NULL) != 0)
+	{
+		LOG_ERROR(self->log, "Failed to create TaskRunner: mutex creation failed.");
+		free(self);
+		return NULL;
+	}
+
+	pthread_attr_t attr;
+	if (pthread_attr_init(&attr) != 0)
+	{
+		LOG_ERROR(self->log, "Failed to create TaskRunner: thread attributes failed.");
+		pthread_mutex_destroy(&self->timesMutex);
+		free(self);
+		return NULL;
+	}
 
-	if(pthread_create(&self->thread, NULL, TaskRunner_Run, self) != 0)
+	if (cpu >= 0)
 	{
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET((size_t) cpu, &cpus);
+
+		if (pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &cpus) != 0)
+		{
+			LOG_ERROR(self->log, "Failed to create TaskRunner: can't pin to CPU %d.", cpu);
+			pthread_attr_destroy(&attr);
+			pthread_mutex_destroy(&self->timesMutex);
+			free(self);
+			return NULL;
+		}
+	}
+
+	self->startNs = Metrics_NowNs();
+
+	int error = pthread_create(&self->thread, &attr, TaskRunner_Run, self);
+	pthread_attr_destroy(&attr);
+
+	if (error != 0)
+	{
+		errno = error;
 		LOG_ERROR(self->log, "Failed to create TaskRunner: thread creation failed.");
+		pthread_mutex_destroy(&self->timesMutex);
+		free(self);
 		return NULL;
 	}
 
+	// Only a nicety for debugging, so failing is fine.
+	if (name != NULL && pthread_setname_np(self->thread, name) != 0)
+	{
+		LOG_WARN(self->log, "Failed to name TaskRunner thread %s.", name);
+	}
+
 	return self;
 }
 
-void TaskRunner_Delete(TaskRunner* self)
+void TaskRunner_Join(TaskRunner* self)
 {
-	if (self == NULL)
+	if (self == NULL || self->joined)
 	{
 		return;
 	}
@@ -51,11 +118,63 @@ void TaskRunner_Delete(TaskRunner* self)
 		LOG_ERROR(self->log, "Failed to stop TaskRunner: thread join failed.");
 	}
 
+	self->joined = true;
+
 	LOG_DEBUG(self->log, "Task runner shut down.");
+}
+
+void TaskRunner_Delete(TaskRunner* self)
+{
+	if (self == NULL)
+	{
+		return;
+	}
+
+	TaskRunner_Join(self);
 
+	pthread_mutex_destroy(&self->timesMutex);
 	free(self);
 }
 
+bool TaskRunner_Times(TaskRunner* self, uint64_t* busyNs, uint64_t* idleNs)
+{
+	if (pthread_mutex_lock(&self->timesMutex) != 0)
+	{
+		return false;
+	}
+
+	bool success = true;
+	if (self->exited)
+	{
+		*busyNs = self->exitBusyNs;
+	}
+	else
+	{
+		// Read from the kernel's accounting, so running tasks isn't slowed down by timing them.
+		clockid_t clock;
+		struct timespec cpuTime;
+		success = pthread_getcpuclockid(self->thread, &clock) == 0
+			&& clock_gettime(clock, &cpuTime) == 0;
+
+		if (success)
+		{
+			*busyNs = (uint64_t) cpuTime.tv_sec * 1000000000 + (uint64_t) cpuTime.tv_nsec;
+		}
+	}
+
+	pthread_mutex_unlock(&self->timesMutex);
+
+	if (!success)
+	{
+		return false;
+	}
+
+	uint64_t elapsedNs = Metrics_NowNs() - self->startNs;
+	*idleNs = elapsedNs > *busyNs ? elapsedNs - *busyNs : 0;
+
+	return true;
+}
+
 static void* TaskRunner_Run(void* arg)
 {
 	TaskRunner* self = (TaskRunner*) arg;
@@ -63,16 +182,22 @@ static void* TaskRunner_Run(void* arg)
 	while (!Application_ShouldShutdown())
 	{
 		Task* task = TaskQueue_Pop(self->tasks);
-		if (task == NULL && errno == EAGAIN)
+		if (task == NULL && errno == ECANCELED)
 		{
-			continue;
+			// The queue was shut down.
+			break;
 		}
 		else if (task == NULL)
 		{
 			LOG_ERROR(self->log, "Failed to get task from queue!");
+			FlightRecorder_Dump("runner failed to get a task");
+			TaskRunner_Exit(self);
 			return NULL;
 		}
 
+		FlightRecorder_Record(FlightEventType_TaskStarted, IrcCmdType_Null, -1,
+				TaskQueue_Depth(self->tasks), 0);
+
 		TaskStatus status;
 		do
 		{
@@ -80,6 +205,20 @@ static void* TaskRunner_Run(void* arg)
 		}
 		while (status == TaskStatus_Yield && !Application_ShouldShutdown());
 
+		if (status == TaskStatus_Done)
+		{
+			FlightRecorder_Record(FlightEventType_TaskDone, IrcCmdType_Null, -1, 0, 0);
+		}
+		else if (status == TaskStatus_Failed)
+		{
+			FlightRecorder_Record(FlightEventType_TaskFailed, IrcCmdType_Null, -1, 0, 0);
+
+			if (FlightRecorder_DumpThrottled("task failed"))
+			{
+				LOG_WARN(self->log, "Task failed, dumped the flight recorder.");
+			}
+		}
+
 		Task_Delete(task);
 	}
 
@@ -87,5 +226,23 @@ static void* TaskRunner_Run(void* arg)
 
 	LOG_INFO(self->log, "Task runner shutting down.");
 
+	TaskRunner_Exit(self);
 	return NULL;
 }
+
+/**
+ * Keeps the thread's CPU time for TaskRunner_Times, which must not read the
+ * thread's clock once it may be joined. Called by the thread before it exits.
+ */
+static void TaskRunner_Exit(TaskRunner* self)
+{
+	struct timespec cpuTime;
+	bool hasCpuTime = clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuTime) == 0;
+
+	pthread_mutex_lock(&self->timesMutex);
+	self->exitBusyNs = hasCpuTime
+		? (uint64_t) cpuTime.tv_sec * 1000000000 + (uint64_t) cpuTime.tv_nsec
+		: 0;
+	self->exited = true;
+	pthread_mutex_unlock(&self->timesMutex);
+}
@@ -0,0 +1,32 @@
+#ifndef AMN_BENCH_H
+#define AMN_BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+  * Helpers for the benchmarks, which print their measurements and are run
+  * by hand. Times are from Metrics_NowNs.
+  */
+
+static inline int Bench_CompareU64(const void* a, const void* b)
+{
+	uint64_t x = *(const uint64_t*) a;
+	uint64_t y = *(const uint64_t*) b;
+
+	return (x > y) - (x < y);
+}
+
+/**
+ * Sorts the samples and returns the one at the percentile, 0 to 100.
+ * There must be at least one sample.
+ */
+static inline uint64_t Bench_Percentile(uint64_t* samples, size_t count, double percentile)
+{
+	qsort(samples, count, sizeof(uint64_t), Bench_CompareU64);
+
+	return samples[(size_t) ((double) (count - 1) * percentile / 100.0)];
+}
+
+#endif // AMN_BENCH_H
@@ -0,0 +1,165 @@
+/**
+ * Prints ns per operation of the executor's containers against the
+ * ArrayList they replaced, at sizes from a small channel to a full server:
+ * channel members added, looked up and removed by id, and users looked up
+ * by socket.
+ * Usage: bench_containers [operations per size]
+ */
+
+#include "array_list.h"
+#include "hash_map.h"
+#include "metrics.h"
+#include "vector.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+VECTOR_DEFINE(IdVector, uint64_t, VECTOR_EQUALS_SCALAR)
+
+#define SOCKET_HASH(socket) HashMap_HashU64((uint64_t) (socket))
+
+HASH_MAP_DEFINE(SocketMap, int, uint64_t, SOCKET_HASH, HASH_MAP_EQUALS_SCALAR)
+
+// What the user list stored, found by socket.
+typedef struct SocketUser
+{
+	int socket;
+	uint64_t id;
+}
+SocketUser;
+
+static bool IdEquals(const void* element, const void* id)
+{
+	return *(const uint64_t*) element == *(const uint64_t*) id;
+}
+
+static bool SocketEquals(const void* element, const void* socket)
+{
+	return ((const SocketUser*) element)->socket == *(const int*) socket;
+}
+
+// Keeps the compiler from dropping lookups whose result is unused.
+static volatile uint64_t sink;
+
+static double NsPerOp(uint64_t startNs, size_t ops)
+{
+	return (double) (Metrics_NowNs() - startNs) / (double) ops;
+}
+
+/**
+ * Adds size members, then looks up and removes them in another order.
+ */
+static void BenchMembers(size_t size, size_t ops)
+{
+	size_t rounds = ops / size > 0 ? ops / size : 1;
+	uint64_t found = 0;
+
+	uint64_t startNs = Metrics_NowNs();
+	for (size_t round = 0; round < rounds; round++)
+	{
+		ArrayList* list = ArrayList_New(8, 8, sizeof(uint64_t), NULL);
+		for (uint64_t id = 0; id < size; id++)
+		{
+			ArrayList_Append(list, &id);
+		}
+		for (uint64_t id = 0; id < size; id++)
+		{
+			uint64_t key = size - 1 - id;
+			found += ArrayList_Find(list, IdEquals, &key) != NULL;
+		}
+		for (uint64_t id = 0; id < size; id++)
+		{
+			ArrayList_Remove(list, IdEquals, &id, false);
+		}
+		ArrayList_Delete(list);
+	}
+	double listNs = NsPerOp(startNs, rounds * size * 3);
+
+	startNs = Metrics_NowNs();
+	for (size_t round = 0; round < rounds; round++)
+	{
+		IdVector vector = {0};
+		for (uint64_t id = 0; id < size; id++)
+		{
+			IdVector_Push(&vector, id);
+		}
+		for (uint64_t id = 0; id < size; id++)
+		{
+			found += IdVector_Contains(&vector, size - 1 - id);
+		}
+		for (uint64_t id = 0; id < size; id++)
+		{
+			IdVector_SwapRemoveItem(&vector, id);
+		}
+		IdVector_Free(&vector);
+	}
+	double vectorNs = NsPerOp(startNs, rounds * size * 3);
+
+	sink = found;
+	printf("members %5zu: array list %8.1fns/op, vector %8.1fns/op\n",
+			size, listNs, vectorNs);
+}
+
+static void BenchUsers(size_t size, size_t ops)
+{
+	ArrayList* list = ArrayList_New(8, 8, sizeof(SocketUser), NULL);
+	SocketMap map = {0};
+
+	// Sockets are small numbers, reused as clients come and go.
+	for (size_t i = 0; i < size; i++)
+	{
+		SocketUser user = { .socket = (int) i + 5, .id = i };
+		ArrayList_Append(list, &user);
+		SocketMap_Put(&map, user.socket, user.id);
+	}
+
+	uint64_t found = 0;
+
+	uint64_t startNs = Metrics_NowNs();
+	for (size_t i = 0; i < ops; i++)
+	{
+		int socket = (int) (i * 7919 % size) + 5;
+		SocketUser* user = ArrayList_Find(list, SocketEquals, &socket);
+		found += user->id;
+	}
+	double listNs = NsPerOp(startNs, ops);
+
+	startNs = Metrics_NowNs();
+	for (size_t i = 0; i < ops; i++)
+	{
+		int socket = (int) (i * 7919 % size) + 5;
+		found += *SocketMap_Get(&map, socket);
+	}
+	double mapNs = NsPerOp(startNs, ops);
+
+	sink = found;
+	printf("users   %5zu: array list %8.1fns/op, hash map %6.1fns/op\n",
+			size, listNs, mapNs);
+
+	ArrayList_Delete(list);
+	SocketMap_Free(&map);
+}
+
+int main(int argc, char** argv)
+{
+	size_t ops = argc > 1 ? strtoul(argv[1], NULL, 10) : 200000;
+	if (ops == 0)
+	{
+		fprintf(stderr, "Usage: %s [operations per size]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	const size_t sizes[] = { 8, 64, 512, 4096 };
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+	{
+		BenchMembers(sizes[i], ops);
+	}
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+	{
+		BenchUsers(sizes[i], ops);
+	}
+
+	return EXIT_SUCCESS;
+}
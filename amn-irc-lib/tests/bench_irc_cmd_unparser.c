@@ -0,0 +1,76 @@
+/**
+ * Prints how long unparsing a PRIVMSG takes, into an IrcMsg and that into
+ * text, and straight into a buffer with IrcCmdUnparser_UnparseTo.
+ * Usage: bench_irc_cmd_unparser [messages]
+ */
+
+#include "irc_cmd_unparser.h"
+#include "irc_msg_unparser.h"
+#include "irc_msg_validator.h"
+#include "log.h"
+#include "metrics.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char** argv)
+{
+	size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+	if (count == 0)
+	{
+		fprintf(stderr, "Usage: %s [messages]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	FILE* logFiles[] = { stderr };
+	Logger* log = Logger_Create(logFiles, 1);
+	IrcMsgValidator* validator = IrcMsgValidator_New(log);
+	IrcCmdUnparser* cmdUnparser = IrcCmdUnparser_New(log, validator);
+	IrcMsgUnparser* msgUnparser = IrcMsgUnparser_New(log);
+
+	// What the server relays most.
+	IrcCmd cmd = {
+		.type = IrcCmdType_PrivMsg,
+		.prefix = { .origin = "alice", .username = "al", .hostname = "example.org" },
+		.privMsg = {
+			.receiverCount = 3,
+			.text = "Did anyone see the game last night? What a finish!",
+		},
+	};
+	cmd.privMsg.receiver[0] = (IrcReceiver) { IrcReceiverType_Nickname, "bob" };
+	cmd.privMsg.receiver[1] = (IrcReceiver) { IrcReceiverType_DistChannelOrHostMask, "sports" };
+	cmd.privMsg.receiver[2] = (IrcReceiver) { IrcReceiverType_LocalChannel, "local" };
+
+	size_t written = 0;
+
+	uint64_t startNs = Metrics_NowNs();
+	for (size_t i = 0; i < count; i++)
+	{
+		IrcMsg* msg = IrcCmdUnparser_Unparse(cmdUnparser, &cmd);
+		const char* text = IrcMsgUnparser_Unparse(msgUnparser, msg);
+		written += text[0] != '\0';
+		IrcMsg_Delete(msg);
+	}
+	uint64_t twoStageNs = Metrics_NowNs() - startNs;
+
+	char buffer[IRC_MSG_SIZE + 1];
+
+	startNs = Metrics_NowNs();
+	for (size_t i = 0; i < count; i++)
+	{
+		written += IrcCmdUnparser_UnparseTo(cmdUnparser, &cmd, buffer, sizeof(buffer)) > 0;
+	}
+	uint64_t directNs = Metrics_NowNs() - startNs;
+
+	printf("%zu messages, %zu written\n", count, written);
+	printf("%-10s %6.1fns/message\n", "two-stage", (double) twoStageNs / (double) count);
+	printf("%-10s %6.1fns/message\n", "direct", (double) directNs / (double) count);
+
+	IrcMsgUnparser_Delete(msgUnparser);
+	IrcCmdUnparser_Delete(cmdUnparser);
+	IrcMsgValidator_Delete(validator);
+	Logger_Destroy(log);
+
+	return EXIT_SUCCESS;
+}
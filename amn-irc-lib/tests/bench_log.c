@@ -0,0 +1,110 @@
+/**
+ * Prints ns per LOG_INFO call, for a message like the server's, written as
+ * text and to a binary log file, and the bytes each message takes in the
+ * file. The caller's time is what a task pays, the total adds the writer
+ * thread draining the rest. Callers block when their ring is full, so
+ * nothing is dropped. Files are temporary, in /tmp.
+ * Usage: bench_log [messages]
+ */
+
+#include "log.h"
+#include "metrics.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define NULL_PATH "/dev/null"
+
+static void LogMessages(Logger* log, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		LOG_INFO(log, "Received %s from socket %d, %zu bytes queued", "PRIVMSG", 17, i);
+	}
+}
+
+static void Bench(const char* name, bool binary, size_t count)
+{
+	char path[] = "/tmp/bench_log_XXXXXX";
+	int fd = mkstemp(path);
+	if (fd == -1)
+	{
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	close(fd);
+
+	// The text files are replaced by the binary one.
+	FILE* file = fopen(binary ? NULL_PATH : path, "w");
+	FILE* logFiles[] = { file };
+	Logger* log = file != NULL ? Logger_Create(logFiles, 1) : NULL;
+	if (log == NULL || (binary && !Logger_OpenBinaryFile(log, path)))
+	{
+		fprintf(stderr, "Failed to create the %s logger.\n", name);
+		exit(EXIT_FAILURE);
+	}
+
+	Logger_SetFullPolicy(log, LogFullPolicy_Block);
+
+	uint64_t startNs = Metrics_NowNs();
+	LogMessages(log, count);
+	uint64_t callerNs = Metrics_NowNs() - startNs;
+
+	uint64_t dropped = Logger_DroppedCount(log);
+	Logger_Destroy(log);
+	uint64_t totalNs = Metrics_NowNs() - startNs;
+	fclose(file);
+
+	struct stat fileStat;
+	double bytes = stat(path, &fileStat) == 0 ? (double) fileStat.st_size / (double) count : 0;
+	unlink(path);
+
+	printf("%-7s caller %6.1fns/call, total %6.1fns/message, %5.1f bytes/message, %"
+			PRIu64 " dropped\n", name, (double) callerNs / (double) count,
+			(double) totalNs / (double) count, bytes, dropped);
+}
+
+/**
+ * What a call below the level costs, the check of its site's cached level.
+ */
+static void BenchDisabled(size_t count)
+{
+	FILE* logFiles[] = { stderr };
+	Logger* log = Logger_Create(logFiles, 1);
+	if (log == NULL)
+	{
+		fprintf(stderr, "Failed to create the logger.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	Logger_SetLevel(log, LogLevel_Warn);
+
+	uint64_t startNs = Metrics_NowNs();
+	LogMessages(log, count);
+	uint64_t callerNs = Metrics_NowNs() - startNs;
+
+	Logger_Destroy(log);
+
+	printf("%-7s caller %6.1fns/call\n", "off", (double) callerNs / (double) count);
+}
+
+int main(int argc, char** argv)
+{
+	size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000000;
+	if (count == 0)
+	{
+		fprintf(stderr, "Usage: %s [messages]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	Bench("text", false, count);
+	Bench("binary", true, count);
+	BenchDisabled(count);
+
+	return EXIT_SUCCESS;
+}
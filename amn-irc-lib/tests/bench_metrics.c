@@ -0,0 +1,197 @@
+/**
+ * Prints ns per message through the receive and execute path of a PRIVMSG,
+ * parsed, queued, executed and deleted, with the metric updates the server
+ * makes for it and with them stubbed out, and what the updates cost. Those
+ * are the read counters, the queue gauge and wait histogram, the timed
+ * execution histogram and the sampled latency of the message. Times are the
+ * CPU time of each thread, so they hold with more threads than CPUs. Each
+ * thread updates its own shard, so the cost shouldn't grow with threads.
+ * Usage: bench_metrics [messages] [threads]
+ */
+
+#include "irc_cmd_parser.h"
+#include "irc_msg_parser.h"
+#include "irc_msg_validator.h"
+#include "log.h"
+#include "metrics.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#define MAX_THREADS 64
+
+static const char RAW_MSG[] = "PRIVMSG #sports,bob :What a finish!\r\n";
+
+static Metric ReceivedBytes = METRIC_COUNTER("bench_receive_bytes_total", "Bytes read.");
+static Metric ReceivedLines = METRIC_COUNTER("bench_receive_lines_total", "Messages read.");
+static Metric QueueDepth = METRIC_GAUGE("bench_cmd_queue_depth", "Queued commands.");
+static Metric QueueWait = METRIC_HISTOGRAM("bench_cmd_queue_wait_seconds", "Queue waits.");
+static Metric ExecTime = METRIC_HISTOGRAM("bench_exec_seconds", "Execution times.");
+static Metric Latency = METRIC_HISTOGRAM("bench_latency_seconds", "Read to executed.");
+
+typedef struct Worker
+{
+	pthread_t thread;
+	IrcMsgParser* msgParser;
+	IrcCmdParser* cmdParser;
+	size_t count;
+	bool metrics;
+	uint64_t ns;
+}
+Worker;
+
+/**
+ * One message, with the updates of ReceiveMsgTask, IrcCmdQueue and the
+ * executor if metrics is set.
+ */
+static void HandleMessage(const Worker* worker, bool metrics)
+{
+	uint64_t readNs = metrics ? Metrics_SampleNs() : 0;
+
+	IrcMsg* msg = IrcMsgParser_Parse(worker->msgParser, RAW_MSG);
+	IrcCmd* cmd = msg != NULL ? IrcCmdParser_Parse(worker->cmdParser, msg, 5) : NULL;
+	if (cmd == NULL)
+	{
+		fprintf(stderr, "Failed to parse %s", RAW_MSG);
+		exit(EXIT_FAILURE);
+	}
+
+	if (metrics)
+	{
+		Metric_Add(&ReceivedBytes, (int64_t) strlen(RAW_MSG));
+		Metric_Add(&ReceivedLines, 1);
+
+		// Pushed, then popped.
+		uint64_t queuedNs = Metrics_SampleNs();
+		Metric_Add(&QueueDepth, 1);
+		Metric_Add(&QueueDepth, -1);
+		Metric_ObserveSince(&QueueWait, queuedNs);
+
+		uint64_t startNs = Metrics_NowNs();
+		Metric_Observe(&ExecTime, Metrics_NowNs() - startNs);
+	}
+
+	IrcCmd_Delete(cmd);
+
+	if (metrics)
+	{
+		Metric_ObserveSince(&Latency, readNs);
+	}
+}
+
+static uint64_t ThreadCpuNs(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+
+	return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+static void* RunWorker(void* arg)
+{
+	Worker* self = arg;
+
+	uint64_t startNs = ThreadCpuNs();
+	for (size_t i = 0; i < self->count; i++)
+	{
+		HandleMessage(self, self->metrics);
+	}
+	self->ns = ThreadCpuNs() - startNs;
+
+	return NULL;
+}
+
+/**
+ * @return Mean ns per message of the threads.
+ */
+static double Run(Worker* workers, size_t threadCount, bool metrics)
+{
+	for (size_t i = 0; i < threadCount; i++)
+	{
+		workers[i].metrics = metrics;
+		if (pthread_create(&workers[i].thread, NULL, RunWorker, &workers[i]) != 0)
+		{
+			fprintf(stderr, "Failed to start thread %zu.\n", i);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	uint64_t ns = 0;
+	for (size_t i = 0; i < threadCount; i++)
+	{
+		pthread_join(workers[i].thread, NULL);
+		ns += workers[i].ns;
+	}
+
+	return (double) ns / (double) (workers[0].count * threadCount);
+}
+
+int main(int argc, char** argv)
+{
+	size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+	size_t threadCount = argc > 2 ? strtoul(argv[2], NULL, 10) : 1;
+	if (count == 0 || threadCount == 0 || threadCount > MAX_THREADS)
+	{
+		fprintf(stderr, "Usage: %s [messages] [threads, 1 to %d]\n", argv[0], MAX_THREADS);
+		return EXIT_FAILURE;
+	}
+
+	FILE* logFiles[] = { stderr };
+	Logger* log = Logger_Create(logFiles, 1);
+	IrcMsgValidator* validator = IrcMsgValidator_New(log);
+	IrcMsgParser* msgParser = IrcMsgParser_New(log, validator);
+	IrcCmdParser* cmdParser = IrcCmdParser_New(log, validator);
+	if (msgParser == NULL || cmdParser == NULL)
+	{
+		fprintf(stderr, "Failed to create the parsers.\n");
+		return EXIT_FAILURE;
+	}
+
+	Metric_Register(&ReceivedBytes);
+	Metric_Register(&ReceivedLines);
+	Metric_Register(&QueueDepth);
+	Metric_Register(&QueueWait);
+	Metric_Register(&ExecTime);
+	Metric_Register(&Latency);
+
+	static Worker workers[MAX_THREADS];
+	for (size_t i = 0; i < threadCount; i++)
+	{
+		workers[i] = (Worker) {
+			.msgParser = msgParser,
+			.cmdParser = cmdParser,
+			.count = count,
+		};
+	}
+
+	printf("%zu messages of %.*s on %zu threads\n", count, (int) strlen(RAW_MSG) - 2, RAW_MSG,
+			threadCount);
+
+	// Warms up the object pools and the metric shards.
+	Run(workers, threadCount, true);
+
+	double stubNs = Run(workers, threadCount, false);
+	double metricsNs = Run(workers, threadCount, true);
+
+	printf("%-8s %8.1fns/message\n", "stubbed", stubNs);
+	printf("%-8s %8.1fns/message\n", "metrics", metricsNs);
+	printf("%-8s %8.1fns/message %5.1f%%\n", "cost", metricsNs - stubNs,
+			100.0 * (metricsNs - stubNs) / stubNs);
+
+	MetricHistogram execTime;
+	Metric_ReadHistogram(&ExecTime, &execTime);
+	printf("%" PRIu64 " execution times recorded\n", execTime.count);
+
+	IrcCmdParser_Delete(cmdParser);
+	IrcMsgParser_Delete(msgParser);
+	IrcMsgValidator_Delete(validator);
+	Logger_Destroy(log);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,221 @@
+/**
+ * Prints mallocs and ns per message through the parse, clone and delete
+ * pipeline of a PRIVMSG: on one thread, and handing the commands to another
+ * thread that deletes them, like the executor does. Linked with malloc,
+ * calloc and realloc wrapped to count the calls, including the library's.
+ * Configure with AMN_OBJ_POOL_USE_MALLOC=ON to compare with plain malloc.
+ * Then checks that a PRIVMSG to several receivers and a JOIN of as many
+ * channels as fit inline take no malloc beyond their IrcCmd and IrcMsg,
+ * failing if they do.
+ * Usage: bench_obj_pool [messages]
+ */
+
+#include "irc_cmd_parser.h"
+#include "irc_msg_parser.h"
+#include "irc_msg_validator.h"
+#include "log.h"
+#include "metrics.h"
+#include "queue.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <pthread.h>
+
+static const char RAW_MSG[] = ":alice!al@example.org PRIVMSG #sports,bob :What a finish!\r\n";
+// Without a prefix, whose strings are copied.
+static const char RAW_PRIVMSG[] = "PRIVMSG #sports,&ops,bob,carol,dave :What a finish!\r\n";
+
+#define CHECKED_MESSAGES 1000
+#ifdef AMN_OBJ_POOL_USE_MALLOC
+// The IrcCmd and IrcMsg of the parsed command and of its clone.
+#define CMD_MALLOCS 4
+#else
+#define CMD_MALLOCS 0
+#endif // AMN_OBJ_POOL_USE_MALLOC
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+static atomic_size_t mallocCount;
+
+void* __wrap_malloc(size_t size)
+{
+	atomic_fetch_add_explicit(&mallocCount, 1, memory_order_relaxed);
+	return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size)
+{
+	atomic_fetch_add_explicit(&mallocCount, 1, memory_order_relaxed);
+	return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+	atomic_fetch_add_explicit(&mallocCount, 1, memory_order_relaxed);
+	return __real_realloc(ptr, size);
+}
+
+typedef struct Pipeline
+{
+	IrcMsgParser* msgParser;
+	IrcCmdParser* cmdParser;
+}
+Pipeline;
+
+/**
+ * What a receive task does with a line, and what the executor keeps of it.
+ */
+static IrcCmd* Receive(const Pipeline* pipeline, const char* rawMsg)
+{
+	IrcMsg* msg = IrcMsgParser_Parse(pipeline->msgParser, rawMsg);
+	IrcCmd* cmd = msg != NULL ? IrcCmdParser_Parse(pipeline->cmdParser, msg, 5) : NULL;
+	if (cmd == NULL)
+	{
+		fprintf(stderr, "Failed to parse %s", rawMsg);
+		exit(EXIT_FAILURE);
+	}
+
+	IrcCmd* clone = IrcCmd_Clone(cmd);
+	IrcCmd_Delete(cmd);
+
+	return clone;
+}
+
+static void Report(const char* name, size_t count, size_t mallocs, uint64_t ns)
+{
+	printf("%-12s %6.2f mallocs/message %8.1fns/message\n", name,
+			(double) mallocs / (double) count, (double) ns / (double) count);
+}
+
+static void BenchLocal(const Pipeline* pipeline, size_t count)
+{
+	size_t mallocs = atomic_load(&mallocCount);
+	uint64_t startNs = Metrics_NowNs();
+
+	for (size_t i = 0; i < count; i++)
+	{
+		IrcCmd_Delete(Receive(pipeline, RAW_MSG));
+	}
+
+	Report("same thread", count, atomic_load(&mallocCount) - mallocs, Metrics_NowNs() - startNs);
+}
+
+static void* DeleteCmds(void* arg)
+{
+	Queue* queue = arg;
+	IrcCmd* cmd;
+
+	while (Queue_Pop(queue, &cmd, sizeof(IrcCmd*)))
+	{
+		IrcCmd_Delete(cmd);
+	}
+
+	return NULL;
+}
+
+static void DeleteCmd(void* cmd)
+{
+	IrcCmd_Delete(cmd);
+}
+
+static void BenchHandOff(const Pipeline* pipeline, size_t count)
+{
+	Queue* queue = Queue_New(1024, sizeof(IrcCmd*));
+	pthread_t deleter;
+	if (queue == NULL || pthread_create(&deleter, NULL, DeleteCmds, queue) != 0)
+	{
+		fprintf(stderr, "Failed to start the deleting thread.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	size_t mallocs = atomic_load(&mallocCount);
+	uint64_t startNs = Metrics_NowNs();
+
+	for (size_t i = 0; i < count; i++)
+	{
+		IrcCmd* cmd = Receive(pipeline, RAW_MSG);
+		Queue_Push(queue, &cmd, sizeof(IrcCmd*));
+	}
+
+	Queue_Shutdown(queue);
+	pthread_join(deleter, NULL);
+
+	Report("other thread", count, atomic_load(&mallocCount) - mallocs, Metrics_NowNs() - startNs);
+
+	Queue_Delete(queue, DeleteCmd, sizeof(IrcCmd*));
+}
+
+/**
+ * Checks the pipeline of rawMsg only mallocs the IrcCmd and IrcMsg, and
+ * those only without the pool, once the pool has warmed up.
+ */
+static bool CheckMallocs(const Pipeline* pipeline, const char* name, const char* rawMsg)
+{
+	IrcCmd_Delete(Receive(pipeline, rawMsg));
+
+	size_t mallocs = atomic_load(&mallocCount);
+	for (size_t i = 0; i < CHECKED_MESSAGES; i++)
+	{
+		IrcCmd_Delete(Receive(pipeline, rawMsg));
+	}
+	mallocs = atomic_load(&mallocCount) - mallocs;
+
+	printf("%-12s %6.2f mallocs/message beyond the IrcCmd and IrcMsg\n", name,
+			(double) mallocs / CHECKED_MESSAGES - CMD_MALLOCS);
+
+	return mallocs == CMD_MALLOCS * CHECKED_MESSAGES;
+}
+
+/**
+ * "JOIN #c0,#c1,... k0,k1\r\n" with as many channels as fit inline.
+ */
+static void FormatJoin(char* buffer, size_t size)
+{
+	int len = snprintf(buffer, size, "JOIN ");
+	for (int i = 0; i < IRC_CMD_JOIN_INLINE_CHANNELS; i++)
+	{
+		len += snprintf(buffer + len, size - (size_t) len, i == 0 ? "#c%d" : ",#c%d", i);
+	}
+	snprintf(buffer + len, size - (size_t) len, " k0,k1\r\n");
+}
+
+int main(int argc, char** argv)
+{
+	size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+	if (count == 0)
+	{
+		fprintf(stderr, "Usage: %s [messages]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	FILE* logFiles[] = { stderr };
+	Logger* log = Logger_Create(logFiles, 1);
+	IrcMsgValidator* validator = IrcMsgValidator_New(log);
+	Pipeline pipeline = {
+		.msgParser = IrcMsgParser_New(log, validator),
+		.cmdParser = IrcCmdParser_New(log, validator),
+	};
+
+	printf("%zu messages of %s", count, RAW_MSG);
+
+	BenchLocal(&pipeline, count);
+	BenchHandOff(&pipeline, count);
+
+	char rawJoin[IRC_MSG_SIZE];
+	FormatJoin(rawJoin, sizeof(rawJoin));
+
+	bool exact = CheckMallocs(&pipeline, "privmsg", RAW_PRIVMSG);
+	exact = CheckMallocs(&pipeline, "join", rawJoin) && exact;
+
+	IrcCmdParser_Delete(pipeline.cmdParser);
+	IrcMsgParser_Delete(pipeline.msgParser);
+	IrcMsgValidator_Delete(validator);
+	Logger_Destroy(log);
+
+	return exact ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,28 @@
+#ifndef AMN_TEST_H
+#define AMN_TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+  * Checks for the tests, which are plain executables run by ctest.
+  * A failed check is printed and the test goes on, so one run shows every
+  * failure. main returns TEST_RESULT().
+  */
+
+static int testFailures = 0;
+
+#define CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			fprintf(stderr, "%s:%d: CHECK(%s) failed.\n", __FILE__, __LINE__, #condition); \
+			testFailures++; \
+		} \
+	} \
+	while (0)
+
+#define TEST_RESULT() (testFailures == 0 ? EXIT_SUCCESS : EXIT_FAILURE)
+
+#endif // AMN_TEST_H
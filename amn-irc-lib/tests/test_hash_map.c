@@ -0,0 +1,230 @@
+#include "hash_map.h"
+
+#include "test.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define INT_HASH(key) HashMap_HashU64((uint64_t) (key))
+// Keys land in the slot of their value, to build collision chains by hand.
+#define IDENTITY_HASH(key) ((size_t) (key))
+// Long runs of keys sharing a few home slots.
+#define CLUSTER_HASH(key) ((size_t) (key) % 7)
+
+HASH_MAP_DEFINE(IntMap, int, int, INT_HASH, HASH_MAP_EQUALS_SCALAR)
+HASH_MAP_DEFINE(SlotMap, int, int, IDENTITY_HASH, HASH_MAP_EQUALS_SCALAR)
+HASH_MAP_DEFINE(ClusterMap, int, int, CLUSTER_HASH, HASH_MAP_EQUALS_SCALAR)
+
+#define MAX_KEYS 2000
+
+static size_t CountUsed(const SlotMap* map)
+{
+	size_t count = 0;
+	for (size_t i = 0; i < map->capacity; i++)
+	{
+		count += SlotMap_At(map, i) != NULL;
+	}
+
+	return count;
+}
+
+static void TestPutGetRemove(void)
+{
+	IntMap map = {0};
+	CHECK(IntMap_Get(&map, 1) == NULL);
+	CHECK(!IntMap_Remove(&map, 1, NULL));
+
+	int* value = IntMap_Put(&map, 1, 10);
+	CHECK(value != NULL && *value == 10);
+	CHECK(IntMap_Put(&map, 2, 20) != NULL);
+	CHECK(map.size == 2);
+
+	// Overwrites.
+	CHECK(IntMap_Put(&map, 1, 11) != NULL);
+	CHECK(map.size == 2);
+	CHECK(*IntMap_Get(&map, 1) == 11);
+
+	int removed = 0;
+	CHECK(IntMap_Remove(&map, 1, &removed));
+	CHECK(removed == 11);
+	CHECK(map.size == 1);
+	CHECK(IntMap_Get(&map, 1) == NULL);
+	CHECK(!IntMap_Remove(&map, 1, &removed));
+	CHECK(*IntMap_Get(&map, 2) == 20);
+
+	IntMap_Clear(&map);
+	CHECK(map.size == 0);
+	CHECK(IntMap_Get(&map, 2) == NULL);
+
+	IntMap_Free(&map);
+	CHECK(map.entries == NULL && map.capacity == 0);
+}
+
+/**
+ * Removing from the middle of a chain wrapping around the end of the slots
+ * moves back the entries after it, so every remaining key is still found and
+ * no slot stays used for nothing.
+ */
+static void TestBackwardShift(void)
+{
+	SlotMap map = {0};
+
+	// 7, 15 and 23 all want slot 7 of 8, 0 and 1 the slots 15 and 23 took:
+	// the chain runs from slot 7 to slot 3.
+	const int keys[] = { 7, 15, 23, 0, 1 };
+	const size_t keyCount = sizeof(keys) / sizeof(keys[0]);
+	for (size_t i = 0; i < keyCount; i++)
+	{
+		CHECK(SlotMap_Put(&map, keys[i], keys[i] * 10) != NULL);
+	}
+	CHECK(map.capacity == 8);
+	CHECK(SlotMap_At(&map, 2)->key == 0);
+	CHECK(SlotMap_At(&map, 3)->key == 1);
+	CHECK(SlotMap_At(&map, 4) == NULL);
+
+	CHECK(SlotMap_Remove(&map, 7, NULL));
+
+	// 15 and 23 moved back across the end, 0 to its home slot and 1 after it.
+	CHECK(SlotMap_At(&map, 7)->key == 15);
+	CHECK(SlotMap_At(&map, 0)->key == 23);
+	CHECK(SlotMap_At(&map, 1)->key == 0);
+	CHECK(SlotMap_At(&map, 2)->key == 1);
+	CHECK(SlotMap_At(&map, 3) == NULL);
+	CHECK(CountUsed(&map) == map.size);
+
+	for (size_t i = 1; i < keyCount; i++)
+	{
+		int* value = SlotMap_Get(&map, keys[i]);
+		CHECK(value != NULL && *value == keys[i] * 10);
+	}
+
+	// Nothing after the chain's end moves.
+	CHECK(SlotMap_Remove(&map, 1, NULL));
+	CHECK(SlotMap_At(&map, 2) == NULL);
+	CHECK(SlotMap_At(&map, 1)->key == 0);
+
+	// 0 moves back to its home slot, 15 before the hole stays.
+	CHECK(SlotMap_Remove(&map, 23, NULL));
+	CHECK(SlotMap_At(&map, 7)->key == 15);
+	CHECK(SlotMap_At(&map, 0)->key == 0);
+	CHECK(SlotMap_At(&map, 1) == NULL);
+	CHECK(*SlotMap_Get(&map, 15) == 150);
+	CHECK(*SlotMap_Get(&map, 0) == 0);
+	CHECK(CountUsed(&map) == map.size);
+
+	CHECK(SlotMap_Remove(&map, 15, NULL));
+	CHECK(SlotMap_Remove(&map, 0, NULL));
+	CHECK(map.size == 0);
+	CHECK(CountUsed(&map) == 0);
+
+	SlotMap_Free(&map);
+}
+
+/**
+ * Random operations on clustered keys agree with a plain array.
+ */
+static void TestAgainstReference(void)
+{
+	ClusterMap map = {0};
+	int values[MAX_KEYS];
+	bool present[MAX_KEYS] = {0};
+	size_t size = 0;
+
+	srand(1);
+	for (size_t i = 0; i < 200000; i++)
+	{
+		int key = rand() % MAX_KEYS;
+		int* value = NULL;
+
+		switch (rand() % 3)
+		{
+		case 0:
+			values[key] = rand();
+			size += !present[key];
+			present[key] = true;
+			CHECK(ClusterMap_Put(&map, key, values[key]) != NULL);
+			break;
+		case 1:
+			CHECK(ClusterMap_Remove(&map, key, NULL) == present[key]);
+			size -= present[key];
+			present[key] = false;
+			break;
+		default:
+			value = ClusterMap_Get(&map, key);
+			CHECK((value != NULL) == present[key]);
+			CHECK(value == NULL || *value == values[key]);
+			break;
+		}
+
+		CHECK(map.size == size);
+	}
+
+	for (int key = 0; key < MAX_KEYS; key++)
+	{
+		int* value = ClusterMap_Get(&map, key);
+		CHECK((value != NULL) == present[key]);
+		CHECK(value == NULL || *value == values[key]);
+	}
+
+	ClusterMap_Free(&map);
+}
+
+static void TestGrowth(void)
+{
+	IntMap map = {0};
+
+	for (int key = 0; key < MAX_KEYS; key++)
+	{
+		CHECK(IntMap_Put(&map, key, -key) != NULL);
+
+		// A power of two at most 3/4 full.
+		CHECK((map.capacity & (map.capacity - 1)) == 0);
+		CHECK(map.size <= map.capacity / 4 * 3);
+	}
+
+	for (int key = 0; key < MAX_KEYS; key++)
+	{
+		int* value = IntMap_Get(&map, key);
+		CHECK(value != NULL && *value == -key);
+	}
+
+	IntMap_Free(&map);
+}
+
+static void TestReserve(void)
+{
+	IntMap map = {0};
+
+	CHECK(IntMap_Reserve(&map, 100));
+	size_t capacity = map.capacity;
+	IntMapEntry* entries = map.entries;
+	CHECK(capacity / 4 * 3 >= 100);
+
+	for (int key = 0; key < 100; key++)
+	{
+		CHECK(IntMap_Put(&map, key, key) != NULL);
+	}
+	CHECK(map.capacity == capacity && map.entries == entries);
+
+	// Never shrinks.
+	CHECK(IntMap_Reserve(&map, 1));
+	CHECK(map.capacity == capacity);
+
+	CHECK(!IntMap_Reserve(&map, SIZE_MAX));
+	CHECK(map.capacity == capacity && map.size == 100);
+
+	IntMap_Free(&map);
+}
+
+int main(void)
+{
+	TestPutGetRemove();
+	TestBackwardShift();
+	TestAgainstReference();
+	TestGrowth();
+	TestReserve();
+
+	return TEST_RESULT();
+}
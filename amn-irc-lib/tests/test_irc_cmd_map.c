@@ -0,0 +1,37 @@
+/**
+ * Every command name of IRC_CMD_TYPE_INFOS is found by the generated map,
+ * which has to be regenerated from commands.gperf whenever they change.
+ */
+
+#include "irc_cmd_map.h"
+
+#include "test.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+int main(void)
+{
+	for (int type = IrcCmdType_Null + 1; type < IrcCmdType_Len; type++)
+	{
+		const char* name = IRC_CMD_TYPE_INFOS[type].name;
+		CHECK(name != NULL);
+
+		if (name != NULL && IrcCmdType_FromStr(name, strlen(name)) != (IrcCmdType) type)
+		{
+			printf("%s isn't mapped to its type.\n", name);
+			CHECK(false);
+		}
+	}
+
+	// Names as they are on the wire, with the length of the command only.
+	CHECK(IrcCmdType_FromStr("OPER", 4) == IrcCmdType_Operator);
+	CHECK(IrcCmdType_FromStr("OPERATOR", 8) == IrcCmdType_Null);
+	CHECK(IrcCmdType_FromStr("PRIVMSG bob :hi", 7) == IrcCmdType_PrivMsg);
+	CHECK(IrcCmdType_FromStr("PRIV", 4) == IrcCmdType_Null);
+	CHECK(IrcCmdType_FromStr("", 0) == IrcCmdType_Null);
+	CHECK(IrcCmdType_FromStr("WALLOPSX", 8) == IrcCmdType_Null);
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,148 @@
+/**
+ * JOIN lists up to IRC_CMD_JOIN_INLINE_CHANNELS are kept in the command,
+ * longer ones on the heap, with the same channels and keys either way, and
+ * clones get their own list.
+ */
+
+#include "irc_cmd_parser.h"
+#include "irc_msg_parser.h"
+#include "irc_msg_validator.h"
+#include "log.h"
+
+#include "test.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef struct Parsers
+{
+	IrcMsgParser* msgParser;
+	IrcCmdParser* cmdParser;
+}
+Parsers;
+
+static IrcCmd* Parse(const Parsers* parsers, const char* rawMsg)
+{
+	IrcMsg* msg = IrcMsgParser_Parse(parsers->msgParser, rawMsg);
+	CHECK(msg != NULL);
+
+	return msg != NULL ? IrcCmdParser_Parse(parsers->cmdParser, msg, 5) : NULL;
+}
+
+/**
+ * "JOIN #c0,&c1,... k0,k1,...\r\n", channels alternating '#' and '&'.
+ */
+static void FormatJoin(char* buffer, size_t size, size_t channelCount, size_t keyCount)
+{
+	int len = snprintf(buffer, size, "JOIN ");
+	for (size_t i = 0; i < channelCount; i++)
+	{
+		len += snprintf(buffer + len, size - (size_t) len, "%s%cc%zu", i == 0 ? "" : ",",
+				i % 2 == 0 ? '#' : '&', i);
+	}
+
+	for (size_t i = 0; i < keyCount; i++)
+	{
+		len += snprintf(buffer + len, size - (size_t) len, "%sk%zu", i == 0 ? " " : ",", i);
+	}
+
+	snprintf(buffer + len, size - (size_t) len, "\r\n");
+}
+
+static void CheckJoin(const IrcCmd* cmd, size_t channelCount, size_t keyCount)
+{
+	CHECK(cmd->type == IrcCmdType_Join);
+	CHECK(cmd->join.channelCount == channelCount);
+	CHECK((cmd->join.channels == cmd->join.inlineChannels)
+			== (channelCount <= IRC_CMD_JOIN_INLINE_CHANNELS));
+
+	for (size_t i = 0; i < cmd->join.channelCount; i++)
+	{
+		const IrcChannelAndKey* channel = &cmd->join.channels[i];
+
+		char name[32];
+		snprintf(name, sizeof(name), "c%zu", i);
+		CHECK(strcmp(channel->name, name) == 0);
+		CHECK(channel->type == (i % 2 == 0 ? IrcChannelType_Distributed : IrcChannelType_Local));
+
+		char key[32];
+		snprintf(key, sizeof(key), "k%zu", i);
+		CHECK(i < keyCount ? channel->key != NULL && strcmp(channel->key, key) == 0
+				: channel->key == NULL);
+	}
+}
+
+static void TestJoin(const Parsers* parsers, size_t channelCount, size_t keyCount)
+{
+	char rawMsg[IRC_MSG_SIZE];
+	FormatJoin(rawMsg, sizeof(rawMsg), channelCount, keyCount);
+
+	IrcCmd* cmd = Parse(parsers, rawMsg);
+	CHECK(cmd != NULL);
+	if (cmd == NULL)
+	{
+		printf("Failed to parse %s", rawMsg);
+		return;
+	}
+
+	CheckJoin(cmd, channelCount, keyCount);
+
+	IrcCmd* clone = IrcCmd_Clone(cmd);
+	CHECK(clone != NULL);
+	IrcCmd_Delete(cmd);
+
+	// Still valid without the original.
+	if (clone != NULL)
+	{
+		CheckJoin(clone, channelCount, keyCount);
+		IrcCmd_Delete(clone);
+	}
+}
+
+static void TestJoinLists(const Parsers* parsers)
+{
+	TestJoin(parsers, 1, 0);
+	TestJoin(parsers, IRC_CMD_JOIN_INLINE_CHANNELS, 2);
+	TestJoin(parsers, IRC_CMD_JOIN_INLINE_CHANNELS + 1, 0);
+	TestJoin(parsers, IRC_CMD_JOIN_INLINE_CHANNELS + 1, IRC_CMD_JOIN_INLINE_CHANNELS + 1);
+	TestJoin(parsers, 3 * IRC_CMD_JOIN_INLINE_CHANNELS, 5);
+}
+
+static void TestJoinInvalid(const Parsers* parsers)
+{
+	// More keys than channels, and a bad channel after the heap list was made.
+	char rawMsg[IRC_MSG_SIZE];
+	FormatJoin(rawMsg, sizeof(rawMsg), 2, 3);
+	CHECK(Parse(parsers, rawMsg) == NULL);
+
+	FormatJoin(rawMsg, sizeof(rawMsg), IRC_CMD_JOIN_INLINE_CHANNELS + 1, 0);
+	rawMsg[strlen(rawMsg) - 2] = '\0';
+	strcat(rawMsg, ",c99\r\n");
+	CHECK(Parse(parsers, rawMsg) == NULL);
+}
+
+int main(void)
+{
+	FILE* logFiles[] = { stdout };
+	Logger* log = Logger_Create(logFiles, 1);
+	CHECK(log != NULL);
+	Logger_SetLevel(log, LogLevel_Error);
+
+	IrcMsgValidator* validator = IrcMsgValidator_New(log);
+	Parsers parsers = {
+		.msgParser = IrcMsgParser_New(log, validator),
+		.cmdParser = IrcCmdParser_New(log, validator),
+	};
+	CHECK(validator != NULL && parsers.msgParser != NULL && parsers.cmdParser != NULL);
+
+	TestJoinLists(&parsers);
+	TestJoinInvalid(&parsers);
+
+	IrcCmdParser_Delete(parsers.cmdParser);
+	IrcMsgParser_Delete(parsers.msgParser);
+	IrcMsgValidator_Delete(validator);
+	Logger_Destroy(log);
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,210 @@
+/**
+ * IrcCmdUnparser_UnparseTo writes the same bytes as unparsing into an IrcMsg
+ * and that into text with IrcMsgUnparser, and fails where it fails.
+ */
+
+#include "irc_cmd_unparser.h"
+#include "irc_msg_unparser.h"
+#include "irc_msg_validator.h"
+#include "log.h"
+
+#include "test.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef struct Unparsers
+{
+	IrcCmdUnparser* cmd;
+	IrcMsgUnparser* msg;
+}
+Unparsers;
+
+static IrcCmd NewPrivMsg(size_t receiverCount, const char* text)
+{
+	IrcCmd cmd = {
+		.type = IrcCmdType_PrivMsg,
+		.prefix = { .origin = "alice", .username = "al", .hostname = "example.org" },
+		.privMsg = {
+			.receiverCount = receiverCount,
+			.text = text,
+		},
+	};
+
+	cmd.privMsg.receiver[0] = (IrcReceiver) { IrcReceiverType_Nickname, "bob" };
+	cmd.privMsg.receiver[1] = (IrcReceiver) { IrcReceiverType_DistChannelOrHostMask, "chan" };
+	cmd.privMsg.receiver[2] = (IrcReceiver) { IrcReceiverType_LocalChannel, "local" };
+	cmd.privMsg.receiver[3] = (IrcReceiver) { IrcReceiverType_ServerMask, "*.org" };
+
+	return cmd;
+}
+
+/**
+ * Unparses through both paths and checks they agree.
+ * @return The length written by UnparseTo, 0 if both failed.
+ */
+static size_t CheckSame(const Unparsers* unparsers, const IrcCmd* cmd)
+{
+	char buffer[IRC_MSG_SIZE + 1];
+	size_t len = IrcCmdUnparser_UnparseTo(unparsers->cmd, cmd, buffer, sizeof(buffer));
+
+	IrcMsg* msg = IrcCmdUnparser_Unparse(unparsers->cmd, cmd);
+	if (msg == NULL)
+	{
+		CHECK(len == 0);
+		return 0;
+	}
+
+	const char* expected = IrcMsgUnparser_Unparse(unparsers->msg, msg);
+	CHECK(expected != NULL);
+
+	if (expected != NULL && (len != strlen(expected) || strcmp(buffer, expected) != 0))
+	{
+		printf("Expected: %sUnparsed: %s", expected, len > 0 ? buffer : "\n");
+		CHECK(false);
+	}
+
+	IrcMsg_Delete(msg);
+
+	return len;
+}
+
+static void TestSameAsTwoStage(const Unparsers* unparsers)
+{
+	IrcCmd cmds[] = {
+		{
+			.type = IrcCmdType_Pong,
+			.prefix = { .origin = "irc.example.org" },
+			.pong = { .daemon1 = "irc.example.org", .daemon2 = "token" },
+		},
+		{
+			.type = IrcCmdType_Pong,
+			.prefix = { .origin = "irc.example.org" },
+			.pong = { .daemon1 = "irc.example.org" },
+		},
+		{
+			.type = IrcCmdType_Nick,
+			.nick = { .nickname = "alice" },
+		},
+		{
+			.type = IrcCmdType_Nick,
+			.prefix = { .origin = "alice" },
+			.nick = { .nickname = "alice2", .hopCount = 12 },
+		},
+		{
+			.type = IrcCmdType_Nick,
+			.nick = { .nickname = "alice", .hopCount = SIZE_MAX },
+		},
+		{
+			.type = IrcCmdType_User,
+			.user = {
+				.username = "al",
+				.hostname = "host",
+				.servername = "server",
+				.realname = "Alice Liddell",
+			},
+		},
+		NewPrivMsg(1, "hello"),
+		NewPrivMsg(3, "hello there, all of you"),
+		NewPrivMsg(4, ":starts with a colon"),
+		NewPrivMsg(2, ""),
+	};
+
+	for (size_t i = 0; i < sizeof(cmds) / sizeof(cmds[0]); i++)
+	{
+		CHECK(CheckSame(unparsers, &cmds[i]) > 0);
+	}
+}
+
+static void TestMissingParam(const Unparsers* unparsers)
+{
+	IrcCmd cmds[] = {
+		{ .type = IrcCmdType_Pong },
+		{ .type = IrcCmdType_Nick },
+		{
+			.type = IrcCmdType_User,
+			.user = { .username = "al", .servername = "server", .realname = "Alice" },
+		},
+		NewPrivMsg(2, NULL),
+		NewPrivMsg(2, "hello"),
+	};
+	cmds[4].privMsg.receiver[1].value = NULL;
+
+	char buffer[IRC_MSG_SIZE + 1];
+	for (size_t i = 0; i < sizeof(cmds) / sizeof(cmds[0]); i++)
+	{
+		errno = 0;
+		CHECK(IrcCmdUnparser_UnparseTo(unparsers->cmd, &cmds[i], buffer, sizeof(buffer)) == 0);
+		CHECK(errno == EINVAL);
+
+		CHECK(CheckSame(unparsers, &cmds[i]) == 0);
+	}
+}
+
+static void TestTooLong(const Unparsers* unparsers)
+{
+	char text[IRC_MSG_SIZE];
+	memset(text, 'x', sizeof(text) - 1);
+	text[sizeof(text) - 1] = '\0';
+
+	IrcCmd cmd = NewPrivMsg(1, text);
+	CHECK(CheckSame(unparsers, &cmd) == 0);
+
+	// Fills a message exactly, CR LF included.
+	const char* prefixAndCmd = ":alice!al@example.org PRIVMSG bob :";
+	text[IRC_MSG_SIZE - strlen(prefixAndCmd) - 2] = '\0';
+	CHECK(CheckSame(unparsers, &cmd) == IRC_MSG_SIZE);
+}
+
+static void TestBufferSize(const Unparsers* unparsers)
+{
+	IrcCmd cmd = NewPrivMsg(3, "hello");
+	char buffer[IRC_MSG_SIZE + 1];
+
+	size_t len = IrcCmdUnparser_UnparseTo(unparsers->cmd, &cmd, buffer, sizeof(buffer));
+	CHECK(len > 0);
+
+	// No room for the NUL terminator.
+	CHECK(IrcCmdUnparser_UnparseTo(unparsers->cmd, &cmd, buffer, len) == 0);
+	CHECK(IrcCmdUnparser_UnparseTo(unparsers->cmd, &cmd, buffer, 0) == 0);
+
+	memset(buffer, '#', sizeof(buffer));
+	CHECK(IrcCmdUnparser_UnparseTo(unparsers->cmd, &cmd, buffer, len + 1) == len);
+	CHECK(buffer[len] == '\0');
+}
+
+static void TestUnimplemented(const Unparsers* unparsers)
+{
+	IrcCmd cmd = {
+		.type = IrcCmdType_Quit,
+		.quit = { .quitMessage = "bye" },
+	};
+
+	CHECK(CheckSame(unparsers, &cmd) == 0);
+}
+
+int main(void)
+{
+	FILE* logFiles[] = { stdout };
+	Logger* log = Logger_Create(logFiles, 1);
+	IrcMsgValidator* validator = IrcMsgValidator_New(log);
+	Unparsers unparsers = {
+		.cmd = IrcCmdUnparser_New(log, validator),
+		.msg = IrcMsgUnparser_New(log),
+	};
+	CHECK(unparsers.cmd != NULL && unparsers.msg != NULL);
+
+	TestSameAsTwoStage(&unparsers);
+	TestMissingParam(&unparsers);
+	TestTooLong(&unparsers);
+	TestBufferSize(&unparsers);
+	TestUnimplemented(&unparsers);
+
+	IrcMsgUnparser_Delete(unparsers.msg);
+	IrcCmdUnparser_Delete(unparsers.cmd);
+	IrcMsgValidator_Delete(validator);
+	Logger_Destroy(log);
+
+	return TEST_RESULT();
+}
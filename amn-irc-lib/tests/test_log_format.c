@@ -0,0 +1,289 @@
+/**
+ * Packed log arguments format to what printf would have written, directly
+ * and through a binary log file, and are truncated without breaking the
+ * text when they don't fit.
+ */
+
+#include "log.h"
+#include "log_format.h"
+
+#include "test.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <unistd.h>
+
+#define MAX_FILE_BYTES (64 * 1024)
+
+static void CheckText(const char* format, const char* expected, const char* text, size_t len)
+{
+	if (len != strlen(expected) || strcmp(text, expected) != 0)
+	{
+		printf("Format:   %s\nExpected: %s\nFormatted: %s\n", format, expected, text);
+		CHECK(false);
+	}
+}
+
+/**
+ * Packs the arguments and checks they format like vsnprintf.
+ */
+static void CheckRoundTrip(const char* format, ...)
+{
+	va_list args;
+	va_list packArgs;
+	va_start(args, format);
+	va_copy(packArgs, args);
+
+	char expected[LOG_MAX_LINE_BYTES];
+	vsnprintf(expected, sizeof(expected), format, args);
+
+	unsigned char packed[LOG_MAX_ARGS_BYTES];
+	size_t packedLen = LogArgs_Pack(packed, sizeof(packed), format, packArgs);
+
+	va_end(packArgs);
+	va_end(args);
+
+	char text[LOG_MAX_LINE_BYTES];
+	size_t len = LogArgs_Format(text, sizeof(text), format, packed, packedLen);
+	CheckText(format, expected, text, len);
+}
+
+static size_t Pack(unsigned char* packed, size_t capacity, const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	size_t len = LogArgs_Pack(packed, capacity, format, args);
+	va_end(args);
+
+	return len;
+}
+
+static void TestRoundTrip(void)
+{
+	const char* str = "hello";
+	const char chars[] = { 'a', 'b', 'c', 'd', 'e', 'f' };
+
+	CheckRoundTrip("plain");
+	CheckRoundTrip("%s|%10s|%-10s|%.3s|%.*s|%*s|", str, str, str, str, 4, chars, 7, "x");
+	CheckRoundTrip("%d %i %5d %-5d|%+d %03d %ld %lld", -1, 2, 3, 4, 5, 7, -8L, 9LL);
+	CheckRoundTrip("%zu %zd %u %x %X %#o %hhd %hu", (size_t) 10, (ssize_t) -11, 12u, 255u,
+			255u, 8u, 300, 70000);
+	CheckRoundTrip("%jd %td %lu %llx", (intmax_t) -5, (ptrdiff_t) 6, 7ul, 0xabcull);
+	CheckRoundTrip("%d %u %lld %llu", INT32_MIN, UINT32_MAX, (long long) INT64_MIN,
+			(unsigned long long) UINT64_MAX);
+	CheckRoundTrip("%c%c %% %p", 'o', 'k', (void*) 0x1234);
+	CheckRoundTrip("%f %.2f %e %g %10.3f %a", 1.5, 3.14159, 1e10, 0.0001, 2.5, 0.5);
+	// Long doubles are packed as doubles, exact for this one.
+	CheckRoundTrip("%Lf", (long double) 1.25);
+	CheckRoundTrip("%s, %d %s", "", 0, "end");
+}
+
+static void TestNullString(void)
+{
+	unsigned char packed[LOG_MAX_ARGS_BYTES];
+	size_t packedLen = Pack(packed, sizeof(packed), "[%s]", (const char*) NULL);
+
+	char text[LOG_MAX_LINE_BYTES];
+	size_t len = LogArgs_Format(text, sizeof(text), "[%s]", packed, packedLen);
+	CheckText("[%s]", "[(null)]", text, len);
+}
+
+static void TestTruncation(void)
+{
+	// A string longer than the arguments can take, followed by a number.
+	char big[LOG_MAX_ARGS_BYTES * 3];
+	memset(big, 'z', sizeof(big) - 1);
+	big[sizeof(big) - 1] = '\0';
+
+	unsigned char packed[LOG_MAX_ARGS_BYTES];
+	size_t packedLen = Pack(packed, sizeof(packed), "%s end %d", big, 42);
+	CHECK(packedLen == sizeof(packed));
+
+	// The string truncated to what fits, the number left out.
+	char text[LOG_MAX_LINE_BYTES];
+	size_t len = LogArgs_Format(text, sizeof(text), "%s end %d", packed, packedLen);
+	CHECK(len == LOG_MAX_ARGS_BYTES - sizeof(uint32_t) + strlen(" end "));
+	CHECK(len == strlen(text));
+	CHECK(strspn(text, "z") == LOG_MAX_ARGS_BYTES - sizeof(uint32_t));
+
+	// Text truncated to its capacity, still NUL terminated.
+	packedLen = Pack(packed, sizeof(packed), "%s %s %d", "abcdef", "ghijkl", 12345);
+	char small[8];
+	len = LogArgs_Format(small, sizeof(small), "%s %s %d", packed, packedLen);
+	CHECK(len == sizeof(small) - 1);
+	CHECK(strcmp(small, "abcdef ") == 0);
+
+	// Arguments packed into a small buffer stop at the first that doesn't fit.
+	packedLen = Pack(packed, 20, "%d %d %d", 1, 2, 3);
+	CHECK(packedLen == 16);
+	len = LogArgs_Format(text, sizeof(text), "%d %d %d", packed, packedLen);
+	CheckText("%d %d %d", "1 2 ", text, len);
+}
+
+static void TestFormatSafe(void)
+{
+	const char* format = "%s=%d %u %x %X %p %c %5d %f %s";
+
+	unsigned char packed[LOG_MAX_ARGS_BYTES];
+	size_t packedLen = Pack(packed, sizeof(packed), format, "count", -12, 34u, 0xabu, 0xabu,
+			(void*) 0x1f, 'c', 7, 1.5, "end");
+
+	// Widths are ignored, floating point values not formatted.
+	char text[LOG_MAX_LINE_BYTES];
+	size_t len = LogArgs_FormatSafe(text, sizeof(text), format, packed, packedLen);
+	CheckText(format, "count=-12 34 ab AB 0x1f c 7 ? end", text, len);
+}
+
+typedef struct LoggedMsg
+{
+	const char* expected;
+	LogLevel level;
+	int errnum;
+}
+LoggedMsg;
+
+/**
+ * Messages logged to a binary file decode to the text they would have had,
+ * with the level, errno and time they were logged with.
+ */
+static void TestBinaryFile(void)
+{
+	char path[] = "/tmp/test_log_format_XXXXXX";
+	int fd = mkstemp(path);
+	CHECK(fd != -1);
+	close(fd);
+
+	FILE* logFiles[] = { stdout };
+	Logger* log = Logger_Create(logFiles, 1);
+	CHECK(log != NULL);
+	Logger_SetLevel(log, LogLevel_Debug);
+	CHECK(Logger_OpenBinaryFile(log, path));
+	CHECK(!Logger_OpenBinaryFile(log, path));
+
+	time_t startSec = time(NULL);
+
+	const LoggedMsg logged[] = {
+		{ "user alice joined #sports, 3 users", LogLevel_Info, 0 },
+		{ "Failed to open motd.txt", LogLevel_Error, ENOENT },
+		{ "user bob joined #sports, 4 users", LogLevel_Info, 0 },
+		{ "queue 75.0% full", LogLevel_Warn, 0 },
+	};
+
+	// The first site is logged twice, its site record written once.
+	for (size_t i = 0; i < 2; i++)
+	{
+		LOG_INFO(log, "user %s joined #%s, %zu users", i == 0 ? "alice" : "bob", "sports",
+				(size_t) 3 + i);
+
+		if (i == 0)
+		{
+			errno = ENOENT;
+			LOG_ERROR(log, "Failed to open %s", "motd.txt");
+		}
+	}
+	LOG_WARN(log, "queue %.1f%% full", 75.0);
+
+	Logger_Destroy(log);
+
+	time_t endSec = time(NULL);
+
+	FILE* file = fopen(path, "rb");
+	CHECK(file != NULL);
+	static unsigned char data[MAX_FILE_BYTES];
+	size_t dataLen = file != NULL ? fread(data, 1, sizeof(data), file) : 0;
+	if (file != NULL)
+	{
+		fclose(file);
+	}
+	unlink(path);
+
+	CHECK(dataLen >= LOG_FILE_MAGIC_LEN && memcmp(data, LOG_FILE_MAGIC, LOG_FILE_MAGIC_LEN) == 0);
+
+	// Formats and levels by site id.
+	const char* formats[16] = {0};
+	uint32_t levels[16] = {0};
+	size_t siteCount = 0;
+	size_t msgCount = 0;
+
+	size_t offset = LOG_FILE_MAGIC_LEN;
+	while (dataLen - offset >= sizeof(LogFileRecord))
+	{
+		LogFileRecord record;
+		memcpy(&record, data + offset, sizeof(record));
+		if (record.size == 0)
+		{
+			break;
+		}
+
+		CHECK(record.size % LOG_FILE_ALIGN == 0);
+		if (record.size < sizeof(LogFileRecord) || record.size > dataLen - offset)
+		{
+			CHECK(false);
+			break;
+		}
+
+		if (record.type == LogFileRecordType_Site)
+		{
+			LogFileSite site;
+			memcpy(&site, data + offset, sizeof(site));
+			CHECK(site.id < 16 && formats[site.id] == NULL);
+
+			// After the file and function.
+			const char* file = (const char*) data + offset + sizeof(LogFileSite);
+			const char* function = file + strlen(file) + 1;
+			CHECK(strcmp(function, "TestBinaryFile") == 0);
+
+			if (site.id < 16)
+			{
+				formats[site.id] = function + strlen(function) + 1;
+				levels[site.id] = site.level;
+			}
+			siteCount++;
+		}
+		else if (record.type == LogFileRecordType_Message && msgCount < 4)
+		{
+			LogFileMessage msg;
+			memcpy(&msg, data + offset, sizeof(msg));
+
+			// Sites come before their messages.
+			CHECK(msg.siteId < 16 && formats[msg.siteId] != NULL);
+			if (msg.siteId < 16 && formats[msg.siteId] != NULL)
+			{
+				char text[LOG_MAX_LINE_BYTES];
+				size_t len = LogArgs_Format(text, sizeof(text), formats[msg.siteId],
+						data + offset + sizeof(LogFileMessage), msg.argsLen);
+
+				CheckText(formats[msg.siteId], logged[msgCount].expected, text, len);
+				CHECK(levels[msg.siteId] == (uint32_t) logged[msgCount].level);
+			}
+
+			CHECK(msg.errnum == logged[msgCount].errnum);
+			CHECK(msg.sec >= startSec && msg.sec <= endSec);
+			msgCount++;
+		}
+
+		offset += record.size;
+	}
+
+	CHECK(siteCount == 3);
+	CHECK(msgCount == 4);
+}
+
+int main(void)
+{
+	TestRoundTrip();
+	TestNullString();
+	TestTruncation();
+	TestFormatSafe();
+	TestBinaryFile();
+
+	return TEST_RESULT();
+}
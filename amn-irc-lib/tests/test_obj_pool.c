@@ -0,0 +1,274 @@
+/**
+ * Objects of every size are aligned, usable and don't overlap, freed objects
+ * are reused by their size class, and objects freed by other threads, even
+ * after their owner exited, go back to their owner's free lists.
+ */
+
+#include "obj_pool.h"
+
+#include "test.h"
+
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#define THREAD_COUNT 4
+#define BATCH_SIZE 1000
+#define ROUNDS 50
+// Larger than every size class.
+#define LARGE_SIZE 4096
+
+static bool IsAligned(const void* obj)
+{
+	return (uintptr_t) obj % alignof(max_align_t) == 0;
+}
+
+static void Fill(uint8_t* obj, size_t size, uint8_t pattern)
+{
+	memset(obj, pattern, size);
+}
+
+static bool IsFilled(const uint8_t* obj, size_t size, uint8_t pattern)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		if (obj[i] != pattern)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Objects of each size up to past the largest class, all alive at once.
+ */
+static void TestSizes(void)
+{
+	enum { MAX_SIZE = 700 };
+	uint8_t* objs[MAX_SIZE + 1];
+
+	for (size_t size = 1; size <= MAX_SIZE; size++)
+	{
+		objs[size] = ObjPool_Alloc(size);
+		CHECK(objs[size] != NULL);
+		CHECK(IsAligned(objs[size]));
+		Fill(objs[size], size, (uint8_t) size);
+	}
+
+	for (size_t size = 1; size <= MAX_SIZE; size++)
+	{
+		CHECK(IsFilled(objs[size], size, (uint8_t) size));
+		ObjPool_Free(objs[size]);
+	}
+
+	ObjPool_Free(NULL);
+}
+
+static void TestLarge(void)
+{
+	const size_t sizes[] = { LARGE_SIZE, 1 << 20 };
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+	{
+		uint8_t* obj = ObjPool_Alloc(sizes[i]);
+		CHECK(obj != NULL);
+		CHECK(IsAligned(obj));
+		Fill(obj, sizes[i], 0xab);
+		CHECK(IsFilled(obj, sizes[i], 0xab));
+		ObjPool_Free(obj);
+	}
+
+	CHECK(ObjPool_Alloc(SIZE_MAX) == NULL);
+}
+
+#ifndef AMN_OBJ_POOL_USE_MALLOC
+
+/**
+ * The last object freed is the next one allocated, for any size of its
+ * class, and never for another class.
+ */
+static void TestReuse(void)
+{
+	void* obj = ObjPool_Alloc(40);
+	ObjPool_Free(obj);
+	CHECK(ObjPool_Alloc(64) == obj);
+	ObjPool_Free(obj);
+	CHECK(ObjPool_Alloc(33) == obj);
+
+	void* other = ObjPool_Alloc(200);
+	CHECK(other != obj);
+	ObjPool_Free(other);
+	void* small = ObjPool_Alloc(10);
+	CHECK(small != other);
+	ObjPool_Free(small);
+	ObjPool_Free(obj);
+
+	// Large objects go back to malloc, not to a free list.
+	void* large = ObjPool_Alloc(LARGE_SIZE);
+	ObjPool_Free(large);
+	void* largest = ObjPool_Alloc(640);
+	CHECK(largest != large);
+	ObjPool_Free(largest);
+}
+
+#endif // AMN_OBJ_POOL_USE_MALLOC
+
+typedef struct Worker
+{
+	pthread_t thread;
+	size_t index;
+	struct Worker* workers;
+	pthread_barrier_t* barrier;
+	// Allocated by this worker, by round parity, freed by the previous one.
+	uint8_t* batches[2][BATCH_SIZE];
+}
+Worker;
+
+/**
+ * Each round allocates a batch while freeing the next worker's batch of the
+ * round before, so remote frees race the owner taking its remote free list.
+ */
+static void* RunWorker(void* arg)
+{
+	Worker* self = arg;
+	Worker* next = &self->workers[(self->index + 1) % THREAD_COUNT];
+
+	for (size_t round = 0; round < ROUNDS; round++)
+	{
+		uint8_t** batch = self->batches[round % 2];
+		for (size_t i = 0; i < BATCH_SIZE; i++)
+		{
+			size_t size = 1 + (i * 37 + round) % 600;
+			batch[i] = ObjPool_Alloc(size);
+			CHECK(batch[i] != NULL);
+			Fill(batch[i], size, (uint8_t) self->index);
+		}
+
+		if (round > 0)
+		{
+			uint8_t** remote = next->batches[(round - 1) % 2];
+			for (size_t i = 0; i < BATCH_SIZE; i++)
+			{
+				size_t size = 1 + (i * 37 + round - 1) % 600;
+				CHECK(IsFilled(remote[i], size, (uint8_t) next->index));
+				ObjPool_Free(remote[i]);
+			}
+		}
+
+		pthread_barrier_wait(self->barrier);
+	}
+
+	return NULL;
+}
+
+static void TestRemoteFree(void)
+{
+	pthread_barrier_t barrier;
+	CHECK(pthread_barrier_init(&barrier, NULL, THREAD_COUNT) == 0);
+
+	static Worker workers[THREAD_COUNT];
+	for (size_t i = 0; i < THREAD_COUNT; i++)
+	{
+		workers[i] = (Worker) {
+			.index = i,
+			.workers = workers,
+			.barrier = &barrier,
+		};
+		CHECK(pthread_create(&workers[i].thread, NULL, RunWorker, &workers[i]) == 0);
+	}
+
+	for (size_t i = 0; i < THREAD_COUNT; i++)
+	{
+		pthread_join(workers[i].thread, NULL);
+	}
+
+	// The last batches outlived their threads.
+	for (size_t i = 0; i < THREAD_COUNT; i++)
+	{
+		for (size_t j = 0; j < BATCH_SIZE; j++)
+		{
+			ObjPool_Free(workers[i].batches[(ROUNDS - 1) % 2][j]);
+		}
+	}
+
+	pthread_barrier_destroy(&barrier);
+}
+
+static void* AllocOne(void* arg)
+{
+	void** obj = arg;
+	*obj = ObjPool_Alloc(100);
+
+	return NULL;
+}
+
+#ifndef AMN_OBJ_POOL_USE_MALLOC
+
+static void* AllocUntilFreed(void* arg)
+{
+	void** obj = arg;
+	void* objs[4 * BATCH_SIZE];
+	size_t count = 0;
+
+	// Freed after its owner exited, so it went to the remote free list of the
+	// heap this thread adopted, which comes after what's left of its local one.
+	bool found = false;
+	while (!found && count < sizeof(objs) / sizeof(objs[0]))
+	{
+		objs[count] = ObjPool_Alloc(100);
+		found = objs[count] == *obj;
+		count++;
+	}
+	CHECK(found);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		ObjPool_Free(objs[i]);
+	}
+	*obj = NULL;
+
+	return NULL;
+}
+
+#endif // AMN_OBJ_POOL_USE_MALLOC
+
+/**
+ * The heap of an exited thread is adopted by the next new one, with what
+ * was freed to it in the meantime.
+ */
+static void TestExitedOwner(void)
+{
+	void* obj = NULL;
+	pthread_t thread;
+
+	CHECK(pthread_create(&thread, NULL, AllocOne, &obj) == 0);
+	pthread_join(thread, NULL);
+	CHECK(obj != NULL);
+
+	// From this thread, after its owner exited.
+	ObjPool_Free(obj);
+
+#ifndef AMN_OBJ_POOL_USE_MALLOC
+	CHECK(pthread_create(&thread, NULL, AllocUntilFreed, &obj) == 0);
+	pthread_join(thread, NULL);
+#endif // AMN_OBJ_POOL_USE_MALLOC
+}
+
+int main(void)
+{
+	TestSizes();
+	TestLarge();
+#ifndef AMN_OBJ_POOL_USE_MALLOC
+	TestReuse();
+#endif // AMN_OBJ_POOL_USE_MALLOC
+	TestRemoteFree();
+	TestExitedOwner();
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,182 @@
+/**
+ * Shutdown wakes every blocking wait at once, runners waiting for tasks and
+ * tasks waiting for data, instead of them noticing it after a timeout. Until
+ * then idle waits don't wake up at all. Prints how long shutdown took.
+ */
+
+#include "application.h"
+#include "log.h"
+#include "metrics.h"
+#include "task.h"
+#include "task_queue.h"
+#include "task_runner.h"
+
+#include "test.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#define RUNNER_COUNT 4
+// Runners left with nothing to do, two of them blocked in a task.
+#define BLOCKED_TASK_COUNT 2
+#define IDLE_MS 300
+// Far below the 10s timeouts waits used to have, far above scheduling delays
+// of a loaded machine.
+#define MAX_SHUTDOWN_NS 1000000000
+// CPU time an idle runner may take, starting up included.
+#define MAX_IDLE_BUSY_NS 50000000
+
+typedef struct BlockedRead
+{
+	// Read end of a pipe nothing is written to.
+	int fd;
+	atomic_int wakeups;
+	atomic_bool done;
+}
+BlockedRead;
+
+/**
+ * Blocks like a receive task on a silent client.
+ */
+static TaskStatus WaitForData(void* arg)
+{
+	BlockedRead* read = arg;
+
+	errno = 0;
+	bool readable = Application_WaitReadable(read->fd, -1);
+	atomic_fetch_add(&read->wakeups, 1);
+
+	if (!readable && errno == EINTR && Application_ShouldShutdown())
+	{
+		atomic_store(&read->done, true);
+		return TaskStatus_Done;
+	}
+
+	return TaskStatus_Yield;
+}
+
+static void KeepContext(void* arg)
+{
+	// Owned by main.
+	(void) arg;
+}
+
+static void* WaitForReload(void* arg)
+{
+	atomic_int* reloads = arg;
+
+	while (Application_WaitForReload())
+	{
+		atomic_fetch_add(reloads, 1);
+	}
+
+	return NULL;
+}
+
+static void SleepMs(long ms)
+{
+	struct timespec delay = { .tv_sec = ms / 1000, .tv_nsec = ms % 1000 * 1000000 };
+	nanosleep(&delay, NULL);
+}
+
+int main(void)
+{
+	CHECK(Application_Init());
+
+	FILE* logFiles[] = { stdout };
+	Logger* log = Logger_Create(logFiles, 1);
+	TaskQueue* tasks = TaskQueue_New(16);
+	CHECK(log != NULL && tasks != NULL);
+
+	TaskRunner* runners[RUNNER_COUNT];
+	for (size_t i = 0; i < RUNNER_COUNT; i++)
+	{
+		runners[i] = TaskRunner_New(log, tasks, "test-runner", -1);
+		CHECK(runners[i] != NULL);
+	}
+
+	BlockedRead reads[BLOCKED_TASK_COUNT] = {0};
+	int writeFds[BLOCKED_TASK_COUNT];
+	for (size_t i = 0; i < BLOCKED_TASK_COUNT; i++)
+	{
+		int fds[2];
+		CHECK(pipe(fds) == 0);
+		reads[i].fd = fds[0];
+		writeFds[i] = fds[1];
+
+		CHECK(TaskQueue_Push(tasks, Task_Create(WaitForData, &reads[i], KeepContext)));
+	}
+
+	atomic_int reloads = 0;
+	pthread_t reloader;
+	CHECK(pthread_create(&reloader, NULL, WaitForReload, &reloads) == 0);
+
+	SleepMs(IDLE_MS);
+
+	for (size_t i = 0; i < BLOCKED_TASK_COUNT; i++)
+	{
+		// Each ran once, and has been blocked since.
+		CHECK(atomic_load(&reads[i].wakeups) == 0);
+	}
+	CHECK(atomic_load(&reloads) == 0);
+
+	for (size_t i = 0; i < RUNNER_COUNT; i++)
+	{
+		uint64_t busyNs = 0;
+		uint64_t idleNs = 0;
+		CHECK(TaskRunner_Times(runners[i], &busyNs, &idleNs));
+		CHECK(busyNs < MAX_IDLE_BUSY_NS);
+	}
+
+	uint64_t startNs = Metrics_NowNs();
+
+	// Like the server's main thread, the eventfd wakes the rest.
+	Application_StartShutdown();
+	TaskQueue_Shutdown(tasks);
+
+	for (size_t i = 0; i < RUNNER_COUNT; i++)
+	{
+		TaskRunner_Join(runners[i]);
+	}
+	pthread_join(reloader, NULL);
+
+	uint64_t shutdownNs = Metrics_NowNs() - startNs;
+	printf("Shutdown took %" PRIu64 "us.\n", shutdownNs / 1000);
+	CHECK(shutdownNs < MAX_SHUTDOWN_NS);
+
+	for (size_t i = 0; i < BLOCKED_TASK_COUNT; i++)
+	{
+		CHECK(atomic_load(&reads[i].done));
+		CHECK(atomic_load(&reads[i].wakeups) == 1);
+	}
+
+	for (size_t i = 0; i < RUNNER_COUNT; i++)
+	{
+		// Still readable once joined, the metrics export may read them until
+		// its own runner exits.
+		uint64_t busyNs = 0;
+		uint64_t idleNs = 0;
+		CHECK(TaskRunner_Times(runners[i], &busyNs, &idleNs));
+		CHECK(busyNs < MAX_IDLE_BUSY_NS);
+
+		TaskRunner_Delete(runners[i]);
+	}
+
+	for (size_t i = 0; i < BLOCKED_TASK_COUNT; i++)
+	{
+		close(reads[i].fd);
+		close(writeFds[i]);
+	}
+
+	TaskQueue_Delete(tasks);
+	Application_Cleanup();
+	Logger_Destroy(log);
+
+	return TEST_RESULT();
+}
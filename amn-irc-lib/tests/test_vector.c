@@ -0,0 +1,154 @@
+#include "vector.h"
+
+#include "test.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+VECTOR_DEFINE(IntVector, int, VECTOR_EQUALS_SCALAR)
+
+typedef struct Point
+{
+	int x;
+	int y;
+}
+Point;
+
+#define POINT_EQUALS(a, b) ((a).x == (b).x && (a).y == (b).y)
+
+VECTOR_DEFINE(PointVector, Point, POINT_EQUALS)
+
+static void TestPush(void)
+{
+	IntVector vector = {0};
+	CHECK(vector.size == 0 && vector.capacity == 0 && vector.items == NULL);
+	CHECK(!IntVector_Contains(&vector, 0));
+
+	size_t reallocs = 0;
+	for (int i = 0; i < 1000; i++)
+	{
+		size_t capacity = vector.capacity;
+		CHECK(IntVector_Push(&vector, i));
+		reallocs += vector.capacity != capacity;
+	}
+
+	CHECK(vector.size == 1000);
+	CHECK(vector.capacity >= 1000);
+	// Geometric growth, from VECTOR_MIN_CAPACITY up to 1024.
+	CHECK(reallocs == 8);
+
+	for (int i = 0; i < 1000; i++)
+	{
+		CHECK(vector.items[i] == i);
+		CHECK(IntVector_IndexOf(&vector, i) == (size_t) i);
+	}
+	CHECK(IntVector_IndexOf(&vector, 1000) == SIZE_MAX);
+
+	IntVector_Free(&vector);
+	CHECK(vector.size == 0 && vector.capacity == 0 && vector.items == NULL);
+}
+
+static void TestSwapRemove(void)
+{
+	IntVector vector = {0};
+	for (int i = 0; i < 5; i++)
+	{
+		CHECK(IntVector_Push(&vector, i));
+	}
+
+	// The last element takes the removed one's place.
+	IntVector_SwapRemove(&vector, 1);
+	CHECK(vector.size == 4);
+	CHECK(vector.items[0] == 0 && vector.items[1] == 4 && vector.items[2] == 2
+			&& vector.items[3] == 3);
+
+	CHECK(IntVector_SwapRemoveItem(&vector, 3));
+	CHECK(vector.size == 3);
+	CHECK(!IntVector_Contains(&vector, 3));
+	CHECK(!IntVector_SwapRemoveItem(&vector, 3));
+	CHECK(vector.size == 3);
+
+	// Only the first of equal elements.
+	CHECK(IntVector_Push(&vector, 2));
+	CHECK(IntVector_SwapRemoveItem(&vector, 2));
+	CHECK(IntVector_Contains(&vector, 2));
+
+	while (vector.size > 0)
+	{
+		IntVector_SwapRemove(&vector, 0);
+	}
+	CHECK(!IntVector_Contains(&vector, 0));
+
+	IntVector_Free(&vector);
+}
+
+static void TestReserveShrink(void)
+{
+	IntVector vector = {0};
+
+	CHECK(IntVector_Reserve(&vector, 100));
+	CHECK(vector.capacity == 100 && vector.size == 0);
+
+	// Never shrinks.
+	CHECK(IntVector_Reserve(&vector, 10));
+	CHECK(vector.capacity == 100);
+
+	int* items = vector.items;
+	for (int i = 0; i < 100; i++)
+	{
+		CHECK(IntVector_Push(&vector, i));
+	}
+	CHECK(vector.items == items);
+
+	CHECK(!IntVector_Reserve(&vector, SIZE_MAX));
+	CHECK(vector.capacity == 100 && vector.items == items);
+
+	for (int i = 0; i < 90; i++)
+	{
+		CHECK(IntVector_SwapRemoveItem(&vector, i));
+	}
+
+	IntVector_Shrink(&vector);
+	CHECK(vector.size == 10 && vector.capacity == 10);
+	for (int i = 90; i < 100; i++)
+	{
+		CHECK(IntVector_Contains(&vector, i));
+	}
+
+	IntVector_Clear(&vector);
+	CHECK(vector.size == 0 && vector.capacity == 10);
+
+	// Shrinking an empty vector frees it.
+	IntVector_Shrink(&vector);
+	CHECK(vector.capacity == 0 && vector.items == NULL);
+
+	CHECK(IntVector_Push(&vector, 1));
+	CHECK(vector.capacity == VECTOR_MIN_CAPACITY);
+
+	IntVector_Free(&vector);
+}
+
+static void TestCustomEquals(void)
+{
+	PointVector vector = {0};
+
+	CHECK(PointVector_Push(&vector, (Point) { 1, 2 }));
+	CHECK(PointVector_Push(&vector, (Point) { 2, 1 }));
+
+	CHECK(PointVector_IndexOf(&vector, (Point) { 2, 1 }) == 1);
+	CHECK(!PointVector_Contains(&vector, (Point) { 1, 1 }));
+	CHECK(PointVector_SwapRemoveItem(&vector, (Point) { 1, 2 }));
+	CHECK(vector.size == 1 && vector.items[0].x == 2);
+
+	PointVector_Free(&vector);
+}
+
+int main(void)
+{
+	TestPush();
+	TestSwapRemove();
+	TestReserveShrink();
+	TestCustomEquals();
+
+	return TEST_RESULT();
+}
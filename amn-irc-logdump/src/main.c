@@ -0,0 +1,228 @@
+#include "log_format.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+  * Decodes a binary log file, see Logger_OpenBinaryFile, to the text lines
+  * the logger would have written.
+  */
+
+#define TIME_PATTERN "%H:%M:%S"
+#define MAX_TIME_BYTES 128
+#define MAX_MSG_BYTES 1024
+
+typedef struct Site
+{
+	bool known;
+	LogLevel level;
+	uint32_t line;
+	const char* file;
+	const char* function;
+	const char* format;
+}
+Site;
+
+typedef struct Decoder
+{
+	// Indexed by site id.
+	Site* sites;
+	size_t siteCount;
+
+	time_t cachedSecond;
+	char cachedTime[MAX_TIME_BYTES];
+}
+Decoder;
+
+static bool decodeSite(Decoder* decoder, const LogFileSite* record);
+static bool decodeMessage(Decoder* decoder, const LogFileMessage* record);
+static const char* nextString(const char* strings, size_t stringsLen, const char* str);
+
+int main(int argc, char** argv)
+{
+	if (argc != 2)
+	{
+		fprintf(stderr, "Usage: %s [binary log file]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	int fd = open(argv[1], O_RDONLY);
+	struct stat fileStat;
+	if (fd == -1 || fstat(fd, &fileStat) == -1)
+	{
+		perror(argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	size_t fileLen = (size_t) fileStat.st_size;
+	if (fileLen < LOG_FILE_MAGIC_LEN)
+	{
+		fprintf(stderr, "%s: Not a binary log file.\n", argv[1]);
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	const unsigned char* map = mmap(NULL, fileLen, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+	{
+		perror(argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	int returnCode = EXIT_FAILURE;
+	Decoder decoder = {
+		.sites = NULL,
+		.siteCount = 0,
+		.cachedSecond = (time_t) -1,
+	};
+
+	if (memcmp(map, LOG_FILE_MAGIC, LOG_FILE_MAGIC_LEN) != 0)
+	{
+		fprintf(stderr, "%s: Not a binary log file.\n", argv[1]);
+		goto cleanup;
+	}
+
+	size_t offset = LOG_FILE_MAGIC_LEN;
+	while (fileLen - offset >= sizeof(LogFileRecord))
+	{
+		const LogFileRecord* record = (const LogFileRecord*) (map + offset);
+
+		// A file the logger didn't close ends with zeroes.
+		if (record->size == 0)
+		{
+			break;
+		}
+
+		if (record->size < sizeof(LogFileRecord) || record->size > fileLen - offset)
+		{
+			fprintf(stderr, "%s: Truncated record at %zu.\n", argv[1], offset);
+			goto cleanup;
+		}
+
+		bool ok = true;
+		if (record->type == LogFileRecordType_Site && record->size >= sizeof(LogFileSite))
+		{
+			ok = decodeSite(&decoder, (const LogFileSite*) record);
+		}
+		else if (record->type == LogFileRecordType_Message
+				&& record->size >= sizeof(LogFileMessage))
+		{
+			ok = decodeMessage(&decoder, (const LogFileMessage*) record);
+		}
+
+		if (!ok)
+		{
+			fprintf(stderr, "%s: Invalid record at %zu.\n", argv[1], offset);
+			goto cleanup;
+		}
+
+		offset += record->size;
+	}
+
+	returnCode = EXIT_SUCCESS;
+
+cleanup:
+	free(decoder.sites);
+	munmap((void*) map, fileLen);
+	return returnCode;
+}
+
+static bool decodeSite(Decoder* decoder, const LogFileSite* record)
+{
+	const char* strings = (const char*) (record + 1);
+	size_t stringsLen = record->record.size - sizeof(LogFileSite);
+
+	// The file, function and format, each NUL terminated.
+	const char* file = strings;
+	const char* function = nextString(strings, stringsLen, file);
+	const char* format = function != NULL ? nextString(strings, stringsLen, function) : NULL;
+
+	if (format == NULL || nextString(strings, stringsLen, format) == NULL
+			|| record->level > LogLevel_Error)
+	{
+		return false;
+	}
+
+	if (record->id >= decoder->siteCount)
+	{
+		size_t count = (size_t) record->id + 1;
+		Site* sites = realloc(decoder->sites, sizeof(Site) * count);
+		if (sites == NULL)
+		{
+			return false;
+		}
+
+		memset(sites + decoder->siteCount, 0, sizeof(Site) * (count - decoder->siteCount));
+		decoder->sites = sites;
+		decoder->siteCount = count;
+	}
+
+	decoder->sites[record->id] = (Site) {
+		.known = true,
+		.level = (LogLevel) record->level,
+		.line = record->line,
+		.file = file,
+		.function = function,
+		.format = format,
+	};
+
+	return true;
+}
+
+static bool decodeMessage(Decoder* decoder, const LogFileMessage* record)
+{
+	if (record->siteId >= decoder->siteCount || !decoder->sites[record->siteId].known
+			|| record->argsLen > record->record.size - sizeof(LogFileMessage))
+	{
+		return false;
+	}
+
+	const Site* site = &decoder->sites[record->siteId];
+
+	char text[MAX_MSG_BYTES];
+	size_t textLen = LogArgs_Format(text, MAX_MSG_BYTES, site->format,
+			(const unsigned char*) (record + 1), record->argsLen);
+
+	// Format time, localtime_r reads the time zone so only once per second.
+	time_t second = (time_t) record->sec;
+	if (second != decoder->cachedSecond)
+	{
+		struct tm localTime;
+		bool timeOk = localtime_r(&second, &localTime) != NULL
+			&& strftime(decoder->cachedTime, MAX_TIME_BYTES, TIME_PATTERN, &localTime) != 0;
+
+		if (!timeOk)
+		{
+			strcpy(decoder->cachedTime, "time fmt err");
+		}
+
+		decoder->cachedSecond = second;
+	}
+
+	char line[LOG_MAX_LINE_BYTES];
+	size_t lineLen = LogLine_Format(line, LOG_MAX_LINE_BYTES, decoder->cachedTime,
+			(long) (record->nsec / 1000), site->level, site->file, site->line, site->function,
+			text, textLen, record->errnum);
+
+	return fwrite(line, 1, lineLen, stdout) == lineLen;
+}
+
+/**
+ * The string after str, or null if str isn't terminated within strings.
+ */
+static const char* nextString(const char* strings, size_t stringsLen, const char* str)
+{
+	const char* end = memchr(str, '\0', stringsLen - (size_t) (str - strings));
+
+	return end != NULL ? end + 1 : NULL;
+}
@@ -0,0 +1,83 @@
+#!/bin/sh
+# Regenerates the @name tables of the scripts, which turn IrcCmdType values
+# back into names, from the IrcCmdType enum and IRC_CMD_TYPE_INFOS.
+# Run after changing either. With --check, only fails if a table is stale.
+# Usage: cmd_names.sh [--check]
+
+set -eu
+
+dir=$(cd "$(dirname "$0")" && pwd)
+lib="$dir/../../amn-irc-lib"
+
+# "@name[N] = "NAME";" for each type but IrcCmdType_Null, four to a line.
+table=$(awk '
+	FNR == NR {
+		if (match($0, /^\t\[IrcCmdType_[A-Za-z]+\] = \{ "[A-Z]+"/))
+		{
+			split(substr($0, RSTART, RLENGTH), parts, /[][ "]+/);
+			names[parts[2]] = parts[5];
+		}
+		next;
+	}
+	/^\tIrcCmdType_[A-Za-z]+,$/ {
+		type = $1;
+		sub(/,$/, "", type);
+		if (type == "IrcCmdType_Len")
+		{
+			exit;
+		}
+		if (!(type in names))
+		{
+			printf("%s has no name in IRC_CMD_TYPE_INFOS\n", type) > "/dev/stderr";
+			failed = 1;
+			exit;
+		}
+		value++;
+		line = line (line == "" ? "\t" : " ") sprintf("@name[%d] = \"%s\";", value, names[type]);
+		if (value % 4 == 0)
+		{
+			print line;
+			line = "";
+		}
+	}
+	END {
+		if (failed)
+		{
+			exit 1;
+		}
+		if (line != "")
+		{
+			print line;
+		}
+	}
+' "$lib/src/irc_cmd_type.c" "$lib/include/irc_cmd_type.h")
+
+stale=0
+for script in "$dir"/*.bt; do
+	grep -q '^	@name\[' "$script" || continue
+
+	updated=$(printf '%s\n' "$table" | awk '
+		FNR == NR { table = table $0 "\n"; next; }
+		/^\t@name\[/ {
+			if (!printed)
+			{
+				printf("%s", table);
+				printed = 1;
+			}
+			next;
+		}
+		{ print; }
+	' - "$script")
+
+	if [ "$updated" != "$(cat "$script")" ]; then
+		if [ "${1:-}" = "--check" ]; then
+			echo "$(basename "$script") is stale, run $(basename "$0")." >&2
+			stale=1
+		else
+			printf '%s\n' "$updated" > "$script"
+			echo "Updated $(basename "$script")."
+		fi
+	fi
+done
+
+exit $stale
@@ -1,5 +1,7 @@
 #include "accept_conn_task.h"
 
+#include "application.h"
+#include "metrics.h"
 #include "receive_msg_task.h"
 
 #include <errno.h>
@@ -13,14 +15,21 @@ typedef struct AcceptConnContext
 	const Logger* log;
 	TaskQueue* tasks;
 	IrcCmdQueue* cmds;
+	const ServerConfig* config;
+	const ReceiveMsgShared* receiveShared;
 	int socket;
 }
 AcceptConnContext;
 
+static Metric AcceptedConnections = METRIC_COUNTER("amn_connections_accepted_total",
+		"Connections accepted since the server started.");
+
 static TaskStatus WaitForConnections(void* context);
 static void DeleteContext(void* context);
+static void SetBufferSizes(AcceptConnContext* ctx, int clientSocket);
 
-Task* AcceptConnTask_New(const Logger* log, TaskQueue* tasks, IrcCmdQueue* cmds, int socket)
+Task* AcceptConnTask_New(const Logger* log, TaskQueue* tasks, IrcCmdQueue* cmds,
+		const ServerConfig* config, const ReceiveMsgShared* receiveShared, int socket)
 {
 	AcceptConnContext* context = malloc(sizeof(AcceptConnContext));
 	if (context == NULL)
@@ -31,8 +40,12 @@ Task* AcceptConnTask_New(const Logger* log, TaskQueue* tasks, IrcCmdQueue* cmds,
 	context->log = log;
 	context->tasks = tasks;
 	context->cmds = cmds;
+	context->config = config;
+	context->receiveShared = receiveShared;
 	context->socket = socket;
 
+	Metric_Register(&AcceptedConnections);
+
 	Task* self = Task_Create(WaitForConnections, context, DeleteContext);
 	if (self == NULL)
 	{
@@ -61,11 +74,21 @@ static TaskStatus WaitForConnections(void* arg)
 
 	// LOG_DEBUG(ctx->log, "Waiting for connection");
 
+	if (!Application_WaitReadable(ctx->socket, -1) && errno != EINTR)
+	{
+		LOG_ERROR(ctx->log, "Failed to wait for connections.");
+		return TaskStatus_Failed;
+	}
+
+	if (Application_ShouldShutdown())
+	{
+		return TaskStatus_Done;
+	}
+
 	int clientSocket = accept(ctx->socket, NULL, NULL);
 	if (clientSocket == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
 	{
-		// Socket timeout
-		// LOG_DEBUG(ctx->log, "Timeout while accepting connections.");
+		// Interrupted by a signal, or the connection went away before we got to it.
 		errno = 0;
 		return TaskStatus_Yield;
 	}
@@ -75,13 +98,17 @@ static TaskStatus WaitForConnections(void* arg)
 		return TaskStatus_Failed;
 	}
 
+	Metric_Add(&AcceptedConnections, 1);
+
+	SetBufferSizes(ctx, clientSocket);
+
 	Task* receiveTask = ReceiveMsgTask_New(
-			ctx->log, ctx->tasks, ctx->cmds, clientSocket);	
+			ctx->log, ctx->tasks, ctx->cmds, ctx->config, ctx->receiveShared, clientSocket);	
 	if (receiveTask == NULL)
 	{
 		LOG_ERROR(ctx->log, "Failed to create ReceiveMsgTask.");
 
-		if (close(ctx->socket) != 0)
+		if (close(clientSocket) != 0)
 		{
 			LOG_ERROR(ctx->log, "Failed to close client socket.");
 		}
@@ -97,3 +124,25 @@ static TaskStatus WaitForConnections(void* arg)
 
 	return TaskStatus_Yield;
 }
+
+static void SetBufferSizes(AcceptConnContext* ctx, int clientSocket)
+{
+	// Config limits these to INT_MAX.
+	int recvBuffer = (int) ctx->config->socketRecvBuffer;
+	int sendBuffer = (int) ctx->config->socketSendBuffer;
+
+	// The system defaults work, so failures aren't fatal.
+	if (recvBuffer > 0
+			&& setsockopt(clientSocket, SOL_SOCKET, SO_RCVBUF, &recvBuffer, sizeof(int)) == -1)
+	{
+		LOG_WARN(ctx->log, "Failed to set client socket receive buffer size.");
+	}
+
+	if (sendBuffer > 0
+			&& setsockopt(clientSocket, SOL_SOCKET, SO_SNDBUF, &sendBuffer, sizeof(int)) == -1)
+	{
+		LOG_WARN(ctx->log, "Failed to set client socket send buffer size.");
+	}
+
+	errno = 0;
+}
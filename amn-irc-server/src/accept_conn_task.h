@@ -5,12 +5,15 @@
 #include "task.h"
 #include "task_queue.h"
 #include "irc_cmd_queue.h"
+#include "receive_msg_task.h"
+#include "server_config.h"
 
 /**
   * Task to accept incoming connection from a socket.
   * Accepted connections are added to the TaskQueue.
   */
-Task* AcceptConnTask_New(const Logger* log, TaskQueue* tasks, IrcCmdQueue* cmds, int socket);
+Task* AcceptConnTask_New(const Logger* log, TaskQueue* tasks, IrcCmdQueue* cmds,
+		const ServerConfig* config, const ReceiveMsgShared* receiveShared, int socket);
 
 
 #endif // AMN_ACCEPT_CONN_TASK_H
@@ -0,0 +1,40 @@
+#include "flood_control.h"
+
+#include <time.h>
+
+static uint64_t NowMs()
+{
+	struct timespec now;
+	if (clock_gettime(CLOCK_MONOTONIC, &now) != 0)
+	{
+		return 0;
+	}
+
+	return (uint64_t) now.tv_sec * 1000 + (uint64_t) now.tv_nsec / 1000000;
+}
+
+void FloodControl_Init(FloodControl* self, uint64_t burstMs)
+{
+	self->messageTimerMs = NowMs();
+	self->burstMs = burstMs;
+}
+
+void FloodControl_Charge(FloodControl* self, IrcCmdType cmd)
+{
+	uint64_t now = NowMs();
+
+	// Idle time is not saved up beyond the burst allowance.
+	if (self->messageTimerMs < now)
+	{
+		self->messageTimerMs = now;
+	}
+
+	self->messageTimerMs += IRC_CMD_TYPE_INFOS[cmd < IrcCmdType_Len ? cmd : IrcCmdType_Null].penaltyMs;
+}
+
+uint64_t FloodControl_Delay(const FloodControl* self)
+{
+	uint64_t limit = NowMs() + self->burstMs;
+
+	return self->messageTimerMs > limit ? self->messageTimerMs - limit : 0;
+}
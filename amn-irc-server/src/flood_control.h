@@ -0,0 +1,41 @@
+#ifndef AMN_FLOOD_CONTROL_H
+#define AMN_FLOOD_CONTROL_H
+
+#include "irc_cmd_type.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+  * Per-connection flood control.
+  * https://datatracker.ietf.org/doc/html/rfc1459#section-8.10
+  *
+  * Each received command advances the connection's message timer by a penalty
+  * that depends on the command type. While the timer is more than burstMs ahead
+  * of the current time the connection must not be read from, so the client
+  * is throttled by TCP instead of by taking more executor time.
+  */
+typedef struct FloodControl
+{
+	// Monotonic time, in milliseconds, the client has "spent" up to.
+	uint64_t messageTimerMs;
+	// How far ahead of the current time the message timer may run.
+	uint64_t burstMs;
+}
+FloodControl;
+
+void FloodControl_Init(FloodControl* self, uint64_t burstMs);
+
+/**
+ * Penalizes the connection for a received command.
+ * Use IrcCmdType_Null for messages that failed to parse.
+ */
+void FloodControl_Charge(FloodControl* self, IrcCmdType cmd);
+
+/**
+ * How long, in milliseconds, the connection must wait before being read from again.
+ * Zero if the connection is within its limit.
+ */
+uint64_t FloodControl_Delay(const FloodControl* self);
+
+#endif // AMN_FLOOD_CONTROL_H
@@ -1,15 +1,27 @@
 #include "irc_cmd_executor_task.h"
 
+#include "application.h"
 #include "array_list.h"
+#include "hash_map.h"
 #include "irc_cmd.h"
 #include "irc_reply.h"
+#include "link_stats.h"
 #include "send_msg_task.h"
+#include "str_atom.h"
 #include "irc_cmd_unparser.h"
+#include "flight_recorder.h"
+#include "metrics.h"
+#include "probes.h"
 #include "str_utils.h"
+#include "vector.h"
 
 #include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 // Unsigned integers overflow nicely so even if you manage to have over
 // 18,446,744,073,709,551,616 users across the timespan the server is running
@@ -17,36 +29,39 @@
 // for that same amount of time.
 typedef uint64_t UserId;
 
-static bool UserId_Cmp(const void* self, const void* other)
-{
-	return *((UserId*)self) == *((UserId*) other);
-}
+VECTOR_DEFINE(UserIdVector, UserId, VECTOR_EQUALS_SCALAR)
 
 typedef struct User
 {
 	UserId id;
 	int socket;
-	char* nickname;
-	char* username;
-	char* hostname;
+	StrAtom* nickname;
+	StrAtom* username;
+	StrAtom* hostname;
 	char* realname;
 	bool isOperator;
+	// ":nick!user@host " ready to be written in front of messages from this
+	// user, null until registered.
+	char* prefix;
+	size_t prefixLen;
+
+	// For STATS l. Sending is counted by link, receiving by the executor,
+	// as only it reads these.
+	LinkStats* link;
+	uint64_t receivedMsgs;
+	uint64_t receivedBytes;
+	uint64_t connectedNs;
 } User;
 
-static void User_Delete(void* arg)
+static void User_Delete(User* user)
 {
-	if (arg == NULL)
-	{
-		return;
-	}
-
-	User* user = (User*) arg;
-
-	free(user->nickname);
-	free(user->username);
-	free(user->hostname);
+	StrAtom_Unref(user->nickname);
+	StrAtom_Unref(user->username);
+	StrAtom_Unref(user->hostname);
 	free(user->realname);
-	// User struct is part of the arraylist storage
+	free(user->prefix);
+	LinkStats_Unref(user->link);
+	// User struct is part of the map storage
 	// free(user);
 }
 
@@ -58,70 +73,130 @@ static bool User_IsRegistered(const User* self)
 		&& self->realname != NULL;
 }
 
-static bool User_CmpSocket(const void* user, const void* socket)
+/**
+ * Rebuilds the cached prefix, must be called whenever nickname, username or
+ * hostname change.
+ */
+static bool User_UpdatePrefix(User* self)
 {
-	return ((User*) user)->socket == *((int*) socket);
+	if (!User_IsRegistered(self))
+	{
+		return true;
+	}
+
+	size_t nickLen = StrAtom_Len(self->nickname);
+	size_t userLen = StrAtom_Len(self->username);
+	size_t hostLen = StrAtom_Len(self->hostname);
+	size_t prefixLen = 1 + nickLen + 1 + userLen + 1 + hostLen + 1;
+
+	char* prefix = malloc(prefixLen + 1);
+	if (prefix == NULL)
+	{
+		return false;
+	}
+
+	char* pos = prefix;
+	*pos++ = ':';
+	memcpy(pos, StrAtom_Str(self->nickname), nickLen);
+	pos += nickLen;
+	*pos++ = '!';
+	memcpy(pos, StrAtom_Str(self->username), userLen);
+	pos += userLen;
+	*pos++ = '@';
+	memcpy(pos, StrAtom_Str(self->hostname), hostLen);
+	pos += hostLen;
+	*pos++ = ' ';
+	*pos = '\0';
+
+	free(self->prefix);
+	self->prefix = prefix;
+	self->prefixLen = prefixLen;
+
+	return true;
 }
 
-// static bool User_CmpId(const void* user, const void* id)
-// {
-// 	return ((User*) user)->id == *((UserId*) id);
-// }
+#define SOCKET_HASH(socket) HashMap_HashU64((uint64_t) (socket))
 
-static bool User_CmpNick(const void* arg1, const void* arg2)
-{
-	User* user = (User*) arg1;
-	char* nickname = (char*) arg2;
+// Users by socket.
+HASH_MAP_DEFINE(UserMap, int, User, SOCKET_HASH, HASH_MAP_EQUALS_SCALAR)
 
-	if (user->nickname == NULL)
+static void DeleteUsers(UserMap* users)
+{
+	for (size_t i = 0; i < users->capacity; i++)
 	{
-		return false;
+		UserMapEntry* entry = UserMap_At(users, i);
+		if (entry != NULL)
+		{
+			User_Delete(&entry->value);
+		}
 	}
 
-	return StrUtils_Equals(user->nickname, nickname);
+	UserMap_Free(users);
 }
 
+// Sockets of users by casefolded nickname atom.
+HASH_MAP_DEFINE(NickMap, const StrAtom*, int, StrAtom_Hash, HASH_MAP_EQUALS_SCALAR)
+
 typedef struct Channel
 {
-	char* name;
+	StrAtom* name;
 
 	IrcModes modes;
-	ArrayList* operatorIds;
+	UserIdVector operatorIds;
 	size_t limit;
 	char* banmask;
 	char* key;
 
-	ArrayList* memberIds;
+	UserIdVector memberIds;
 	char* topic;
 }
 Channel;
 
-static void Channel_Delete(void* arg)
+static void Channel_Delete(Channel* channel)
 {
-	if (arg == NULL)
-	{
-		return;
-	}
-	
-	Channel* channel = (Channel*) arg;
-
-	free(channel->name);
-	ArrayList_Delete(channel->operatorIds);
+	StrAtom_Unref(channel->name);
+	UserIdVector_Free(&channel->operatorIds);
 	free(channel->banmask);
 	free(channel->key);
-	ArrayList_Delete(channel->memberIds);
+	UserIdVector_Free(&channel->memberIds);
 	free(channel->topic);
-	// Channel struct is part of the arraylist storage
+	// Channel struct is part of the map storage
 	// free(channel);
 }
 
-static bool Channel_CmpName(const void* arg1, const void* arg2)
+// Channels by casefolded name atom.
+HASH_MAP_DEFINE(ChannelMap, const StrAtom*, Channel, StrAtom_Hash, HASH_MAP_EQUALS_SCALAR)
+
+static void DeleteChannels(ChannelMap* channels)
 {
-	Channel* channel = (Channel*) arg1;
-	char* name = (char*) arg2;
+	for (size_t i = 0; i < channels->capacity; i++)
+	{
+		ChannelMapEntry* entry = ChannelMap_At(channels, i);
+		if (entry != NULL)
+		{
+			Channel_Delete(&entry->value);
+		}
+	}
+
+	ChannelMap_Free(channels);
+}
 
-	return StrUtils_Equals(channel->name, name);
+// Execution time and failures of one command type, labeled with its name.
+typedef struct CmdMetrics
+{
+	char labels[32];
+	Metric execTime;
+	Metric failures;
 }
+CmdMetrics;
+
+// Enough for the replies to most commands, fuller buffers are sent early.
+#define REPLY_BUF_SIZE (IRC_MSG_SIZE * 4)
+
+// Of the welcome burst, see AddWelcome. Modes are the letters of IrcMode.
+#define SERVER_VERSION "amn-irc-server-0.1"
+#define USER_MODES "iswo"
+#define CHANNEL_MODES "psitnmlbkov"
 
 typedef struct IrcCmdExecutorContext
 {
@@ -129,17 +204,30 @@ typedef struct IrcCmdExecutorContext
 	const Logger* log;
 	TaskQueue* tasks;
 	IrcCmdQueue* cmds;
+	TaskRunner** runners;
+	size_t runnerCount;
+	const ServerConfig* config;
 
 	// Owned objects
 	char* servername;
-	// There are better data structures for this but this is C
-	// and I don't have time to implement a entire hashmap.
-	ArrayList* users;
-	ArrayList* localChannels;
-	ArrayList* distChannels;
+	// Nicknames, usernames, hostnames and channel names, so each is only
+	// stored once and compared by pointer.
+	StrAtomTable* atoms;
+	UserMap users;
+	// Index of users with a nickname.
+	NickMap nicks;
+	ChannelMap localChannels;
+	ChannelMap distChannels;
 	IrcMsgValidator* msgValidator;
 	IrcCmdUnparser* cmdUnparser;
+	IrcReplies* replies;
 	UserId nextUserId;
+	// For STATS u.
+	uint64_t startNs;
+	// For RPL_CREATED, when the executor started.
+	char createdDate[64];
+	// Indexed by IrcCmdType.
+	CmdMetrics cmdMetrics[IrcCmdType_Len];
 
 	// Execution scoped fields:
 	
@@ -147,15 +235,37 @@ typedef struct IrcCmdExecutorContext
 	// Only unexpected errors are considered failures.
 	// Bad user input correctly handled is still a success.
 	bool success;
-	// Replies to be sent after processing this command
-	ArrayList* replyBuf;
-	// Commands to be sent after processing this command
-	ArrayList* cmdBuf;
+	// Replies to the command's sender, rendered here until sent after
+	// processing the command.
+	char replyBuf[REPLY_BUF_SIZE];
+	size_t replyLen;
+	int replySocket;
+	TaskPriority replyPriority;
+	// Messages in wire format to be sent after processing this command
+	ArrayList* outBuf;
+	// Of the command, copied to its sends.
+	MsgTrace* trace;
 }
 IrcCmdExecutorContext;
 
-static IrcCmdExecutorContext* IrcCmdExecutorContext_New(
-		const Logger* log, TaskQueue* tasks, IrcCmdQueue* cmds, const char* servername);
+// Message already composed in wire format.
+typedef struct OutMsg
+{
+	int peerSocket;
+	TaskPriority priority;
+	char* rawMsg;
+	size_t rawMsgLen;
+}
+OutMsg;
+
+static void OutMsg_Delete(void* arg)
+{
+	free(((OutMsg*) arg)->rawMsg);
+}
+
+static IrcCmdExecutorContext* IrcCmdExecutorContext_New(const Logger* log,
+		TaskQueue* tasks, IrcCmdQueue* cmds, TaskRunner** runners, size_t runnerCount,
+		const ServerConfig* config);
 
 static void IrcCmdExecutorContext_Delete(void* context);
 
@@ -163,50 +273,109 @@ static TaskStatus WaitForCmds(void* context);
 
 static void ExecuteCmd(IrcCmdExecutorContext* ctx, IrcCmd* cmd);
 
-static void ExecuteCmdNick(
-		IrcCmdExecutorContext* ctx, int peerSocket, IrcCmdNick* cmd);
+static void ExecuteCmdNick(IrcCmdExecutorContext* ctx, IrcCmd* ircCmd, User* existingUser);
 
 static bool ExecuteCmdNick_CheckCollision(IrcCmdExecutorContext* ctx, IrcCmdNick* cmd);
 
-static void ExecuteCmdUser(
-		IrcCmdExecutorContext* ctx, int peerSocket, IrcCmdUser* cmd);
+static void ExecuteCmdUser(IrcCmdExecutorContext* ctx, IrcCmd* ircCmd, User* existingUser);
 
-static void ExecuteCmdQuit(
-		IrcCmdExecutorContext* ctx, int peerSocket, IrcCmdQuit* cmd);
+static void ExecuteCmdQuit(IrcCmdExecutorContext* ctx, IrcCmd* ircCmd, User* user);
 
-static void ExecuteCmdJoin(
-		IrcCmdExecutorContext* ctx, int peerSocket, IrcCmdJoin* cmd);
+static void ExecuteCmdJoin(IrcCmdExecutorContext* ctx, IrcCmd* ircCmd, User* user);
 
 static void ExecuteCmdJoin_CreateChannel(
-		IrcCmdExecutorContext* ctx, ArrayList* channels,
-		User* user, IrcChannelAndKey* channelAndKey);
+		IrcCmdExecutorContext* ctx, ChannelMap* channels,
+		User* user, const IrcChannelAndKey* channelAndKey);
 
 static void ExecuteCmdJoin_JoinChannel(
 		IrcCmdExecutorContext* ctx,
 		User* user,
 		Channel* channel,
 		IrcChannelType channelType,
-		char* key);
+		const char* key);
+
+static void ExecuteCmdPrivMsg(IrcCmdExecutorContext* ctx, IrcCmd* ircCmd, User* user);
+
+static void ExecuteCmdPing(IrcCmdExecutorContext* ctx, IrcCmd* ircCmd, User* user);
+
+static void ExecuteCmdPong(IrcCmdExecutorContext* ctx, IrcCmd* ircCmd, User* user);
+
+static void ExecuteCmdStats(IrcCmdExecutorContext* ctx, IrcCmd* ircCmd, User* user);
 
-static void ExecuteCmdPrivMsg(
-		IrcCmdExecutorContext* ctx, int peerSocket, IrcCmdPrivMsg* cmd);
+static void ExecuteCmdStats_Links(IrcCmdExecutorContext* ctx);
 
+static void ExecuteCmdStats_Commands(IrcCmdExecutorContext* ctx);
 
-static User* WithRegisteredUser(IrcCmdExecutorContext* ctx, int peerSocket);
-static ArrayList* ChannelList(IrcCmdExecutorContext* ctx, IrcChannelType type);
+static void ExecuteCmdStats_Uptime(IrcCmdExecutorContext* ctx);
 
-static void AddReply(IrcCmdExecutorContext* ctx, IrcMsg* msg);
-static void AddCmd(IrcCmdExecutorContext* ctx, const IrcCmd* cmd);
+static void ExecuteCmdStats_Amn(IrcCmdExecutorContext* ctx);
 
-static void SendReplies(IrcCmdExecutorContext* ctx, int peerSocket);
-static void SendCmds(IrcCmdExecutorContext* ctx);
-static void SendMsg(IrcCmdExecutorContext* ctx, int peerSocket, IrcMsg* msg);
+static void ExecuteCmdRehash(IrcCmdExecutorContext* ctx, IrcCmd* ircCmd, User* user);
+
+static void ExecuteCmdOper(IrcCmdExecutorContext* ctx, IrcCmd* ircCmd, User* user);
+
+static bool SecretEquals(const char* secret, const char* guess);
+
+/**
+ * @param user	Sender of the command, null if it hasn't sent NICK or USER yet.
+ */
+typedef void (*CmdHandler)(IrcCmdExecutorContext* ctx, IrcCmd* cmd, User* user);
+
+typedef struct CmdHandlerInfo
+{
+	CmdHandler handler;
+	// Unregistered senders get ERR_NOTREGISTERED instead.
+	bool requiresRegistration;
+}
+CmdHandlerInfo;
+
+// Indexed by IrcCmdType. The parser drops commands it doesn't support, so
+// every command reaching the executor should have a handler.
+static const CmdHandlerInfo HANDLERS[IrcCmdType_Len] = {
+	[IrcCmdType_Nick] = { ExecuteCmdNick, false },
+	[IrcCmdType_User] = { ExecuteCmdUser, false },
+	[IrcCmdType_Quit] = { ExecuteCmdQuit, false },
+	[IrcCmdType_Join] = { ExecuteCmdJoin, true },
+	[IrcCmdType_PrivMsg] = { ExecuteCmdPrivMsg, true },
+	[IrcCmdType_Ping] = { ExecuteCmdPing, false },
+	[IrcCmdType_Pong] = { ExecuteCmdPong, false },
+	[IrcCmdType_Stats] = { ExecuteCmdStats, true },
+	[IrcCmdType_Rehash] = { ExecuteCmdRehash, true },
+	[IrcCmdType_Operator] = { ExecuteCmdOper, true },
+};
+
+static void CmdMetrics_Init(CmdMetrics* self, IrcCmdType type);
+static void CmdMetrics_Log(CmdMetrics* self, const Logger* log, IrcCmdType type);
+
+static User* FindUserByNick(IrcCmdExecutorContext* ctx, const char* nickname);
+static Channel* FindChannel(IrcCmdExecutorContext* ctx, ChannelMap* channels, const char* name);
+static ChannelMap* ChannelList(IrcCmdExecutorContext* ctx, IrcChannelType type);
+
+static void AddReply(IrcCmdExecutorContext* ctx,
+		IrcReplyType type, size_t argCount, const char* const* args);
+static void AddChannelReply(IrcCmdExecutorContext* ctx,
+		IrcReplyType type, IrcChannelType channelType, const Channel* channel);
+static void AddPrivMsg(IrcCmdExecutorContext* ctx, const User* sender,
+		int peerSocket, const char* receiver, const char* text);
+static void AddOutCmd(IrcCmdExecutorContext* ctx,
+		int peerSocket, const IrcCmd* cmd, TaskPriority priority);
+static void AddOutMsg(IrcCmdExecutorContext* ctx,
+		int peerSocket, char* rawMsg, size_t rawMsgLen, TaskPriority priority);
+
+static void AddStatsDebug(IrcCmdExecutorContext* ctx, const char* format, ...);
+static void AddWelcome(IrcCmdExecutorContext* ctx, const User* user);
+
+static void SendReplies(IrcCmdExecutorContext* ctx);
+static void SendOutMsgs(IrcCmdExecutorContext* ctx);
+static void SendRawMsg(IrcCmdExecutorContext* ctx,
+		int peerSocket, char* rawMsg, size_t rawMsgLen, TaskPriority priority);
 
 
 Task* IrcCmdExecutorTask_New(const Logger* log, TaskQueue* tasks, IrcCmdQueue* cmds,
-		const char* servername)
+		TaskRunner** runners, size_t runnerCount, const ServerConfig* config)
 {
-	IrcCmdExecutorContext* context = IrcCmdExecutorContext_New(log, tasks, cmds, servername);
+	IrcCmdExecutorContext* context = IrcCmdExecutorContext_New(
+			log, tasks, cmds, runners, runnerCount, config);
 	if (context == NULL)
 	{
 		LOG_ERROR(log, "Failed to create command executor context.");
@@ -224,16 +393,12 @@ Task* IrcCmdExecutorTask_New(const Logger* log, TaskQueue* tasks, IrcCmdQueue* c
 	return self;
 }
 
-static void IrcMsgPtrDelete(void* arg)
+static IrcCmdExecutorContext* IrcCmdExecutorContext_New(const Logger* log,
+		TaskQueue* tasks, IrcCmdQueue* cmds, TaskRunner** runners, size_t runnerCount,
+		const ServerConfig* config)
 {
-	IrcMsg* msg = *(IrcMsg**) arg;
-
-	IrcMsg_Delete(msg);
-}
+	const char* servername = config->serverName;
 
-static IrcCmdExecutorContext* IrcCmdExecutorContext_New(
-		const Logger* log, TaskQueue* tasks, IrcCmdQueue* cmds, const char* servername)
-{
 	IrcCmdExecutorContext* ctx = malloc(sizeof(IrcCmdExecutorContext));
 	if (ctx == NULL)
 		return NULL;
@@ -242,29 +407,44 @@ static IrcCmdExecutorContext* IrcCmdExecutorContext_New(
 	ctx->log = log;
 	ctx->tasks = tasks;
 	ctx->cmds = cmds;
+	ctx->runners = runners;
+	ctx->runnerCount = runnerCount;
+	ctx->config = config;
 	ctx->nextUserId = 0;
+	ctx->startNs = Metrics_NowNs();
 	ctx->success = true;
 
-	ctx->users = ArrayList_New(100, 100, sizeof(User), User_Delete);
-	if (ctx->users == NULL)
+	time_t now = time(NULL);
+	struct tm created;
+	if (gmtime_r(&now, &created) == NULL
+			|| strftime(ctx->createdDate, sizeof(ctx->createdDate),
+					"%a %b %d %Y at %H:%M:%S UTC", &created) == 0)
 	{
-		LOG_ERROR(log, "Failed to create users list.");
-		IrcCmdExecutorContext_Delete(ctx);
-		return NULL;
+		snprintf(ctx->createdDate, sizeof(ctx->createdDate), "%lld", (long long) now);
+	}
+
+	for (size_t type = 0; type < IrcCmdType_Len; type++)
+	{
+		if (HANDLERS[type].handler != NULL)
+		{
+			CmdMetrics_Init(&ctx->cmdMetrics[type], (IrcCmdType) type);
+		}
 	}
 
-	ctx->localChannels = ArrayList_New(50, 50, sizeof(Channel), Channel_Delete);
-	if (ctx->localChannels == NULL)
+	ctx->atoms = StrAtomTable_New(256);
+	if (ctx->atoms == NULL)
 	{
-		LOG_ERROR(log, "Failed to create local channels list.");
+		LOG_ERROR(log, "Failed to create atom table.");
 		IrcCmdExecutorContext_Delete(ctx);
 		return NULL;
 	}
 
-	ctx->distChannels = ArrayList_New(100, 100, sizeof(Channel), Channel_Delete);
-	if (ctx->distChannels == NULL)
+	if (!UserMap_Reserve(&ctx->users, 100)
+			|| !NickMap_Reserve(&ctx->nicks, 100)
+			|| !ChannelMap_Reserve(&ctx->localChannels, 50)
+			|| !ChannelMap_Reserve(&ctx->distChannels, 100))
 	{
-		LOG_ERROR(log, "Failed to create distributed channels list.");
+		LOG_ERROR(log, "Failed to create user and channel maps.");
 		IrcCmdExecutorContext_Delete(ctx);
 		return NULL;
 	}
@@ -300,18 +480,18 @@ static IrcCmdExecutorContext* IrcCmdExecutorContext_New(
 		return NULL;
 	}
 
-	ctx->replyBuf = ArrayList_New(100, 100, sizeof(IrcMsg*), IrcMsgPtrDelete);
-	if (ctx->replyBuf == NULL)
+	ctx->replies = IrcReplies_New(servername);
+	if (ctx->replies == NULL)
 	{
-		LOG_ERROR(log, "Failed to create reply buffer.");
+		LOG_ERROR(log, "Failed to create replies.");
 		IrcCmdExecutorContext_Delete(ctx);
 		return NULL;
 	}
 
-	ctx->cmdBuf = ArrayList_New(100, 100, sizeof(IrcCmd), NULL);
-	if (ctx->cmdBuf == NULL)
+	ctx->outBuf = ArrayList_New(100, 100, sizeof(OutMsg), OutMsg_Delete);
+	if (ctx->outBuf == NULL)
 	{
-		LOG_ERROR(log, "Failed to create cmd buffer.");
+		LOG_ERROR(log, "Failed to create out buffer.");
 		IrcCmdExecutorContext_Delete(ctx);
 		return NULL;
 	}
@@ -328,14 +508,25 @@ static void IrcCmdExecutorContext_Delete(void* arg)
 
 	IrcCmdExecutorContext* ctx = (IrcCmdExecutorContext*) arg;
 
+	for (size_t type = 0; type < IrcCmdType_Len; type++)
+	{
+		if (HANDLERS[type].handler != NULL)
+		{
+			CmdMetrics_Log(&ctx->cmdMetrics[type], ctx->log, (IrcCmdType) type);
+		}
+	}
+
 	free(ctx->servername);
 	IrcCmdUnparser_Delete(ctx->cmdUnparser);
 	IrcMsgValidator_Delete(ctx->msgValidator);
-	ArrayList_Delete(ctx->users);
-	ArrayList_Delete(ctx->localChannels);
-	ArrayList_Delete(ctx->distChannels);
-	ArrayList_Delete(ctx->replyBuf);
-	ArrayList_Delete(ctx->cmdBuf);
+	DeleteUsers(&ctx->users);
+	NickMap_Free(&ctx->nicks);
+	DeleteChannels(&ctx->localChannels);
+	DeleteChannels(&ctx->distChannels);
+	IrcReplies_Delete(ctx->replies);
+	ArrayList_Delete(ctx->outBuf);
+	// After everything holding atoms.
+	StrAtomTable_Delete(ctx->atoms);
 	free(ctx);
 }
 
@@ -344,9 +535,9 @@ static TaskStatus WaitForCmds(void* arg)
 	IrcCmdExecutorContext* ctx = (IrcCmdExecutorContext*) arg;
 	
 	IrcCmd* cmd = IrcCmdQueue_Pop(ctx->cmds);
-	if (cmd == NULL && errno == EAGAIN)
+	if (cmd == NULL && errno == ECANCELED)
 	{
-		return TaskStatus_Yield;
+		return TaskStatus_Done;
 	}
 	else if (cmd == NULL)
 	{
@@ -354,15 +545,31 @@ static TaskStatus WaitForCmds(void* arg)
 		return TaskStatus_Failed;
 	}
 
+	MsgTrace_Stamp(&cmd->trace, MsgTraceStage_Dequeued);
+
 	ctx->success = true;
 
+	// Replies to control commands skip ahead of other tasks too.
+	TaskPriority replyPriority = cmd->priority == IrcCmdPriority_Control
+		? TaskPriority_High
+		: TaskPriority_Normal;
+
+	ctx->replyLen = 0;
+	ctx->replySocket = cmd->peerSocket;
+	ctx->replyPriority = replyPriority;
+	ctx->trace = &cmd->trace;
+
 	ExecuteCmd(ctx, cmd);
-	SendReplies(ctx, cmd->peerSocket);
-	SendCmds(ctx);
+
+	MsgTrace_Stamp(&cmd->trace, MsgTraceStage_Executed);
+	MsgTrace_RecordExecuted(&cmd->trace);
+
+	SendReplies(ctx);
+	SendOutMsgs(ctx);
 
 	IrcCmd_Delete(cmd);
-	ArrayList_Clear(ctx->replyBuf);
-	ArrayList_Clear(ctx->cmdBuf);
+	ArrayList_Clear(ctx->outBuf);
+	ctx->trace = NULL;
 
 	if (!ctx->success)
 	{
@@ -375,32 +582,60 @@ static TaskStatus WaitForCmds(void* arg)
 
 static void ExecuteCmd(IrcCmdExecutorContext* ctx, IrcCmd* cmd)
 {
-	switch(cmd->type)
-	{
-		case IrcCmdType_Nick:
-			ExecuteCmdNick(ctx, cmd->peerSocket, &cmd->nick);
-		break;
-		case IrcCmdType_User:
-			ExecuteCmdUser(ctx, cmd->peerSocket, &cmd->user);
-		break;
-		case IrcCmdType_Quit:
-			ExecuteCmdQuit(ctx, cmd->peerSocket, &cmd->quit);
-		break;
-		case IrcCmdType_Join:
-			ExecuteCmdJoin(ctx, cmd->peerSocket, &cmd->join);
-		break;
-		case IrcCmdType_PrivMsg:
-			ExecuteCmdPrivMsg(ctx, cmd->peerSocket, &cmd->privMsg);
-		break;
-		default:
-		break;
+	const CmdHandlerInfo* info = cmd->type < IrcCmdType_Len ? &HANDLERS[cmd->type] : NULL;
+	if (info == NULL || info->handler == NULL)
+	{
+		LOG_WARN(ctx->log, "No handler for command type %d.", (int) cmd->type);
+		return;
+	}
+
+	User* user = UserMap_Get(&ctx->users, cmd->peerSocket);
+
+	if (info->requiresRegistration && (user == NULL || !User_IsRegistered(user)))
+	{
+		AddReply(ctx, IrcReplyType_ErrNotRegistered, 0, NULL);
+		return;
+	}
+
+	uint64_t start = Metrics_NowNs();
+	AMN_PROBE2(exec_start, cmd->peerSocket, (int) cmd->type);
+
+	info->handler(ctx, cmd, user);
+
+	AMN_PROBE3(exec_done, cmd->peerSocket, (int) cmd->type, (int) ctx->success);
+
+	// Users are created by their first command, counted once they exist.
+	if (user == NULL)
+	{
+		user = UserMap_Get(&ctx->users, cmd->peerSocket);
+	}
+
+	// After QUIT the user is gone.
+	if (cmd->type != IrcCmdType_Quit && user != NULL)
+	{
+		user->receivedMsgs++;
+		// The parsed parts each end with a terminator where the raw message had
+		// a separator, so this is the raw length give or take a colon or two.
+		user->receivedBytes += strlen(IRC_CMD_TYPE_INFOS[cmd->type].name) + 2
+			+ (cmd->msg != NULL ? cmd->msg->bufferLen : 0u);
+	}
+
+	uint64_t execNs = Metrics_NowNs() - start;
+
+	CmdMetrics* metrics = &ctx->cmdMetrics[cmd->type];
+	Metric_Observe(&metrics->execTime, execNs);
+	if (!ctx->success)
+	{
+		Metric_Add(&metrics->failures, 1);
 	}
+
+	FlightRecorder_Record(ctx->success ? FlightEventType_CmdExecuted : FlightEventType_CmdFailed,
+			cmd->type, cmd->peerSocket, 0, execNs);
 }
 
-static void ExecuteCmdNick(
-		IrcCmdExecutorContext* ctx, int peerSocket, IrcCmdNick* cmd)
+static void ExecuteCmdNick(IrcCmdExecutorContext* ctx, IrcCmd* ircCmd, User* existingUser)
 {
-	User* existingUser = ArrayList_Find(ctx->users, User_CmpSocket, &peerSocket);
+	IrcCmdNick* cmd = &ircCmd->nick;
 
 	if (existingUser != NULL && existingUser->nickname != NULL)
 	{
@@ -415,34 +650,65 @@ static void ExecuteCmdNick(
 		return;
 	}
 
+	StrAtom* nickname = StrAtomTable_Intern(ctx->atoms, cmd->nickname);
+	if (nickname == NULL)
+	{
+		LOG_ERROR(ctx->log, "Failed to intern nickname.");
+		ctx->success = false;
+		return;
+	}
+
+	if (NickMap_Put(&ctx->nicks, StrAtom_Folded(nickname), ircCmd->peerSocket) == NULL)
+	{
+		LOG_ERROR(ctx->log, "Failed to index nickname.");
+		StrAtom_Unref(nickname);
+		ctx->success = false;
+		return;
+	}
+
 	if (existingUser != NULL)
 	{
-		existingUser->nickname = cmd->nickname;
+		bool wasRegistered = User_IsRegistered(existingUser);
+		existingUser->nickname = nickname;
+
+		if (!User_UpdatePrefix(existingUser))
+		{
+			LOG_ERROR(ctx->log, "Failed to build user prefix.");
+			ctx->success = false;
+			return;
+		}
+
+		if (!wasRegistered && User_IsRegistered(existingUser))
+		{
+			AddWelcome(ctx, existingUser);
+		}
 	}
 	else
 	{
 		User newUser = {
 			.id = ctx->nextUserId++,
-			.socket = peerSocket,
-			.nickname = cmd->nickname
+			.socket = ircCmd->peerSocket,
+			.nickname = nickname,
+			.link = LinkStats_New(),
+			.connectedNs = Metrics_NowNs(),
 		};
 
-		if (!ArrayList_Append(ctx->users, &newUser))
+		if (newUser.link == NULL || UserMap_Put(&ctx->users, newUser.socket, newUser) == NULL)
 		{
+			NickMap_Remove(&ctx->nicks, StrAtom_Folded(nickname), NULL);
+			StrAtom_Unref(nickname);
+			LinkStats_Unref(newUser.link);
 			ctx->success = false;
 			return;
 		}
 	}
 
-	LOG_INFO(ctx->log, "New client registered nickname: %s.", cmd->nickname);
-
-	// IrcCmd will not be used afterwards so we can steal the memory allocation
-	cmd->nickname = NULL;
+	LOG_INFO(ctx->log, "New client registered nickname: %s.", StrAtom_Str(nickname));
 }
 
 static bool ExecuteCmdNick_CheckCollision(IrcCmdExecutorContext* ctx, IrcCmdNick* cmd)
 {
-	User* userWithNick = ArrayList_Find(ctx->users, User_CmpNick, cmd->nickname);
+	User* userWithNick = FindUserByNick(ctx, cmd->nickname);
 
 	if (userWithNick == NULL)
 	{
@@ -450,40 +716,55 @@ static bool ExecuteCmdNick_CheckCollision(IrcCmdExecutorContext* ctx, IrcCmdNick
 	}
 
 	LOG_INFO(ctx->log, "Nickname collision: %s.", cmd->nickname);
-	AddReply(ctx, IrcReply_ErrNickCollision(ctx->servername, cmd->nickname));
+	AddReply(ctx, IrcReplyType_ErrNickCollision, 1, (const char*[]) { cmd->nickname });
 
 	return true;
 }
 
-static void ExecuteCmdUser(
-		IrcCmdExecutorContext* ctx, int peerSocket, IrcCmdUser* cmd)
+static void ExecuteCmdUser(IrcCmdExecutorContext* ctx, IrcCmd* ircCmd, User* existingUser)
 {
-	User* existingUser = ArrayList_Find(ctx->users, User_CmpSocket, &peerSocket);
+	IrcCmdUser* cmd = &ircCmd->user;
 
 	if (existingUser != NULL && User_IsRegistered(existingUser))
 	{
-		AddReply(ctx, IrcReply_ErrAlreadyRegistered(ctx->servername));
+		AddReply(ctx, IrcReplyType_ErrAlreadyRegistered, 0, NULL);
+		return;
+	}
+
+	StrAtom* username = StrAtomTable_Intern(ctx->atoms, cmd->username);
+	StrAtom* hostname = StrAtomTable_Intern(ctx->atoms, cmd->hostname);
+	if (username == NULL || hostname == NULL)
+	{
+		LOG_ERROR(ctx->log, "Failed to intern username and hostname.");
+		StrAtom_Unref(username);
+		StrAtom_Unref(hostname);
+		ctx->success = false;
 		return;
 	}
 
 	if (existingUser != NULL)
 	{
-		existingUser->username = cmd->username;
-		existingUser->hostname = cmd->hostname;
+		existingUser->username = username;
+		existingUser->hostname = hostname;
 		existingUser->realname = cmd->realname;
 	}
 	else
 	{
 		User newUser = {
 			.id = ctx->nextUserId++,
-			.socket = peerSocket,
-			.username = cmd->username,
-			.hostname = cmd->hostname,
+			.socket = ircCmd->peerSocket,
+			.username = username,
+			.hostname = hostname,
 			.realname = cmd->realname,
+			.link = LinkStats_New(),
+			.connectedNs = Metrics_NowNs(),
 		};
 
-		if (!ArrayList_Append(ctx->users, &newUser))
+		if (newUser.link == NULL || UserMap_Put(&ctx->users, newUser.socket, newUser) == NULL)
 		{
+			StrAtom_Unref(username);
+			StrAtom_Unref(hostname);
+			LinkStats_Unref(newUser.link);
 			ctx->success = false;
 			return;
 		}
@@ -496,38 +777,25 @@ static void ExecuteCmdUser(
 			"\trealname:\t%s\n",
 			cmd->username, cmd->hostname, ctx->servername, cmd->realname);
 
-	// IrcCmd will not be used afterwards so we can steal the memory allocations
-	cmd->username = NULL;
-	cmd->hostname = NULL;
+	// IrcCmd will not be used afterwards so we can steal the memory allocation
 	cmd->realname = NULL;
-}
 
-static void ExecuteCmdPrivMsg(
-		IrcCmdExecutorContext* ctx, int peerSocket, IrcCmdPrivMsg* cmd)
-{
-	User* user = WithRegisteredUser(ctx, peerSocket);
-	if (user == NULL)
+	if (existingUser != NULL && !User_UpdatePrefix(existingUser))
 	{
+		LOG_ERROR(ctx->log, "Failed to build user prefix.");
+		ctx->success = false;
 		return;
 	}
 
-	IrcCmd cmdToSend = {
-		.prefix = {
-			.origin = user->nickname,
-			.username = user->username,
-			.hostname = user->hostname,
-		},
-		.type = IrcCmdType_PrivMsg,
-		.privMsg = *cmd,
-	};
-
-	IrcMsg* msgToSend = IrcCmdUnparser_Unparse(ctx->cmdUnparser, &cmdToSend);
-	if (msgToSend == NULL)
+	if (existingUser != NULL && User_IsRegistered(existingUser))
 	{
-		LOG_ERROR(ctx->log, "Failed to unparse PRIVMSG");
-		ctx->success = false;
-		return;
+		AddWelcome(ctx, existingUser);
 	}
+}
+
+static void ExecuteCmdPrivMsg(IrcCmdExecutorContext* ctx, IrcCmd* ircCmd, User* user)
+{
+	IrcCmdPrivMsg* cmd = &ircCmd->privMsg;
 
 	for (size_t i = 0; i < cmd->receiverCount; i++)
 	{
@@ -535,13 +803,12 @@ static void ExecuteCmdPrivMsg(
 		{
 			case IrcReceiverType_Nickname:
 			{
-				User* userWithNick = ArrayList_Find(
-						ctx->users, User_CmpNick, cmd->receiver[i].value);
+				User* userWithNick = FindUserByNick(ctx, cmd->receiver[i].value);
 
 				if (userWithNick == NULL || !User_IsRegistered(userWithNick))
 				{
-					AddReply(ctx, IrcReply_ErrNoSuchNick(
-								ctx->servername, cmd->receiver[i].value));
+					AddReply(ctx, IrcReplyType_ErrNoSuchNick, 1,
+							(const char*[]) { cmd->receiver[i].value });
 					if (!ctx->success)
 					{
 						return;
@@ -550,8 +817,8 @@ static void ExecuteCmdPrivMsg(
 					continue;
 				}
 
-				cmdToSend.peerSocket = userWithNick->socket;
-				AddCmd(ctx, &cmdToSend);
+				AddPrivMsg(ctx, user, userWithNick->socket,
+						cmd->receiver[i].value, cmd->text);
 				if (!ctx->success)
 				{
 					return;
@@ -567,20 +834,15 @@ static void ExecuteCmdPrivMsg(
 	}
 }
 
-static void ExecuteCmdJoin(
-		IrcCmdExecutorContext* ctx, int peerSocket, IrcCmdJoin* cmd)
+static void ExecuteCmdJoin(IrcCmdExecutorContext* ctx, IrcCmd* ircCmd, User* user)
 {
 	LOG_DEBUG(ctx->log, "Got JOIN command");
-	User* user = WithRegisteredUser(ctx, peerSocket);
-	if (user == NULL)
-	{
-		return;
-	}
+	IrcCmdJoin* cmd = &ircCmd->join;
 
 	for (size_t i = 0; ctx->success && i < cmd->channelCount; i++)
 	{
-		ArrayList* channels = ChannelList(ctx, cmd->channels[i].type); 
-		Channel* channel = ArrayList_Find(channels, Channel_CmpName, cmd->channels[i].name);
+		ChannelMap* channels = ChannelList(ctx, cmd->channels[i].type);
+		Channel* channel = FindChannel(ctx, channels, cmd->channels[i].name);
 
 		if (channel != NULL)
 		{
@@ -596,57 +858,55 @@ static void ExecuteCmdJoin(
 
 static void ExecuteCmdJoin_CreateChannel(
 		IrcCmdExecutorContext* ctx,
-		ArrayList* channels,
+		ChannelMap* channels,
 		User* user,
-		IrcChannelAndKey* channelAndKey)
+		const IrcChannelAndKey* channelAndKey)
 {
 	Channel channel = {
-		.name = channelAndKey->name,
-		.operatorIds = ArrayList_New(10, 10, sizeof(UserId), NULL),
+		.name = StrAtomTable_Intern(ctx->atoms, channelAndKey->name),
 		.modes = channelAndKey->key != NULL ? IrcMode_Channel_RequiresKey : IrcMode_None,
 		.limit = SIZE_MAX,
 		.banmask = NULL,
-		.key = channelAndKey->key,
-		.memberIds = ArrayList_New(100, 100, sizeof(UserId), NULL),
+		.key = NULL,
 		.topic = NULL,
 	};
 
-	if (channel.operatorIds == NULL)
+	if (channel.name == NULL)
 	{
-		LOG_ERROR(ctx->log, "Failed to create channel operator id list.");
+		LOG_ERROR(ctx->log, "Failed to intern channel name.");
 		goto error;
 	}
 
-	if (channel.memberIds == NULL)
+	// The command only has a view into its message.
+	if (channelAndKey->key != NULL)
 	{
-		LOG_ERROR(ctx->log, "Failed to create channel member id list.");
-		goto error;
+		channel.key = StrUtils_Clone(channelAndKey->key);
+		if (channel.key == NULL)
+		{
+			LOG_ERROR(ctx->log, "Failed to clone channel key.");
+			goto error;
+		}
 	}
 
-	if (!ArrayList_Append(channel.operatorIds, &user->id))
+	if (!UserIdVector_Push(&channel.operatorIds, user->id))
 	{
 		LOG_ERROR(ctx->log, "Failed to add user id to operator list.");
 		goto error;
 	}
 
-	if (!ArrayList_Append(channel.memberIds, &user->id))
+	if (!UserIdVector_Push(&channel.memberIds, user->id))
 	{
 		LOG_ERROR(ctx->log, "Failed to add user id to member list.");
 		goto error;
 	}
 
-	if (!ArrayList_Append(channels, &channel))
+	if (ChannelMap_Put(channels, StrAtom_Folded(channel.name), channel) == NULL)
 	{
 		LOG_ERROR(ctx->log, "Failed to add channel to list.");
 		goto error;
 	}
 
-
-	// Steal allocations.
-	channelAndKey->name = NULL;
-	channelAndKey->key = NULL;
-
-	LOG_DEBUG(ctx->log, "Created channel: %s", channel.name);
+	LOG_DEBUG(ctx->log, "Created channel: %s", StrAtom_Str(channel.name));
 	return;
 
 error:
@@ -659,167 +919,659 @@ static void ExecuteCmdJoin_JoinChannel(
 		User* user,
 		Channel* channel,
 		IrcChannelType channelType,
-		char* key)
+		const char* key)
 {
-	if (ArrayList_Find(channel->memberIds, UserId_Cmp, &user->id) != NULL)
+	if (UserIdVector_Contains(&channel->memberIds, user->id))
 	{
-		LOG_DEBUG(ctx->log, "User already in channel: %s.", channel->name);
+		LOG_DEBUG(ctx->log, "User already in channel: %s.", StrAtom_Str(channel->name));
 		return;
 	}
 
 	if (channel->modes & IrcMode_Channel_InviteOnly)
 	{
-		AddReply(ctx, IrcReply_ErrInviteOnlyChan(
-					ctx->servername, channelType, channel->name)); 
+		AddChannelReply(ctx, IrcReplyType_ErrInviteOnlyChan, channelType, channel);
 		return;
 	}
 
 	if (channel->modes & IrcMode_Channel_RequiresKey
 			&& !StrUtils_Equals(channel->key, key))
 	{
-		AddReply(ctx, IrcReply_ErrBadChannelKey(ctx->servername, channelType, channel->name)); 
+		AddChannelReply(ctx, IrcReplyType_ErrBadChannelKey, channelType, channel);
 		return;
 	}
 
 	if (channel->modes & IrcMode_Channel_LimitedUsers
-			&& ArrayList_Size(channel->memberIds) >= channel->limit)
+			&& channel->memberIds.size >= channel->limit)
 	{
-		AddReply(ctx, IrcReply_ErrChannelIsFull(
-					ctx->servername, channelType, channel->name)); 
+		AddChannelReply(ctx, IrcReplyType_ErrChannelIsFull, channelType, channel);
 		return;
 	}
 
 	// TODO: Validate banmask!
 
-	if (!ArrayList_Append(channel->memberIds, &user->id))
+	if (!UserIdVector_Push(&channel->memberIds, user->id))
 	{
 		LOG_ERROR(ctx->log, "Failed to add user id to member list.");
 		ctx->success = false;
 		return;
 	}
 
-	LOG_DEBUG(ctx->log, "Joined channel: %s.", channel->name);
+	LOG_DEBUG(ctx->log, "Joined channel: %s.", StrAtom_Str(channel->name));
 
 	if (channel->topic == NULL)
 	{
 		return;
 	}
 
-	AddReply(ctx, IrcReply_RplTopic(
-				ctx->servername, channelType, channel->name, channel->topic));
+	AddReply(ctx, IrcReplyType_RplTopic, 3, (const char*[]) {
+				IrcReply_ChannelPrefix(channelType), StrAtom_Str(channel->name), channel->topic });
+}
+
+
+static void ExecuteCmdQuit(IrcCmdExecutorContext* ctx, IrcCmd* ircCmd, User* user)
+{
+	if (user == NULL)
+	{
+		return;
+	}
+
+	if (user->nickname != NULL)
+	{
+		NickMap_Remove(&ctx->nicks, StrAtom_Folded(user->nickname), NULL);
+	}
+
+	User_Delete(user);
+	UserMap_Remove(&ctx->users, ircCmd->peerSocket, NULL);
+
+	LOG_DEBUG(ctx->log, "Client unregistered: %s", ircCmd->quit.quitMessage);
+}
+
+
+static void ExecuteCmdPing(IrcCmdExecutorContext* ctx, IrcCmd* ircCmd, User* user)
+{
+	(void) user;
+	IrcCmdPing* cmd = &ircCmd->ping;
+
+	IrcCmd pong = {
+		.prefix = {
+			.origin = ctx->servername,
+		},
+		.type = IrcCmdType_Pong,
+		.pong = {
+			.daemon1 = ctx->servername,
+			.daemon2 = cmd->server1,
+		},
+	};
+
+	// PING is always a control command, so is its reply.
+	AddOutCmd(ctx, ircCmd->peerSocket, &pong, TaskPriority_High);
+}
+
+static void ExecuteCmdPong(IrcCmdExecutorContext* ctx, IrcCmd* ircCmd, User* user)
+{
+	// The server doesn't ping clients, so there's nothing to do.
+	(void) ctx;
+	(void) ircCmd;
+	(void) user;
+}
+
+/**
+ * Every letter is answered from counters read without locking, which the
+ * executor, runners and send tasks keep updating meanwhile, so a report is
+ * only consistent within each line.
+ */
+static void ExecuteCmdStats(IrcCmdExecutorContext* ctx, IrcCmd* ircCmd, User* user)
+{
+	IrcCmdStats* cmd = &ircCmd->stats;
+
+	if (!user->isOperator)
+	{
+		AddReply(ctx, IrcReplyType_ErrNoPrivileges, 0, NULL);
+		return;
+	}
+
+	if (cmd->server != NULL && !StrUtils_Equals(cmd->server, ctx->servername))
+	{
+		AddReply(ctx, IrcReplyType_ErrNoSuchServer, 1, (const char*[]) { cmd->server });
+		return;
+	}
+
+	switch (cmd->query)
+	{
+		case 'l':
+			ExecuteCmdStats_Links(ctx);
+			break;
+		case 'm':
+			ExecuteCmdStats_Commands(ctx);
+			break;
+		case 'u':
+			ExecuteCmdStats_Uptime(ctx);
+			break;
+		case 'a':
+			ExecuteCmdStats_Amn(ctx);
+			break;
+		default:
+			// Unknown letters only get the end of the report.
+			break;
+	}
+
+	char letter[2] = { cmd->query != '\0' ? cmd->query : '*', '\0' };
+	AddReply(ctx, IrcReplyType_RplEndOfStats, 1, (const char*[]) { letter });
+}
+
+/**
+ * RPL_STATSLINKINFO for every connection that sent NICK or USER.
+ */
+static void ExecuteCmdStats_Links(IrcCmdExecutorContext* ctx)
+{
+	uint64_t now = Metrics_NowNs();
+
+	for (size_t i = 0; i < ctx->users.capacity; i++)
+	{
+		UserMapEntry* entry = UserMap_At(&ctx->users, i);
+		if (entry == NULL)
+		{
+			continue;
+		}
+
+		User* user = &entry->value;
+		LinkStatsSnapshot link;
+		LinkStats_Read(user->link, &link);
+
+		char name[IRC_MSG_SIZE];
+		snprintf(name, sizeof(name), "%s[%s@%s]",
+				user->nickname != NULL ? StrAtom_Str(user->nickname) : "*",
+				user->username != NULL ? StrAtom_Str(user->username) : "*",
+				user->hostname != NULL ? StrAtom_Str(user->hostname) : "*");
+
+		char numbers[6][24];
+		snprintf(numbers[0], sizeof(numbers[0]), "%" PRIu64, link.sendqBytes);
+		snprintf(numbers[1], sizeof(numbers[1]), "%" PRIu64, link.sentWrites);
+		snprintf(numbers[2], sizeof(numbers[2]), "%" PRIu64, link.sentBytes);
+		snprintf(numbers[3], sizeof(numbers[3]), "%" PRIu64, user->receivedMsgs);
+		snprintf(numbers[4], sizeof(numbers[4]), "%" PRIu64, user->receivedBytes);
+		snprintf(numbers[5], sizeof(numbers[5]), "%" PRIu64,
+				(now - user->connectedNs) / 1000000000);
+
+		AddReply(ctx, IrcReplyType_RplStatsLinkInfo, 7, (const char*[]) {
+				name, numbers[0], numbers[1], numbers[2], numbers[3], numbers[4], numbers[5] });
+	}
+}
+
+/**
+ * RPL_STATSCOMMANDS for every command executed at least once, counted by
+ * the execution time histograms.
+ */
+static void ExecuteCmdStats_Commands(IrcCmdExecutorContext* ctx)
+{
+	for (size_t type = 0; type < IrcCmdType_Len; type++)
+	{
+		if (HANDLERS[type].handler == NULL)
+		{
+			continue;
+		}
+
+		MetricHistogram histogram;
+		Metric_ReadHistogram(&ctx->cmdMetrics[type].execTime, &histogram);
+
+		if (histogram.count == 0)
+		{
+			continue;
+		}
+
+		char count[24];
+		snprintf(count, sizeof(count), "%" PRIu64, histogram.count);
+
+		AddReply(ctx, IrcReplyType_RplStatsCommands, 2, (const char*[]) {
+				IRC_CMD_TYPE_INFOS[type].name, count });
+	}
+}
+
+static void ExecuteCmdStats_Uptime(IrcCmdExecutorContext* ctx)
+{
+	uint64_t seconds = (Metrics_NowNs() - ctx->startNs) / 1000000000;
+
+	char days[24];
+	char hms[32];
+	snprintf(days, sizeof(days), "%" PRIu64, seconds / 86400);
+	snprintf(hms, sizeof(hms), "%" PRIu64 ":%02" PRIu64 ":%02" PRIu64,
+			seconds / 3600 % 24, seconds / 60 % 60, seconds % 60);
+
+	AddReply(ctx, IrcReplyType_RplStatsUptime, 2, (const char*[]) { days, hms });
+}
+
+/**
+ * The server's own letter: every gauge in the metrics registry, which has
+ * the queue depths, the queues' high-water marks, how busy each runner has
+ * been and the median and 99th percentile time of each command.
+ */
+static void ExecuteCmdStats_Amn(IrcCmdExecutorContext* ctx)
+{
+	size_t metricCount = Metrics_Count();
+	for (size_t i = 0; i < metricCount; i++)
+	{
+		Metric* metric = Metrics_At(i);
+
+		if (metric->type == MetricType_Gauge)
+		{
+			AddStatsDebug(ctx, "%s%s%s%s %" PRId64, metric->name,
+					metric->labels != NULL ? "{" : "",
+					metric->labels != NULL ? metric->labels : "",
+					metric->labels != NULL ? "}" : "",
+					Metric_Value(metric));
+		}
+	}
+
+	AddStatsDebug(ctx, "task queue high water %zu", TaskQueue_HighWater(ctx->tasks));
+	AddStatsDebug(ctx, "command queue high water %zu", IrcCmdQueue_HighWater(ctx->cmds));
+
+	// Runners are being joined.
+	for (size_t i = 0; i < ctx->runnerCount && !Application_ShouldShutdown(); i++)
+	{
+		uint64_t busyNs;
+		uint64_t idleNs;
+		if (!TaskRunner_Times(ctx->runners[i], &busyNs, &idleNs))
+		{
+			continue;
+		}
+
+		uint64_t totalNs = busyNs + idleNs;
+		AddStatsDebug(ctx, "runner %zu %.1f%% busy, %.3fs busy, %.3fs idle", i,
+				totalNs > 0 ? (double) busyNs * 100 / (double) totalNs : 0.0,
+				(double) busyNs / 1e9, (double) idleNs / 1e9);
+	}
+
+	for (size_t type = 0; type < IrcCmdType_Len; type++)
+	{
+		if (HANDLERS[type].handler == NULL)
+		{
+			continue;
+		}
+
+		MetricHistogram histogram;
+		Metric_ReadHistogram(&ctx->cmdMetrics[type].execTime, &histogram);
+
+		if (histogram.count == 0)
+		{
+			continue;
+		}
+
+		AddStatsDebug(ctx, "%s %" PRIu64 "ns p50, %" PRIu64 "ns p99",
+				IRC_CMD_TYPE_INFOS[type].name,
+				MetricHistogram_Percentile(&histogram, 50),
+				MetricHistogram_Percentile(&histogram, 99));
+	}
 }
 
+static void ExecuteCmdRehash(IrcCmdExecutorContext* ctx, IrcCmd* ircCmd, User* user)
+{
+	(void) ircCmd;
+
+	if (!user->isOperator)
+	{
+		AddReply(ctx, IrcReplyType_ErrNoPrivileges, 0, NULL);
+		return;
+	}
+
+	LOG_INFO(ctx->log, "%s requested a configuration reload.", StrAtom_Str(user->nickname));
+
+	// Reloading is done by the main thread, so the executor doesn't stall on file IO.
+	Application_RequestReload();
+
+	AddReply(ctx, IrcReplyType_RplRehashing, 1, (const char*[]) {
+				ctx->config->path != NULL ? ctx->config->path : SERVER_CONFIG_DEFAULT_PATH });
+}
 
-static void ExecuteCmdQuit(
-		IrcCmdExecutorContext* ctx, int peerSocket, IrcCmdQuit* cmd)
+static void ExecuteCmdOper(IrcCmdExecutorContext* ctx, IrcCmd* ircCmd, User* user)
 {
-	if (ArrayList_Remove(ctx->users, User_CmpSocket, &peerSocket, true))
+	IrcCmdOper* cmd = &ircCmd->oper;
+	const ServerConfig* config = ctx->config;
+
+	if (config->operName == NULL || config->operPassword == NULL)
 	{
-		LOG_DEBUG(ctx->log, "Client unregistered: %s", cmd->quitMessage);
+		AddReply(ctx, IrcReplyType_ErrNoOperHost, 0, NULL);
+		return;
 	}
+
+	// Both are compared, so a wrong name takes as long as a wrong password.
+	bool nameMatches = SecretEquals(config->operName, cmd->user);
+	bool passwordMatches = SecretEquals(config->operPassword, cmd->password);
+	if (!nameMatches || !passwordMatches)
+	{
+		LOG_WARN(ctx->log, "%s failed to become an operator.", StrAtom_Str(user->nickname));
+		AddReply(ctx, IrcReplyType_ErrPasswdMismatch, 0, NULL);
+		return;
+	}
+
+	user->isOperator = true;
+	LOG_INFO(ctx->log, "%s is now an operator.", StrAtom_Str(user->nickname));
+
+	AddReply(ctx, IrcReplyType_RplYoureOper, 0, NULL);
 }
 
+/**
+ * Compares in a time that only depends on the length of guess, so timing
+ * doesn't tell how much of the secret was guessed right.
+ */
+static bool SecretEquals(const char* secret, const char* guess)
+{
+	size_t secretLen = strlen(secret);
+	size_t guessLen = strlen(guess);
+
+	unsigned char diff = secretLen != guessLen;
+	for (size_t i = 0; i < guessLen; i++)
+	{
+		// Wraps around a shorter secret, which doesn't match anyway. Secrets aren't empty.
+		diff |= (unsigned char) (guess[i] ^ secret[i % secretLen]);
+	}
 
-static User* WithRegisteredUser(IrcCmdExecutorContext* ctx, int peerSocket)
+	return diff == 0;
+}
+
+/**
+ * Case-insensitive lookup. If no atom has the casefolded form of the nickname,
+ * no user can have it.
+ */
+static User* FindUserByNick(IrcCmdExecutorContext* ctx, const char* nickname)
 {
-	User* user = ArrayList_Find(ctx->users, User_CmpSocket, &peerSocket);
+	const StrAtom* folded = StrAtomTable_FindFolded(ctx->atoms, nickname);
+	if (folded == NULL)
+	{
+		return NULL;
+	}
+
+	const int* socket = NickMap_Get(&ctx->nicks, folded);
 
-	if (user == NULL || !User_IsRegistered(user))
+	return socket != NULL ? UserMap_Get(&ctx->users, *socket) : NULL;
+}
+
+static Channel* FindChannel(IrcCmdExecutorContext* ctx, ChannelMap* channels, const char* name)
+{
+	const StrAtom* folded = StrAtomTable_FindFolded(ctx->atoms, name);
+	if (folded == NULL)
 	{
-		AddReply(ctx, IrcReply_ErrNotRegistered(ctx->servername));
 		return NULL;
 	}
 
-	return user;
+	return ChannelMap_Get(channels, folded);
 }
 
-static ArrayList* ChannelList(IrcCmdExecutorContext* ctx, IrcChannelType type)
+static ChannelMap* ChannelList(IrcCmdExecutorContext* ctx, IrcChannelType type)
 {
 	switch (type)
 	{
 		case IrcChannelType_Local:
-			return ctx->localChannels;
+			return &ctx->localChannels;
 		case IrcChannelType_Distributed:
-			return ctx->distChannels;
+			return &ctx->distChannels;
 		default:
 			LOG_ERROR(ctx->log, "Unknown channel type");
 			return NULL;
 	}
 }
 
-static void AddReply(IrcCmdExecutorContext* ctx, IrcMsg* reply)
+static void AddReply(IrcCmdExecutorContext* ctx,
+		IrcReplyType type, size_t argCount, const char* const* args)
+{
+	size_t len = IrcReplies_Render(ctx->replies, type, args, argCount,
+			ctx->replyBuf + ctx->replyLen, sizeof(ctx->replyBuf) - ctx->replyLen);
+
+	if (len == 0 && ctx->replyLen > 0)
+	{
+		// Make room by sending what's already there.
+		SendReplies(ctx);
+		len = IrcReplies_Render(ctx->replies, type, args, argCount,
+				ctx->replyBuf, sizeof(ctx->replyBuf));
+	}
+
+	if (len == 0)
+	{
+		LOG_WARN(ctx->log, "Failed to render reply %03d, it's dropped.", type);
+		return;
+	}
+
+	ctx->replyLen += len;
+}
+
+static void AddChannelReply(IrcCmdExecutorContext* ctx,
+		IrcReplyType type, IrcChannelType channelType, const Channel* channel)
+{
+	AddReply(ctx, type, 2, (const char*[]) {
+			IrcReply_ChannelPrefix(channelType), StrAtom_Str(channel->name) });
+}
+
+/**
+ * RPL_STATSDEBUG with the letter of ExecuteCmdStats_Amn and printf style text.
+ */
+static void AddStatsDebug(IrcCmdExecutorContext* ctx, const char* format, ...)
+{
+	char text[IRC_MSG_SIZE];
+
+	va_list args;
+	va_start(args, format);
+	vsnprintf(text, sizeof(text), format, args);
+	va_end(args);
+
+	AddReply(ctx, IrcReplyType_RplStatsDebug, 2, (const char*[]) { "a", text });
+}
+
+/**
+ * RPL_WELCOME to RPL_MYINFO, sent once the user is registered.
+ */
+static void AddWelcome(IrcCmdExecutorContext* ctx, const User* user)
+{
+	// The cached prefix without its colon and trailing space.
+	char mask[IRC_MSG_SIZE];
+	snprintf(mask, sizeof(mask), "%.*s", (int) user->prefixLen - 2, user->prefix + 1);
+
+	AddReply(ctx, IrcReplyType_RplWelcome, 1, (const char*[]) { mask });
+	AddReply(ctx, IrcReplyType_RplYourHost, 2,
+			(const char*[]) { ctx->servername, SERVER_VERSION });
+	AddReply(ctx, IrcReplyType_RplCreated, 1, (const char*[]) { ctx->createdDate });
+	AddReply(ctx, IrcReplyType_RplMyInfo, 4,
+			(const char*[]) { ctx->servername, SERVER_VERSION, USER_MODES, CHANNEL_MODES });
+}
+
+/**
+ * Composes ":nick!user@host PRIVMSG receiver :text" from the sender's cached
+ * prefix, straight into the buffer that will be written to the socket.
+ */
+static void AddPrivMsg(IrcCmdExecutorContext* ctx, const User* sender,
+		int peerSocket, const char* receiver, const char* text)
+{
+	static const char command[] = "PRIVMSG ";
+	size_t commandLen = sizeof(command) - 1;
+	size_t receiverLen = strlen(receiver);
+	size_t textLen = strlen(text);
+	size_t rawMsgLen = sender->prefixLen + commandLen + receiverLen + 2 + textLen + 2;
+
+	if (rawMsgLen > IRC_MSG_SIZE)
+	{
+		LOG_WARN(ctx->log, "Message exceeds size limit. Limit: %d", IRC_MSG_SIZE);
+		return;
+	}
+
+	char* rawMsg = malloc(rawMsgLen + 1);
+	if (rawMsg == NULL)
+	{
+		LOG_ERROR(ctx->log, "Failed to allocate PRIVMSG.");
+		ctx->success = false;
+		return;
+	}
+
+	char* pos = rawMsg;
+	memcpy(pos, sender->prefix, sender->prefixLen);
+	pos += sender->prefixLen;
+	memcpy(pos, command, commandLen);
+	pos += commandLen;
+	memcpy(pos, receiver, receiverLen);
+	pos += receiverLen;
+	*pos++ = ' ';
+	*pos++ = ':';
+	memcpy(pos, text, textLen);
+	pos += textLen;
+	*pos++ = '\r';
+	*pos++ = '\n';
+	*pos = '\0';
+
+	AddOutMsg(ctx, peerSocket, rawMsg, rawMsgLen, TaskPriority_Normal);
+}
+
+static void AddOutCmd(IrcCmdExecutorContext* ctx,
+		int peerSocket, const IrcCmd* cmd, TaskPriority priority)
 {
-	if (reply == NULL)
+	char buffer[IRC_MSG_SIZE + 1];
+
+	size_t rawMsgLen = IrcCmdUnparser_UnparseTo(ctx->cmdUnparser, cmd, buffer, sizeof(buffer));
+	if (rawMsgLen == 0)
 	{
-		LOG_ERROR(ctx->log, "Failed to generate reply");
+		LOG_ERROR(ctx->log, "Failed to unparse command.");
 		ctx->success = false;
 		return;
 	}
 
-	if (!ArrayList_Append(ctx->replyBuf, &reply))
+	char* rawMsg = StrUtils_CloneRange(buffer, buffer + rawMsgLen);
+	if (rawMsg == NULL)
 	{
-		LOG_ERROR(ctx->log, "Failed to append to replyBuf");
+		LOG_ERROR(ctx->log, "Failed to allocate message.");
 		ctx->success = false;
+		return;
 	}
+
+	AddOutMsg(ctx, peerSocket, rawMsg, rawMsgLen, priority);
 }
 
-static void AddCmd(IrcCmdExecutorContext* ctx, const IrcCmd* cmd)
+/**
+ * Takes ownership of rawMsg.
+ */
+static void AddOutMsg(IrcCmdExecutorContext* ctx,
+		int peerSocket, char* rawMsg, size_t rawMsgLen, TaskPriority priority)
 {
-	if (!ArrayList_Append(ctx->cmdBuf, cmd))
+	OutMsg outMsg = {
+		.peerSocket = peerSocket,
+		.priority = priority,
+		.rawMsg = rawMsg,
+		.rawMsgLen = rawMsgLen,
+	};
+
+	if (!ArrayList_Append(ctx->outBuf, &outMsg))
 	{
-		LOG_ERROR(ctx->log, "Failed to append to cmdBuf.");
+		LOG_ERROR(ctx->log, "Failed to append to outBuf.");
+		free(rawMsg);
 		ctx->success = false;
 	}
 }
 
-static void SendReplies(IrcCmdExecutorContext* ctx, int peerSocket)
+/**
+ * Sends every reply rendered so far as a single message.
+ */
+static void SendReplies(IrcCmdExecutorContext* ctx)
 {
-	for (size_t i = ArrayList_Size(ctx->replyBuf); ctx->success && i > 0; i--)
+	if (!ctx->success || ctx->replyLen == 0)
 	{
-		IrcMsg* reply = *(IrcMsg**) ArrayList_Get(ctx->replyBuf, i - 1);
-		if (!ArrayList_RemoveIndex(ctx->replyBuf, i - 1, false))
-		{
-			LOG_ERROR(ctx->log, "Failed to remove from reply buffer.");
-			ctx->success = false;
-			return;
-		}
+		return;
+	}
 
-		SendMsg(ctx, peerSocket, reply);
+	char* rawMsg = StrUtils_CloneRange(ctx->replyBuf, ctx->replyBuf + ctx->replyLen);
+	if (rawMsg == NULL)
+	{
+		LOG_ERROR(ctx->log, "Failed to allocate replies.");
+		ctx->success = false;
+		return;
 	}
+
+	SendRawMsg(ctx, ctx->replySocket, rawMsg, ctx->replyLen, ctx->replyPriority);
+	ctx->replyLen = 0;
 }
 
-static void SendCmds(IrcCmdExecutorContext* ctx)
+static void SendOutMsgs(IrcCmdExecutorContext* ctx)
 {
-	for (size_t i = 0; ctx->success && i < ArrayList_Size(ctx->cmdBuf); i++)
+	for (size_t i = 0; ctx->success && i < ArrayList_Size(ctx->outBuf); i++)
 	{
-		IrcCmd* cmd = ArrayList_Get(ctx->cmdBuf, i);
+		OutMsg* outMsg = ArrayList_Get(ctx->outBuf, i);
 
-		IrcMsg* msg = IrcCmdUnparser_Unparse(ctx->cmdUnparser, cmd);
-		if (msg == NULL)
-		{
-			LOG_ERROR(ctx->log, "Failed to unparse command.");
-			ctx->success = false;
-			return;	
-		}
+		char* rawMsg = outMsg->rawMsg;
+		// Owned by SendRawMsg now.
+		outMsg->rawMsg = NULL;
 
-		SendMsg(ctx, cmd->peerSocket, msg);
+		SendRawMsg(ctx, outMsg->peerSocket, rawMsg, outMsg->rawMsgLen, outMsg->priority);
 	}
 }
 
-static void SendMsg(IrcCmdExecutorContext* ctx, int peerSocket, IrcMsg* msg)
+/**
+ * Takes ownership of rawMsg.
+ */
+static void SendRawMsg(IrcCmdExecutorContext* ctx,
+		int peerSocket, char* rawMsg, size_t rawMsgLen, TaskPriority priority)
 {
-	Task* sendMsgTask = SendMsgTask_New(ctx->log, peerSocket, msg);
+	// Messages to users who already quit aren't counted.
+	User* user = UserMap_Get(&ctx->users, peerSocket);
+	LinkStats* link = user != NULL ? user->link : NULL;
+
+	Task* sendMsgTask = SendMsgTask_New(ctx->log, peerSocket, rawMsg, rawMsgLen, link,
+			ctx->trace);
 
 	if (sendMsgTask == NULL)
 	{
 		LOG_ERROR(ctx->log, "Failed to create send msg task!");
+		free(rawMsg);
 		ctx->success = false;
 		return;
 	}
 
-	if (!TaskQueue_Push(ctx->tasks, sendMsgTask))
+	if (link != NULL)
+	{
+		// Before pushing, a runner may write it right away.
+		LinkStats_Queue(link, rawMsgLen);
+	}
+
+	// Only the first send logs the trace, so a message to a big channel
+	// doesn't flood the log.
+	if (ctx->trace != NULL)
+	{
+		ctx->trace->logged = false;
+	}
+
+	// Before pushing, so tracers see it before it's written.
+	AMN_PROBE3(send_queue, peerSocket, rawMsg, rawMsgLen);
+
+	if (!TaskQueue_PushPriority(ctx->tasks, sendMsgTask, priority))
 	{
 		LOG_ERROR(ctx->log, "Failed to push send message task onto queue");
+		Task_Delete(sendMsgTask);
 		ctx->success = false;
 	}
 }
+
+static void CmdMetrics_Init(CmdMetrics* self, IrcCmdType type)
+{
+	snprintf(self->labels, sizeof(self->labels), "command=\"%s\"", IRC_CMD_TYPE_INFOS[type].name);
+
+	self->execTime = (Metric) METRIC_HISTOGRAM("amn_cmd_exec_seconds",
+			"Time the executor spent on commands.");
+	self->execTime.labels = self->labels;
+	self->failures = (Metric) METRIC_COUNTER("amn_cmd_failures_total",
+			"Commands that failed with an unexpected error.");
+	self->failures.labels = self->labels;
+
+	Metric_Register(&self->execTime);
+	Metric_Register(&self->failures);
+}
+
+static void CmdMetrics_Log(CmdMetrics* self, const Logger* log, IrcCmdType type)
+{
+	MetricHistogram execTime;
+	Metric_ReadHistogram(&self->execTime, &execTime);
+
+	if (execTime.count == 0)
+	{
+		return;
+	}
+
+	LOG_INFO(log, "%s: %" PRIu64 " executed, %" PRId64 " failed, "
+			"%" PRIu64 "ns average, %" PRIu64 "ns p50, %" PRIu64 "ns p99.",
+			IRC_CMD_TYPE_INFOS[type].name, execTime.count, Metric_Value(&self->failures),
+			execTime.sum / execTime.count,
+			MetricHistogram_Percentile(&execTime, 50),
+			MetricHistogram_Percentile(&execTime, 99));
+}
@@ -3,13 +3,18 @@
 
 #include "log.h"
 #include "task_queue.h"
+#include "task_runner.h"
 #include "irc_cmd_queue.h"
+#include "server_config.h"
+
+#include <stddef.h>
 
 /**
   * Task that executes the commands on the received IrcCmds.
+  * The runners are only read, for STATS.
   */
 Task* IrcCmdExecutorTask_New(const Logger* log, TaskQueue* tasks, IrcCmdQueue* cmds,
-		const char* servername);
+		TaskRunner** runners, size_t runnerCount, const ServerConfig* config);
 
 
 #endif // AMN_IRC_CMD_EXECUTOR_TASK_H
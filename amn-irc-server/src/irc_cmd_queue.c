@@ -1,36 +1,595 @@
 #include "irc_cmd_queue.h"
 
-#include "queue.h"
+#include "flight_recorder.h"
+#include "metrics.h"
+#include "probes.h"
 
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
 
-IrcCmdQueue* IrcCmdQueue_New(size_t capacity, int32_t shutdownTimeout)
+#include <pthread.h>
+
+// Commands waiting to be executed for a single connection.
+typedef struct ConnQueue
 {
-	return (IrcCmdQueue*) Queue_New(capacity, shutdownTimeout, sizeof(IrcCmd*)); 
+	// Ring buffer of connCapacity commands, allocated on first push.
+	IrcCmd** cmds;
+	// When each command was pushed if sampled, parallel to cmds.
+	uint64_t* queuedNs;
+	size_t front;
+	size_t count;
+	// How many of the queued commands are IrcCmdPriority_Control.
+	size_t controlCount;
+	// Commands this connection may still execute in its current or next
+	// turn. Negative after commands executed out of turn, which is repaid by
+	// skipping turns.
+	int64_t deficit;
+	// Whether the connection is in the ready/control rings.
+	bool ready;
+	bool control;
 }
+ConnQueue;
 
-static void ElementDeleter(void* element)
+// Ring of sockets, sized like IrcCmdQueue.conns as each socket is in it at most once.
+typedef struct SocketRing
 {
-	IrcCmd_Delete((IrcCmd*) element);
+	int* sockets;
+	size_t front;
+	size_t count;
+}
+SocketRing;
+
+struct IrcCmdQueue
+{
+	size_t connCapacity;
+	size_t quantum;
+	bool shutdown;
+
+	// Indexed by socket. Sockets are small, dense integers.
+	ConnQueue* conns;
+	size_t connsSize;
+	// Total commands across all connections.
+	size_t count;
+	// Most commands queued at once. Written under the mutex, read without it.
+	_Atomic size_t highWater;
+
+	// Sockets with pending commands, in round-robin order.
+	SocketRing ready;
+	// Sockets with pending control commands. These are served first, so a
+	// PONG or QUIT doesn't wait behind everyone else's chat traffic.
+	// Commands of a connection are still executed in the order they were received.
+	SocketRing control;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t notEmpty;
+	pthread_cond_t notFull;
+};
+
+static Metric CmdQueueDepth = METRIC_GAUGE("amn_cmd_queue_depth",
+		"Commands waiting for the executor.");
+static Metric CmdQueueWait = METRIC_HISTOGRAM("amn_cmd_queue_wait_seconds",
+		"Time commands waited for the executor.");
+
+static bool IrcCmdQueue_Reserve(IrcCmdQueue* self, int socket);
+static bool IrcCmdQueue_Wait(IrcCmdQueue* self, pthread_cond_t* cond);
+static IrcCmd* IrcCmdQueue_PopControl(IrcCmdQueue* self, uint64_t* queuedNs);
+static IrcCmd* IrcCmdQueue_PopReady(IrcCmdQueue* self, uint64_t* queuedNs);
+static void IrcCmdQueue_EndTurn(IrcCmdQueue* self, ConnQueue* conn);
+static void IrcCmdQueue_Unready(IrcCmdQueue* self, ConnQueue* conn);
+static IrcCmd* ConnQueue_Pop(ConnQueue* self, size_t capacity, uint64_t* queuedNs);
+static void SocketRing_Move(SocketRing* self, size_t oldSize, int* sockets);
+static void SocketRing_Push(SocketRing* self, size_t size, int socket);
+static int SocketRing_Pop(SocketRing* self, size_t size);
+
+IrcCmdQueue* IrcCmdQueue_New(size_t connCapacity, size_t quantum)
+{
+	// Each connection's queue is allocated as connCapacity commands and times.
+	if (connCapacity == 0 || connCapacity > SIZE_MAX / sizeof(uint64_t)
+			|| quantum == 0 || quantum > IRC_CMD_QUEUE_MAX_QUANTUM)
+	{
+		return NULL;
+	}
+
+	Metric_Register(&CmdQueueDepth);
+	Metric_Register(&CmdQueueWait);
+
+	IrcCmdQueue* self = malloc(sizeof(IrcCmdQueue));
+	if (self == NULL)
+		return NULL;
+
+	*self = (IrcCmdQueue) {
+		.connCapacity = connCapacity,
+		.quantum = quantum,
+	};
+
+	if (pthread_mutex_init(&self->mutex, NULL) != 0)
+		goto error_mutex;
+
+	if (pthread_cond_init(&self->notEmpty, NULL) != 0)
+		goto error_notEmpty;
+
+	if (pthread_cond_init(&self->notFull, NULL) != 0)
+		goto error_notFull;
+
+	return self;
+
+error_notFull:
+	pthread_cond_destroy(&self->notEmpty);
+error_notEmpty:
+	pthread_mutex_destroy(&self->mutex);
+error_mutex:
+	free(self);
+	return NULL;
 }
 
 void IrcCmdQueue_Delete(IrcCmdQueue* self)
 {
-	Queue_Delete((Queue*) self, ElementDeleter, sizeof(IrcCmd*));
+	if (self == NULL)
+	{
+		return;
+	}
+
+	pthread_cond_destroy(&self->notFull);
+	pthread_cond_destroy(&self->notEmpty);
+	pthread_mutex_destroy(&self->mutex);
+
+	for (size_t i = 0; i < self->connsSize; i++)
+	{
+		ConnQueue* conn = &self->conns[i];
+
+		for (size_t j = 0; j < conn->count; j++)
+		{
+			IrcCmd_Delete(conn->cmds[(conn->front + j) % self->connCapacity]);
+		}
+		Metric_Add(&CmdQueueDepth, -(int64_t) conn->count);
+
+		free(conn->cmds);
+		free(conn->queuedNs);
+	}
+
+	free(self->conns);
+	free(self->ready.sockets);
+	free(self->control.sockets);
+	free(self);
+}
+
+void IrcCmdQueue_Shutdown(IrcCmdQueue* self)
+{
+	if (pthread_mutex_lock(&self->mutex) != 0)
+	{
+		return;
+	}
+
+	self->shutdown = true;
+
+	pthread_cond_broadcast(&self->notEmpty);
+	pthread_cond_broadcast(&self->notFull);
+
+	pthread_mutex_unlock(&self->mutex);
+}
+
+bool IrcCmdQueue_SetQuantum(IrcCmdQueue* self, size_t quantum)
+{
+	if (quantum == 0 || quantum > IRC_CMD_QUEUE_MAX_QUANTUM)
+	{
+		errno = EINVAL;
+		return false;
+	}
+
+	if (pthread_mutex_lock(&self->mutex) != 0)
+	{
+		return false;
+	}
+
+	self->quantum = quantum;
+
+	if (pthread_mutex_unlock(&self->mutex) != 0)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+size_t IrcCmdQueue_HighWater(IrcCmdQueue* self)
+{
+	return atomic_load_explicit(&self->highWater, memory_order_relaxed);
 }
 
 bool IrcCmdQueue_Push(IrcCmdQueue* self, IrcCmd* ircCmd)
 {
-	return Queue_Push((Queue*) self, &ircCmd, sizeof(IrcCmd*));
+	if (ircCmd == NULL || ircCmd->peerSocket < 0)
+	{
+		errno = EINVAL;
+		return false;
+	}
+
+	// Read outside the mutex, to keep it short.
+	uint64_t queuedNs = Metrics_SampleNs();
+	// Recorded outside too, when the command may be gone already.
+	IrcCmdType type = ircCmd->type;
+	int socket = ircCmd->peerSocket;
+	size_t depth = 0;
+
+	if (pthread_mutex_lock(&self->mutex) != 0)
+	{
+		return false;
+	}
+
+	bool success = false;
+
+	if (!IrcCmdQueue_Reserve(self, ircCmd->peerSocket))
+	{
+		goto cleanup;
+	}
+
+	ConnQueue* conn = &self->conns[ircCmd->peerSocket];
+
+	// Only the connection's own queue being full blocks, so a flooding client
+	// stalls itself and not everyone else.
+	while (conn->count == self->connCapacity && !self->shutdown)
+	{
+		if (!IrcCmdQueue_Wait(self, &self->notFull))
+		{
+			goto cleanup;
+		}
+
+		// Wait released the mutex, so conns may have been reallocated.
+		conn = &self->conns[ircCmd->peerSocket];
+	}
+
+	if (self->shutdown)
+	{
+		errno = ECANCELED;
+		goto cleanup;
+	}
+
+	size_t index = (conn->front + conn->count) % self->connCapacity;
+	conn->cmds[index] = ircCmd;
+	conn->queuedNs[index] = queuedNs;
+	conn->count++;
+	self->count++;
+	depth = self->count;
+
+	// Before it can be popped, so tracers see the push first.
+	AMN_PROBE3(cmd_push, ircCmd->peerSocket, ircCmd, (int) ircCmd->type);
+
+	if (self->count > atomic_load_explicit(&self->highWater, memory_order_relaxed))
+	{
+		atomic_store_explicit(&self->highWater, self->count, memory_order_relaxed);
+	}
+
+	if (!conn->ready)
+	{
+		conn->ready = true;
+		conn->deficit += (int64_t) self->quantum;
+		SocketRing_Push(&self->ready, self->connsSize, ircCmd->peerSocket);
+	}
+
+	if (ircCmd->priority == IrcCmdPriority_Control)
+	{
+		conn->controlCount++;
+
+		if (!conn->control)
+		{
+			conn->control = true;
+			SocketRing_Push(&self->control, self->connsSize, ircCmd->peerSocket);
+		}
+	}
+
+	// Counted under the mutex, so a pop can't take the depth below zero.
+	Metric_Add(&CmdQueueDepth, 1);
+
+	if (pthread_cond_signal(&self->notEmpty) != 0)
+	{
+		goto cleanup;
+	}
+
+	success = true;
+
+cleanup:
+	if (pthread_mutex_unlock(&self->mutex) != 0)
+	{
+		return false;
+	}
+
+	if (success)
+	{
+		FlightRecorder_Record(FlightEventType_CmdQueued, type, socket, depth, 0);
+	}
+
+	return success;
 }
 
 IrcCmd* IrcCmdQueue_Pop(IrcCmdQueue* self)
 {
-	IrcCmd* ircCmd;
+	if (pthread_mutex_lock(&self->mutex) != 0)
+	{
+		return NULL;
+	}
+
+	IrcCmd* ircCmd = NULL;
+	uint64_t queuedNs = 0;
 
-	if (!Queue_Pop((Queue*) self, &ircCmd, sizeof(IrcCmd*)))
+	while (self->count == 0 && !self->shutdown)
 	{
+		if (!IrcCmdQueue_Wait(self, &self->notEmpty))
+		{
+			goto cleanup;
+		}
+	}
+
+	if (self->count == 0)
+	{
+		errno = ECANCELED;
+		goto cleanup;
+	}
+
+	ircCmd = IrcCmdQueue_PopControl(self, &queuedNs);
+	if (ircCmd == NULL)
+	{
+		ircCmd = IrcCmdQueue_PopReady(self, &queuedNs);
+	}
+	self->count--;
+	Metric_Add(&CmdQueueDepth, -1);
+
+	if (pthread_cond_broadcast(&self->notFull) != 0)
+	{
+		IrcCmd_Delete(ircCmd);
+		ircCmd = NULL;
+		goto cleanup;
+	}
+
+cleanup:
+	if (pthread_mutex_unlock(&self->mutex) != 0)
+	{
+		IrcCmd_Delete(ircCmd);
+		return NULL;
+	}
+
+	if (ircCmd != NULL)
+	{
+		Metric_ObserveSince(&CmdQueueWait, queuedNs);
+		AMN_PROBE3(cmd_pop, ircCmd->peerSocket, ircCmd, (int) ircCmd->type);
+	}
+
+	return ircCmd;
+}
+
+/**
+ * Makes sure the queue can hold commands from the socket.
+ * Must be called with the mutex held.
+ */
+static bool IrcCmdQueue_Reserve(IrcCmdQueue* self, int socket)
+{
+	size_t index = (size_t) socket;
+
+	if (index >= self->connsSize)
+	{
+		size_t newSize = self->connsSize > 0 ? self->connsSize : 64;
+		while (newSize <= index)
+		{
+			newSize *= 2;
+		}
+
+		// Everything is allocated before anything is committed, so a failure
+		// leaves the queue as it was.
+		int* readySockets = malloc(sizeof(int) * newSize);
+		int* controlSockets = malloc(sizeof(int) * newSize);
+		ConnQueue* conns = readySockets != NULL && controlSockets != NULL
+			? realloc(self->conns, sizeof(ConnQueue) * newSize)
+			: NULL;
+		if (conns == NULL)
+		{
+			free(readySockets);
+			free(controlSockets);
+			return false;
+		}
+
+		memset(conns + self->connsSize, 0, sizeof(ConnQueue) * (newSize - self->connsSize));
+		self->conns = conns;
+		SocketRing_Move(&self->ready, self->connsSize, readySockets);
+		SocketRing_Move(&self->control, self->connsSize, controlSockets);
+		self->connsSize = newSize;
+	}
+
+	ConnQueue* conn = &self->conns[index];
+	if (conn->cmds == NULL)
+	{
+		conn->cmds = malloc(sizeof(IrcCmd*) * self->connCapacity);
+		if (conn->cmds == NULL)
+		{
+			return false;
+		}
+	}
+
+	if (conn->queuedNs == NULL)
+	{
+		conn->queuedNs = malloc(sizeof(uint64_t) * self->connCapacity);
+		if (conn->queuedNs == NULL)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Waits on a condition until signaled or shut down.
+ * Must be called with the mutex held.
+ */
+static bool IrcCmdQueue_Wait(IrcCmdQueue* self, pthread_cond_t* cond)
+{
+	int error = pthread_cond_wait(cond, &self->mutex);
+	if (error != 0)
+	{
+		errno = error;
 		return false;
 	}
 
+	return true;
+}
+
+/**
+ * Pops the next command of a connection that has control commands pending,
+ * or null if there are none. Must be called with the mutex held.
+ */
+static IrcCmd* IrcCmdQueue_PopControl(IrcCmdQueue* self, uint64_t* queuedNs)
+{
+	while (self->control.count > 0)
+	{
+		int socket = self->control.sockets[self->control.front];
+		ConnQueue* conn = &self->conns[socket];
+
+		if (conn->controlCount == 0)
+		{
+			// Already served through the ready ring.
+			conn->control = false;
+			SocketRing_Pop(&self->control, self->connsSize);
+			continue;
+		}
+
+		// Earlier commands of the connection go first, to keep them in order.
+		IrcCmd* ircCmd = ConnQueue_Pop(conn, self->connCapacity, queuedNs);
+
+		if (ircCmd->priority != IrcCmdPriority_Control)
+		{
+			// Executed out of turn, so charged to the connection's deficit,
+			// or flooders could jump the round robin with a PONG.
+			conn->deficit--;
+
+			if (conn->deficit <= 0 && conn->count > 0
+					&& self->ready.sockets[self->ready.front] == socket)
+			{
+				IrcCmdQueue_EndTurn(self, conn);
+			}
+		}
+
+		if (conn->controlCount == 0)
+		{
+			conn->control = false;
+			SocketRing_Pop(&self->control, self->connsSize);
+		}
+
+		return ircCmd;
+	}
+
+	return NULL;
+}
+
+/**
+ * Pops the next command in deficit round robin order, every command costs one unit.
+ * The connection at the front of the ready ring keeps its turn until it has
+ * used up its quantum or has nothing left to execute.
+ * There must be a command queued. Must be called with the mutex held.
+ */
+static IrcCmd* IrcCmdQueue_PopReady(IrcCmdQueue* self, uint64_t* queuedNs)
+{
+	ConnQueue* conn = &self->conns[self->ready.sockets[self->ready.front]];
+
+	while (conn->count == 0 || conn->deficit <= 0)
+	{
+		if (conn->count == 0)
+		{
+			// Emptied through the control ring.
+			IrcCmdQueue_Unready(self, conn);
+		}
+		else
+		{
+			// Still repaying commands executed out of turn.
+			IrcCmdQueue_EndTurn(self, conn);
+		}
+
+		conn = &self->conns[self->ready.sockets[self->ready.front]];
+	}
+
+	IrcCmd* ircCmd = ConnQueue_Pop(conn, self->connCapacity, queuedNs);
+	conn->deficit--;
+
+	if (conn->count == 0)
+	{
+		IrcCmdQueue_Unready(self, conn);
+	}
+	else if (conn->deficit <= 0)
+	{
+		IrcCmdQueue_EndTurn(self, conn);
+	}
+
 	return ircCmd;
 }
+
+/**
+ * Moves the connection at the front of the ready ring to the back, with the
+ * quantum of its next turn. Must be called with the mutex held.
+ */
+static void IrcCmdQueue_EndTurn(IrcCmdQueue* self, ConnQueue* conn)
+{
+	conn->deficit += (int64_t) self->quantum;
+	SocketRing_Push(&self->ready, self->connsSize,
+			SocketRing_Pop(&self->ready, self->connsSize));
+}
+
+/**
+ * Removes the connection at the front of the ready ring, which has nothing
+ * left to execute. Must be called with the mutex held.
+ */
+static void IrcCmdQueue_Unready(IrcCmdQueue* self, ConnQueue* conn)
+{
+	// Idle connections don't keep what's left of their quantum, but keep
+	// their debt.
+	conn->ready = false;
+	if (conn->deficit > 0)
+	{
+		conn->deficit = 0;
+	}
+	SocketRing_Pop(&self->ready, self->connsSize);
+}
+
+static IrcCmd* ConnQueue_Pop(ConnQueue* self, size_t capacity, uint64_t* queuedNs)
+{
+	IrcCmd* ircCmd = self->cmds[self->front];
+	*queuedNs = self->queuedNs[self->front];
+	self->front = (self->front + 1) % capacity;
+	self->count--;
+
+	if (ircCmd->priority == IrcCmdPriority_Control)
+	{
+		self->controlCount--;
+	}
+
+	return ircCmd;
+}
+
+/**
+ * Moves the ring to new storage, at least as large, and frees the old one.
+ */
+static void SocketRing_Move(SocketRing* self, size_t oldSize, int* sockets)
+{
+	// Unwrap the ring into the new storage.
+	for (size_t i = 0; i < self->count; i++)
+	{
+		sockets[i] = self->sockets[(self->front + i) % oldSize];
+	}
+
+	free(self->sockets);
+	self->sockets = sockets;
+	self->front = 0;
+}
+
+static void SocketRing_Push(SocketRing* self, size_t size, int socket)
+{
+	self->sockets[(self->front + self->count) % size] = socket;
+	self->count++;
+}
+
+static int SocketRing_Pop(SocketRing* self, size_t size)
+{
+	int socket = self->sockets[self->front];
+	self->front = (self->front + 1) % size;
+	self->count--;
+
+	return socket;
+}
@@ -8,11 +8,42 @@
 #include <stdint.h>
 
 
+/**
+  * Queue of commands waiting for the executor.
+  * Each connection has its own small queue, and connections are served in
+  * deficit round robin order, so a chatty client can't delay everyone else.
+  */
 typedef struct IrcCmdQueue IrcCmdQueue;
 
-IrcCmdQueue* IrcCmdQueue_New(size_t capacity, int32_t shutdownTimeout);
+// Largest quantum, so deficits can't overflow.
+#define IRC_CMD_QUEUE_MAX_QUANTUM INT32_MAX
+
+/**
+ * @param connCapacity		How many commands each connection may have queued,
+ *							pushing past it blocks that connection's reader.
+ * @param quantum			How many commands a connection may execute per turn.
+ *							Commands executed ahead of a control command count
+ *							against it too.
+ */
+IrcCmdQueue* IrcCmdQueue_New(size_t connCapacity, size_t quantum);
 void IrcCmdQueue_Delete(IrcCmdQueue* self);
 
+/**
+ * Wakes every thread blocked on the queue. Afterwards pushes fail, and pops
+ * fail once the queue is empty, both setting errno to ECANCELED.
+ */
+void IrcCmdQueue_Shutdown(IrcCmdQueue* self);
+
+/**
+ * Changes how many commands a connection may execute per turn, from its next turn on.
+ */
+bool IrcCmdQueue_SetQuantum(IrcCmdQueue* self, size_t quantum);
+
+/**
+ * @return The most commands the queue held at once, across all connections.
+ */
+size_t IrcCmdQueue_HighWater(IrcCmdQueue* self);
+
 bool IrcCmdQueue_Push(IrcCmdQueue* self, IrcCmd* ircCmd);
 IrcCmd* IrcCmdQueue_Pop(IrcCmdQueue* self);
 
@@ -1,306 +1,332 @@
 #include "irc_reply.h"
 
-#include "irc_cmd_type.h"
-#include "str_utils.h"
+#include "irc_msg.h"
 
+#include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-
-static IrcMsg* IrcReply_Base(const char* servername)
+// Reply text after the numeric. $1 to $9 are replaced by the arguments.
+typedef struct IrcReplyTemplate
 {
-	IrcMsg* self = malloc(sizeof(IrcMsg));
-	if (self == NULL)
-	{
-		return NULL;
-	}
-
-	*self = (IrcMsg) { 0 };
-
-	self->prefix.origin = StrUtils_Clone(servername);
-	if (self->prefix.origin == NULL)
-	{
-		return NULL;
-	}
-
-	return self;
+	IrcReplyType type;
+	size_t argCount;
+	const char* text;
 }
-
-static char* WriteChannel(IrcChannelType channelType, const char* channelName)
+IrcReplyTemplate;
+
+static const IrcReplyTemplate TEMPLATES[] = {
+	/*
+	 * 001	 RPL_WELCOME
+	 * 		- The server sends replies 001 to 004 to a user upon
+	 * 		  successful registration.
+	 * Args: nick!user@host.
+	 */
+	{ IrcReplyType_RplWelcome, 1, ":Welcome to the Internet Relay Network $1" },
+	/*
+	 * 002	 RPL_YOURHOST
+	 * Args: servername, version.
+	 */
+	{ IrcReplyType_RplYourHost, 2, ":Your host is $1, running version $2" },
+	/*
+	 * 003	 RPL_CREATED
+	 * Args: date.
+	 */
+	{ IrcReplyType_RplCreated, 1, ":This server was created $1" },
+	/*
+	 * 004	 RPL_MYINFO
+	 * Args: servername, version, available user modes, available channel modes.
+	 */
+	{ IrcReplyType_RplMyInfo, 4, "$1 $2 $3 $4" },
+	/*
+	 * 211	 RPL_STATSLINKINFO
+	 * Args: link name, sendq, sent messages, sent bytes, received messages,
+	 *       received bytes, seconds open.
+	 */
+	{ IrcReplyType_RplStatsLinkInfo, 7, "$1 $2 $3 $4 $5 $6 $7" },
+	/*
+	 * 212	 RPL_STATSCOMMANDS
+	 * Args: command, count.
+	 */
+	{ IrcReplyType_RplStatsCommands, 2, "$1 $2" },
+	/*
+	 * 219	 RPL_ENDOFSTATS
+	 * Args: stats letter.
+	 */
+	{ IrcReplyType_RplEndOfStats, 1, "$1 :End of /STATS report" },
+	/*
+	 * 242	 RPL_STATSUPTIME
+	 * Args: days, hours:minutes:seconds.
+	 */
+	{ IrcReplyType_RplStatsUptime, 2, ":Server Up $1 days $2" },
+	/*
+	 * 249	 RPL_STATSDEBUG
+	 * 		- Not in the RFC, used by other servers for free form
+	 * 		  statistics. Here for the server's own letter.
+	 * Args: stats letter, text.
+	 */
+	{ IrcReplyType_RplStatsDebug, 2, "$1 :$2" },
+	/*
+	 * 332	 RPL_TOPIC
+	 * 		- When sending a TOPIC message to determine the
+	 * 		  channel topic, one of two replies is sent.  If
+	 * 		  the topic is set, RPL_TOPIC is sent back else
+	 * 		  RPL_NOTOPIC.
+	 * Args: channel prefix, channel, topic.
+	 */
+	{ IrcReplyType_RplTopic, 3, "$1$2 :$3" },
+	/*
+	 * 381	 RPL_YOUREOPER
+	 * 		- RPL_YOUREOPER is sent back to a client which has
+	 * 		  just successfully issued an OPER message and gained
+	 * 		  operator status.
+	 */
+	{ IrcReplyType_RplYoureOper, 0, ":You are now an IRC operator" },
+	/*
+	 * 382	 RPL_REHASHING
+	 * 		- If the REHASH option is used and an operator sends
+	 * 		  a REHASH message, an RPL_REHASHING is sent back to
+	 * 		  the operator.
+	 * Args: config file.
+	 */
+	{ IrcReplyType_RplRehashing, 1, "$1 :Rehashing" },
+	/*
+	 * 401	 ERR_NOSUCHNICK
+	 * 		- Used to indicate the nickname parameter supplied to a
+	 * 		  command is currently unused.
+	 * Args: nickname.
+	 */
+	{ IrcReplyType_ErrNoSuchNick, 1, "$1 :No such nick/channel" },
+	/*
+	 * 402	 ERR_NOSUCHSERVER
+	 * 		- Used to indicate the server name given currently
+	 * 		  doesn't exist.
+	 * Args: server name.
+	 */
+	{ IrcReplyType_ErrNoSuchServer, 1, "$1 :No such server" },
+	/*
+	 * 436	 ERR_NICKCOLLISION
+	 * 		- Returned by a server to a client when it detects a
+	 * 		  nickname collision (registered of a NICK that
+	 * 		  already exists by another server).
+	 * Args: nickname.
+	 */
+	{ IrcReplyType_ErrNickCollision, 1, "$1 :Nickname collision KILL" },
+	/*
+	 * 451	 ERR_NOTREGISTERED
+	 * 		- Returned by the server to indicate that the client
+	 * 		  must be registered before the server will allow it
+	 * 		  to be parsed in detail.
+	 */
+	{ IrcReplyType_ErrNotRegistered, 0, ":You have not registered" },
+	/*
+	 * 461	 ERR_NEEDMOREPARAMS
+	 * 		- Returned by the server by numerous commands to
+	 * 		  indicate to the client that it didn't supply enough
+	 * 		  parameters.
+	 * Args: command.
+	 */
+	{ IrcReplyType_ErrNeedMoreParams, 1, "$1 :Not enough parameters" },
+	/*
+	 * 462	 ERR_ALREADYREGISTRED
+	 * 		- Returned by the server to any link which tries to
+	 * 		  change part of the registered details (such as
+	 * 		  password or user details from second USER message).
+	 */
+	{ IrcReplyType_ErrAlreadyRegistered, 0, ":You may not reregister" },
+	/*
+	 * 464	 ERR_PASSWDMISMATCH
+	 * 		- Returned to indicate a failed attempt at registering
+	 * 		  a connection for which a password was required and
+	 * 		  was either not given or incorrect.
+	 */
+	{ IrcReplyType_ErrPasswdMismatch, 0, ":Password incorrect" },
+	/*
+	 * 471	 ERR_CHANNELISFULL
+	 * Args: channel prefix, channel.
+	 */
+	{ IrcReplyType_ErrChannelIsFull, 2, "$1$2 :Cannot join channel (+l)" },
+	/*
+	 * 473	 ERR_INVITEONLYCHAN
+	 * Args: channel prefix, channel.
+	 */
+	{ IrcReplyType_ErrInviteOnlyChan, 2, "$1$2 :Cannot join channel (+i)" },
+	/*
+	 * 474	 ERR_BANNEDFROMCHAN
+	 * Args: channel prefix, channel.
+	 */
+	{ IrcReplyType_ErrBannedFromChan, 2, "$1$2 :Cannot join channel (+b)" },
+	/*
+	 * 475	 ERR_BADCHANNELKEY
+	 * Args: channel prefix, channel.
+	 */
+	{ IrcReplyType_ErrBadChannelKey, 2, "$1$2 :Cannot join channel (+k)" },
+	/*
+	 * 481	 ERR_NOPRIVILEGES
+	 * 		- Any command requiring operator privileges to operate
+	 * 		  must return this error to indicate the attempt was
+	 * 		  unsuccessful.
+	 */
+	{ IrcReplyType_ErrNoPrivileges, 0, ":Permission Denied- You're not an IRC operator" },
+	/*
+	 * 491	 ERR_NOOPERHOST
+	 * 		- If a client sends an OPER message and the server has
+	 * 		  not been configured to allow connections from the
+	 * 		  client's host as an operator, this error must be
+	 * 		  returned.
+	 */
+	{ IrcReplyType_ErrNoOperHost, 0, ":No O-lines for your host" },
+};
+
+#define TEMPLATE_COUNT (sizeof(TEMPLATES) / sizeof(TEMPLATES[0]))
+
+// Marks numerics without a template in templateIndex.
+#define NO_TEMPLATE UINT8_MAX
+
+struct IrcReplies
 {
-	size_t len = strlen(channelName) + 1;
+	// ":servername NNN " of each template, in the same order.
+	char* prefixes[TEMPLATE_COUNT];
+	size_t prefixLens[TEMPLATE_COUNT];
 
-	char* param = malloc(sizeof(char) * (len + 1));
-	if (param == NULL)
-	{
-		return NULL;
-	}
+	uint8_t templateIndex[IRC_REPLY_TYPE_MAX + 1];
+};
 
-	switch (channelType)
-	{
-		case IrcChannelType_Local:
-			param[0] = '&';
-			break;
-		case IrcChannelType_Distributed:
-			param[0] = '#';
-			break;
-	}
-	memcpy(param + 1, channelName, len - 1);
-	param[len] = '\0';
+static bool Append(char* buffer, size_t capacity, size_t* len, const char* str, size_t strLen);
 
-	return param;
-}
 
-IrcMsg* IrcReply_RplTopic(
-		const char* servername, IrcChannelType channelType, const char* channel,
-		const char* topic)
+IrcReplies* IrcReplies_New(const char* servername)
 {
-	IrcMsg* self = IrcReply_Base(servername);
+	IrcReplies* self = malloc(sizeof(IrcReplies));
 	if (self == NULL)
 	{
 		return NULL;
 	}
 
-	self->replyNumber = 332;
-	self->paramCount = 2;
-
-	self->params[0] = WriteChannel(channelType, channel);
-	if (self->params[0] == NULL)
-	{
-		return NULL;
-	}
-
-	self->params[1] = StrUtils_Clone(topic);
-	if (self->params[1] == NULL)
-	{
-		return NULL;
-	}
-
-	return self;
-}
+	*self = (IrcReplies) { 0 };
+	memset(self->templateIndex, NO_TEMPLATE, sizeof(self->templateIndex));
 
-IrcMsg* IrcReply_ErrNoSuchNick(const char* servername, const char* nickname)
-{
-	IrcMsg* self = IrcReply_Base(servername);
-	if (self == NULL)
+	for (size_t i = 0; i < TEMPLATE_COUNT; i++)
 	{
-		return NULL;
-	}
+		int len = snprintf(NULL, 0, ":%s %03d ", servername, TEMPLATES[i].type);
+		if (len < 0)
+		{
+			goto error;
+		}
 
-	self->replyNumber = 401;
-	self->paramCount = 2;
+		self->prefixes[i] = malloc((size_t) len + 1);
+		if (self->prefixes[i] == NULL)
+		{
+			goto error;
+		}
 
-	self->params[0] = StrUtils_Clone(nickname);
-	if (self->params[0] == NULL)
-	{
-		return NULL;
+		snprintf(self->prefixes[i], (size_t) len + 1, ":%s %03d ", servername, TEMPLATES[i].type);
+		self->prefixLens[i] = (size_t) len;
+		self->templateIndex[TEMPLATES[i].type] = (uint8_t) i;
 	}
 
-	self->params[1] = StrUtils_Clone("No such nick/channel");
-	if (self->params[1] == NULL)
-	{
-		return NULL;
-	};
-
 	return self;
-}
 
-IrcMsg* IrcReply_ErrNickCollision(const char* servername, const char* nickname)
-{
-	IrcMsg* self = IrcReply_Base(servername);
-	if (self == NULL)
-	{
-		return NULL;
-	}
-
-	self->replyNumber = 436;
-	self->paramCount = 2;
-
-	self->params[0] = StrUtils_Clone(nickname);
-	if (self->params[0] == NULL)
-	{
-		return NULL;
-	}
-
-	self->params[1] = StrUtils_Clone("Nickname collision KILL");
-	if (self->params[1] == NULL)
-	{
-		return NULL;
-	};
-
-	return self;
+error:
+	IrcReplies_Delete(self);
+	return NULL;
 }
 
-IrcMsg* IrcReply_ErrNotRegistered(const char* servername)
+void IrcReplies_Delete(IrcReplies* self)
 {
-	IrcMsg* self = IrcReply_Base(servername);
 	if (self == NULL)
 	{
-		return NULL;
+		return;
 	}
 
-	self->replyNumber = 451;
-	self->paramCount = 1;
-
-	self->params[0] = StrUtils_Clone("You have not registered");
-	if (self->params[0] == NULL)
+	for (size_t i = 0; i < TEMPLATE_COUNT; i++)
 	{
-		return NULL;
+		free(self->prefixes[i]);
 	}
 
-	return self;
+	free(self);
 }
 
-IrcMsg* IrcReply_ErrNeedMoreParams(const char* servername, IrcCmdType cmd)
+size_t IrcReplies_Render(const IrcReplies* self, IrcReplyType type,
+		const char* const* args, size_t argCount, char* buffer, size_t bufferSize)
 {
-	IrcMsg* self = IrcReply_Base(servername);
-	if (self == NULL)
+	if ((size_t) type > IRC_REPLY_TYPE_MAX || self->templateIndex[type] == NO_TEMPLATE)
 	{
-		return NULL;
+		return 0;
 	}
 
-	self->replyNumber = 461;
-	self->paramCount = 2;
+	size_t index = self->templateIndex[type];
+	const IrcReplyTemplate* template = &TEMPLATES[index];
 
-	self->params[0] = StrUtils_Clone(IRC_CMD_TYPE_STRS[cmd]);
-	if (self->params[0] == NULL)
+	if (argCount < template->argCount)
 	{
-		return NULL;
+		return 0;
 	}
 
-	self->params[1] = StrUtils_Clone("Not enough parameters");
-	if (self->params[1] == NULL)
-	{
-		return NULL;
-	};
+	size_t capacity = bufferSize > IRC_MSG_SIZE ? IRC_MSG_SIZE : bufferSize;
+	size_t len = 0;
 
-	return self;
-}
-
-IrcMsg* IrcReply_ErrAlreadyRegistered(const char* servername)
-{
-	IrcMsg* self = IrcReply_Base(servername);
-	if (self == NULL)
+	if (!Append(buffer, capacity, &len, self->prefixes[index], self->prefixLens[index]))
 	{
-		return NULL;
+		return 0;
 	}
 
-	self->replyNumber = 462;
-	self->paramCount = 1;
-
-	self->params[0] = StrUtils_Clone("You may not reregister");
-	if (self->params[0] == NULL)
+	const char* text = template->text;
+	while (*text != '\0')
 	{
-		return NULL;
-	}
+		const char* slot = strchr(text, '$');
+		const char* literalEnd = slot != NULL ? slot : text + strlen(text);
 
-	return self;
-}
+		if (!Append(buffer, capacity, &len, text, (size_t) (literalEnd - text)))
+		{
+			return 0;
+		}
 
-IrcMsg* IrcReply_ErrChannelIsFull(
-		const char* servername, IrcChannelType channelType, const char* channelName)
-{
-	IrcMsg* self = IrcReply_Base(servername);
-	if (self == NULL)
-	{
-		return NULL;
-	}
-	
-	self->replyNumber = 471;
-	self->paramCount = 2;
+		if (slot == NULL)
+		{
+			break;
+		}
 
-	self->params[0] = WriteChannel(channelType, channelName);
-	if (self->params[0] == NULL)
-	{
-		return NULL;
-	}
+		const char* arg = args[slot[1] - '1'];
+		if (!Append(buffer, capacity, &len, arg, strlen(arg)))
+		{
+			return 0;
+		}
 
-	self->params[1] = StrUtils_Clone("Cannot join channel (+l)");
-	if (self->params[1] == NULL)
-	{
-		return NULL;
+		text = slot + 2;
 	}
 
-	return self;
-}
-
-IrcMsg* IrcReply_ErrInviteOnlyChan(
-		const char* servername, IrcChannelType channelType, const char* channelName)
-{
-	IrcMsg* self = IrcReply_Base(servername);
-	if (self == NULL)
+	if (!Append(buffer, capacity, &len, "\r\n", 2))
 	{
-		return NULL;
+		return 0;
 	}
-	
-	self->replyNumber = 473;
-	self->paramCount = 2;
 
-	self->params[0] = WriteChannel(channelType, channelName);
-	if (self->params[0] == NULL)
-	{
-		return NULL;
-	}
-
-	self->params[1] = StrUtils_Clone("Cannot join channel (+i)");
-	if (self->params[1] == NULL)
-	{
-		return NULL;
-	}
-
-	return self;
+	return len;
 }
 
-IrcMsg* IrcReply_ErrBannedFromChan(
-		const char* servername, IrcChannelType channelType, const char* channelName)
+const char* IrcReply_ChannelPrefix(IrcChannelType channelType)
 {
-	IrcMsg* self = IrcReply_Base(servername);
-	if (self == NULL)
-	{
-		return NULL;
-	}
-	
-	self->replyNumber = 474;
-	self->paramCount = 2;
-
-	self->params[0] = WriteChannel(channelType, channelName);
-	if (self->params[0] == NULL)
-	{
-		return NULL;
-	}
-
-	self->params[1] = StrUtils_Clone("Cannot join channel (+b)");
-	if (self->params[1] == NULL)
+	switch (channelType)
 	{
-		return NULL;
+		case IrcChannelType_Local:
+			return "&";
+		case IrcChannelType_Distributed:
+			return "#";
+		default:
+			return "";
 	}
-
-	return self;
 }
 
-IrcMsg* IrcReply_ErrBadChannelKey(
-		const char* servername, IrcChannelType channelType, const char* channelName)
+static bool Append(char* buffer, size_t capacity, size_t* len, const char* str, size_t strLen)
 {
-	IrcMsg* self = IrcReply_Base(servername);
-	if (self == NULL)
-	{
-		return NULL;
-	}
-	
-	self->replyNumber = 475;
-	self->paramCount = 2;
-
-	self->params[0] = WriteChannel(channelType, channelName);
-	if (self->params[0] == NULL)
+	if (*len + strLen > capacity)
 	{
-		return NULL;
+		return false;
 	}
 
-	self->params[1] = StrUtils_Clone("Cannot join channel (+k)");
-	if (self->params[1] == NULL)
-	{
-		return NULL;
-	}
+	memcpy(buffer + *len, str, strLen);
+	*len += strLen;
 
-	return self;
+	return true;
 }
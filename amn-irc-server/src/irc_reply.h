@@ -2,96 +2,34 @@
 #define AMN_IRC_REPLY_H
 
 #include "irc_cmd.h"
-#include "irc_msg.h"
+#include "irc_reply_type.h"
 
-/*
- * 332	 RPL_TOPIC
- * 				"<channel> :<topic>"
+#include <stddef.h>
 
- * 		- When sending a TOPIC message to determine the
- * 		  channel topic, one of two replies is sent.  If
- * 		  the topic is set, RPL_TOPIC is sent back else
- * 		  RPL_NOTOPIC.
- */
-IrcMsg* IrcReply_RplTopic(
-		const char* servername, IrcChannelType channelType, const char* channel,
-		const char* topic);
-
-/*
- * 401	 ERR_NOSUCHNICK
- * 				"<nickname> :No such nick/channel"
-
- * 		- Used to indicate the nickname parameter supplied to a
- * 		  command is currently unused.
- */
-IrcMsg* IrcReply_ErrNoSuchNick(const char* servername, const char* nickname);
-
-/*
- * 436	 ERR_NICKCOLLISION
- * 				"<nick> :Nickname collision KILL"
-
- * 		- Returned by a server to a client when it detects a
- * 		  nickname collision (registered of a NICK that
- * 		  already exists by another server).
- */
-IrcMsg* IrcReply_ErrNickCollision(const char* servername, const char* nickname);
-
-/*
- * 451	 ERR_NOTREGISTERED
- * 				":You have not registered"
-
- * 		- Returned by the server to indicate that the client
- * 		  must be registered before the server will allow it
- * 		  to be parsed in detail.
- */
-IrcMsg* IrcReply_ErrNotRegistered(const char* servername);
+/**
+  * Renders numeric replies straight into an output buffer.
+  * Every reply has a compile-time template, and its ":servername NNN " prefix
+  * is rendered once when created. Rendering a reply only copies the prefix,
+  * the template text and the arguments filling its slots.
+  * Immutable once created, so it can be shared between threads.
+  */
+typedef struct IrcReplies IrcReplies;
 
-/*
- * 461	 ERR_NEEDMOREPARAMS
- * 				"<command> :Not enough parameters"
-
- * 		- Returned by the server by numerous commands to
- * 		  indicate to the client that it didn't supply enough
- * 		  parameters.
- */
-IrcMsg* IrcReply_ErrNeedMoreParams(const char* servername, IrcCmdType cmd);
-
-/*
- * 462	 ERR_ALREADYREGISTRED
- * 				":You may not reregister"
-
- * 		- Returned by the server to any link which tries to
- * 		  change part of the registered details (such as
- * 		  password or user details from second USER message).
- */
-IrcMsg* IrcReply_ErrAlreadyRegistered(const char* servername);
-
-/*
- * 471	 ERR_CHANNELISFULL
- * 				"<channel> :Cannot join channel (+l)"
- */
-IrcMsg* IrcReply_ErrChannelIsFull(
-		const char* servername, IrcChannelType channelType, const char* channelName);
-
-/*
- * 473	 ERR_INVITEONLYCHAN
- * 				"<channel> :Cannot join channel (+i)"
- */
-IrcMsg* IrcReply_ErrInviteOnlyChan(
-		const char* servername, IrcChannelType channelType, const char* channelName);
+IrcReplies* IrcReplies_New(const char* servername);
+void IrcReplies_Delete(IrcReplies* self);
 
-/*
- * 474	 ERR_BANNEDFROMCHAN
- * 				"<channel> :Cannot join channel (+b)"
+/**
+ * Writes a reply, CRLF included, at the start of buffer. Not NUL terminated.
+ * @param args	Strings filling the template slots, see the templates in irc_reply.c.
+ * @return Length written, or 0 if it doesn't fit in bufferSize or IRC_MSG_SIZE,
+ *         or the reply type has no template.
  */
-IrcMsg* IrcReply_ErrBannedFromChan(
-		const char* servername, IrcChannelType channelType, const char* channelName);
+size_t IrcReplies_Render(const IrcReplies* self, IrcReplyType type,
+		const char* const* args, size_t argCount, char* buffer, size_t bufferSize);
 
-/*
- * 475	 ERR_BADCHANNELKEY
- * 				"<channel> :Cannot join channel (+k)"
+/**
+ * "&" or "#", to prefix a channel name in reply arguments.
  */
-IrcMsg* IrcReply_ErrBadChannelKey(
-		const char* servername, IrcChannelType channelType, const char* channelName);
+const char* IrcReply_ChannelPrefix(IrcChannelType channelType);
 
 #endif // AMN_IRC_REPLY_H
@@ -0,0 +1,78 @@
+#include "link_stats.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+struct LinkStats
+{
+	atomic_size_t refCount;
+	_Atomic uint64_t queuedBytes;
+	// Queued bytes written or dropped.
+	_Atomic uint64_t dequeuedBytes;
+	_Atomic uint64_t sentBytes;
+	_Atomic uint64_t sentWrites;
+};
+
+LinkStats* LinkStats_New(void)
+{
+	LinkStats* self = malloc(sizeof(LinkStats));
+	if (self == NULL)
+	{
+		return NULL;
+	}
+
+	atomic_init(&self->refCount, 1);
+	atomic_init(&self->queuedBytes, 0);
+	atomic_init(&self->dequeuedBytes, 0);
+	atomic_init(&self->sentBytes, 0);
+	atomic_init(&self->sentWrites, 0);
+
+	return self;
+}
+
+LinkStats* LinkStats_Ref(LinkStats* self)
+{
+	atomic_fetch_add_explicit(&self->refCount, 1, memory_order_relaxed);
+	return self;
+}
+
+void LinkStats_Unref(LinkStats* self)
+{
+	if (self == NULL)
+	{
+		return;
+	}
+
+	if (atomic_fetch_sub_explicit(&self->refCount, 1, memory_order_acq_rel) == 1)
+	{
+		free(self);
+	}
+}
+
+void LinkStats_Queue(LinkStats* self, size_t bytes)
+{
+	atomic_fetch_add_explicit(&self->queuedBytes, bytes, memory_order_relaxed);
+}
+
+void LinkStats_Dequeue(LinkStats* self, size_t bytes, bool written)
+{
+	if (written)
+	{
+		atomic_fetch_add_explicit(&self->sentBytes, bytes, memory_order_relaxed);
+		atomic_fetch_add_explicit(&self->sentWrites, 1, memory_order_relaxed);
+	}
+
+	// Release, so a reader seeing these bytes dequeued also sees them queued.
+	atomic_fetch_add_explicit(&self->dequeuedBytes, bytes, memory_order_release);
+}
+
+void LinkStats_Read(LinkStats* self, LinkStatsSnapshot* snapshot)
+{
+	// Dequeued first, so it's never ahead of queued.
+	uint64_t dequeuedBytes = atomic_load_explicit(&self->dequeuedBytes, memory_order_acquire);
+	uint64_t queuedBytes = atomic_load_explicit(&self->queuedBytes, memory_order_relaxed);
+
+	snapshot->sendqBytes = queuedBytes - dequeuedBytes;
+	snapshot->sentBytes = atomic_load_explicit(&self->sentBytes, memory_order_relaxed);
+	snapshot->sentWrites = atomic_load_explicit(&self->sentWrites, memory_order_relaxed);
+}
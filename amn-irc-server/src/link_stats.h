@@ -0,0 +1,51 @@
+#ifndef AMN_LINK_STATS_H
+#define AMN_LINK_STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+  * Counters of what is sent to one client, for STATS l. The executor counts
+  * the bytes it queues and the send tasks the bytes they write, each with
+  * a few atomic adds, and anyone may read them without locking.
+  *
+  * Reference counted, as send tasks may still hold it after the client left.
+  */
+typedef struct LinkStats LinkStats;
+
+typedef struct LinkStatsSnapshot
+{
+	// Queued but not yet written or dropped.
+	uint64_t sendqBytes;
+	uint64_t sentBytes;
+	// Each send task is one write, which may hold several messages.
+	uint64_t sentWrites;
+}
+LinkStatsSnapshot;
+
+/**
+ * The caller owns the first reference, null on allocation failure.
+ */
+LinkStats* LinkStats_New(void);
+
+LinkStats* LinkStats_Ref(LinkStats* self);
+
+/**
+ * Releases a reference. Null is ignored.
+ */
+void LinkStats_Unref(LinkStats* self);
+
+/**
+ * Counts bytes handed to a send task.
+ */
+void LinkStats_Queue(LinkStats* self, size_t bytes);
+
+/**
+ * Counts queued bytes leaving the sendq, as sent only if written.
+ */
+void LinkStats_Dequeue(LinkStats* self, size_t bytes, bool written);
+
+void LinkStats_Read(LinkStats* self, LinkStatsSnapshot* snapshot);
+
+#endif // AMN_LINK_STATS_H
@@ -1,4 +1,5 @@
 #include "application.h"
+#include "flight_recorder.h"
 #include "log.h"
 #include "irc_msg.h"
 #include "irc_msg_parser.h"
@@ -7,6 +8,9 @@
 #include "task_runner.h"
 #include "accept_conn_task.h"
 #include "irc_cmd_executor_task.h"
+#include "metrics_export_task.h"
+#include "receive_msg_task.h"
+#include "server_config.h"
 
 #include <errno.h>
 #include <signal.h>
@@ -18,20 +22,27 @@
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netdb.h>
 #include <unistd.h>
 
-#define RUNNER_COUNT 10
-#define SERVER_NAME "amn-irc.server.local"
 #define PROTOCOL_IP 0
-#define SERVER_PORT "6667"
-#define TIMEOUT 10
 
-struct addrinfo* getServerAddress(const Logger* log)
+// Signals the queued log messages are written and the flight recorder is
+// dumped on before the process dies.
+static const int FATAL_SIGNALS[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+#define FATAL_SIGNAL_COUNT (sizeof(FATAL_SIGNALS) / sizeof(int))
+
+// Handlers replaced by fatalSignalHandler, e.g. the sanitizers'.
+static struct sigaction previousFatalActions[FATAL_SIGNAL_COUNT];
+// Whose messages fatalSignalHandler writes, null once it's destroyed.
+static Logger* volatile fatalLog = NULL;
+
+struct addrinfo* getServerAddress(const Logger* log, const ServerConfig* config)
 {
 	struct addrinfo hints = {
-		// Find an IPv6 address
-		.ai_family = AF_INET6,
+		// Find an IPv6 address, that also accepts IPv4, unless an address is configured
+		.ai_family = config->listenAddress == NULL ? AF_INET6 : AF_UNSPEC,
 		// for stream socket
 		.ai_socktype = SOCK_STREAM,
 		// to bind a socket to accept connections
@@ -42,7 +53,7 @@ struct addrinfo* getServerAddress(const Logger* log)
 
 	struct addrinfo* result = NULL;
 
-	if(getaddrinfo(NULL, SERVER_PORT, &hints, &result) == 0)
+	if(getaddrinfo(config->listenAddress, config->listenPort, &hints, &result) == 0)
 	{
 		return result;
 	}
@@ -53,26 +64,17 @@ struct addrinfo* getServerAddress(const Logger* log)
 	}
 }
 
-int setupSocket(const Logger* log, struct addrinfo* address)
+int setupSocket(const Logger* log, const ServerConfig* config, struct addrinfo* address)
 {
 	LOG_DEBUG(log, "Creating socket");
 
-	int listenSocket = socket(AF_INET6, SOCK_STREAM, PROTOCOL_IP);
+	int listenSocket = socket(address->ai_family, SOCK_STREAM, PROTOCOL_IP);
 	if (listenSocket == -1)
 	{
 		LOG_ERROR(log, "Failed to create socket");
 		return -1;
 	}
 
-	struct timeval timeout = { .tv_sec = TIMEOUT };
-
-	if (setsockopt(listenSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(struct timeval))
-			== -1)
-	{
-		LOG_ERROR(log, "Failed to set socket receive timeout");
-		return -1;
-	}
-
 	LOG_DEBUG(log, "Binding socket");
 
 	if(bind(listenSocket, address->ai_addr, address->ai_addrlen) == -1)
@@ -82,7 +84,8 @@ int setupSocket(const Logger* log, struct addrinfo* address)
 	}
 
 	LOG_DEBUG(log, "Setting socket to listen");
-	if(listen(listenSocket, 10) == -1) {
+	// Config limits the backlog to INT_MAX.
+	if(listen(listenSocket, (int) config->listenBacklog) == -1) {
 		LOG_ERROR(log, "Failed to listen socket.");
 		return -1;
 	}
@@ -90,18 +93,20 @@ int setupSocket(const Logger* log, struct addrinfo* address)
 	return listenSocket;
 }
 
-bool StartServer(const Logger* log, TaskQueue* tasks, IrcCmdQueue* cmds)
+bool StartServer(const Logger* log, TaskQueue* tasks, IrcCmdQueue* cmds,
+		const ServerConfig* config, const ReceiveMsgShared* receiveShared)
 {
-	struct addrinfo* address = getServerAddress(log);
+	struct addrinfo* address = getServerAddress(log, config);
 	if(address == NULL)
 		return false;
 
-	int listenSocket = setupSocket(log, address);
+	int listenSocket = setupSocket(log, config, address);
 	freeaddrinfo(address);
 	if(listenSocket == -1)
 		return false;
 
-	Task* acceptConnTask = AcceptConnTask_New(log, tasks, cmds, listenSocket);
+	Task* acceptConnTask = AcceptConnTask_New(
+			log, tasks, cmds, config, receiveShared, listenSocket);
 	if (acceptConnTask == NULL)
 	{
 		LOG_ERROR(log, "Failed to create task to accept connections.");
@@ -122,6 +127,64 @@ bool StartServer(const Logger* log, TaskQueue* tasks, IrcCmdQueue* cmds)
 	return true;
 }
 
+/**
+ * Starts serving metrics on a Unix socket at path, replacing a socket left
+ * there by a previous run.
+ */
+bool StartMetricsExport(const Logger* log, TaskQueue* tasks, IrcCmdQueue* cmds,
+		TaskRunner** runners, size_t runnerCount, const char* path)
+{
+	struct sockaddr_un address = { .sun_family = AF_UNIX };
+	if (strlen(path) >= sizeof(address.sun_path))
+	{
+		LOG_ERROR(log, "Metrics socket path %s is too long.", path);
+		return false;
+	}
+
+	strcpy(address.sun_path, path);
+
+	int listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listenSocket == -1)
+	{
+		LOG_ERROR(log, "Failed to create metrics socket.");
+		return false;
+	}
+
+	if (unlink(path) != 0 && errno != ENOENT)
+	{
+		LOG_WARN(log, "Failed to remove old metrics socket %s.", path);
+	}
+
+	if (bind(listenSocket, (struct sockaddr*) &address, sizeof(address)) == -1
+			|| listen(listenSocket, SOMAXCONN) == -1)
+	{
+		LOG_ERROR(log, "Failed to listen on metrics socket %s.", path);
+		close(listenSocket);
+		return false;
+	}
+
+	Task* exportTask = MetricsExportTask_New(
+			log, tasks, cmds, runners, runnerCount, listenSocket, path);
+	if (exportTask == NULL)
+	{
+		LOG_ERROR(log, "Failed to create task to export metrics.");
+		close(listenSocket);
+		unlink(path);
+		return false;
+	}
+
+	if (!TaskQueue_Push(tasks, exportTask))
+	{
+		LOG_ERROR(log, "Failed to push metrics export task to queue.");
+		Task_Delete(exportTask);
+		return false;
+	}
+
+	LOG_INFO(log, "Serving metrics on %s.", path);
+
+	return true;
+}
+
 void signalHandler(int signum)
 {
 	switch (signum)
@@ -131,7 +194,56 @@ void signalHandler(int signum)
 		case SIGQUIT:
 			Application_StartShutdown();
 		break;
+		case SIGHUP:
+			Application_RequestReload();
+		break;
+	}
+}
+
+/**
+ * Writes the queued log messages and dumps the flight recorder, then lets
+ * the previous handler, or the default action, take the signal.
+ */
+void fatalSignalHandler(int signum)
+{
+	const char* reason = "fatal signal";
+	switch (signum)
+	{
+		case SIGSEGV:
+			reason = "SIGSEGV";
+		break;
+		case SIGBUS:
+			reason = "SIGBUS";
+		break;
+		case SIGILL:
+			reason = "SIGILL";
+		break;
+		case SIGFPE:
+			reason = "SIGFPE";
+		break;
+		case SIGABRT:
+			reason = "SIGABRT";
+		break;
+	}
+
+	Logger* log = fatalLog;
+	if (log != NULL)
+	{
+		Logger_WriteFatal(log);
 	}
+
+	FlightRecorder_Dump(reason);
+
+	for (size_t i = 0; i < FATAL_SIGNAL_COUNT; i++)
+	{
+		if (FATAL_SIGNALS[i] == signum)
+		{
+			sigaction(signum, &previousFatalActions[i], NULL);
+		}
+	}
+
+	// Blocked until this returns, then delivered to the restored handler.
+	raise(signum);
 }
 
 bool setupSignals(const Logger* log) {
@@ -165,41 +277,155 @@ bool setupSignals(const Logger* log) {
 		return false;
 	}
 
+	if (sigaction(SIGHUP, &act, NULL) != 0)
+	{
+		LOG_ERROR(log, "Failed to register SIGHUP handler!");
+		return false;
+	}
+
+	act.sa_handler = fatalSignalHandler;
+
+	for (size_t i = 0; i < FATAL_SIGNAL_COUNT; i++)
+	{
+		if (sigaction(FATAL_SIGNALS[i], &act, &previousFatalActions[i]) != 0)
+		{
+			LOG_ERROR(log, "Failed to register handler of fatal signal %d!", FATAL_SIGNALS[i]);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Applies the configured log settings.
+ */
+void applyLogSettings(Logger* log, const ServerConfig* config)
+{
+	Logger_SetLevel(log, config->logLevel);
+	Logger_SetFullPolicy(log, config->logFullPolicy);
+
+	// Validated when loading, so this only fails on allocation failure.
+	if (!Logger_SetModuleLevels(log, config->logModuleLevels))
+	{
+		LOG_ERROR(log, "Failed to set module log levels.");
+	}
+}
+
+/**
+ * Reloads configuration until shutdown starts.
+ */
+void reloadLoop(Logger* log, ServerConfig* config, IrcCmdQueue* cmds)
+{
+	while (Application_WaitForReload())
+	{
+		if (!ServerConfig_Reload(config, log))
+			continue;
+
+		applyLogSettings(log, config);
+
+		if (!IrcCmdQueue_SetQuantum(cmds, atomic_load(&config->cmdQueueQuantum)))
+		{
+			LOG_ERROR(log, "Failed to change command queue quantum.");
+		}
+	}
+}
+
+bool startRunners(const Logger* log, const ServerConfig* config, TaskQueue* tasks,
+		TaskRunner** runners)
+{
+	for (size_t i = 0; i < config->runnerCount; i++)
+	{
+		// Thread names are limited to 15 characters.
+		char name[16];
+		snprintf(name, sizeof(name), "amn-runner-%zu", i % SERVER_CONFIG_MAX_RUNNERS);
+
+		int cpu = config->runnerCpuCount > 0
+			? config->runnerCpus[i % config->runnerCpuCount]
+			: -1;
+
+		runners[i] = TaskRunner_New((Logger*) log, tasks, name, cpu);
+		if (runners[i] == NULL)
+		{
+			LOG_ERROR(log, "Failed to create runner %zu.", i);
+			return false;
+		}
+	}
+
 	return true;
 }
 
-int main()
+int main(int argc, char** argv)
 {
 	int returnCode = EXIT_FAILURE;
 	Logger* log = Logger_Create(&stdout, 1);
+	ServerConfig* config = NULL;
 	TaskQueue* tasks = NULL;
-	TaskRunner* runners[RUNNER_COUNT] = {0};
+	TaskRunner** runners = NULL;
 	IrcCmdQueue* cmds = NULL;
+	ReceiveMsgShared* receiveShared = NULL;
 
 	LOG_INFO(log, "Server starting");
 
+	if (argc > 2)
+	{
+		LOG_ERROR(log, "Usage: %s [config file]", argv[0]);
+		goto cleanup;
+	}
+
+	config = ServerConfig_Load(log, argc == 2 ? argv[1] : NULL);
+	if (config == NULL)
+		goto cleanup;
+
+	applyLogSettings(log, config);
+
+	if (!FlightRecorder_SetPath(config->flightRecorderPath))
+	{
+		LOG_ERROR(log, "Flight recorder path %s is too long.", config->flightRecorderPath);
+		goto cleanup;
+	}
+
+	if (config->logBinaryPath != NULL && !Logger_OpenBinaryFile(log, config->logBinaryPath))
+	{
+		LOG_ERROR(log, "Failed to open binary log file %s.", config->logBinaryPath);
+		goto cleanup;
+	}
+
+	if (!Application_Init())
+	{
+		LOG_ERROR(log, "Failed to create shutdown eventfd!");
+		goto cleanup;
+	}
+
+	fatalLog = log;
+
 	if (!setupSignals(log))
 		goto cleanup;
 
-	tasks = TaskQueue_New(256, TIMEOUT);
+	tasks = TaskQueue_New(config->taskQueueCapacity);
 	if (tasks == NULL)
 		goto cleanup;
 
-	cmds = IrcCmdQueue_New(1024, TIMEOUT);
+	cmds = IrcCmdQueue_New(config->connCmdQueueCapacity, atomic_load(&config->cmdQueueQuantum));
 	if (cmds == NULL)
 		goto cleanup;
 
-	for (size_t i = 0; i < RUNNER_COUNT; i++)
+	receiveShared = ReceiveMsgShared_New(log);
+	if (receiveShared == NULL)
 	{
-		runners[i] = TaskRunner_New(log, tasks);
-		if (runners[i] == NULL)
-		{
-			LOG_ERROR(log, "Failed to create runner %zu.", i);
-			goto cleanup;
-		}
+		LOG_ERROR(log, "Failed to create receive parsers and buffers.");
+		goto cleanup;
 	}
 
-	Task* cmdExecutorTask = IrcCmdExecutorTask_New(log, tasks, cmds, SERVER_NAME);
+	runners = calloc(config->runnerCount, sizeof(TaskRunner*));
+	if (runners == NULL)
+		goto cleanup;
+
+	if (!startRunners(log, config, tasks, runners))
+		goto cleanup;
+
+	Task* cmdExecutorTask = IrcCmdExecutorTask_New(
+			log, tasks, cmds, runners, config->runnerCount, config);
 	if (cmdExecutorTask == NULL)
 	{
 		LOG_ERROR(log, "Failed to create command executor task.");
@@ -213,9 +439,16 @@ int main()
 		goto cleanup;
 	}
 
-	if(!StartServer(log, tasks, cmds))
+	if(!StartServer(log, tasks, cmds, config, receiveShared))
+		goto cleanup;
+
+	if (config->metricsSocketPath != NULL && !StartMetricsExport(
+			log, tasks, cmds, runners, config->runnerCount, config->metricsSocketPath))
 		goto cleanup;
 
+	LOG_INFO(log, "Server started");
+
+	reloadLoop(log, config, cmds);
 
 	returnCode = EXIT_SUCCESS;
 
@@ -227,14 +460,41 @@ cleanup:
 		Application_StartShutdown();
 	}
 
-	for (size_t i = 0; i < RUNNER_COUNT; i++)
+	struct timespec shutdownStart;
+	clock_gettime(CLOCK_MONOTONIC, &shutdownStart);
+
+	// Wake up runners blocked on the queues, the others are woken by the eventfd.
+	if (cmds != NULL)
+		IrcCmdQueue_Shutdown(cmds);
+	if (tasks != NULL)
+		TaskQueue_Shutdown(tasks);
+
+	// All are joined first, the metrics export task may read any of them until its runner exits.
+	for (size_t i = 0; runners != NULL && i < config->runnerCount; i++)
+	{
+		TaskRunner_Join(runners[i]);
+	}
+
+	struct timespec shutdownEnd;
+	clock_gettime(CLOCK_MONOTONIC, &shutdownEnd);
+
+	for (size_t i = 0; runners != NULL && i < config->runnerCount; i++)
 	{
 		TaskRunner_Delete(runners[i]);
 	}
+	free(runners);
+
+	LOG_INFO(log, "Runners stopped in %ldus.",
+			(shutdownEnd.tv_sec - shutdownStart.tv_sec) * 1000000
+			+ (shutdownEnd.tv_nsec - shutdownStart.tv_nsec) / 1000);
 
 	IrcCmdQueue_Delete(cmds);
+	ReceiveMsgShared_Delete(receiveShared);
 
 	TaskQueue_Delete(tasks);
+	ServerConfig_Delete(config);
+	Application_Cleanup();
+	fatalLog = NULL;
 	Logger_Destroy(log);
 
 	return returnCode;
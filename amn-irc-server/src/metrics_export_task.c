@@ -0,0 +1,417 @@
+#include "metrics_export_task.h"
+
+#include "application.h"
+#include "metrics.h"
+#include "str_utils.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+// Scrapers that take longer to send their request or read the response are dropped,
+// so a stuck one can't hold the runner.
+#define SCRAPE_TIMEOUT_MS 1000
+#define MAX_REQUEST_BYTES 4096
+#define INITIAL_RESPONSE_BYTES 16384
+
+#define RESPONSE_HEADER \
+	"HTTP/1.0 200 OK\r\n" \
+	"Content-Type: text/plain; version=0.0.4\r\n" \
+	"Connection: close\r\n" \
+	"\r\n"
+
+typedef struct MetricsExportContext
+{
+	const Logger* log;
+	TaskQueue* tasks;
+	IrcCmdQueue* cmds;
+	TaskRunner** runners;
+	size_t runnerCount;
+	int socket;
+	// Unlinked when the task is deleted.
+	char* path;
+}
+MetricsExportContext;
+
+// Growing buffer the response is written to.
+typedef struct Text
+{
+	char* chars;
+	size_t len;
+	size_t capacity;
+}
+Text;
+
+static const char* const TYPE_NAMES[] = {
+	[MetricType_Counter] = "counter",
+	[MetricType_Gauge] = "gauge",
+	// Exported as quantiles, which are what the text format can show without
+	// hundreds of buckets per histogram.
+	[MetricType_Histogram] = "summary",
+};
+
+static const double QUANTILES[] = { 0.5, 0.9, 0.99, 0.999 };
+
+static TaskStatus WaitForScrapes(void* context);
+static void DeleteContext(void* context);
+static void Serve(MetricsExportContext* ctx, int client);
+static bool ReadRequest(int client);
+static bool WriteSnapshot(MetricsExportContext* ctx, Text* text);
+static bool WriteMetric(Text* text, Metric* metric);
+static bool WriteRunners(MetricsExportContext* ctx, Text* text);
+static bool Text_Append(Text* self, const char* format, ...);
+static bool SendAll(int socket, const char* data, size_t len);
+
+Task* MetricsExportTask_New(const Logger* log, TaskQueue* tasks, IrcCmdQueue* cmds,
+		TaskRunner** runners, size_t runnerCount, int socket, const char* path)
+{
+	MetricsExportContext* context = malloc(sizeof(MetricsExportContext));
+	if (context == NULL)
+	{
+		return NULL;
+	}
+
+	context->log = log;
+	context->tasks = tasks;
+	context->cmds = cmds;
+	context->runners = runners;
+	context->runnerCount = runnerCount;
+	context->socket = socket;
+	context->path = StrUtils_Clone(path);
+
+	if (context->path == NULL)
+	{
+		free(context);
+		return NULL;
+	}
+
+	Task* self = Task_Create(WaitForScrapes, context, DeleteContext);
+	if (self == NULL)
+	{
+		free(context->path);
+		free(context);
+		return NULL;
+	}
+
+	return self;
+}
+
+static void DeleteContext(void* arg)
+{
+	MetricsExportContext* ctx = (MetricsExportContext*) arg;
+
+	if (close(ctx->socket) != 0)
+	{
+		LOG_ERROR(ctx->log, "Failed to close metrics socket.");
+	}
+
+	if (unlink(ctx->path) != 0)
+	{
+		LOG_WARN(ctx->log, "Failed to remove metrics socket %s.", ctx->path);
+	}
+
+	free(ctx->path);
+	free(ctx);
+}
+
+static TaskStatus WaitForScrapes(void* arg)
+{
+	MetricsExportContext* ctx = (MetricsExportContext*) arg;
+
+	if (!Application_WaitReadable(ctx->socket, -1) && errno != EINTR)
+	{
+		LOG_ERROR(ctx->log, "Failed to wait for metrics scrapes.");
+		return TaskStatus_Failed;
+	}
+
+	if (Application_ShouldShutdown())
+	{
+		return TaskStatus_Done;
+	}
+
+	int client = accept(ctx->socket, NULL, NULL);
+	if (client == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+	{
+		errno = 0;
+		return TaskStatus_Yield;
+	}
+	else if (client == -1)
+	{
+		LOG_ERROR(ctx->log, "Failed to accept metrics scrape.");
+		return TaskStatus_Failed;
+	}
+
+	Serve(ctx, client);
+
+	if (close(client) != 0)
+	{
+		LOG_WARN(ctx->log, "Failed to close metrics scrape socket.");
+	}
+
+	errno = 0;
+
+	return TaskStatus_Yield;
+}
+
+static void Serve(MetricsExportContext* ctx, int client)
+{
+	struct timeval timeout = {
+		.tv_sec = SCRAPE_TIMEOUT_MS / 1000,
+		.tv_usec = (SCRAPE_TIMEOUT_MS % 1000) * 1000,
+	};
+
+	if (setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == -1
+			|| setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) == -1)
+	{
+		LOG_WARN(ctx->log, "Failed to set metrics scrape timeouts.");
+		return;
+	}
+
+	if (!ReadRequest(client))
+	{
+		LOG_DEBUG(ctx->log, "Dropped metrics scrape without a request.");
+		return;
+	}
+
+	Text text = {
+		.chars = malloc(INITIAL_RESPONSE_BYTES),
+		.len = 0,
+		.capacity = INITIAL_RESPONSE_BYTES,
+	};
+
+	if (text.chars == NULL
+			|| !Text_Append(&text, "%s", RESPONSE_HEADER)
+			|| !WriteSnapshot(ctx, &text))
+	{
+		LOG_ERROR(ctx->log, "Failed to write metrics snapshot.");
+	}
+	else if (!SendAll(client, text.chars, text.len))
+	{
+		LOG_DEBUG(ctx->log, "Failed to send metrics snapshot.");
+	}
+
+	free(text.chars);
+}
+
+/**
+ * Reads the request up to its empty line. Its contents don't matter, every
+ * request gets the snapshot.
+ * @return False if the scraper went away or timed out before sending it.
+ */
+static bool ReadRequest(int client)
+{
+	char request[MAX_REQUEST_BYTES + 1];
+	size_t len = 0;
+
+	while (len < MAX_REQUEST_BYTES)
+	{
+		ssize_t received = recv(client, request + len, MAX_REQUEST_BYTES - len, 0);
+		if (received == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		else if (received <= 0)
+		{
+			// Closing its end after the request is fine too.
+			return received == 0 && len > 0;
+		}
+
+		len += (size_t) received;
+		request[len] = '\0';
+
+		if (strstr(request, "\r\n\r\n") != NULL || strstr(request, "\n\n") != NULL)
+		{
+			return true;
+		}
+	}
+
+	return true;
+}
+
+static bool WriteSnapshot(MetricsExportContext* ctx, Text* text)
+{
+	size_t count = Metrics_Count();
+
+	for (size_t i = 0; i < count; i++)
+	{
+		Metric* metric = Metrics_At(i);
+
+		// Metrics sharing a name, with different labels, are written together
+		// under the first one's help.
+		bool written = false;
+		for (size_t j = 0; j < i && !written; j++)
+		{
+			written = StrUtils_Equals(Metrics_At(j)->name, metric->name);
+		}
+
+		if (written)
+		{
+			continue;
+		}
+
+		if (!Text_Append(text, "# HELP %s %s\n# TYPE %s %s\n",
+				metric->name, metric->help, metric->name, TYPE_NAMES[metric->type]))
+		{
+			return false;
+		}
+
+		for (size_t j = i; j < count; j++)
+		{
+			Metric* other = Metrics_At(j);
+
+			if (StrUtils_Equals(other->name, metric->name) && !WriteMetric(text, other))
+			{
+				return false;
+			}
+		}
+	}
+
+	return WriteRunners(ctx, text)
+		&& Text_Append(text, "# HELP amn_task_queue_high_water Most tasks queued at once.\n"
+				"# TYPE amn_task_queue_high_water gauge\n"
+				"amn_task_queue_high_water %zu\n", TaskQueue_HighWater(ctx->tasks))
+		&& Text_Append(text, "# HELP amn_cmd_queue_high_water Most commands queued at once.\n"
+				"# TYPE amn_cmd_queue_high_water gauge\n"
+				"amn_cmd_queue_high_water %zu\n", IrcCmdQueue_HighWater(ctx->cmds));
+}
+
+static bool WriteMetric(Text* text, Metric* metric)
+{
+	bool labeled = metric->labels != NULL;
+	const char* labels = labeled ? metric->labels : "";
+	// Braces around the labels, left out if there are none.
+	const char* openBrace = labeled ? "{" : "";
+	const char* closeBrace = labeled ? "}" : "";
+
+	if (metric->type != MetricType_Histogram)
+	{
+		return Text_Append(text, "%s%s%s%s %" PRId64 "\n",
+				metric->name, openBrace, labels, closeBrace, Metric_Value(metric));
+	}
+
+	MetricHistogram histogram;
+	Metric_ReadHistogram(metric, &histogram);
+
+	for (size_t i = 0; i < sizeof(QUANTILES) / sizeof(double); i++)
+	{
+		double seconds = (double) MetricHistogram_Percentile(&histogram, QUANTILES[i] * 100) / 1e9;
+
+		// Quantiles of nothing are NaN in Prometheus, rather than zero.
+		if (!Text_Append(text, histogram.count > 0
+					? "%s{%s%squantile=\"%g\"} %.9f\n"
+					: "%s{%s%squantile=\"%g\"} NaN\n",
+				metric->name, labels, labeled ? "," : "", QUANTILES[i], seconds))
+		{
+			return false;
+		}
+	}
+
+	return Text_Append(text, "%s_sum%s%s%s %.9f\n%s_count%s%s%s %" PRIu64 "\n",
+			metric->name, openBrace, labels, closeBrace, (double) histogram.sum / 1e9,
+			metric->name, openBrace, labels, closeBrace, histogram.count);
+}
+
+static bool WriteRunners(MetricsExportContext* ctx, Text* text)
+{
+	// Runners are being joined.
+	if (Application_ShouldShutdown())
+	{
+		return true;
+	}
+
+	static const char* const NAMES[] = {
+		"amn_runner_busy_seconds_total",
+		"amn_runner_idle_seconds_total",
+	};
+	static const char* const HELPS[] = {
+		"CPU time of each runner thread.",
+		"Time each runner waited for tasks or was blocked in them.",
+	};
+
+	for (size_t kind = 0; kind < 2; kind++)
+	{
+		if (!Text_Append(text, "# HELP %s %s\n# TYPE %s counter\n",
+				NAMES[kind], HELPS[kind], NAMES[kind]))
+		{
+			return false;
+		}
+
+		for (size_t i = 0; i < ctx->runnerCount; i++)
+		{
+			uint64_t times[2];
+			if (!TaskRunner_Times(ctx->runners[i], &times[0], &times[1]))
+			{
+				continue;
+			}
+
+			if (!Text_Append(text, "%s{runner=\"%zu\"} %.9f\n",
+					NAMES[kind], i, (double) times[kind] / 1e9))
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+static bool Text_Append(Text* self, const char* format, ...)
+{
+	while (true)
+	{
+		va_list args;
+		va_start(args, format);
+		int appended = vsnprintf(self->chars + self->len, self->capacity - self->len, format, args);
+		va_end(args);
+
+		if (appended < 0)
+		{
+			return false;
+		}
+
+		if ((size_t) appended < self->capacity - self->len)
+		{
+			self->len += (size_t) appended;
+			return true;
+		}
+
+		size_t capacity = self->capacity * 2 + (size_t) appended;
+		char* chars = realloc(self->chars, capacity);
+		if (chars == NULL)
+		{
+			return false;
+		}
+
+		self->chars = chars;
+		self->capacity = capacity;
+	}
+}
+
+static bool SendAll(int socket, const char* data, size_t len)
+{
+	size_t sent = 0;
+	while (sent < len)
+	{
+		// The scraper may be gone already, which mustn't raise SIGPIPE.
+		ssize_t bytesSent = send(socket, data + sent, len - sent, MSG_NOSIGNAL);
+		if (bytesSent == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		else if (bytesSent == -1)
+		{
+			return false;
+		}
+
+		sent += (size_t) bytesSent;
+	}
+
+	return true;
+}
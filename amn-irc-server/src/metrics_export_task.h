@@ -0,0 +1,26 @@
+#ifndef AMN_METRICS_EXPORT_TASK_H
+#define AMN_METRICS_EXPORT_TASK_H
+
+#include "log.h"
+#include "task.h"
+#include "task_queue.h"
+#include "task_runner.h"
+#include "irc_cmd_queue.h"
+
+#include <stddef.h>
+
+/**
+  * Task serving metrics to scrapers on a Unix socket, so they don't go
+  * through IRC or the command executor. Every connection gets one HTTP/1.0
+  * response with a snapshot in the Prometheus text format, e.g.
+  * curl --unix-socket path http://localhost/metrics
+  *
+  * The snapshot has every registered metric, histograms as summaries, and
+  * the busy and idle time of each runner and the high-water marks of the
+  * queues.
+  */
+Task* MetricsExportTask_New(const Logger* log, TaskQueue* tasks, IrcCmdQueue* cmds,
+		TaskRunner** runners, size_t runnerCount, int socket, const char* path);
+
+
+#endif // AMN_METRICS_EXPORT_TASK_H
@@ -1,10 +1,16 @@
 #include "receive_msg_task.h"
 
+#include "application.h"
+#include "flood_control.h"
 #include "irc_msg_reader.h"
 #include "irc_msg_parser.h"
 #include "irc_cmd_parser.h"
+#include "metrics.h"
+#include "probes.h"
 
 #include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <stdlib.h>
 
 #include <sys/socket.h>
@@ -15,23 +21,105 @@ typedef struct ReceiveMsgContext
 	const Logger* log;
 	TaskQueue* tasks;
 	IrcCmdQueue* cmds;
+	const ServerConfig* config;
+
+	const ReceiveMsgShared* shared;
 
 	int socket;
 	IrcMsgReader* reader;
+	FloodControl flood;
+	// Messages until the next one whose trace is logged, see traceLogEvery.
+	size_t traceLogCountdown;
+}
+ReceiveMsgContext;
+
+struct ReceiveMsgShared
+{
 	IrcMsgValidator* validator;
 	IrcMsgParser* msgParser;
 	IrcCmdParser* cmdParser;
-}
-ReceiveMsgContext;
+	BufferPool* buffers;
+};
+
+static Metric ReceivedBytes = METRIC_COUNTER("amn_receive_bytes_total",
+		"Bytes read from clients.");
+static Metric ReceivedLines = METRIC_COUNTER("amn_receive_lines_total",
+		"Messages read from clients.");
+static Metric ParseFailures = METRIC_COUNTER("amn_receive_parse_failures_total",
+		"Messages or commands from clients that failed to parse.");
+static Metric Connections = METRIC_GAUGE("amn_connections",
+		"Connected clients.");
+
+// Read buffers are only borrowed while processing received data, so the pool
+// grows up to about one buffer per runner thread.
+#define READ_BUFFERS_PER_SLAB 16
 
 static ReceiveMsgContext* ReceiveMsgContext_New(
-		const Logger* log, TaskQueue* tasks, IrcCmdQueue* cmds, int socket);
+		const Logger* log, TaskQueue* tasks, IrcCmdQueue* cmds, const ServerConfig* config,
+		const ReceiveMsgShared* shared, int socket);
 static void ReceiveMsgContext_Delete(void* context);
 static TaskStatus ReadMessages(void* context);
+static TaskStatus ReceiveMessages(ReceiveMsgContext* ctx);
+static TaskStatus HandleMessage(ReceiveMsgContext* ctx, const char* rawMsg,
+		uint64_t readNs, bool sampled);
+static bool ShouldLogTrace(ReceiveMsgContext* ctx);
+static bool WaitForFloodControl(ReceiveMsgContext* ctx);
+
+ReceiveMsgShared* ReceiveMsgShared_New(const Logger* log)
+{
+	Metric_Register(&ReceivedBytes);
+	Metric_Register(&ReceivedLines);
+	Metric_Register(&ParseFailures);
+	Metric_Register(&Connections);
+
+	ReceiveMsgShared* self = malloc(sizeof(ReceiveMsgShared));
+	if (self == NULL)
+		return NULL;
+
+	*self = (ReceiveMsgShared) {0};
+
+	self->validator = IrcMsgValidator_New(log);
+	if (self->validator == NULL)
+		goto error;
+
+	self->msgParser = IrcMsgParser_New(log, self->validator);
+	if (self->msgParser == NULL)
+		goto error;
+
+	self->cmdParser = IrcCmdParser_New(log, self->validator);
+	if (self->cmdParser == NULL)
+		goto error;
+
+	self->buffers = BufferPool_New(IRC_MSG_READER_BUFFER_SIZE, READ_BUFFERS_PER_SLAB);
+	if (self->buffers == NULL)
+		goto error;
+
+	return self;
+error:
+	ReceiveMsgShared_Delete(self);
+	return NULL;
+}
 
-Task* ReceiveMsgTask_New(const Logger* log, TaskQueue* tasks, IrcCmdQueue* cmds, int socket)
+void ReceiveMsgShared_Delete(ReceiveMsgShared* self)
 {
-	ReceiveMsgContext* context = ReceiveMsgContext_New(log, tasks, cmds, socket);
+	if (self == NULL)
+	{
+		return;
+	}
+
+	// These functions are all safe to call with null.
+	BufferPool_Delete(self->buffers);
+	IrcCmdParser_Delete(self->cmdParser);
+	IrcMsgParser_Delete(self->msgParser);
+	IrcMsgValidator_Delete(self->validator);
+	free(self);
+}
+
+Task* ReceiveMsgTask_New(const Logger* log, TaskQueue* tasks, IrcCmdQueue* cmds,
+		const ServerConfig* config, const ReceiveMsgShared* shared, int socket)
+{
+	ReceiveMsgContext* context = ReceiveMsgContext_New(
+			log, tasks, cmds, config, shared, socket);
 	if (context == NULL)
 	{
 		return NULL;
@@ -40,7 +128,9 @@ Task* ReceiveMsgTask_New(const Logger* log, TaskQueue* tasks, IrcCmdQueue* cmds,
 	Task* self = Task_Create(ReadMessages, context, ReceiveMsgContext_Delete);
 	if (self == NULL)
 	{
-		free(context);
+		// Undoes the rest of the context, the socket goes back to the caller.
+		context->socket = -1;
+		ReceiveMsgContext_Delete(context);
 		return NULL;
 	}
 
@@ -48,7 +138,8 @@ Task* ReceiveMsgTask_New(const Logger* log, TaskQueue* tasks, IrcCmdQueue* cmds,
 }
 
 static ReceiveMsgContext* ReceiveMsgContext_New(
-		const Logger* log, TaskQueue* tasks, IrcCmdQueue* cmds, int socket)
+		const Logger* log, TaskQueue* tasks, IrcCmdQueue* cmds, const ServerConfig* config,
+		const ReceiveMsgShared* shared, int socket)
 {
 	ReceiveMsgContext* ctx = malloc(sizeof(ReceiveMsgContext));
 	if (ctx == NULL)
@@ -58,34 +149,22 @@ static ReceiveMsgContext* ReceiveMsgContext_New(
 	ctx->log = log;
 	ctx->tasks = tasks;
 	ctx->cmds = cmds;
+	ctx->config = config;
+	ctx->shared = shared;
 	ctx->socket = socket;
+	FloodControl_Init(&ctx->flood, atomic_load(&config->floodBurstMs));
 
-	ctx->reader = IrcMsgReader_New(log, socket);
+	ctx->reader = IrcMsgReader_New(log, shared->buffers, socket);
 	if (ctx->reader == NULL)
-		goto error;
-
-	ctx->validator = IrcMsgValidator_New(ctx->log);
-	if (ctx->validator == NULL)
-		goto error;
-
-	ctx->msgParser = IrcMsgParser_New(ctx->log, ctx->validator);
-	if (ctx->msgParser == NULL)
-		goto error;
+	{
+		free(ctx);
+		// On failure the socket ownership return to the caller, so don't close it.
+		return NULL;
+	}
 
-	ctx->cmdParser = IrcCmdParser_New(ctx->log, ctx->validator);
-	if (ctx->cmdParser == NULL)
-		goto error;
+	Metric_Add(&Connections, 1);
 
 	return ctx;
-error:
-	// These functions are all safe to call with null.
-	IrcCmdParser_Delete(ctx->cmdParser);
-	IrcMsgParser_Delete(ctx->msgParser);
-	IrcMsgValidator_Delete(ctx->validator);
-	IrcMsgReader_Delete(ctx->reader);
-	free(ctx);
-	// On failure the socket ownership return to the caller, so don't close it.
-	return NULL;
 }
 
 static void ReceiveMsgContext_Delete(void* arg)
@@ -97,16 +176,15 @@ static void ReceiveMsgContext_Delete(void* arg)
 
 	ReceiveMsgContext* ctx = (ReceiveMsgContext*) arg;
 
-	IrcCmdParser_Delete(ctx->cmdParser);
-	IrcMsgParser_Delete(ctx->msgParser);
-	IrcMsgValidator_Delete(ctx->validator);
 	IrcMsgReader_Delete(ctx->reader);
 
-	if (close(ctx->socket) != 0)
+	if (ctx->socket != -1 && close(ctx->socket) != 0)
 	{
 		LOG_ERROR(ctx->log, "Failed to close listen socket.");
 	}
 
+	Metric_Add(&Connections, -1);
+
 	free(ctx);
 }
 
@@ -114,39 +192,113 @@ static TaskStatus ReadMessages(void* arg)
 {
 	ReceiveMsgContext* ctx = (ReceiveMsgContext*) arg;
 
-	errno = 0;
-	const char* rawMsg = IrcMsgReader_Read(ctx->reader);
-	if (rawMsg == NULL && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+	AMN_PROBE1(read_start, ctx->socket);
+
+	TaskStatus status = ReceiveMessages(ctx);
+
+	AMN_PROBE2(read_done, ctx->socket, (int) status);
+
+	return status;
+}
+
+static TaskStatus ReceiveMessages(ReceiveMsgContext* ctx)
+{
+	if (!WaitForFloodControl(ctx))
 	{
-		// Socket timeout
-		// LOG_DEBUG(ctx->log, "Timeout while reading message.");
+		// Still over the limit, leave the data in the socket so TCP pushes back
+		// on the client.
 		return TaskStatus_Yield;
 	}
-	else if (rawMsg == NULL)
+
+	errno = 0;
+	bool filled = IrcMsgReader_Fill(ctx->reader);
+	if (!filled && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+	{
+		// Interrupted, either by a signal or shutdown.
+		return Application_ShouldShutdown() ? TaskStatus_Done : TaskStatus_Yield;
+	}
+	else if (!filled)
 	{
-		LOG_ERROR(ctx->log, "Failed to read message.");
+		// The client closing the connection, or dropping it, is how sessions
+		// normally end, only other errors fail the task.
+		bool disconnected = errno == 0 || errno == ECONNRESET;
+		if (!disconnected)
+		{
+			LOG_ERROR(ctx->log, "Failed to read message.");
+		}
 
 		IrcCmd* quit = IrcCmd_Clone(&(IrcCmd) {
 			.peerSocket = ctx->socket,
 			.type = IrcCmdType_Quit,
+			.priority = IrcCmdPriority_Control,
 			.quit = {
-				.quitMessage = "Connection error"
+				.quitMessage = disconnected ? "Connection closed" : "Connection error"
 			}
 		});
 
 		if (!IrcCmdQueue_Push(ctx->cmds, quit))
 		{
+			IrcCmd_Delete(quit);
+
+			if (errno == ECANCELED)
+			{
+				// Shutting down.
+				return TaskStatus_Done;
+			}
+
 			LOG_ERROR(ctx->log, "Failed to add command to queue");
 			return TaskStatus_Failed;
 		}
 
-		return TaskStatus_Failed;
+		return disconnected ? TaskStatus_Done : TaskStatus_Failed;
+	}
+
+	AMN_PROBE2(read_filled, ctx->socket, IrcMsgReader_LastReadLen(ctx->reader));
+
+	Metric_Add(&ReceivedBytes, (int64_t) IrcMsgReader_LastReadLen(ctx->reader));
+
+	// Messages of sampled reads are traced, see MsgTrace. With trace logging on
+	// any of them may be logged, so every read needs its time.
+	uint64_t readNs = Metrics_SampleNs();
+	bool sampled = readNs != 0;
+	if (!sampled && atomic_load_explicit(&ctx->config->traceLogEvery, memory_order_relaxed) != 0)
+	{
+		readNs = Metrics_NowNs();
+	}
+
+	// Messages are handled until the client goes over its flood limit. The
+	// rest stay in the reader, and are handled once flood control lets the
+	// client go on, before the socket is read again.
+	const char* rawMsg;
+	int64_t lines = 0;
+	TaskStatus status = TaskStatus_Yield;
+	while (status == TaskStatus_Yield && (rawMsg = IrcMsgReader_Next(ctx->reader)) != NULL)
+	{
+		lines++;
+		status = HandleMessage(ctx, rawMsg, readNs, sampled);
+
+		if (status == TaskStatus_Yield && FloodControl_Delay(&ctx->flood) != 0)
+		{
+			break;
+		}
 	}
 
-	IrcMsg* msg = IrcMsgParser_Parse(ctx->msgParser, rawMsg);
+	// Counted once per read rather than per message, as this is the hot path.
+	Metric_Add(&ReceivedLines, lines);
+
+	return status;
+}
+
+static TaskStatus HandleMessage(ReceiveMsgContext* ctx, const char* rawMsg,
+		uint64_t readNs, bool sampled)
+{
+	IrcMsg* msg = IrcMsgParser_Parse(ctx->shared->msgParser, rawMsg);
 	if (msg == NULL)
 	{
 		LOG_WARN(ctx->log, "Failed to parse message.");
+		AMN_PROBE2(parse_fail, ctx->socket, (int) IrcCmdType_Null);
+		Metric_Add(&ParseFailures, 1);
+		FloodControl_Charge(&ctx->flood, IrcCmdType_Null);
 		return TaskStatus_Yield;
 	}
 
@@ -161,32 +313,95 @@ static TaskStatus ReadMessages(void* arg)
 			"\tParams 03: %s\n"
 			"\tParams 04: %s\n"
 			"\tParams 05: %s\n",
-			msg->prefix.origin != NULL ? msg->prefix.origin : "[NULL]",
-			msg->prefix.username != NULL ? msg->prefix.username : "[NULL]",
-			msg->prefix.hostname != NULL ? msg->prefix.hostname : "[NULL]",
+			IrcMsg_Origin(msg) != NULL ? IrcMsg_Origin(msg) : "[NULL]",
+			IrcMsg_Username(msg) != NULL ? IrcMsg_Username(msg) : "[NULL]",
+			IrcMsg_Hostname(msg) != NULL ? IrcMsg_Hostname(msg) : "[NULL]",
 			msg->cmd,
 			msg->paramCount,
-			msg->paramCount >= 1 ? msg->params[0] : "[EMPTY]",
-			msg->paramCount >= 2 ? msg->params[1] : "[EMPTY]",
-			msg->paramCount >= 3 ? msg->params[2] : "[EMPTY]",
-			msg->paramCount >= 4 ? msg->params[3] : "[EMPTY]",
-			msg->paramCount >= 5 ? msg->params[4] : "[EMPTY]");
-
-	IrcCmd* cmd = IrcCmdParser_Parse(ctx->cmdParser, msg, ctx->socket);
-	IrcMsg_Delete(msg);
+			msg->paramCount >= 1 ? IrcMsg_Param(msg, 0) : "[EMPTY]",
+			msg->paramCount >= 2 ? IrcMsg_Param(msg, 1) : "[EMPTY]",
+			msg->paramCount >= 3 ? IrcMsg_Param(msg, 2) : "[EMPTY]",
+			msg->paramCount >= 4 ? IrcMsg_Param(msg, 3) : "[EMPTY]",
+			msg->paramCount >= 5 ? IrcMsg_Param(msg, 4) : "[EMPTY]");
+
+	FloodControl_Charge(&ctx->flood, msg->cmd);
+
+	// For the probes, the message is gone if parsing fails.
+	int cmdType = (int) msg->cmd;
+
+	// Takes the message, the command keeps it for its views.
+	IrcCmd* cmd = IrcCmdParser_Parse(ctx->shared->cmdParser, msg, ctx->socket);
 	if (cmd == NULL)
 	{
 		// TODO: Send validation error replies
 		LOG_WARN(ctx->log, "Failed to parse command.");
+		AMN_PROBE2(parse_fail, ctx->socket, cmdType);
+		Metric_Add(&ParseFailures, 1);
 		return TaskStatus_Yield;
 	}
 
+	AMN_PROBE2(parse_ok, ctx->socket, cmdType);
+
+	MsgTrace_Begin(&cmd->trace, readNs, sampled, readNs != 0 && ShouldLogTrace(ctx));
+	MsgTrace_Stamp(&cmd->trace, MsgTraceStage_Parsed);
+
 	if (!IrcCmdQueue_Push(ctx->cmds, cmd))
 	{
 		IrcCmd_Delete(cmd);
+
+		if (errno == ECANCELED)
+		{
+			// Shutting down.
+			return TaskStatus_Done;
+		}
+
 		LOG_ERROR(ctx->log, "Failed to add command to queue");
 		return TaskStatus_Failed;
 	}
 
 	return TaskStatus_Yield;
 }
+
+/**
+ * Counts down traceLogEvery messages.
+ */
+static bool ShouldLogTrace(ReceiveMsgContext* ctx)
+{
+	size_t every = atomic_load_explicit(&ctx->config->traceLogEvery, memory_order_relaxed);
+	if (every == 0)
+	{
+		return false;
+	}
+
+	// Also restarts the count when a reload lowered it.
+	if (ctx->traceLogCountdown == 0 || ctx->traceLogCountdown > every)
+	{
+		ctx->traceLogCountdown = every;
+	}
+
+	return --ctx->traceLogCountdown == 0;
+}
+
+/**
+ * Sleeps while the client is over its flood limit, or until shutdown.
+ * Returns true if the client may be read from.
+ */
+static bool WaitForFloodControl(ReceiveMsgContext* ctx)
+{
+	// Picks up configuration reloads.
+	ctx->flood.burstMs = atomic_load(&ctx->config->floodBurstMs);
+
+	uint64_t delayMs = FloodControl_Delay(&ctx->flood);
+	if (delayMs == 0)
+	{
+		return true;
+	}
+
+	LOG_DEBUG(ctx->log, "Client flooding, not reading for %" PRIu64 "ms.", delayMs);
+
+	// Interruptions are fine, the caller yields and checks for shutdown.
+	Application_WaitReadable(-1, delayMs < INT_MAX ? (int) delayMs : INT_MAX);
+	errno = 0;
+
+	return FloodControl_Delay(&ctx->flood) == 0;
+}
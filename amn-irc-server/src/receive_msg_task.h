@@ -5,11 +5,22 @@
 #include "task.h"
 #include "task_queue.h"
 #include "irc_cmd_queue.h"
+#include "server_config.h"
+
+/**
+  * Parsers and read buffers shared by every client's ReceiveMsgTask.
+  * It must outlive the tasks.
+  */
+typedef struct ReceiveMsgShared ReceiveMsgShared;
+
+ReceiveMsgShared* ReceiveMsgShared_New(const Logger* log);
+void ReceiveMsgShared_Delete(ReceiveMsgShared* self);
 
 /**
   * Task to reading incoming messages from one client. 
   */
-Task* ReceiveMsgTask_New(const Logger* log, TaskQueue* tasks, IrcCmdQueue* cmds, int socket);
+Task* ReceiveMsgTask_New(const Logger* log, TaskQueue* tasks, IrcCmdQueue* cmds,
+		const ServerConfig* config, const ReceiveMsgShared* shared, int socket);
 
 #endif // AMN_RECEIVE_MSG_TASK_H
 
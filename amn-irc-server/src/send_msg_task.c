@@ -1,27 +1,45 @@
 #include "send_msg_task.h"
 
-#include "irc_msg_unparser.h"
 #include "irc_msg_writer.h"
+#include "metrics.h"
+#include "obj_pool.h"
 
 #include <stdlib.h>
 
 typedef struct SendMsgContext
 {
 	const Logger* log;
-	IrcMsg* msg;
+	char* rawMsg;
+	size_t rawMsgLen;
+	// When the message was created if sampled, see Metrics_SampleNs.
+	uint64_t createdNs;
+	// Null if not counted.
+	LinkStats* link;
+	bool written;
+	// Copy of the trace of the command that caused the message, null if
+	// untraced. Only allocated for traced messages, few enough that they
+	// don't need the pool.
+	MsgTrace* trace;
+	int socket;
 
-	IrcMsgUnparser* unparser;
 	IrcMsgWriter* writer;
 }
 SendMsgContext;
 
-static SendMsgContext* SendMsgContext_New(const Logger* log, int socket, IrcMsg* msg);
+static Metric SentBytes = METRIC_COUNTER("amn_send_bytes_total",
+		"Bytes written to clients.");
+static Metric SendLatency = METRIC_HISTOGRAM("amn_send_latency_seconds",
+		"Time from a message being created to it being written to its client.");
+
+static SendMsgContext* SendMsgContext_New(const Logger* log, int socket,
+		char* rawMsg, size_t rawMsgLen, LinkStats* link, const MsgTrace* trace);
 static void SendMsgContext_Delete(void* context);
 static TaskStatus SendMessages(void* context);
 
-Task* SendMsgTask_New(const Logger* log, int socket, IrcMsg* msg)
+Task* SendMsgTask_New(const Logger* log, int socket, char* rawMsg, size_t rawMsgLen,
+		LinkStats* link, const MsgTrace* trace)
 {
-	SendMsgContext* ctx = SendMsgContext_New(log, socket, msg);
+	SendMsgContext* ctx = SendMsgContext_New(log, socket, rawMsg, rawMsgLen, link, trace);
 	if (ctx == NULL)
 	{
 		LOG_ERROR(log, "Failed to create SendMsgContext.");
@@ -32,16 +50,20 @@ Task* SendMsgTask_New(const Logger* log, int socket, IrcMsg* msg)
 	if (self == NULL)
 	{
 		LOG_ERROR(log, "Failed to create SendMsgTask.");
-		free(ctx);
+		IrcMsgWriter_Delete(ctx->writer);
+		LinkStats_Unref(ctx->link);
+		free(ctx->trace);
+		ObjPool_Free(ctx);
 		return NULL;
 	}
 
 	return self;
 }
 
-static SendMsgContext* SendMsgContext_New(const Logger* log, int socket, IrcMsg* msg)
+static SendMsgContext* SendMsgContext_New(const Logger* log, int socket,
+		char* rawMsg, size_t rawMsgLen, LinkStats* link, const MsgTrace* trace)
 {
-	SendMsgContext* ctx = malloc(sizeof(SendMsgContext));
+	SendMsgContext* ctx = ObjPool_Alloc(sizeof(SendMsgContext));
 	if (ctx == NULL)
 	{
 		LOG_ERROR(log, "Failed to allocate SendMsgContext.");
@@ -49,24 +71,34 @@ static SendMsgContext* SendMsgContext_New(const Logger* log, int socket, IrcMsg*
 	}
 
 	ctx->log = log;
-	ctx->msg = msg;
-
-	ctx->unparser = IrcMsgUnparser_New(log);
-	if (ctx->unparser == NULL)
+	ctx->rawMsg = rawMsg;
+	ctx->rawMsgLen = rawMsgLen;
+	ctx->createdNs = Metrics_SampleNs();
+	ctx->link = link != NULL ? LinkStats_Ref(link) : NULL;
+	ctx->written = false;
+	ctx->trace = NULL;
+	ctx->socket = socket;
+
+	// Left untraced if the copy can't be allocated.
+	if (trace != NULL && MsgTrace_IsTraced(trace)
+			&& (ctx->trace = malloc(sizeof(MsgTrace))) != NULL)
 	{
-		LOG_ERROR(log, "Failed to create IrcMsgUnparser.");
-		free(ctx->msg);
-		free(ctx);
-		return NULL;
+		*ctx->trace = *trace;
+
+		// Sent early by a command that's still running, e.g. with many replies.
+		if (ctx->trace->stampNs[MsgTraceStage_Executed] == 0)
+		{
+			MsgTrace_Stamp(ctx->trace, MsgTraceStage_Executed);
+		}
 	}
 
 	ctx->writer = IrcMsgWriter_New(log, socket);
 	if (ctx->writer == NULL)
 	{
 		LOG_ERROR(log, "Failed to create IrcMsgWriter.");
-		free(ctx->unparser);
-		free(ctx->msg);
-		free(ctx);
+		LinkStats_Unref(ctx->link);
+		free(ctx->trace);
+		ObjPool_Free(ctx);
 		return NULL;
 	}
 
@@ -77,30 +109,45 @@ static void SendMsgContext_Delete(void* context)
 {
 	SendMsgContext* ctx = (SendMsgContext*) context;
 
-	IrcMsgUnparser_Delete(ctx->unparser);
+	if (ctx->link != NULL)
+	{
+		// Messages of tasks that failed or never ran leave the sendq too.
+		LinkStats_Dequeue(ctx->link, ctx->rawMsgLen, ctx->written);
+		LinkStats_Unref(ctx->link);
+	}
+
 	IrcMsgWriter_Delete(ctx->writer);
-	IrcMsg_Delete(ctx->msg);
-	free(ctx);
+	free(ctx->rawMsg);
+	free(ctx->trace);
+	ObjPool_Free(ctx);
 }
 
 static TaskStatus SendMessages(void* context)
 {
 	SendMsgContext* ctx = (SendMsgContext*) context;
 
-	const char* rawMsg = IrcMsgUnparser_Unparse(ctx->unparser, ctx->msg);
-	if (rawMsg == NULL)
+	if (ctx->trace != NULL)
 	{
-		LOG_ERROR(ctx->log, "Failure to unparse message");
-		return TaskStatus_Failed;
+		MsgTrace_Stamp(ctx->trace, MsgTraceStage_Sending);
 	}
 
-	LOG_DEBUG(ctx->log, "Sending message: %s", rawMsg);
+	LOG_DEBUG(ctx->log, "Sending message: %.*s", (int) ctx->rawMsgLen, ctx->rawMsg);
 
-	if (!IrcMsgWriter_Write(ctx->writer, rawMsg))
+	if (!IrcMsgWriter_WriteLen(ctx->writer, ctx->rawMsg, ctx->rawMsgLen))
 	{
 		LOG_ERROR(ctx->log, "Failure to write message");
 		return TaskStatus_Failed;
 	}
 
+	ctx->written = true;
+	Metric_Add(&SentBytes, (int64_t) ctx->rawMsgLen);
+	Metric_ObserveSince(&SendLatency, ctx->createdNs);
+
+	if (ctx->trace != NULL)
+	{
+		MsgTrace_Stamp(ctx->trace, MsgTraceStage_Written);
+		MsgTrace_RecordWritten(ctx->trace, ctx->log, ctx->socket);
+	}
+
 	return TaskStatus_Done;
 }
@@ -1,14 +1,23 @@
 #ifndef AMN_SEND_MSG_TASK_H
 #define AMN_SEND_MSG_TASK_H
 
+#include "link_stats.h"
 #include "log.h"
+#include "msg_trace.h"
 #include "task.h"
-#include "irc_msg.h"
+
+#include <stddef.h>
 
 /**
-  * Task to send an message. 
+  * Task to send a message already in wire format, CRLF included.
+  * It may hold several messages.
+  * Takes ownership of rawMsg, unless it fails.
+  * The message is counted in link, if not null, which the task references
+  * until it's deleted.
+  * trace is copied, if not null and traced, and completed when written.
   */
-Task* SendMsgTask_New(const Logger* log, int socket, IrcMsg* msg);
+Task* SendMsgTask_New(const Logger* log, int socket, char* rawMsg, size_t rawMsgLen,
+		LinkStats* link, const MsgTrace* trace);
 
 
 #endif // AMN_SEND_MSG_TASK_H
@@ -0,0 +1,500 @@
+#include "server_config.h"
+
+#include "str_utils.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum ConfigType
+{
+	ConfigType_String,
+	ConfigType_Size,
+	// Can be changed at runtime.
+	ConfigType_AtomicSize,
+	// Comma separated list of CPUs and CPU ranges, e.g. "0,2,4-7".
+	ConfigType_CpuList,
+	// Can be changed at runtime.
+	ConfigType_LogLevel,
+	// String in the format of Logger_SetModuleLevels, can be changed at runtime.
+	ConfigType_LogModuleLevels,
+	// Can be changed at runtime.
+	ConfigType_LogFullPolicy,
+}
+ConfigType;
+
+typedef struct ConfigKey
+{
+	const char* name;
+	ConfigType type;
+	size_t offset;
+	// Valid range for sizes. For strings, a min of 1 means they can't be empty.
+	size_t min;
+	size_t max;
+}
+ConfigKey;
+
+#define MAX_CPUS 4096
+
+static const ConfigKey CONFIG_KEYS[] = {
+	{ "server_name",				ConfigType_String,		offsetof(ServerConfig, serverName), 1, 0 },
+	{ "listen_address",				ConfigType_String,		offsetof(ServerConfig, listenAddress), 0, 0 },
+	{ "listen_port",				ConfigType_String,		offsetof(ServerConfig, listenPort), 1, 0 },
+	{ "listen_backlog",				ConfigType_Size,		offsetof(ServerConfig, listenBacklog), 1, INT_MAX },
+	{ "socket_recv_buffer",			ConfigType_Size,		offsetof(ServerConfig, socketRecvBuffer), 0, INT_MAX },
+	{ "socket_send_buffer",			ConfigType_Size,		offsetof(ServerConfig, socketSendBuffer), 0, INT_MAX },
+	{ "runner_count",				ConfigType_Size,		offsetof(ServerConfig, runnerCount), 1, SERVER_CONFIG_MAX_RUNNERS },
+	{ "runner_cpus",				ConfigType_CpuList,		offsetof(ServerConfig, runnerCpus), 0, 0 },
+	{ "task_queue_capacity",		ConfigType_Size,		offsetof(ServerConfig, taskQueueCapacity), 1, SERVER_CONFIG_MAX_QUEUE_CAPACITY },
+	{ "conn_cmd_queue_capacity",	ConfigType_Size,		offsetof(ServerConfig, connCmdQueueCapacity), 1, SERVER_CONFIG_MAX_QUEUE_CAPACITY },
+	{ "cmd_queue_quantum",			ConfigType_AtomicSize,	offsetof(ServerConfig, cmdQueueQuantum), 1, INT32_MAX },
+	{ "flood_burst_ms",				ConfigType_AtomicSize,	offsetof(ServerConfig, floodBurstMs), 0, SIZE_MAX },
+	{ "trace_log_every",			ConfigType_AtomicSize,	offsetof(ServerConfig, traceLogEvery), 0, SIZE_MAX },
+	{ "log_level",					ConfigType_LogLevel,	offsetof(ServerConfig, logLevel), 0, 0 },
+	{ "log_module_levels",			ConfigType_LogModuleLevels,	offsetof(ServerConfig, logModuleLevels), 0, 0 },
+	{ "log_full_policy",			ConfigType_LogFullPolicy,	offsetof(ServerConfig, logFullPolicy), 0, 0 },
+	{ "log_binary_path",			ConfigType_String,		offsetof(ServerConfig, logBinaryPath), 0, 0 },
+	{ "metrics_socket_path",		ConfigType_String,		offsetof(ServerConfig, metricsSocketPath), 0, 0 },
+	{ "flight_recorder_path",		ConfigType_String,		offsetof(ServerConfig, flightRecorderPath), 0, 0 },
+	{ "oper_name",					ConfigType_String,		offsetof(ServerConfig, operName), 0, 0 },
+	{ "oper_password",				ConfigType_String,		offsetof(ServerConfig, operPassword), 0, 0 },
+};
+
+static ServerConfig* ServerConfig_NewDefault();
+static bool ServerConfig_ParseFile(ServerConfig* self, const Logger* log, FILE* file);
+static bool ServerConfig_Set(
+		ServerConfig* self, const Logger* log, size_t lineNumber, const char* key,
+		const char* value);
+static bool ParseCpuList(const char* value, int** cpus, size_t* cpuCount);
+static char* Trim(char* str);
+
+ServerConfig* ServerConfig_Load(const Logger* log, const char* path)
+{
+	ServerConfig* self = ServerConfig_NewDefault();
+	if (self == NULL)
+	{
+		LOG_ERROR(log, "Failed to allocate ServerConfig.");
+		return NULL;
+	}
+
+	bool defaultPath = path == NULL;
+	if (defaultPath)
+	{
+		path = SERVER_CONFIG_DEFAULT_PATH;
+	}
+
+	FILE* file = fopen(path, "r");
+	if (file == NULL && defaultPath && errno == ENOENT)
+	{
+		LOG_INFO(log, "No %s, using default configuration.", path);
+		errno = 0;
+		return self;
+	}
+	else if (file == NULL)
+	{
+		LOG_ERROR(log, "Failed to open configuration file %s.", path);
+		ServerConfig_Delete(self);
+		return NULL;
+	}
+
+	bool success = ServerConfig_ParseFile(self, log, file);
+	fclose(file);
+
+	if (!success)
+	{
+		LOG_ERROR(log, "Invalid configuration file %s.", path);
+		ServerConfig_Delete(self);
+		return NULL;
+	}
+
+	self->path = StrUtils_Clone(path);
+	if (self->path == NULL)
+	{
+		ServerConfig_Delete(self);
+		return NULL;
+	}
+
+	LOG_INFO(log, "Loaded configuration from %s.", path);
+
+	return self;
+}
+
+void ServerConfig_Delete(ServerConfig* self)
+{
+	if (self == NULL)
+	{
+		return;
+	}
+
+	free(self->path);
+	free(self->serverName);
+	free(self->listenAddress);
+	free(self->listenPort);
+	free(self->runnerCpus);
+	free(self->logModuleLevels);
+	free(self->logBinaryPath);
+	free(self->metricsSocketPath);
+	free(self->flightRecorderPath);
+	free(self->operName);
+	free(self->operPassword);
+	free(self);
+}
+
+bool ServerConfig_Reload(ServerConfig* self, const Logger* log)
+{
+	if (self->path == NULL)
+	{
+		LOG_INFO(log, "Not reloading configuration, there's no configuration file.");
+		return true;
+	}
+
+	ServerConfig* next = ServerConfig_Load(log, self->path);
+	if (next == NULL)
+	{
+		LOG_ERROR(log, "Failed to reload configuration, keeping the current one.");
+		return false;
+	}
+
+	for (size_t i = 0; i < sizeof(CONFIG_KEYS) / sizeof(ConfigKey); i++)
+	{
+		const ConfigKey* key = &CONFIG_KEYS[i];
+		void* current = (char*) self + key->offset;
+		void* updated = (char*) next + key->offset;
+
+		bool changed = false;
+		switch (key->type)
+		{
+			case ConfigType_String:
+				changed = !StrUtils_Equals(*(char**) current, *(char**) updated);
+				break;
+			case ConfigType_Size:
+				changed = *(size_t*) current != *(size_t*) updated;
+				break;
+			case ConfigType_AtomicSize:
+				atomic_store((atomic_size_t*) current, atomic_load((atomic_size_t*) updated));
+				break;
+			case ConfigType_CpuList:
+				changed = self->runnerCpuCount != next->runnerCpuCount
+					|| (self->runnerCpuCount > 0 && memcmp(self->runnerCpus, next->runnerCpus,
+								sizeof(int) * self->runnerCpuCount) != 0);
+				break;
+			case ConfigType_LogLevel:
+				*(LogLevel*) current = *(LogLevel*) updated;
+				break;
+			case ConfigType_LogFullPolicy:
+				*(LogFullPolicy*) current = *(LogFullPolicy*) updated;
+				break;
+			case ConfigType_LogModuleLevels:
+			{
+				// Swapped, so next frees the current value.
+				char* str = *(char**) current;
+				*(char**) current = *(char**) updated;
+				*(char**) updated = str;
+			}
+			break;
+		}
+
+		if (changed)
+		{
+			LOG_WARN(log, "%s can't change at runtime, restart the server to apply it.",
+					key->name);
+		}
+	}
+
+	ServerConfig_Delete(next);
+
+	LOG_INFO(log, "Reloaded configuration from %s.", self->path);
+
+	return true;
+}
+
+static ServerConfig* ServerConfig_NewDefault()
+{
+	ServerConfig* self = malloc(sizeof(ServerConfig));
+	if (self == NULL)
+	{
+		return NULL;
+	}
+
+	*self = (ServerConfig) {
+		.listenBacklog = 10,
+		.runnerCount = 10,
+		.taskQueueCapacity = 256,
+		.connCmdQueueCapacity = 16,
+		.logLevel = LogLevel_Info,
+		.logFullPolicy = LogFullPolicy_Drop,
+	};
+	atomic_init(&self->cmdQueueQuantum, 4);
+	// https://datatracker.ietf.org/doc/html/rfc1459#section-8.10
+	atomic_init(&self->floodBurstMs, 10000);
+	atomic_init(&self->traceLogEvery, 0);
+
+	self->serverName = StrUtils_Clone("amn-irc.server.local");
+	self->listenPort = StrUtils_Clone("6667");
+	self->flightRecorderPath = StrUtils_Clone("amn-irc-server.flight");
+
+	if (self->serverName == NULL || self->listenPort == NULL || self->flightRecorderPath == NULL)
+	{
+		ServerConfig_Delete(self);
+		return NULL;
+	}
+
+	return self;
+}
+
+static bool ServerConfig_ParseFile(ServerConfig* self, const Logger* log, FILE* file)
+{
+	bool success = true;
+	char* line = NULL;
+	size_t lineSize = 0;
+
+	for (size_t lineNumber = 1; getline(&line, &lineSize, file) != -1; lineNumber++)
+	{
+		char* content = Trim(line);
+		if (*content == '\0' || *content == '#')
+		{
+			continue;
+		}
+
+		char* equals = strchr(content, '=');
+		if (equals == NULL)
+		{
+			LOG_ERROR(log, "Line %zu: expected \"key = value\".", lineNumber);
+			success = false;
+			continue;
+		}
+
+		*equals = '\0';
+
+		// Keep going on errors, so every error is reported at once.
+		if (!ServerConfig_Set(self, log, lineNumber, Trim(content), Trim(equals + 1)))
+		{
+			success = false;
+		}
+	}
+
+	if (ferror(file))
+	{
+		LOG_ERROR(log, "Failed to read configuration file.");
+		success = false;
+	}
+
+	free(line);
+	return success;
+}
+
+static bool ServerConfig_Set(
+		ServerConfig* self, const Logger* log, size_t lineNumber, const char* name,
+		const char* value)
+{
+	const ConfigKey* key = NULL;
+	for (size_t i = 0; i < sizeof(CONFIG_KEYS) / sizeof(ConfigKey); i++)
+	{
+		if (StrUtils_Equals(CONFIG_KEYS[i].name, name))
+		{
+			key = &CONFIG_KEYS[i];
+			break;
+		}
+	}
+
+	if (key == NULL)
+	{
+		LOG_ERROR(log, "Line %zu: unknown key %s.", lineNumber, name);
+		return false;
+	}
+
+	void* field = (char*) self + key->offset;
+
+	switch (key->type)
+	{
+		case ConfigType_LogModuleLevels:
+			if (!Logger_ValidModuleLevels(value))
+			{
+				LOG_ERROR(log, "Line %zu: %s must be a list of module=level, e.g. "
+						"receive_msg_task=debug,irc_msg_parser=warn.", lineNumber, name);
+				return false;
+			}
+			// fall through
+		case ConfigType_String:
+		{
+			if (*value == '\0' && key->min > 0)
+			{
+				LOG_ERROR(log, "Line %zu: %s can't be empty.", lineNumber, name);
+				return false;
+			}
+
+			// An empty value resets the setting to null.
+			char* str = NULL;
+			if (*value != '\0')
+			{
+				str = StrUtils_Clone(value);
+				if (str == NULL)
+				{
+					LOG_ERROR(log, "Failed to clone %s.", name);
+					return false;
+				}
+			}
+
+			free(*(char**) field);
+			*(char**) field = str;
+		}
+		break;
+		case ConfigType_Size:
+		case ConfigType_AtomicSize:
+		{
+			size_t size;
+			if (!StrUtils_ReadSizeT(value, &size) || size < key->min || size > key->max)
+			{
+				LOG_ERROR(log, "Line %zu: %s must be a number from %zu to %zu.",
+						lineNumber, name, key->min, key->max);
+				return false;
+			}
+
+			if (key->type == ConfigType_Size)
+			{
+				*(size_t*) field = size;
+			}
+			else
+			{
+				atomic_store((atomic_size_t*) field, size);
+			}
+		}
+		break;
+		case ConfigType_CpuList:
+		{
+			int* cpus = NULL;
+			size_t cpuCount = 0;
+			if (!ParseCpuList(value, &cpus, &cpuCount))
+			{
+				LOG_ERROR(log, "Line %zu: %s must be a list of CPUs, e.g. 0,2,4-7.",
+						lineNumber, name);
+				return false;
+			}
+
+			free(self->runnerCpus);
+			self->runnerCpus = cpus;
+			self->runnerCpuCount = cpuCount;
+		}
+		break;
+		case ConfigType_LogLevel:
+			if (!LogLevel_Parse(value, (LogLevel*) field))
+			{
+				LOG_ERROR(log, "Line %zu: %s must be debug, info, warn or error.",
+						lineNumber, name);
+				return false;
+			}
+			break;
+		case ConfigType_LogFullPolicy:
+			if (!LogFullPolicy_Parse(value, (LogFullPolicy*) field))
+			{
+				LOG_ERROR(log, "Line %zu: %s must be drop or block.", lineNumber, name);
+				return false;
+			}
+			break;
+	}
+
+	return true;
+}
+
+static bool ParseCpuList(const char* value, int** cpus, size_t* cpuCount)
+{
+	*cpus = NULL;
+	*cpuCount = 0;
+
+	if (*value == '\0')
+	{
+		return true;
+	}
+
+	char* list = StrUtils_Clone(value);
+	if (list == NULL)
+	{
+		return false;
+	}
+
+	bool success = false;
+	char* savePtr = NULL;
+
+	for (char* item = strtok_r(list, ",", &savePtr); item != NULL;
+			item = strtok_r(NULL, ",", &savePtr))
+	{
+		item = Trim(item);
+
+		size_t first;
+		size_t last;
+		char* dash = strchr(item, '-');
+		if (dash != NULL)
+		{
+			*dash = '\0';
+
+			if (!StrUtils_ReadSizeT(Trim(item), &first)
+					|| !StrUtils_ReadSizeT(Trim(dash + 1), &last))
+			{
+				goto cleanup;
+			}
+		}
+		else if (StrUtils_ReadSizeT(item, &first))
+		{
+			last = first;
+		}
+		else
+		{
+			goto cleanup;
+		}
+
+		if (first > last || last >= MAX_CPUS || *cpuCount + (last - first + 1) > MAX_CPUS)
+		{
+			goto cleanup;
+		}
+
+		int* grown = realloc(*cpus, sizeof(int) * (*cpuCount + (last - first + 1)));
+		if (grown == NULL)
+		{
+			goto cleanup;
+		}
+		*cpus = grown;
+
+		for (size_t cpu = first; cpu <= last; cpu++)
+		{
+			(*cpus)[(*cpuCount)++] = (int) cpu;
+		}
+	}
+
+	success = true;
+
+cleanup:
+	free(list);
+
+	if (!success)
+	{
+		free(*cpus);
+		*cpus = NULL;
+		*cpuCount = 0;
+	}
+
+	return success;
+}
+
+/**
+ * Removes leading and trailing whitespace in place.
+ */
+static char* Trim(char* str)
+{
+	while (isspace((unsigned char) *str))
+	{
+		str++;
+	}
+
+	char* end = str + strlen(str);
+	while (end > str && isspace((unsigned char) end[-1]))
+	{
+		end--;
+	}
+	*end = '\0';
+
+	return str;
+}
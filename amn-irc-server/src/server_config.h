@@ -0,0 +1,94 @@
+#ifndef AMN_SERVER_CONFIG_H
+#define AMN_SERVER_CONFIG_H
+
+#include "log.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Used when no configuration file is given on the command line. It's fine if it doesn't exist.
+#define SERVER_CONFIG_DEFAULT_PATH "amn-irc-server.conf"
+#define SERVER_CONFIG_MAX_RUNNERS 1024
+// Largest task_queue_capacity and conn_cmd_queue_capacity, far above any
+// sensible value but low enough that queue sizes can't overflow.
+#define SERVER_CONFIG_MAX_QUEUE_CAPACITY 1048576
+
+/**
+  * Server settings, loaded from a file of "key = value" lines.
+  * Lines starting with # are comments. Keys that are not in the file keep
+  * their defaults. See amn-irc-server.conf.example for every key.
+  *
+  * Most settings only take effect on startup. The atomic ones, and the log
+  * levels, can be changed at runtime with ServerConfig_Reload, which is
+  * triggered by SIGHUP or REHASH.
+  */
+typedef struct ServerConfig
+{
+	// Where the settings were loaded from, null if only defaults are used.
+	char* path;
+
+	char* serverName;
+	// Address to listen on, null for every address.
+	char* listenAddress;
+	char* listenPort;
+	size_t listenBacklog;
+	// SO_RCVBUF and SO_SNDBUF for client sockets, zero to keep the system default.
+	size_t socketRecvBuffer;
+	size_t socketSendBuffer;
+
+	size_t runnerCount;
+	// CPUs to pin runners to, runner i is pinned to runnerCpus[i % runnerCpuCount].
+	// Runners are not pinned if empty.
+	int* runnerCpus;
+	size_t runnerCpuCount;
+
+	size_t taskQueueCapacity;
+	size_t connCmdQueueCapacity;
+
+	// Commands a connection may execute per turn, see IrcCmdQueue_New.
+	atomic_size_t cmdQueueQuantum;
+	// See FloodControl.
+	atomic_size_t floodBurstMs;
+	// Each connection logs the trace of one in this many messages, zero for none.
+	// See MsgTrace.
+	atomic_size_t traceLogEvery;
+
+	// Reloadable, only used by the main thread. See Logger_SetLevel,
+	// Logger_SetModuleLevels and Logger_SetFullPolicy.
+	LogLevel logLevel;
+	// Null if no module has its own level.
+	char* logModuleLevels;
+	LogFullPolicy logFullPolicy;
+	// Binary log file replacing stdout, null for text. See Logger_OpenBinaryFile.
+	char* logBinaryPath;
+
+	// Unix socket serving metrics, null to not serve them. See MetricsExportTask.
+	char* metricsSocketPath;
+
+	// File the flight recorder is dumped to, null to not dump it. See FlightRecorder_Dump.
+	char* flightRecorderPath;
+
+	// Credentials OPER takes, either null if nobody may become an operator.
+	char* operName;
+	char* operPassword;
+}
+ServerConfig;
+
+/**
+ * Loads the configuration file at path, using defaults for missing keys.
+ * If path is null SERVER_CONFIG_DEFAULT_PATH is used, and only defaults if
+ * it doesn't exist.
+ * @return The configuration, or null if the file is invalid.
+ */
+ServerConfig* ServerConfig_Load(const Logger* log, const char* path);
+void ServerConfig_Delete(ServerConfig* self);
+
+/**
+ * Reads the configuration file again, and applies the settings that can
+ * change at runtime. Changes to other settings are logged and ignored.
+ * If the file is invalid nothing is changed.
+ */
+bool ServerConfig_Reload(ServerConfig* self, const Logger* log);
+
+#endif // AMN_SERVER_CONFIG_H
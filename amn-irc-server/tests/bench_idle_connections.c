@@ -0,0 +1,181 @@
+/**
+ * Prints the memory idle connections take: the RSS a ReceiveMsgTask adds,
+ * once created and once it read a message and the start of another, like a
+ * client that went quiet mid-line, and what that comes to for 100k clients.
+ * Readers share one BufferPool, as in the server, so an idle connection only
+ * holds its context, its reader and the partial line. Settings are the
+ * server's, from amn-irc-server.conf if it's in the working directory.
+ * Sockets are socketpairs, their kernel buffers aren't counted in RSS.
+ * Usage: bench_idle_connections [connections]
+ */
+
+#include "irc_cmd_queue.h"
+#include "receive_msg_task.h"
+#include "server_config.h"
+
+#include "application.h"
+#include "log.h"
+#include "task.h"
+#include "task_queue.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// A whole message, and the start of the next one.
+static const char SENT[] = "PRIVMSG #sports :What a finish!\r\nPRIVMSG #sports :Did you";
+
+#define CLIENTS_PER_REPORT 100000
+// Descriptors left for the logger and the application.
+#define RESERVED_FDS 64
+
+static long RssBytes(void)
+{
+	FILE* file = fopen("/proc/self/statm", "r");
+	long pages = 0;
+	long rssPages = 0;
+	if (file == NULL || fscanf(file, "%ld %ld", &pages, &rssPages) != 2)
+	{
+		fprintf(stderr, "Failed to read /proc/self/statm.\n");
+		exit(EXIT_FAILURE);
+	}
+	fclose(file);
+
+	return rssPages * sysconf(_SC_PAGESIZE);
+}
+
+/**
+ * Raises the descriptor limit as far as allowed, returns how many
+ * connections it leaves room for, two descriptors each.
+ */
+static size_t MaxConnections(void)
+{
+	struct rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+	{
+		return 0;
+	}
+
+	limit.rlim_cur = limit.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &limit);
+	getrlimit(RLIMIT_NOFILE, &limit);
+
+	return limit.rlim_cur > RESERVED_FDS ? (size_t) (limit.rlim_cur - RESERVED_FDS) / 2 : 0;
+}
+
+static void Report(const char* name, long rssBytes, size_t count)
+{
+	double perConn = (double) rssBytes / (double) count;
+	printf("%-8s %8.0f bytes/connection %8.1f MiB per %d connections\n", name, perConn,
+			perConn * CLIENTS_PER_REPORT / (1024.0 * 1024.0), CLIENTS_PER_REPORT);
+}
+
+int main(int argc, char** argv)
+{
+	size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 5000;
+	if (count == 0)
+	{
+		fprintf(stderr, "Usage: %s [connections]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	size_t maxCount = MaxConnections();
+	if (count > maxCount)
+	{
+		printf("Only %zu connections fit the descriptor limit.\n", maxCount);
+		count = maxCount;
+	}
+
+	FILE* logFiles[] = { stderr };
+	Logger* log = Logger_Create(logFiles, 1);
+	if (log == NULL || !Application_Init())
+	{
+		fprintf(stderr, "Failed to start.\n");
+		return EXIT_FAILURE;
+	}
+	Logger_SetLevel(log, LogLevel_Warn);
+
+	ServerConfig* config = ServerConfig_Load(log, NULL);
+	if (config == NULL)
+	{
+		fprintf(stderr, "Failed to load the configuration.\n");
+		return EXIT_FAILURE;
+	}
+
+	ReceiveMsgShared* shared = ReceiveMsgShared_New(log);
+	TaskQueue* taskQueue = TaskQueue_New(config->taskQueueCapacity);
+	IrcCmdQueue* cmds = IrcCmdQueue_New(config->connCmdQueueCapacity,
+			atomic_load(&config->cmdQueueQuantum));
+	Task** tasks = calloc(count, sizeof(Task*));
+	int* clients = calloc(count, sizeof(int));
+	if (shared == NULL || taskQueue == NULL || cmds == NULL || tasks == NULL || clients == NULL)
+	{
+		fprintf(stderr, "Failed to create the receive tasks' state.\n");
+		return EXIT_FAILURE;
+	}
+
+	long startRss = RssBytes();
+
+	for (size_t i = 0; i < count; i++)
+	{
+		int sockets[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0)
+		{
+			perror("socketpair");
+			return EXIT_FAILURE;
+		}
+
+		// The task owns the server's end.
+		clients[i] = sockets[1];
+		tasks[i] = ReceiveMsgTask_New(log, taskQueue, cmds, config, shared, sockets[0]);
+		if (tasks[i] == NULL)
+		{
+			fprintf(stderr, "Failed to create receive task %zu.\n", i);
+			return EXIT_FAILURE;
+		}
+	}
+
+	long createdRss = RssBytes();
+
+	// Each reads once and goes idle, keeping the partial message. The whole one
+	// is executed right away, so its command's memory is reused by the next.
+	for (size_t i = 0; i < count; i++)
+	{
+		if (write(clients[i], SENT, strlen(SENT)) != (ssize_t) strlen(SENT)
+				|| Task_Run(tasks[i]) != TaskStatus_Yield)
+		{
+			fprintf(stderr, "Connection %zu failed to read.\n", i);
+			return EXIT_FAILURE;
+		}
+
+		IrcCmd_Delete(IrcCmdQueue_Pop(cmds));
+	}
+
+	long idleRss = RssBytes();
+
+	printf("%zu connections\n", count);
+	Report("created", createdRss - startRss, count);
+	Report("idle", idleRss - startRss, count);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		Task_Delete(tasks[i]);
+		close(clients[i]);
+	}
+
+	free(clients);
+	free(tasks);
+	IrcCmdQueue_Delete(cmds);
+	TaskQueue_Delete(taskQueue);
+	ReceiveMsgShared_Delete(shared);
+	ServerConfig_Delete(config);
+	Application_Cleanup();
+	Logger_Destroy(log);
+
+	return EXIT_SUCCESS;
+}
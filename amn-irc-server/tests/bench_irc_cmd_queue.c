@@ -0,0 +1,291 @@
+/**
+ * One flooder keeps its commands queued while light users each send a
+ * command and wait for it to be executed, like chatting next to a client
+ * pasting a file. Prints how long the light users' commands wait, through
+ * IrcCmdQueue and through a single FIFO Queue shared by every connection.
+ * Usage: bench_irc_cmd_queue [light users] [seconds]
+ */
+
+#include "irc_cmd_queue.h"
+
+#include "bench.h"
+#include "metrics.h"
+#include "queue.h"
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#define MAX_LIGHT_USERS 256
+#define MAX_SAMPLES (1 << 20)
+// Socket of the flooder, light users follow it.
+#define FLOODER 4
+// How long executing a command takes.
+#define EXEC_NS 2000
+// Pause of light users between commands.
+#define THINK_NS 1000000
+// Commands each connection may have queued, and the FIFO's capacity per connection.
+#define CONN_CAPACITY 16
+#define QUANTUM 4
+
+typedef struct Backend
+{
+	const char* name;
+	void* queue;
+	bool (*push)(void* queue, IrcCmd* cmd);
+	IrcCmd* (*pop)(void* queue);
+	void (*shutdown)(void* queue);
+}
+Backend;
+
+typedef struct LightUser
+{
+	struct Bench* bench;
+	int socket;
+	_Atomic uint64_t pushedNs;
+	atomic_bool executed;
+}
+LightUser;
+
+typedef struct Bench
+{
+	Backend* backend;
+	atomic_bool stop;
+	size_t lightCount;
+	LightUser lights[MAX_LIGHT_USERS];
+
+	// Only written by the executor.
+	uint64_t* waits;
+	size_t waitCount;
+	uint64_t executed;
+}
+Bench;
+
+static void SpinNs(uint64_t ns)
+{
+	uint64_t start = Metrics_NowNs();
+	while (Metrics_NowNs() - start < ns)
+	{
+	}
+}
+
+static void SleepNs(long ns)
+{
+	struct timespec delay = { .tv_sec = 0, .tv_nsec = ns };
+	nanosleep(&delay, NULL);
+}
+
+static IrcCmd* NewCmd(int socket)
+{
+	// The queue only looks at the socket and priority, QUIT clones without a message.
+	return IrcCmd_Clone(&(IrcCmd) {
+		.type = IrcCmdType_Quit,
+		.priority = IrcCmdPriority_Normal,
+		.peerSocket = socket,
+		.quit = {
+			.quitMessage = "bench",
+		},
+	});
+}
+
+static void* RunExecutor(void* arg)
+{
+	Bench* bench = arg;
+
+	IrcCmd* cmd;
+	while ((cmd = bench->backend->pop(bench->backend->queue)) != NULL)
+	{
+		SpinNs(EXEC_NS);
+		bench->executed++;
+
+		if (cmd->peerSocket != FLOODER)
+		{
+			LightUser* light = &bench->lights[cmd->peerSocket - FLOODER - 1];
+
+			if (bench->waitCount < MAX_SAMPLES)
+			{
+				bench->waits[bench->waitCount++] = Metrics_NowNs() - atomic_load(&light->pushedNs);
+			}
+			atomic_store(&light->executed, true);
+		}
+
+		IrcCmd_Delete(cmd);
+	}
+
+	return NULL;
+}
+
+static void* RunFlooder(void* arg)
+{
+	Bench* bench = arg;
+
+	while (!atomic_load(&bench->stop))
+	{
+		IrcCmd* cmd = NewCmd(FLOODER);
+		if (!bench->backend->push(bench->backend->queue, cmd))
+		{
+			IrcCmd_Delete(cmd);
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+static void* RunLightUser(void* arg)
+{
+	LightUser* light = arg;
+	Bench* bench = light->bench;
+
+	while (!atomic_load(&bench->stop))
+	{
+		atomic_store(&light->executed, false);
+		atomic_store(&light->pushedNs, Metrics_NowNs());
+
+		IrcCmd* cmd = NewCmd(light->socket);
+		if (!bench->backend->push(bench->backend->queue, cmd))
+		{
+			IrcCmd_Delete(cmd);
+			break;
+		}
+
+		while (!atomic_load(&light->executed) && !atomic_load(&bench->stop))
+		{
+			SleepNs(10000);
+		}
+
+		SleepNs(THINK_NS);
+	}
+
+	return NULL;
+}
+
+static void Run(Backend* backend, size_t lightCount, unsigned seconds)
+{
+	Bench* bench = calloc(1, sizeof(Bench));
+	bench->backend = backend;
+	bench->lightCount = lightCount;
+	bench->waits = malloc(sizeof(uint64_t) * MAX_SAMPLES);
+
+	pthread_t executor;
+	pthread_t flooder;
+	pthread_t lights[MAX_LIGHT_USERS];
+
+	pthread_create(&executor, NULL, RunExecutor, bench);
+	pthread_create(&flooder, NULL, RunFlooder, bench);
+	for (size_t i = 0; i < lightCount; i++)
+	{
+		bench->lights[i].bench = bench;
+		bench->lights[i].socket = FLOODER + 1 + (int) i;
+		pthread_create(&lights[i], NULL, RunLightUser, &bench->lights[i]);
+	}
+
+	for (unsigned i = 0; i < seconds; i++)
+	{
+		SleepNs(999999999);
+	}
+
+	atomic_store(&bench->stop, true);
+	backend->shutdown(backend->queue);
+
+	pthread_join(flooder, NULL);
+	for (size_t i = 0; i < lightCount; i++)
+	{
+		pthread_join(lights[i], NULL);
+	}
+	pthread_join(executor, NULL);
+
+	if (bench->waitCount > 0)
+	{
+		size_t count = bench->waitCount;
+		printf("%-12s %6zu light commands, wait p50 %9" PRIu64 "ns p99 %9" PRIu64
+				"ns max %9" PRIu64 "ns, %" PRIu64 " commands/s\n",
+				backend->name, count,
+				Bench_Percentile(bench->waits, count, 50),
+				Bench_Percentile(bench->waits, count, 99),
+				Bench_Percentile(bench->waits, count, 100),
+				bench->executed / seconds);
+	}
+
+	free(bench->waits);
+	free(bench);
+}
+
+static bool PushFair(void* queue, IrcCmd* cmd)
+{
+	return IrcCmdQueue_Push(queue, cmd);
+}
+
+static IrcCmd* PopFair(void* queue)
+{
+	return IrcCmdQueue_Pop(queue);
+}
+
+static void ShutdownFair(void* queue)
+{
+	IrcCmdQueue_Shutdown(queue);
+}
+
+static bool PushFifo(void* queue, IrcCmd* cmd)
+{
+	return Queue_Push(queue, &cmd, sizeof(IrcCmd*));
+}
+
+static IrcCmd* PopFifo(void* queue)
+{
+	IrcCmd* cmd = NULL;
+	return Queue_Pop(queue, &cmd, sizeof(IrcCmd*)) ? cmd : NULL;
+}
+
+static void ShutdownFifo(void* queue)
+{
+	Queue_Shutdown(queue);
+}
+
+static void DeleteCmd(void* cmd)
+{
+	IrcCmd_Delete(cmd);
+}
+
+int main(int argc, char** argv)
+{
+	size_t lightCount = argc > 1 ? strtoul(argv[1], NULL, 10) : 32;
+	unsigned seconds = argc > 2 ? (unsigned) strtoul(argv[2], NULL, 10) : 2;
+	if (lightCount == 0 || lightCount > MAX_LIGHT_USERS || seconds == 0)
+	{
+		fprintf(stderr, "Usage: %s [light users, 1 to %d] [seconds]\n", argv[0],
+				MAX_LIGHT_USERS);
+		return EXIT_FAILURE;
+	}
+
+	printf("1 flooder, %zu light users, %dns per command, quantum %d\n",
+			lightCount, EXEC_NS, QUANTUM);
+
+	// Room for every connection's commands, as when each one had a share of it.
+	Backend fifo = {
+		.name = "fifo",
+		.queue = Queue_New(CONN_CAPACITY * (lightCount + 1), sizeof(IrcCmd*)),
+		.push = PushFifo,
+		.pop = PopFifo,
+		.shutdown = ShutdownFifo,
+	};
+	Run(&fifo, lightCount, seconds);
+	Queue_Delete(fifo.queue, DeleteCmd, sizeof(IrcCmd*));
+
+	Backend fair = {
+		.name = "round robin",
+		.queue = IrcCmdQueue_New(CONN_CAPACITY, QUANTUM),
+		.push = PushFair,
+		.pop = PopFair,
+		.shutdown = ShutdownFair,
+	};
+	Run(&fair, lightCount, seconds);
+	IrcCmdQueue_Delete(fair.queue);
+
+	return EXIT_SUCCESS;
+}
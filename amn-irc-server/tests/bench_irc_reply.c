@@ -0,0 +1,104 @@
+/**
+ * Prints replies per second rendered by IrcReplies into a caller's buffer,
+ * for the welcome burst of a newly registered user, RPL_WELCOME to
+ * RPL_MYINFO, and for the error replies clients get most often.
+ * Usage: bench_irc_reply [rounds]
+ */
+
+#include "irc_reply.h"
+
+#include "irc_msg.h"
+#include "metrics.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SERVERNAME "amn-irc.server.local"
+#define VERSION "amn-irc-server-0.1"
+
+typedef struct Reply
+{
+	IrcReplyType type;
+	size_t argCount;
+	const char* args[4];
+}
+Reply;
+
+static const Reply WELCOME[] = {
+	{ IrcReplyType_RplWelcome, 1, { "alice!al@client.example.org" } },
+	{ IrcReplyType_RplYourHost, 2, { SERVERNAME, VERSION } },
+	{ IrcReplyType_RplCreated, 1, { "Mon Oct 19 2026 at 10:41:33 UTC" } },
+	{ IrcReplyType_RplMyInfo, 4, { SERVERNAME, VERSION, "iswo", "psitnmlbkov" } },
+};
+
+static const Reply ERRORS[] = {
+	{ IrcReplyType_ErrNoSuchNick, 1, { "bob" } },
+	{ IrcReplyType_ErrNotRegistered, 0, { NULL } },
+	{ IrcReplyType_ErrNeedMoreParams, 1, { "JOIN" } },
+	{ IrcReplyType_ErrAlreadyRegistered, 0, { NULL } },
+	{ IrcReplyType_ErrBadChannelKey, 2, { "#", "sports" } },
+	{ IrcReplyType_ErrNoPrivileges, 0, { NULL } },
+};
+
+/**
+ * Renders the replies one after the other into buffer, as the executor
+ * batches the replies to a command, starting over every round.
+ */
+static void Bench(const IrcReplies* replies, const char* name, const Reply* batch,
+		size_t batchCount, size_t rounds)
+{
+	char buffer[IRC_MSG_SIZE * 8];
+	uint64_t bytes = 0;
+
+	uint64_t startNs = Metrics_NowNs();
+
+	for (size_t round = 0; round < rounds; round++)
+	{
+		size_t len = 0;
+		for (size_t i = 0; i < batchCount; i++)
+		{
+			size_t replyLen = IrcReplies_Render(replies, batch[i].type, batch[i].args,
+					batch[i].argCount, buffer + len, sizeof(buffer) - len);
+			if (replyLen == 0)
+			{
+				fprintf(stderr, "Failed to render reply %03d.\n", batch[i].type);
+				exit(EXIT_FAILURE);
+			}
+
+			len += replyLen;
+		}
+
+		bytes += len;
+	}
+
+	uint64_t ns = Metrics_NowNs() - startNs;
+	double count = (double) (rounds * batchCount);
+
+	printf("%-8s %6.1fM replies/s %6.1fns/reply %6.1f bytes/reply\n", name,
+			count * 1000.0 / (double) ns, (double) ns / count, (double) bytes / count);
+}
+
+int main(int argc, char** argv)
+{
+	size_t rounds = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+	if (rounds == 0)
+	{
+		fprintf(stderr, "Usage: %s [rounds]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	IrcReplies* replies = IrcReplies_New(SERVERNAME);
+	if (replies == NULL)
+	{
+		fprintf(stderr, "Failed to create the replies.\n");
+		return EXIT_FAILURE;
+	}
+
+	Bench(replies, "welcome", WELCOME, sizeof(WELCOME) / sizeof(WELCOME[0]), rounds);
+	Bench(replies, "errors", ERRORS, sizeof(ERRORS) / sizeof(ERRORS[0]), rounds);
+
+	IrcReplies_Delete(replies);
+
+	return EXIT_SUCCESS;
+}
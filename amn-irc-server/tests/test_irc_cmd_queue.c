@@ -0,0 +1,251 @@
+#include "irc_cmd_queue.h"
+
+#include "test.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define MAX_CMDS 128
+
+// Commands are told apart by address.
+typedef struct Pushed
+{
+	IrcCmd* cmds[MAX_CMDS];
+	int sockets[MAX_CMDS];
+	// Order each command was pushed in among those of its socket.
+	size_t seqs[MAX_CMDS];
+	size_t count;
+}
+Pushed;
+
+/**
+ * The queue only looks at the socket and priority, the type is one that
+ * clones without a message.
+ */
+static IrcCmd* NewCmd(int socket, IrcCmdPriority priority)
+{
+	return IrcCmd_Clone(&(IrcCmd) {
+		.type = IrcCmdType_Quit,
+		.priority = priority,
+		.peerSocket = socket,
+		.quit = {
+			.quitMessage = "test",
+		},
+	});
+}
+
+static IrcCmd* Push(IrcCmdQueue* queue, Pushed* pushed, int socket, IrcCmdPriority priority)
+{
+	IrcCmd* cmd = NewCmd(socket, priority);
+	CHECK(cmd != NULL);
+
+	size_t seq = 0;
+	for (size_t i = 0; i < pushed->count; i++)
+	{
+		seq += pushed->sockets[i] == socket;
+	}
+
+	pushed->cmds[pushed->count] = cmd;
+	pushed->sockets[pushed->count] = socket;
+	pushed->seqs[pushed->count] = seq;
+	pushed->count++;
+
+	CHECK(IrcCmdQueue_Push(queue, cmd));
+
+	return cmd;
+}
+
+/**
+ * Pops a command and checks it's the next one of its socket.
+ * @return Its socket, -1 if it isn't a pushed command.
+ */
+static int Pop(IrcCmdQueue* queue, Pushed* pushed, size_t* popped)
+{
+	IrcCmd* cmd = IrcCmdQueue_Pop(queue);
+
+	for (size_t i = 0; cmd != NULL && i < pushed->count; i++)
+	{
+		if (pushed->cmds[i] == cmd)
+		{
+			int socket = pushed->sockets[i];
+			CHECK(pushed->seqs[i] == popped[socket]);
+			popped[socket]++;
+
+			// Never popped again.
+			pushed->cmds[i] = NULL;
+			IrcCmd_Delete(cmd);
+
+			return socket;
+		}
+	}
+
+	CHECK(cmd != NULL);
+	IrcCmd_Delete(cmd);
+
+	return -1;
+}
+
+static void TestNew(void)
+{
+	CHECK(IrcCmdQueue_New(0, 1) == NULL);
+	CHECK(IrcCmdQueue_New(1, 0) == NULL);
+	CHECK(IrcCmdQueue_New(1, (size_t) IRC_CMD_QUEUE_MAX_QUANTUM + 1) == NULL);
+
+	IrcCmdQueue* queue = IrcCmdQueue_New(1, 1);
+	CHECK(queue != NULL);
+	CHECK(!IrcCmdQueue_SetQuantum(queue, 0));
+	CHECK(IrcCmdQueue_SetQuantum(queue, IRC_CMD_QUEUE_MAX_QUANTUM));
+	IrcCmdQueue_Delete(queue);
+}
+
+/**
+ * A flooder's backlog doesn't delay light users by more than a turn.
+ */
+static void TestRoundRobin(void)
+{
+	const size_t quantum = 2;
+	const int flooder = 5;
+	const int lightCount = 10;
+
+	IrcCmdQueue* queue = IrcCmdQueue_New(64, quantum);
+	Pushed pushed = {0};
+	size_t popped[64] = {0};
+
+	for (size_t i = 0; i < 40; i++)
+	{
+		Push(queue, &pushed, flooder, IrcCmdPriority_Normal);
+	}
+
+	for (int socket = flooder + 1; socket <= flooder + lightCount; socket++)
+	{
+		Push(queue, &pushed, socket, IrcCmdPriority_Normal);
+	}
+
+	CHECK(IrcCmdQueue_HighWater(queue) == pushed.count);
+
+	// The flooder's first turn, then one command of every light user.
+	for (size_t i = 0; i < pushed.count; i++)
+	{
+		int socket = Pop(queue, &pushed, popped);
+
+		if (i < quantum || i >= quantum + (size_t) lightCount)
+		{
+			CHECK(socket == flooder);
+		}
+		else
+		{
+			CHECK(socket == flooder + 1 + (int) (i - quantum));
+		}
+	}
+
+	CHECK(popped[flooder] == 40);
+
+	IrcCmdQueue_Delete(queue);
+}
+
+/**
+ * Control commands skip ahead of other connections, after their own
+ * connection's earlier commands, which are charged to its next turns.
+ */
+static void TestControl(void)
+{
+	IrcCmdQueue* queue = IrcCmdQueue_New(16, 2);
+	Pushed pushed = {0};
+	size_t popped[16] = {0};
+
+	for (size_t i = 0; i < 6; i++)
+	{
+		Push(queue, &pushed, 5, IrcCmdPriority_Normal);
+	}
+
+	for (size_t i = 0; i < 3; i++)
+	{
+		Push(queue, &pushed, 7, IrcCmdPriority_Normal);
+	}
+	Push(queue, &pushed, 7, IrcCmdPriority_Control);
+
+	for (size_t i = 0; i < 4; i++)
+	{
+		CHECK(Pop(queue, &pushed, popped) == 7);
+	}
+
+	for (size_t i = 0; i < 4; i++)
+	{
+		Push(queue, &pushed, 7, IrcCmdPriority_Normal);
+	}
+
+	// Socket 7 executed 3 commands with a quantum of 2, so it skips most of
+	// its next turn.
+	const int expected[] = { 5, 5, 5, 5, 7, 5, 5, 7, 7, 7 };
+	for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++)
+	{
+		CHECK(Pop(queue, &pushed, popped) == expected[i]);
+	}
+
+	IrcCmdQueue_Delete(queue);
+}
+
+/**
+ * Sockets far apart grow the queue while commands are waiting.
+ */
+static void TestGrow(void)
+{
+	IrcCmdQueue* queue = IrcCmdQueue_New(4, 1);
+	Pushed pushed = {0};
+	size_t popped[1024] = {0};
+
+	const int sockets[] = { 3, 70, 4, 200, 1000 };
+	for (size_t i = 0; i < sizeof(sockets) / sizeof(sockets[0]); i++)
+	{
+		Push(queue, &pushed, sockets[i], IrcCmdPriority_Normal);
+		Push(queue, &pushed, sockets[i], IrcCmdPriority_Normal);
+	}
+
+	// Still round robin, in the order the sockets became ready.
+	for (size_t turn = 0; turn < 2; turn++)
+	{
+		for (size_t i = 0; i < sizeof(sockets) / sizeof(sockets[0]); i++)
+		{
+			CHECK(Pop(queue, &pushed, popped) == sockets[i]);
+		}
+	}
+
+	IrcCmdQueue_Delete(queue);
+}
+
+static void TestShutdown(void)
+{
+	IrcCmdQueue* queue = IrcCmdQueue_New(4, 1);
+	Pushed pushed = {0};
+	size_t popped[8] = {0};
+
+	Push(queue, &pushed, 1, IrcCmdPriority_Normal);
+	IrcCmdQueue_Shutdown(queue);
+
+	IrcCmd* cmd = NewCmd(1, IrcCmdPriority_Normal);
+	errno = 0;
+	CHECK(!IrcCmdQueue_Push(queue, cmd));
+	CHECK(errno == ECANCELED);
+	IrcCmd_Delete(cmd);
+
+	// Commands queued before are still popped.
+	CHECK(Pop(queue, &pushed, popped) == 1);
+
+	errno = 0;
+	CHECK(IrcCmdQueue_Pop(queue) == NULL);
+	CHECK(errno == ECANCELED);
+
+	IrcCmdQueue_Delete(queue);
+}
+
+int main(void)
+{
+	TestNew();
+	TestRoundRobin();
+	TestControl();
+	TestGrow();
+	TestShutdown();
+
+	return TEST_RESULT();
+}